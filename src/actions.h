@@ -129,6 +129,8 @@ struct SetStepSequencerMuteSeqAction : public SeqAction {
 struct NoteOnOffSeqAction : public SeqAction {
     virtual SeqActionType Type() const override { return SeqActionType::NoteOnOff; }
     virtual void ExecuteRelease(GameManager& g) override;
+    // Quantizing looks at the clock, so only unquantized notes can go early.
+    virtual bool IsAudioOnly() const override { return _props._quantizeDenom <= 0.0; }
 
     NoteOnOffSeqActionProps _props;
 
@@ -1,166 +1,107 @@
 #include "audio.h"
 
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <chrono>
+#include <cmath>
 #include <vector>
 
-#include "SPSCQueue.h"
+#include "mpsc_queue.h"
 
-#include "samplerate.h"
-
-#include "features.h"
 #include "util.h"
 #include "audio_util.h"
+#include "logger.h"
+#include "math_util.h"
 #include "synth.h"
 #include "sound_bank.h"
 
 using std::chrono::high_resolution_clock;
 
-#define NUM_OUTPUT_CHANNELS (1)
+#define NUM_OUTPUT_CHANNELS (2)
 #define INTERNAL_SR (48000)
 
 namespace audio {
 
 namespace {
 
-bool HeapLess(HeapEntry const &lhs, HeapEntry const &rhs) {
-    if (lhs.key == rhs.key) {
-        return lhs.counter < rhs.counter;
-    }
-    return lhs.key < rhs.key;
-}
-
-int HeapParent(int ix) {
-    return (ix - 1) / 2;
-}
-
-int HeapLeftChild(int ix) {
-    return 2*ix + 1;
-}
-
-void HeapInsert(PendingEventHeap *heap, int key, PendingEvent const& event) {
-    if (heap->size >= heap->maxSize) {
-        return;
-    }
-    int currentIx = heap->size;
-    ++(heap->size);
-    heap->entries[currentIx].e = event;
-    heap->entries[currentIx].key = key;
-    heap->entries[currentIx].counter = heap->counter++;
-
-    while (currentIx > 0) {
-        int parentIx = HeapParent(currentIx);
-        HeapEntry& parent = heap->entries[parentIx];
-        if (HeapLess(heap->entries[currentIx], parent)) {
-            HeapEntry e = heap->entries[currentIx];
-            heap->entries[currentIx] = heap->entries[parentIx];
-            heap->entries[parentIx] = e;
-            currentIx = parentIx;
-        } else {
-            break;
-        }
-    }    
-}
-
-PendingEvent HeapPop(PendingEventHeap *heap) {
-    PendingEvent output;
-    if (heap->size <= 0) {
-        printf("AUDIO ERROR: tried to pop off empty heap!\n");
-        return output;
-    }
-
-    output = heap->entries[0].e;
-    heap->entries[0] = heap->entries[heap->size - 1];
-    --(heap->size);
-
-    int currentIx = 0;
-    int leftChildIx = 1;
-    while (leftChildIx < heap->size) {
-        int minChildIx = leftChildIx;
-        if (leftChildIx + 1 < heap->size) {
-            int rightChildIx = leftChildIx + 1;
-            if (HeapLess(heap->entries[rightChildIx], heap->entries[leftChildIx])) {
-                minChildIx = rightChildIx;
-            }            
-        }
-        if (HeapLess(heap->entries[minChildIx], heap->entries[currentIx])) {
-            HeapEntry e = heap->entries[currentIx];
-            heap->entries[currentIx] = heap->entries[minChildIx];
-            heap->entries[minChildIx] = e;            
-            currentIx = minChildIx;
-            leftChildIx = HeapLeftChild(minChildIx);
-        } else {
-            break;
-        }
-    }
-
-    return output;
-} 
-
-PendingEvent *HeapPeek(PendingEventHeap *heap) {
-    if (heap->size <= 0) {
-        printf("AUDIO ERROR: tried to peek empty heap!\n");
-        return nullptr;
-    }
-    return &heap->entries[0].e;
-}
-
-float *gInternalBuffer = nullptr;
-std::size_t gInternalBufferSize = 0;
-int gLeftoverInputFrames = 0;
-int gLeftoverInputFramesStartIx = -1;
-
-SRC_STATE *gSrcState = nullptr;
-
-typedef rigtorp::SPSCQueue<Event> EventQueue;
-int constexpr kEventQueueLength = 1024;
+// Any thread can add events; only the audio thread pops them.
+typedef MpscQueue<Event> EventQueue;
+int constexpr kEventQueueLength = 4096;
 
 EventQueue sEventQueue(kEventQueueLength);
+std::atomic<int64_t> sDroppedEventCount = 0;
 
 } // namespace
 
 bool AddEvent(Event const &e) {
-    bool success = sEventQueue.try_push(e);
+    bool success = sEventQueue.TryPush(e);
     if (!success) {
-        // TODO: maybe use serialize to get a string of the event
-        std::cout << "Failed to add event to audio queue:" << std::endl;
+        sDroppedEventCount.fetch_add(1, std::memory_order_relaxed);
     }
     return success;
 }
 
-void InitStateData(StateData& state, SoundBank const& soundBank, int outputSampleRate, int framesPerBuffer) {
-
-    if (!gInternalBuffer) {
-        // TODO: can we reduce this size safely?
-        gInternalBufferSize = 3 * framesPerBuffer * NUM_OUTPUT_CHANNELS * sizeof(float);
-        gInternalBuffer = new float[gInternalBufferSize];
+bool AddEvents(Event const* events, int count, double scheduleAudioTime) {
+    bool success;
+    if (scheduleAudioTime >= 0.0) {
+        success = sEventQueue.TryPushBatch(events, count, [scheduleAudioTime](Event& e) {
+            if (e.audioTime < 0.0) {
+                e.audioTime = scheduleAudioTime + e.delaySecs;
+            }
+        });
+    } else {
+        success = sEventQueue.TryPushBatch(events, count);
     }
-    gLeftoverInputFrames = 0;
-    gLeftoverInputFramesStartIx = -1;
+    if (!success) {
+        sDroppedEventCount.fetch_add(count, std::memory_order_relaxed);
+    }
+    return success;
+}
 
-    
+int64_t GetDroppedEventCount() {
+    return sDroppedEventCount.load(std::memory_order_relaxed);
+}
+
+void InitStateData(StateData& state, SoundBank const& soundBank, int outputSampleRate, int framesPerBuffer) {
     state.outputSampleRate = outputSampleRate;
 
     for (int i = 0; i < state.synths.size(); ++i) {
         synth::StateData& s = state.synths[i];
-        synth::InitStateData(s, /*channel=*/i, INTERNAL_SR, framesPerBuffer, NUM_OUTPUT_CHANNELS);
+        // Synths render mono; pan places them on the bus.
+        synth::InitStateData(s, /*channel=*/i, INTERNAL_SR, framesPerBuffer, /*numChannels=*/1);
+        PanToChannelGains(0.f, NUM_OUTPUT_CHANNELS, state._synthChannelGains[i].data());
+        state._synthSendGains[i] = 0.f;
     }
 
     state.soundBank = &soundBank;
+    state._pcmStreamer.Init(soundBank, kNumPcmStreamSlots);
+    state._pcmStreamSlotVoices.fill(-1);
+    state._numActivePcmVoices = 0;
 
-    int constexpr kMaxSize = 1024;
-    delete[] state.pendingEvents.entries;
-    state.pendingEvents = PendingEventHeap();
-    state.pendingEvents.entries = new HeapEntry[kMaxSize];
-    state.pendingEvents.maxSize = kMaxSize;
+    // Fixed size: the audio thread doesn't allocate. Whole phrases scheduled
+    // up front stay well under this.
+    state._pendingEvents.Init(/*capacity=*/16384);
 
     state._bufferFrameCount = framesPerBuffer;
-    state._recentBuffer = new float[framesPerBuffer];
+    state._spectrum.Init(outputSampleRate);
+
+    static_assert(NUM_OUTPUT_CHANNELS <= kMaxBusChannels);
+    state._synthBuffers = new float[kNumSynths * framesPerBuffer];
+    state._busBuffer = new float[NUM_OUTPUT_CHANNELS * framesPerBuffer];
+    state._sendBuffer = new float[framesPerBuffer];
+    state._pcmScratch = new float[framesPerBuffer];
+    state._sendDelay.Init(INTERNAL_SR, /*maxTimeSecs=*/2.f);
+
+    if (state._numSynthWorkers > 0) {
+        state._synthWorkers.Init(state._numSynthWorkers, kNumSynths);
+        printf("Audio: rendering synths on %d worker threads\n", state._numSynthWorkers);
+    }
 
-    int srcErr = 0;
-    gSrcState = src_new(SRC_SINC_FASTEST, NUM_OUTPUT_CHANNELS, &srcErr);
-    if (srcErr) {
-        printf("Audio error in creating SRC state: %s\n", src_strerror(srcErr));
+    if (outputSampleRate != INTERNAL_SR) {
+        // The device asks for framesPerBuffer frames at its rate; we always
+        // render framesPerBuffer at ours.
+        state._resampler.Init(INTERNAL_SR, outputSampleRate, NUM_OUTPUT_CHANNELS, framesPerBuffer, framesPerBuffer, state._resampleMode);
     }
 }
 void DestroyStateData(StateData& state) {
@@ -168,252 +109,421 @@ void DestroyStateData(StateData& state) {
         synth::DestroyStateData(synth);
     }
 
-    delete[] state._recentBuffer;
-    delete[] state.pendingEvents.entries;
-    if (gInternalBuffer) {
-        delete[] gInternalBuffer;
-    }
-    state.pendingEvents = PendingEventHeap();
-
-    src_delete(gSrcState);
-    gSrcState = nullptr;
+    state._pcmStreamer.Destroy();
+    state._synthWorkers.Destroy();
+    delete[] state._synthBuffers;
+    state._synthBuffers = nullptr;
+    delete[] state._busBuffer;
+    state._busBuffer = nullptr;
+    delete[] state._sendBuffer;
+    state._sendBuffer = nullptr;
+    delete[] state._pcmScratch;
+    state._pcmScratch = nullptr;
+
+    state._spectrum.Destroy();
+    state._pendingEvents.Destroy();
+
+    state._resampler.Destroy();
 }
 
-void ProcessEventQueue(EventQueue* eventQueue, int64_t currentBufferCounter, double sampleRate, int bufferSize, PendingEventHeap* pendingEvents) {
-    double const secsToBuffers = sampleRate / static_cast<double>(bufferSize);
-    while (pendingEvents->size < pendingEvents->maxSize) {
-        Event *e = eventQueue->front();
-        if (e == nullptr) {
+// audioTimeAtFrameZero maps Event::audioTime onto frames (see SyncAudioTime).
+// If it's < 0 we don't know the mapping yet, and scheduled events just use
+// delaySecs.
+void ProcessEventQueue(EventQueue* eventQueue, int64_t currentBufferCounter, double sampleRate, int bufferSize, double audioTimeAtFrameZero, EventTimerWheel* pendingEvents) {
+    int64_t const bufferStartFrame = currentBufferCounter * bufferSize;
+    int constexpr kBatchSize = 64;
+    Event batch[kBatchSize];
+    while (true) {
+        int const numPopped = static_cast<int>(eventQueue->TryPopBatch(batch, kBatchSize));
+        for (int i = 0; i < numPopped; ++i) {
+            Event const& e = batch[i];
+            if (e.type == EventType::CancelTagged) {
+                // Anything with this tag that's still in the queue was pushed
+                // before the cancel, so it's already pending by now.
+                pendingEvents->RemoveTagged(e.tag);
+                continue;
+            }
+            PendingEvent p_e;
+            p_e._e = e;
+            int64_t runFrame;
+            if (e.audioTime >= 0.0 && audioTimeAtFrameZero >= 0.0) {
+                runFrame = std::max<int64_t>(bufferStartFrame, std::llround((e.audioTime - audioTimeAtFrameZero) * sampleRate));
+            } else {
+                int64_t delayInFrames = std::max<int64_t>(0, std::llround(e.delaySecs * sampleRate));
+                runFrame = bufferStartFrame + delayInFrames;
+            }
+            p_e._runBufferCounter = runFrame / bufferSize;
+            p_e._sampleOffset = static_cast<int>(runFrame % bufferSize);
+            if (!pendingEvents->Insert(p_e._runBufferCounter, p_e)) {
+                logger::Log("AUDIO PROBLEM: pending event pool full! Dropped an event\n");
+            }
+        }
+        if (numPopped < kBatchSize) {
             break;
         }
-        PendingEvent p_e;
-        p_e._e = *e;
-        int64_t delayInBuffers = static_cast<int64_t>(e->delaySecs * secsToBuffers);
-        p_e._runBufferCounter = currentBufferCounter + delayInBuffers;
-        HeapInsert(pendingEvents, p_e._runBufferCounter, p_e);
-        eventQueue->pop();
-    }
-    if (pendingEvents->size >= pendingEvents->maxSize) {
-        std::cout << "WARNING: WE FILLED THE PENDING EVENT LIST" << std::endl;
     }
 }
 
-void FillBuffer(
-    StateData *state, float *const outputBufferIn, int framesPerBuffer, int sampleRate) {
-     
-    // zero out the output buffer first.
-    memset(outputBufferIn, 0, NUM_OUTPUT_CHANNELS * framesPerBuffer * sizeof(float));
+namespace {
 
-    // Figure out which events apply to this invocation of the callback, and which effects should handle them.
-    ProcessEventQueue(&sEventQueue, state->_bufferCounter, sampleRate, framesPerBuffer, &state->pendingEvents);
+// Returns microseconds since t and resets t to now.
+float LapUs(high_resolution_clock::time_point& t) {
+    high_resolution_clock::time_point now = high_resolution_clock::now();
+    float us = std::chrono::duration<float, std::micro>(now - t).count();
+    t = now;
+    return us;
+}
 
-    int constexpr kMaxSize = 1024;
-    static PendingEvent eventsThisBuffer[kMaxSize];
-    int eventsThisBufferCount = 0;
-    while (state->pendingEvents.size > 0) {
-        PendingEvent e = *HeapPeek(&state->pendingEvents);
-        if (state->_bufferCounter < e._runBufferCounter) {
-            break;
-        }
-        if (eventsThisBufferCount >= kMaxSize) {
-            printf("AUDIO PROBLEM: EventsThisBuffer not big enough!\n");
-            break;
+void StopPcmVoice(StateData* state, int voiceIx) {
+    PcmVoice& voice = state->pcmVoices[voiceIx];
+    if (voice._soundIx < 0) {
+        return;
+    }
+    if (voice._streamSlot >= 0) {
+        state->_pcmStreamer.Stop(voice._streamSlot);
+        state->_pcmStreamSlotVoices[voice._streamSlot] = -1;
+        voice._streamSlot = -1;
+    }
+    voice._soundBufferIx = -1;
+    voice._soundIx = -1;
+
+    int* active = state->_activePcmVoices.data();
+    int* const activeEnd = active + state->_numActivePcmVoices;
+    int* const found = std::find(active, activeEnd, voiceIx);
+    assert(found != activeEnd);
+    std::copy(found + 1, activeEnd, found);
+    --state->_numActivePcmVoices;
+}
+
+void StartPcmVoice(StateData* state, int voiceIx, Event const& e) {
+    PcmSound const& sound = state->soundBank->_sounds[e.pcmSoundIx];
+    PcmVoice& voice = state->pcmVoices[voiceIx];
+    StopPcmVoice(state, voiceIx);
+    voice._soundIx = e.pcmSoundIx;
+    voice._soundBufferIx = 0;
+    voice._gain = e.pcmVelocity;
+    voice._loop = e.loop;
+    PanToChannelGains(e.pcmPan, NUM_OUTPUT_CHANNELS, voice._channelGains.data());
+    if (sound._streamed) {
+        int* const slots = state->_pcmStreamSlotVoices.data();
+        int* const freeSlot = std::find(slots, slots + kNumPcmStreamSlots, -1);
+        if (freeSlot == slots + kNumPcmStreamSlots) {
+            // Still plays the resident head, then silence.
+            logger::Log("NO MORE PCM STREAM SLOTS!\n");
+        } else {
+            *freeSlot = voiceIx;
+            voice._streamSlot = static_cast<int>(freeSlot - slots);
+            state->_pcmStreamer.Start(voice._streamSlot, e.pcmSoundIx, e.loop);
         }
-        eventsThisBuffer[eventsThisBufferCount++] = HeapPop(&state->pendingEvents);
     }
 
-    // PCM playback first
-    float *outputBuffer = outputBufferIn;
-    int currentEventIx = 0;
-    for (int i = 0; i < framesPerBuffer; ++i) {
-        // Handle events
-        for (int eventIx = 0; eventIx < eventsThisBufferCount; ++eventIx) {
-            Event const& e = eventsThisBuffer[eventIx]._e; 
-            switch (e.type) {
-                case EventType::PlayPcm: {
-                    if (e.pcmSoundIx >= state->soundBank->_sounds.size() || e.pcmSoundIx < 0) {
-                        std::cout << "NO PCM SOUND FOR NOTE " << e.pcmSoundIx << std::endl;
-                        break;
-                    }
-                    PcmSound const& sound = state->soundBank->_sounds[e.pcmSoundIx];
-                    if (sound._buffer == nullptr) {
-                        std::cout << "PCM SOUND AT NOTE " << e.pcmSoundIx << " IS NULL" << std::endl;
-                        break;
-                    }
-                    // Find free voice. If this sample is already playing, or if
-                    // the new sample is in the same exclusive group as the
-                    // previous one, cancel the other one and play the new one.
-                    int voiceIx = -1;
-                    for (int i = 0; i < state->pcmVoices.size(); ++i) {
-                        PcmVoice const& pcmVoice = state->pcmVoices[i];
-                        if (pcmVoice._soundBufferIx < 0) {
-                            if (voiceIx < 0) {
-                                voiceIx = i;
-                            }
-                        } else if (pcmVoice._soundIx == e.pcmSoundIx) {
-                            voiceIx = i;                            
-                        } else {
-                            int prevGroup = state->soundBank->_exclusiveGroups[pcmVoice._soundIx];
-                            int newGroup = state->soundBank->_exclusiveGroups[e.pcmSoundIx];
-                            if (prevGroup >= 0 && prevGroup == newGroup) {
-                                voiceIx = i;
-                            }
-                        }
-                        
-                    }
-                    if (voiceIx < 0) {
-                        printf("NO MORE PCM VOICES!\n");
-                        break;
-                    }
-                    state->pcmVoices[voiceIx]._soundIx = e.pcmSoundIx;
-                    state->pcmVoices[voiceIx]._soundBufferIx = 0;
-                    state->pcmVoices[voiceIx]._gain = e.pcmVelocity;
-                    state->pcmVoices[voiceIx]._loop = e.loop;
-                    
-                    break;
-                }
-                case EventType::StopPcm: {
-                    // Stop all voices currently playing the given sound.
-                    for (int i = 0, n = state->pcmVoices.size(); i < n; ++i) {
-                        PcmVoice& voice = state->pcmVoices[i];
-                        if (voice._soundIx == e.pcmSoundIx) {
-                            voice._soundBufferIx = -1;
-                            voice._soundIx = -1;
-                        }
-                    }
-                    break;
-                }
-                case EventType::AllNotesOff: {
-                    // Stop all voices, period.
-                    for (int i = 0, n = state->pcmVoices.size(); i < n; ++i) {
-                        PcmVoice& voice = state->pcmVoices[i];
-                        voice._soundBufferIx = -1;
-                        voice._soundIx = -1;
+    // Keep the active list in voice order so voices always sum in the same
+    // order.
+    int* active = state->_activePcmVoices.data();
+    int* const activeEnd = active + state->_numActivePcmVoices;
+    int* const insertAt = std::lower_bound(active, activeEnd, voiceIx);
+    std::copy_backward(insertAt, activeEnd, activeEnd + 1);
+    *insertAt = voiceIx;
+    ++state->_numActivePcmVoices;
+}
+
+void HandlePcmEvent(StateData* state, Event const& e) {
+    switch (e.type) {
+        case EventType::PlayPcm: {
+            if (e.pcmSoundIx >= state->soundBank->_sounds.size() || e.pcmSoundIx < 0) {
+                logger::Log("NO PCM SOUND FOR NOTE %d\n", e.pcmSoundIx);
+                break;
+            }
+            PcmSound const& sound = state->soundBank->_sounds[e.pcmSoundIx];
+            if (sound._buffer == nullptr && sound._buffer16 == nullptr) {
+                logger::Log("PCM SOUND AT NOTE %d IS NULL\n", e.pcmSoundIx);
+                break;
+            }
+            if (sound._bufferLength == 0) {
+                // A looping voice over no frames would never finish its span.
+                logger::Log("PCM SOUND AT NOTE %d IS EMPTY\n", e.pcmSoundIx);
+                break;
+            }
+            // Find free voice. If this sample is already playing, or if
+            // the new sample is in the same exclusive group as the
+            // previous one, cancel the other one and play the new one.
+            int voiceIx = -1;
+            int const newGroup = state->soundBank->_exclusiveGroups[e.pcmSoundIx];
+            for (int activeIx = 0; activeIx < state->_numActivePcmVoices; ++activeIx) {
+                int const i = state->_activePcmVoices[activeIx];
+                PcmVoice const& pcmVoice = state->pcmVoices[i];
+                if (pcmVoice._soundIx == e.pcmSoundIx) {
+                    voiceIx = i;
+                } else {
+                    int prevGroup = state->soundBank->_exclusiveGroups[pcmVoice._soundIx];
+                    if (prevGroup >= 0 && prevGroup == newGroup) {
+                        voiceIx = i;
                     }
-                    break;
                 }
-                case EventType::SetGain: {
-                    state->_finalGain = e.newGain;
-                    break;
+            }
+            for (int i = 0; voiceIx < 0 && i < state->pcmVoices.size(); ++i) {
+                if (state->pcmVoices[i]._soundIx < 0) {
+                    voiceIx = i;
                 }
-                default: {
-                    break;
+            }
+            if (voiceIx < 0) {
+                logger::Log("NO MORE PCM VOICES!\n");
+                break;
+            }
+            StartPcmVoice(state, voiceIx, e);
+            break;
+        }
+        case EventType::StopPcm: {
+            // Stop all voices currently playing the given sound.
+            for (int activeIx = state->_numActivePcmVoices - 1; activeIx >= 0; --activeIx) {
+                int const voiceIx = state->_activePcmVoices[activeIx];
+                if (state->pcmVoices[voiceIx]._soundIx == e.pcmSoundIx) {
+                    StopPcmVoice(state, voiceIx);
                 }
             }
-            ++currentEventIx;
+            break;
         }
-
-        float v = 0.0f;
-        for (int voiceIx = 0; voiceIx < state->pcmVoices.size(); ++voiceIx) {
-            PcmVoice& voice = state->pcmVoices[voiceIx];
-            if (voice._soundIx < 0) {
-                assert(voice._soundBufferIx < 0);
-                continue;
+        case EventType::AllNotesOff: {
+            // Stop all voices, period.
+            while (state->_numActivePcmVoices > 0) {
+                StopPcmVoice(state, state->_activePcmVoices[state->_numActivePcmVoices - 1]);
             }
-            PcmSound const& sound = state->soundBank->_sounds[voice._soundIx];
-            if (sound._buffer == nullptr) {
-                std::cout << "VOICE TRYING TO PLAY NULL BUFFER" << std::endl;
-                continue;
+            break;
+        }
+        case EventType::SetGain: {
+            state->_finalGain = e.newGain;
+            break;
+        }
+        case EventType::SetSendDelay: {
+            state->_sendDelay._timeSecs = e.sendDelayTimeSecs;
+            state->_sendDelay._feedback = e.sendDelayFeedback;
+            state->_sendDelay._returnGain = e.sendDelayReturnGain;
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+}
+
+// Mixes frames [startFrame, endFrame) of the voice onto the bus, a contiguous
+// span at a time: each span runs to the end of the range, the end of the
+// sound, or the end of the sound's resident part, whichever comes first.
+// Returns false if the voice stopped.
+bool RenderPcmVoice(StateData* state, int voiceIx, float* const* planes, int startFrame, int endFrame) {
+    PcmVoice& voice = state->pcmVoices[voiceIx];
+    PcmSound const& sound = state->soundBank->_sounds[voice._soundIx];
+    float gains[NUM_OUTPUT_CHANNELS];
+    for (int c = 0; c < NUM_OUTPUT_CHANNELS; ++c) {
+        gains[c] = voice._gain * voice._channelGains[c];
+    }
+    for (int frame = startFrame; frame < endFrame;) {
+        assert(voice._soundBufferIx >= 0);
+        assert(voice._soundBufferIx < sound._bufferLength);
+        uint64_t const soundIx = voice._soundBufferIx;
+        uint64_t spanLength = std::min<uint64_t>(endFrame - frame, sound._bufferLength - soundIx);
+        float const* span;
+        if (soundIx < sound._residentLength) {
+            spanLength = std::min(spanLength, sound._residentLength - soundIx);
+            if (sound._buffer != nullptr) {
+                span = sound._buffer + soundIx;
+            } else {
+                Int16ToFloat(sound._buffer16 + soundIx, state->_pcmScratch, static_cast<int>(spanLength));
+                span = state->_pcmScratch;
             }
-            assert(voice._soundBufferIx >= 0);
-            assert(voice._soundBufferIx < sound._bufferLength);
-            v += sound._buffer[voice._soundBufferIx] * voice._gain;
-            ++voice._soundBufferIx;
-            if (voice._soundBufferIx >= sound._bufferLength) {
-                if (voice._loop) {
-                    voice._soundBufferIx = 0;
-                } else {
-                    voice._soundBufferIx = -1;
-                    voice._soundIx = -1;
-                }                
+        } else {
+            state->_pcmStreamer.ReadFrames(voice._streamSlot, state->_pcmScratch, static_cast<int>(spanLength));
+            span = state->_pcmScratch;
+        }
+        int const n = static_cast<int>(spanLength);
+        for (int c = 0; c < NUM_OUTPUT_CHANNELS; ++c) {
+            MixRamped(span, planes[c] + frame, n, gains[c], gains[c]);
+        }
+        frame += n;
+        voice._soundBufferIx += n;
+        if (voice._soundBufferIx >= sound._bufferLength) {
+            if (!voice._loop) {
+                StopPcmVoice(state, voiceIx);
+                return false;
             }
+            voice._soundBufferIx = 0;
         }
+    }
+    return true;
+}
 
-        for (int channelIx = 0; channelIx < NUM_OUTPUT_CHANNELS; ++channelIx) {
-            *outputBuffer++ += v;
+struct SynthJobs {
+    StateData* state;
+    PendingEvent* events;
+    int eventCount;
+    int framesPerBuffer;
+    int sampleRate;
+};
+
+// Each synth renders into its own zeroed mono buffer; MixSynthsToBus places
+// them on the bus afterward.
+void RenderSynth(SynthJobs const& jobs, int synthIx) {
+    StateData* state = jobs.state;
+    float* synthBuffer = state->_synthBuffers + synthIx * jobs.framesPerBuffer;
+    memset(synthBuffer, 0, jobs.framesPerBuffer * sizeof(float));
+    synth::Process(
+        &state->synths[synthIx], jobs.events, jobs.eventCount, synthBuffer,
+        /*numChannels=*/1, jobs.framesPerBuffer, jobs.sampleRate, state->_bufferCounter);
+}
+
+// Runs on a worker thread.
+void ProcessSynthJob(void* userData, int synthIx) {
+    SynthJobs const& jobs = *static_cast<SynthJobs const*>(userData);
+    high_resolution_clock::time_point t = high_resolution_clock::now();
+    RenderSynth(jobs, synthIx);
+    // Each job only touches its own slot, and Run() joins before anyone reads these.
+    jobs.state->_telemetry.Current()._synthUs[synthIx] += LapUs(t);
+}
+
+// In synth order, so the result doesn't depend on how the synths were
+// rendered. Pan and Send are read after the synth has run its automations,
+// and each gain ramps from where the last buffer left it.
+void MixSynthsToBus(StateData* state, float* const* planes, int framesPerBuffer) {
+    memset(state->_sendBuffer, 0, framesPerBuffer * sizeof(float));
+    for (int synthIx = 0; synthIx < kNumSynths; ++synthIx) {
+        float const* synthBuffer = state->_synthBuffers + synthIx * framesPerBuffer;
+        synth::Patch const& patch = state->synths[synthIx].patch;
+        std::array<float,kMaxBusChannels>& channelGains = state->_synthChannelGains[synthIx];
+        float newGains[kMaxBusChannels];
+        PanToChannelGains(patch.Get(SynthParamType::Pan), NUM_OUTPUT_CHANNELS, newGains);
+        for (int c = 0; c < NUM_OUTPUT_CHANNELS; ++c) {
+            MixRamped(synthBuffer, planes[c], framesPerBuffer, channelGains[c], newGains[c]);
+            channelGains[c] = newGains[c];
         }
+        float const newSendGain = math_util::Clamp(patch.Get(SynthParamType::Send), 0.f, 1.f);
+        MixRamped(synthBuffer, state->_sendBuffer, framesPerBuffer, state->_synthSendGains[synthIx], newSendGain);
+        state->_synthSendGains[synthIx] = newSendGain;
     }
+}
 
+}  // namespace
 
-    for (synth::StateData& s : state->synths) {
-        synth::Process(
-            &s, eventsThisBuffer, eventsThisBufferCount, outputBufferIn,
-            NUM_OUTPUT_CHANNELS, framesPerBuffer, sampleRate, state->_bufferCounter);
+void FillBuffer(
+    StateData *state, float *const outputBufferIn, int framesPerBuffer, int sampleRate) {
+
+    CallbackTiming& timing = state->_telemetry.Current();
+    high_resolution_clock::time_point t = high_resolution_clock::now();
+     
+    float* planes[NUM_OUTPUT_CHANNELS];
+    for (int c = 0; c < NUM_OUTPUT_CHANNELS; ++c) {
+        planes[c] = state->_busBuffer + c * framesPerBuffer;
     }
+    memset(state->_busBuffer, 0, NUM_OUTPUT_CHANNELS * framesPerBuffer * sizeof(float));
 
-    if (state->_finalGain != 1.f) {
-        for (int i = 0, n = framesPerBuffer * NUM_OUTPUT_CHANNELS; i < n; ++i) {
-            outputBufferIn[i] *= state->_finalGain;
+    // Figure out which events apply to this invocation of the callback, and which effects should handle them.
+    ProcessEventQueue(&sEventQueue, state->_bufferCounter, sampleRate, framesPerBuffer, state->_audioTimeAtFrameZero, &state->_pendingEvents);
+
+    int constexpr kMaxSize = 1024;
+    static PendingEvent eventsThisBuffer[kMaxSize];
+    int const eventsThisBufferCount = state->_pendingEvents.ExtractDue(state->_bufferCounter, eventsThisBuffer, kMaxSize);
+    if (state->_pendingEvents.GetNumOverdue() > 0) {
+        logger::Log("AUDIO PROBLEM: EventsThisBuffer not big enough! %d events pushed to the next buffer\n", state->_pendingEvents.GetNumOverdue());
+    }
+    for (int i = 0; i < eventsThisBufferCount; ++i) {
+        if (eventsThisBuffer[i]._runBufferCounter < state->_bufferCounter) {
+            // Late. Run it as soon as we can.
+            eventsThisBuffer[i]._sampleOffset = 0;
         }
     }
- 
-    ++state->_bufferCounter;
-}
 
-void FillBufferAndResample(StateData *state, float *outputBuffer, unsigned long framesPerBuffer) {
-    // TODO this should only be computed once way at the beginning, right?
-    float numInputFramesExactFrac = (float)framesPerBuffer * (float) INTERNAL_SR / (float) state->outputSampleRate;
-    int numInputFramesNeededExact = (int) ceilf(numInputFramesExactFrac);
-    int minNumInputFrames = numInputFramesNeededExact; 
-    if (minNumInputFrames > framesPerBuffer) {
-        minNumInputFrames = framesPerBuffer * 2;
-        if (minNumInputFrames < numInputFramesNeededExact) {
-            printf("ERROR not generating enough input frames: %d < %d\n", minNumInputFrames, numInputFramesNeededExact);
+    EventTimerWheel::Stats const& pendingStats = state->_pendingEvents.GetStats();
+    timing._droppedEvents = sDroppedEventCount.load(std::memory_order_relaxed);
+    timing._pendingEvents = pendingStats._numPending;
+    timing._peakPendingEvents = pendingStats._peakPending;
+    timing._farFutureEvents = pendingStats._numFarFuture;
+    timing._lateEvents = pendingStats._numLate;
+    timing._overflowedEvents = pendingStats._numDropped;
+    timing._eventsUs += LapUs(t);
+
+    // PCM playback first. Events come out of the wheel in frame order, so render
+    // the voices in spans between event frames, applying each event at the
+    // start of its span.
+    int currentEventIx = 0;
+    int spanStart = 0;
+    while (spanStart < framesPerBuffer) {
+        for (; currentEventIx < eventsThisBufferCount && eventsThisBuffer[currentEventIx]._sampleOffset <= spanStart; ++currentEventIx) {
+            HandlePcmEvent(state, eventsThisBuffer[currentEventIx]._e);
         }
+        int spanEnd = framesPerBuffer;
+        if (currentEventIx < eventsThisBufferCount) {
+            spanEnd = std::min(spanEnd, eventsThisBuffer[currentEventIx]._sampleOffset);
+        }
+        // Voices can stop mid-span, which takes them out of the active list.
+        for (int activeIx = 0; activeIx < state->_numActivePcmVoices;) {
+            int const voiceIx = state->_activePcmVoices[activeIx];
+            if (RenderPcmVoice(state, voiceIx, planes, spanStart, spanEnd)) {
+                ++activeIx;
+            }
+        }
+        spanStart = spanEnd;
     }
 
-    int numInputFramesGenerated = 0; 
-    if (gLeftoverInputFrames > 0) { 
-        float *leftoversStart = &gInternalBuffer[gLeftoverInputFramesStartIx * NUM_OUTPUT_CHANNELS];
-        size_t leftoversSize = gLeftoverInputFrames * sizeof(float) * NUM_OUTPUT_CHANNELS;
-        assert((char*)leftoversStart + leftoversSize <= (char*)gInternalBuffer + gInternalBufferSize);
-        memmove(gInternalBuffer, leftoversStart, leftoversSize);
-        numInputFramesGenerated += gLeftoverInputFrames;
-    }
 
-    if (numInputFramesGenerated < minNumInputFrames) {
-        float *out = gInternalBuffer;
-        out += gLeftoverInputFrames * NUM_OUTPUT_CHANNELS;
-        assert((char*)out + framesPerBuffer * NUM_OUTPUT_CHANNELS * sizeof(float) <= (char*)gInternalBuffer + gInternalBufferSize);
-        FillBuffer(state, out, framesPerBuffer, INTERNAL_SR);
-        numInputFramesGenerated += framesPerBuffer;
-        if (numInputFramesGenerated < minNumInputFrames) {
-            out += framesPerBuffer * NUM_OUTPUT_CHANNELS;
-            assert((char*)out + framesPerBuffer * NUM_OUTPUT_CHANNELS * sizeof(float) <= (char*)gInternalBuffer + gInternalBufferSize);
-            FillBuffer(state, out, framesPerBuffer, INTERNAL_SR);
-            numInputFramesGenerated += framesPerBuffer;
-            if (numInputFramesGenerated < minNumInputFrames) {
-                printf("audio.cpp: okay wtf is this? left:%d, fpb:%lu nif:%d\n", gLeftoverInputFrames, framesPerBuffer, minNumInputFrames);
-            }
+    timing._pcmUs += LapUs(t);
+
+    SynthJobs jobs;
+    jobs.state = state;
+    jobs.events = eventsThisBuffer;
+    jobs.eventCount = eventsThisBufferCount;
+    jobs.framesPerBuffer = framesPerBuffer;
+    jobs.sampleRate = sampleRate;
+    if (state->_synthWorkers.NumWorkers() > 0) {
+        state->_synthWorkers.Run(&ProcessSynthJob, &jobs);
+    } else {
+        high_resolution_clock::time_point synthT = t;
+        for (int synthIx = 0; synthIx < kNumSynths; ++synthIx) {
+            RenderSynth(jobs, synthIx);
+            timing._synthUs[synthIx] += LapUs(synthT);
         }
-    } 
+    }
+    MixSynthsToBus(state, planes, framesPerBuffer);
+    timing._synthTotalUs += LapUs(t);
 
-#if 1    
-    // RESAMPLE using numInputFramesGenerated from gInternalBuffer!
-    SRC_DATA resampleData = {0};
-    resampleData.data_in = gInternalBuffer;
-    resampleData.data_out = outputBuffer;
-    resampleData.input_frames = numInputFramesGenerated;
-    resampleData.output_frames = (long)framesPerBuffer;
-    resampleData.src_ratio = (double)state->outputSampleRate / (double)INTERNAL_SR;
-    int srcErr = src_process(gSrcState, &resampleData);
-    if (srcErr) {
-        printf("Audio error: src_process error: %s\n", src_strerror(srcErr));
+    state->_sendDelay.Process(state->_sendBuffer, planes, NUM_OUTPUT_CHANNELS, framesPerBuffer, sampleRate);
+    if (state->_finalGain != 1.f) {
+        ScaleInPlace(state->_busBuffer, NUM_OUTPUT_CHANNELS * framesPerBuffer, state->_finalGain);
     }
-    gLeftoverInputFrames = resampleData.input_frames - resampleData.input_frames_used;
-    gLeftoverInputFramesStartIx = resampleData.input_frames_used;
-    if (gLeftoverInputFrames < 0) {
-        printf("negative input frames?!?!?! input: %ld used: %ld\n", resampleData.input_frames, resampleData.input_frames_used);
+    Interleave(planes, NUM_OUTPUT_CHANNELS, framesPerBuffer, outputBufferIn);
+    timing._gainUs += LapUs(t);
+ 
+    ++state->_bufferCounter;
+}
+
+void FillBufferAndResample(StateData *state, float *outputBuffer, unsigned long framesPerBuffer) {
+    float renderUs = 0.f;
+    high_resolution_clock::time_point t = high_resolution_clock::now();
+    state->_resampler.Process(outputBuffer, (int) framesPerBuffer, [&](float* chunk) {
+        high_resolution_clock::time_point renderT = high_resolution_clock::now();
+        FillBuffer(state, chunk, state->_bufferFrameCount, INTERNAL_SR);
+        renderUs += LapUs(renderT);
+    });
+    state->_telemetry.Current()._resampleUs += LapUs(t) - renderUs;
+}
+
+void SyncAudioTime(StateData* state, double audioTime) {
+    // The next frame the device will take from us. When resampling, some
+    // frames were rendered in an earlier callback but haven't gone out yet.
+    int64_t nextFrame = state->_bufferCounter * state->_bufferFrameCount;
+    if (state->outputSampleRate != INTERNAL_SR) {
+        nextFrame -= state->_resampler.GetBufferedInputFrames();
     }
-    if (resampleData.output_frames_gen != framesPerBuffer) {
-        printf("undergen: %ld %ld\n", resampleData.input_frames_used, resampleData.output_frames_gen);
-        memset(outputBuffer, 0, sizeof(float) * NUM_OUTPUT_CHANNELS * framesPerBuffer);
+    double const predicted = state->_audioTimeAtFrameZero + static_cast<double>(nextFrame) / INTERNAL_SR;
+    double const error = audioTime - predicted;
+    // Callback times jitter by a millisecond or so, so only follow them slowly
+    // (enough to track drift between the two clocks). A big jump means an
+    // underrun or a restarted stream: snap to it.
+    double constexpr kMaxTrackedError = 0.05;
+    double constexpr kTrackingGain = 0.01;
+    if (state->_audioTimeAtFrameZero < 0.0 || std::abs(error) > kMaxTrackedError) {
+        state->_audioTimeAtFrameZero = audioTime - static_cast<double>(nextFrame) / INTERNAL_SR;
+    } else {
+        state->_audioTimeAtFrameZero += kTrackingGain * error;
     }
-#else
-    memcpy(outputBuffer, gInternalBuffer, sizeof(float) * NUM_OUTPUT_CHANNELS * framesPerBuffer);
-    gLeftoverInputFrames = numInputFramesGenerated - framesPerBuffer;
-    gLeftoverInputFramesStartIx = framesPerBuffer;
-#endif
 }
 
 void AudioCallback(
@@ -421,28 +531,20 @@ void AudioCallback(
 
     high_resolution_clock::time_point t1 = high_resolution_clock::now();
 
+    float const budgetUs = 1000000.f * static_cast<float>(framesPerBuffer) / state->outputSampleRate;
+    state->_telemetry.BeginCallback(state->_bufferCounter, budgetUs);
+
     if (state->outputSampleRate == INTERNAL_SR) {
         FillBuffer(state, outputBuffer, framesPerBuffer, INTERNAL_SR);
     } else {
         FillBufferAndResample(state, outputBuffer, framesPerBuffer);
     } 
      
-#if COMPUTE_FFT
-    if (state->_recentBufferMutex.try_lock()) {
-        for (int i = 0; i < framesPerBuffer; ++i) {
-            state->_recentBuffer[i] = outputBuffer[i];
-        }
-        state->_recentBufferMutex.unlock();
-    }
-#endif
- 
-    high_resolution_clock::time_point t2 = high_resolution_clock::now();
+    state->_spectrum.Push(outputBuffer, framesPerBuffer, NUM_OUTPUT_CHANNELS);
 
-    const double kSecsPerCallback = static_cast<double>(framesPerBuffer) / state->outputSampleRate;
-    double callbackTimeSecs = std::chrono::duration_cast<std::chrono::duration<double>>(t2 - t1).count();
-    if (callbackTimeSecs / kSecsPerCallback > 0.9) {
-        printf("Frame close to deadline: %f / %f\n", callbackTimeSecs, kSecsPerCallback);
-    }    
+    // No printing from here. The game thread reports near misses from the
+    // telemetry queue (see TelemetryHistory::Update).
+    state->_telemetry.EndCallback(LapUs(t1));
 }
 
 int InternalSampleRate() {
@@ -4,34 +4,27 @@
 #include <vector>
 #include <mutex>
 
+#include "audio_bus.h"
+#include "audio_telemetry.h"
+#include "audio_timer_wheel.h"
 #include "audio_util.h"
+#include "audio_worker_pool.h"
+#include "pcm_streamer.h"
+#include "resampler.h"
+#include "spectrum_analyzer.h"
 #include "synth.h"
 
 class SoundBank;
 
 namespace audio {
 
-int constexpr kNumSynths = 5;
-int constexpr kNumPcmVoices = 8;
-
 struct PcmVoice {
     int _soundIx = -1;
     int _soundBufferIx = -1;
     float _gain = 1.f;
     bool _loop = false;
-};
-
-struct HeapEntry {
-    PendingEvent e;
-    int key;
-    int counter;
-};
-
-struct PendingEventHeap {
-    HeapEntry *entries = nullptr;
-    int size = 0;
-    int counter = 0;
-    int maxSize = 0;
+    std::array<float,kMaxBusChannels> _channelGains = {};  // from the PlayPcm pan
+    int _streamSlot = -1;  // PcmStreamer slot, if the sound is streamed
 };
 
 struct StateData {
@@ -41,16 +34,60 @@ struct StateData {
 
     SoundBank const* soundBank = nullptr;
     std::array<PcmVoice,kNumPcmVoices> pcmVoices;
-
-    PendingEventHeap pendingEvents;
+    // Indices of the playing voices, in voice order. Rendering only walks
+    // these.
+    std::array<int,kNumPcmVoices> _activePcmVoices;
+    int _numActivePcmVoices = 0;
+    // Which voice holds each stream slot, or -1.
+    std::array<int,kNumPcmStreamSlots> _pcmStreamSlotVoices;
+    PcmStreamer _pcmStreamer;
+    // One buffer of frames that need converting before they're mixed (16-bit
+    // or streamed).
+    float* _pcmScratch = nullptr;
+
+    EventTimerWheel _pendingEvents;
 
     float _finalGain = 1.f;
 
     int64_t _bufferCounter = 0;
 
-    std::mutex _recentBufferMutex;
+    // Stream time of frame 0 at INTERNAL_SR, for events scheduled with
+    // Event::audioTime. < 0 until the first SyncAudioTime().
+    double _audioTimeAtFrameZero = -1.0;
+
+    // If > 0, synths render in parallel on this many worker threads (plus the
+    // audio thread) and get mixed in synth order afterward, so the output is
+    // identical to the serial path. Set before InitStateData().
+    int _numSynthWorkers = 0;
+    WorkerPool _synthWorkers;
+    float* _synthBuffers = nullptr;  // one mono buffer per synth
+
+    // Planar mix bus: NumOutputChannels() planes of _bufferFrameCount frames.
+    // Everything mixes in here and gets interleaved into the device buffer
+    // at the end of FillBuffer.
+    float* _busBuffer = nullptr;
+    // Mono input to _sendDelay, which every synth feeds by its Send param.
+    float* _sendBuffer = nullptr;
+    SendDelay _sendDelay;
+    // Pan and send gains each synth ended the last buffer on. Gains ramp from
+    // these to the current values across a buffer, so moving Pan or Send
+    // doesn't click.
+    std::array<std::array<float,kMaxBusChannels>,kNumSynths> _synthChannelGains;
+    std::array<float,kNumSynths> _synthSendGains;
+
+    // Per-callback timings, written by the audio thread and read by the game
+    // thread through a lock-free queue.
+    Telemetry _telemetry;
+
     int _bufferFrameCount = 0;
-    float* _recentBuffer = nullptr;
+
+    // Gets every output buffer, for visualizers.
+    SpectrumAnalyzer _spectrum;
+
+    // Only used when the device doesn't run at INTERNAL_SR. Set the mode
+    // before InitStateData().
+    ResampleMode _resampleMode = ResampleMode::Polyphase;
+    Resampler _resampler;
 };
 
 void InitStateData(StateData& state, SoundBank const& soundBank, int outputSampleRate, int framesPerBuffer);
@@ -58,7 +95,23 @@ void DestroyStateData(StateData& state);
 
 void AudioCallback(float const* inputBuffer, float *outputBuffer, unsigned long framesPerBuffer, StateData *state);
 
+// Call from the platform callback, before AudioCallback, with the current
+// stream time (the clock Context::GetAudioTime() reads). Keeps the mapping
+// from Event::audioTime to frames locked to that clock.
+void SyncAudioTime(StateData* state, double audioTime);
+
+// Renders one buffer at sampleRate with no resampling. AudioCallback uses this
+// under the hood; exposed so we can render offline (see synth_render.cpp).
+void FillBuffer(StateData *state, float *outputBuffer, int framesPerBuffer, int sampleRate);
+
+// Safe to call from any thread. Never blocks; if the queue is full the event
+// is dropped and counted (see GetDroppedEventCount()).
 bool AddEvent(Event const& e);
+// Adds all count events or none of them, e.g. to keep a NoteOn and its NoteOff
+// together. If scheduleAudioTime >= 0, events without an audioTime get
+// scheduleAudioTime + delaySecs (see Context::_scheduleAudioTime).
+bool AddEvents(Event const* events, int count, double scheduleAudioTime = -1.0);
+int64_t GetDroppedEventCount();
 
 int InternalSampleRate();
 
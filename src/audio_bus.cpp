@@ -0,0 +1,204 @@
+#include "audio_bus.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "math_util.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define AUDIO_BUS_SIMD_X86 1
+#include <immintrin.h>
+#else
+#define AUDIO_BUS_SIMD_X86 0
+#endif
+
+namespace audio {
+
+void PanToChannelGains(float pan, int numChannels, float* gains) {
+    pan = math_util::Clamp(pan, -1.f, 1.f);
+    if (numChannels == 1) {
+        gains[0] = 1.f;
+        return;
+    }
+    gains[0] = std::min(1.f, 1.f - pan);
+    gains[1] = std::min(1.f, 1.f + pan);
+    for (int c = 2; c < numChannels; ++c) {
+        gains[c] = 0.f;
+    }
+}
+
+void MixRamped(float const* in, float* out, int n, float gainStart, float gainEnd) {
+    if (n <= 0) {
+        return;
+    }
+    float const step = (gainEnd - gainStart) / n;
+    int i = 0;
+    if (gainStart == gainEnd) {
+        if (gainStart == 0.f) {
+            return;
+        }
+#if AUDIO_BUS_SIMD_X86
+        __m128 const g = _mm_set1_ps(gainStart);
+        for (; i + 4 <= n; i += 4) {
+            __m128 const x = _mm_loadu_ps(in + i);
+            _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), _mm_mul_ps(x, g)));
+        }
+#endif
+        for (; i < n; ++i) {
+            out[i] += in[i] * gainStart;
+        }
+        return;
+    }
+#if AUDIO_BUS_SIMD_X86
+    __m128 g = _mm_setr_ps(gainStart, gainStart + step, gainStart + 2 * step, gainStart + 3 * step);
+    __m128 const gStep = _mm_set1_ps(4 * step);
+    for (; i + 4 <= n; i += 4) {
+        __m128 const x = _mm_loadu_ps(in + i);
+        _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), _mm_mul_ps(x, g)));
+        g = _mm_add_ps(g, gStep);
+    }
+#endif
+    for (; i < n; ++i) {
+        out[i] += in[i] * (gainStart + step * i);
+    }
+}
+
+void ScaleInPlace(float* buffer, int n, float gain) {
+    int i = 0;
+#if AUDIO_BUS_SIMD_X86
+    __m128 const g = _mm_set1_ps(gain);
+    for (; i + 4 <= n; i += 4) {
+        _mm_storeu_ps(buffer + i, _mm_mul_ps(_mm_loadu_ps(buffer + i), g));
+    }
+#endif
+    for (; i < n; ++i) {
+        buffer[i] *= gain;
+    }
+}
+
+void Int16ToFloat(int16_t const* in, float* out, int n) {
+    float constexpr kScale = 1.f / 32768.f;
+    int i = 0;
+#if AUDIO_BUS_SIMD_X86
+    __m128 const scale = _mm_set1_ps(kScale);
+    for (; i + 8 <= n; i += 8) {
+        __m128i const x = _mm_loadu_si128(reinterpret_cast<__m128i const*>(in + i));
+        // Sign-extend by putting each sample in the top half of a 32-bit
+        // lane and shifting it back down.
+        __m128i const lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+        __m128i const hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+        _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+    }
+#endif
+    for (; i < n; ++i) {
+        out[i] = in[i] * kScale;
+    }
+}
+
+void Interleave(float const* const* planes, int numChannels, int numFrames, float* out) {
+    int i = 0;
+#if AUDIO_BUS_SIMD_X86
+    if (numChannels == 2) {
+        float const* l = planes[0];
+        float const* r = planes[1];
+        for (; i + 4 <= numFrames; i += 4) {
+            __m128 const lv = _mm_loadu_ps(l + i);
+            __m128 const rv = _mm_loadu_ps(r + i);
+            _mm_storeu_ps(out + 2 * i, _mm_unpacklo_ps(lv, rv));
+            _mm_storeu_ps(out + 2 * i + 4, _mm_unpackhi_ps(lv, rv));
+        }
+    }
+#endif
+    for (; i < numFrames; ++i) {
+        for (int c = 0; c < numChannels; ++c) {
+            out[i * numChannels + c] = planes[c][i];
+        }
+    }
+}
+
+void Deinterleave(float const* in, int numChannels, int numFrames, float* const* planes) {
+    int i = 0;
+#if AUDIO_BUS_SIMD_X86
+    if (numChannels == 2) {
+        float* l = planes[0];
+        float* r = planes[1];
+        for (; i + 4 <= numFrames; i += 4) {
+            __m128 const a = _mm_loadu_ps(in + 2 * i);      // l0 r0 l1 r1
+            __m128 const b = _mm_loadu_ps(in + 2 * i + 4);  // l2 r2 l3 r3
+            _mm_storeu_ps(l + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+            _mm_storeu_ps(r + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+        }
+    }
+#endif
+    for (; i < numFrames; ++i) {
+        for (int c = 0; c < numChannels; ++c) {
+            planes[c][i] = in[i * numChannels + c];
+        }
+    }
+}
+
+void SendDelay::Init(int sampleRate, float maxTimeSecs) {
+    int const lineLength = static_cast<int>(maxTimeSecs * sampleRate) + 1;
+    for (std::vector<float>& line : _lines) {
+        line.assign(lineLength, 0.f);
+    }
+    _writeIx = 0;
+    _delayFrames = -1.f;
+}
+
+void SendDelay::Process(float const* send, float* const* planes, int numChannels, int numFrames, int sampleRate) {
+    int const lineLength = static_cast<int>(_lines[0].size());
+    if (lineLength == 0) {
+        return;
+    }
+    // Leave room for the interpolated read's second tap.
+    float const targetDelayFrames = math_util::Clamp(std::floor(_timeSecs * sampleRate), 1.f, (float)(lineLength - 2));
+    float const targetFeedback = math_util::Clamp(_feedback, 0.f, 0.95f);
+    if (_delayFrames < 0.f) {
+        _delayFrames = targetDelayFrames;
+        _currentFeedback = targetFeedback;
+        _currentReturnGain = _returnGain;
+    }
+    float const rampCoeff = 1.f - std::exp(-1.f / (kRampSecs * sampleRate));
+    float* lineL = _lines[0].data();
+    float* lineR = _lines[1].data();
+    int writeIx = _writeIx;
+    for (int i = 0; i < numFrames; ++i) {
+        _delayFrames += rampCoeff * (targetDelayFrames - _delayFrames);
+        _currentFeedback += rampCoeff * (targetFeedback - _currentFeedback);
+        _currentReturnGain += rampCoeff * (_returnGain - _currentReturnGain);
+
+        // The read head slides while the delay time glides, so read between
+        // samples.
+        float readPos = writeIx - _delayFrames;
+        if (readPos < 0.f) {
+            readPos += lineLength;
+        }
+        int readIx0 = static_cast<int>(readPos);
+        if (readIx0 >= lineLength) {
+            readIx0 -= lineLength;  // readPos rounded up to lineLength
+        }
+        float const frac = readPos - readIx0;
+        int const readIx1 = (readIx0 + 1 < lineLength) ? readIx0 + 1 : 0;
+        float const wetL = lineL[readIx0] + frac * (lineL[readIx1] - lineL[readIx0]);
+        float const wetR = lineR[readIx0] + frac * (lineR[readIx1] - lineR[readIx0]);
+
+        // Ping-pong: the send enters on the left, and each repeat crosses over.
+        lineL[writeIx] = send[i] + _currentFeedback * wetR;
+        lineR[writeIx] = _currentFeedback * wetL;
+        if (numChannels == 1) {
+            planes[0][i] += _currentReturnGain * 0.5f * (wetL + wetR);
+        } else {
+            planes[0][i] += _currentReturnGain * wetL;
+            planes[1][i] += _currentReturnGain * wetR;
+        }
+        if (++writeIx >= lineLength) {
+            writeIx = 0;
+        }
+    }
+    _writeIx = writeIx;
+}
+
+}  // namespace audio
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace audio {
+
+int constexpr kMaxBusChannels = 8;
+
+// The mix bus is planar (one contiguous buffer per output channel) so every
+// mixing loop is a straight multiply-add over floats. It only becomes
+// interleaved at the device boundary.
+
+// Gains that place a mono source at pan (-1 left, 1 right). Balance law: the
+// near side stays at 1, so a centered source plays at full level everywhere,
+// same as the old mono engine. With more than two channels, pan spreads over
+// the first two and the rest get nothing.
+void PanToChannelGains(float pan, int numChannels, float* gains);
+
+// out[i] += in[i] * gain, with gain moving linearly from gainStart toward
+// gainEnd over the n samples.
+void MixRamped(float const* in, float* out, int n, float gainStart, float gainEnd);
+
+void ScaleInPlace(float* buffer, int n, float gain);
+
+// 16-bit PCM to float in [-1, 1).
+void Int16ToFloat(int16_t const* in, float* out, int n);
+
+// planes[c][i] -> out[i * numChannels + c].
+void Interleave(float const* const* planes, int numChannels, int numFrames, float* out);
+
+// out[i * numChannels + c] -> planes[c][i].
+void Deinterleave(float const* in, int numChannels, int numFrames, float* const* planes);
+
+// The shared send effect: a stereo ping-pong delay. Synths feed it a mono
+// send; its return is added into the bus. Levels set the parameters with a
+// SetSendDelay event (see SendDelaySettings); these are the defaults.
+// Changes glide over kRampSecs instead of jumping, so moving the read head
+// doesn't click.
+struct SendDelay {
+    static float constexpr kRampSecs = 0.05f;
+
+    float _timeSecs = 0.375f;
+    float _feedback = 0.4f;
+    float _returnGain = 1.f;
+
+    void Init(int sampleRate, float maxTimeSecs);
+    void Process(float const* send, float* const* planes, int numChannels, int numFrames, int sampleRate);
+
+    std::vector<float> _lines[2];
+    int _writeIx = 0;
+    // Where the parameters actually are on their way to the targets above.
+    // _delayFrames < 0 until the first Process().
+    float _delayFrames = -1.f;
+    float _currentFeedback = 0.f;
+    float _currentReturnGain = 0.f;
+};
+
+}  // namespace audio
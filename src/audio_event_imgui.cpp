@@ -39,6 +39,7 @@ void EventDrawImGuiNoTime(Event& event, SoundBank const& soundBank) {
             ImGui::Combo("Sound##", &event.pcmSoundIx, soundBank._soundNames.data(), soundBank._soundNames.size());
             ImGui::InputScalar("Vel##", ImGuiDataType_Float, &event.pcmVelocity);
             ImGui::Checkbox("Loop##", &event.loop);
+            ImGui::SliderFloat("Pan##", &event.pcmPan, -1.f, 1.f);
             break;
         }
         case audio::EventType::StopPcm: {
@@ -49,8 +50,15 @@ void EventDrawImGuiNoTime(Event& event, SoundBank const& soundBank) {
             ImGui::InputScalar("Gain##", ImGuiDataType_Float, &event.newGain);
             break;
         }
+        case audio::EventType::SetSendDelay: {
+            ImGui::InputScalar("Time (s)##", ImGuiDataType_Float, &event.sendDelayTimeSecs);
+            ImGui::SliderFloat("Feedback##", &event.sendDelayFeedback, 0.f, 0.95f);
+            ImGui::InputScalar("Return gain##", ImGuiDataType_Float, &event.sendDelayReturnGain);
+            break;
+        }
         case audio::EventType::None:
         case audio::EventType::SynthParam:        
+        case audio::EventType::CancelTagged:
         case audio::EventType::Count:
             ImGui::Text("UNSUPPORTED");
             break;
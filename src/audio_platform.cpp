@@ -28,10 +28,20 @@ void OnPortAudioError(PaError const& err) {
 int PortAudioCallback(
     const void *inputBuffer, void *const outputBufferUntyped,
     unsigned long framesPerBuffer,
-    const PaStreamCallbackTimeInfo* /*timeInfo*/,
-    PaStreamCallbackFlags /*statusFlags*/,
+    const PaStreamCallbackTimeInfo* timeInfo,
+    PaStreamCallbackFlags statusFlags,
     void *userData) {
-    AudioCallback((float const*)inputBuffer, (float *)outputBufferUntyped, framesPerBuffer, (StateData*)userData);
+    StateData* state = (StateData*)userData;
+    if (statusFlags & paOutputUnderflow) {
+        state->_telemetry.RecordUnderrun();
+    }
+    // Some host APIs leave currentTime at 0.
+    double streamTime = timeInfo != nullptr ? timeInfo->currentTime : 0.0;
+    if (streamTime <= 0.0) {
+        streamTime = Pa_GetStreamTime(sStream);
+    }
+    SyncAudioTime(state, streamTime);
+    AudioCallback((float const*)inputBuffer, (float *)outputBufferUntyped, framesPerBuffer, state);
 
     return paContinue;
 }
@@ -165,9 +175,19 @@ PaError PortAudioShutDown() {
 }
 
 bool Context::AddEvent(Event const &e) {
+    if (_scheduleAudioTime >= 0.0 && e.audioTime < 0.0) {
+        Event scheduled = e;
+        scheduled.audioTime = _scheduleAudioTime + e.delaySecs;
+        return audio::AddEvent(scheduled);
+    }
     return audio::AddEvent(e);
 }
 
+bool Context::AddEvents(Event const* events, int count) {
+    // Stamped as they go into the queue, so there's no copy of the batch.
+    return audio::AddEvents(events, count, _scheduleAudioTime);
+}
+
 bool Context::Init(SoundBank const &soundBank) {
     if (PortAudioInit(*this, soundBank) != paNoError) {
         ShutDown();
@@ -188,4 +208,8 @@ double Context::GetAudioTime() {
     return Pa_GetStreamTime(sStream);
 }
 
+void Context::UpdateTelemetry() {
+    _telemetryHistory.Update(_state._telemetry);
+}
+
 }  // namespace audio
\ No newline at end of file
@@ -6,6 +6,7 @@ namespace audio {
     struct Context {
         int _outputSampleRate = -1;        
         StateData _state;
+        TelemetryHistory _telemetryHistory;
 
         // returns true on success
         bool Init(SoundBank const &soundBank);
@@ -13,7 +14,21 @@ namespace audio {
         void ShutDown();
 
         bool AddEvent(Event const &e);        
+        bool AddEvents(Event const* events, int count);
+
+        // While >= 0, AddEvent(s) schedule every event at this audio time plus
+        // its delaySecs (see Event::audioTime). Lets code that only sends
+        // "right now" events, like SeqActions, be run ahead of time.
+        double _scheduleAudioTime = -1.0;
+
+        // Game thread's copy of the level's send delay settings, so the
+        // editor can tweak and save them. Sent to the audio thread as a
+        // SetSendDelay event.
+        SendDelaySettings _sendDelaySettings;
 
         double GetAudioTime();
+
+        // Call once per frame from the game thread.
+        void UpdateTelemetry();
     };
 }
\ No newline at end of file
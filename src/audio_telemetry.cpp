@@ -0,0 +1,197 @@
+#include "audio_telemetry.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#include "imgui/imgui.h"
+
+namespace audio {
+
+void Telemetry::BeginCallback(int64_t bufferCounter, float budgetUs) {
+    _current = CallbackTiming();
+    _current._bufferCounter = bufferCounter;
+    _current._budgetUs = budgetUs;
+}
+
+void Telemetry::EndCallback(float totalUs) {
+    _current._totalUs = totalUs;
+    if (totalUs > _current._budgetUs) {
+        ++_deadlineMisses;
+    }
+    if (totalUs > 0.9f * _current._budgetUs) {
+        ++_nearMisses;
+    }
+    _current._nearMisses = _nearMisses;
+    _current._deadlineMisses = _deadlineMisses;
+    _current._underruns = _underruns;
+    _current._droppedTimings = _droppedTimings;
+    if (!_queue.try_push(_current)) {
+        ++_droppedTimings;
+    }
+}
+
+void TelemetryHistory::Update(Telemetry& telemetry) {
+    Telemetry::Queue& queue = telemetry.GetQueue();
+    CallbackTiming prev = _latest;
+    bool gotAny = false;
+    while (CallbackTiming* t = queue.front()) {
+        _latest = *t;
+        gotAny = true;
+        if (!_paused) {
+            if (_history._count >= kHistoryLength) {
+                _history.Pop();
+            }
+            *_history.Push() = *t;
+        }
+        queue.pop();
+    }
+    if (!gotAny || !_logMisses) {
+        return;
+    }
+    if (_latest._nearMisses > prev._nearMisses || _latest._underruns > prev._underruns) {
+        printf("Audio: %lld callbacks close to deadline, %lld over deadline, %lld underruns so far (latest: %.0f / %.0f us)\n",
+            (long long)_latest._nearMisses, (long long)_latest._deadlineMisses, (long long)_latest._underruns,
+            _latest._totalUs, _latest._budgetUs);
+    }
+    if (_latest._droppedEvents > prev._droppedEvents) {
+        printf("Audio: event queue full, dropped %lld events so far\n", (long long)_latest._droppedEvents);
+    }
+    if (_latest._lateEvents > prev._lateEvents) {
+        printf("Audio: too many events due at once, %lld ran a buffer late so far (%d pending)\n", (long long)_latest._lateEvents, _latest._pendingEvents);
+    }
+    if (_latest._overflowedEvents > prev._overflowedEvents) {
+        printf("Audio: pending event pool full, dropped %lld events so far (peak %d pending)\n", (long long)_latest._overflowedEvents, _latest._peakPendingEvents);
+    }
+}
+
+bool TelemetryHistory::WriteCsv(char const* filename) const {
+    FILE* f = fopen(filename, "w");
+    if (f == nullptr) {
+        printf("Failed to open \"%s\" for writing audio telemetry\n", filename);
+        return false;
+    }
+    fprintf(f, "buffer,events_us,pcm_us");
+    for (int synthIx = 0; synthIx < kNumSynths; ++synthIx) {
+        fprintf(f, ",synth%d_us", synthIx);
+    }
+    fprintf(f, ",synth_total_us,resample_us,gain_us,total_us,budget_us,near_misses,deadline_misses,underruns,dropped,dropped_events,pending_events,peak_pending_events,far_future_events,late_events,overflowed_events\n");
+    for (std::size_t i = 0; i < _history._count; ++i) {
+        CallbackTiming const& t = *_history[i];
+        fprintf(f, "%lld,%f,%f", (long long)t._bufferCounter, t._eventsUs, t._pcmUs);
+        for (int synthIx = 0; synthIx < kNumSynths; ++synthIx) {
+            fprintf(f, ",%f", t._synthUs[synthIx]);
+        }
+        fprintf(f, ",%f,%f,%f,%f,%f,%lld,%lld,%lld,%lld,%lld,%d,%d,%d,%lld,%lld\n",
+            t._synthTotalUs, t._resampleUs, t._gainUs, t._totalUs, t._budgetUs,
+            (long long)t._nearMisses, (long long)t._deadlineMisses, (long long)t._underruns, (long long)t._droppedTimings,
+            (long long)t._droppedEvents, t._pendingEvents, t._peakPendingEvents, t._farFutureEvents, (long long)t._lateEvents,
+            (long long)t._overflowedEvents);
+    }
+    fclose(f);
+    printf("Wrote %zu audio callback timings to \"%s\"\n", _history._count, filename);
+    return true;
+}
+
+namespace {
+
+float GetTotalUs(void* data, int idx) {
+    auto* history = static_cast<RingBuffer<CallbackTiming, TelemetryHistory::kHistoryLength>*>(data);
+    return (*history)[idx]->_totalUs;
+}
+
+}  // namespace
+
+void TelemetryHistory::ImGui() {
+    ImGui::Begin("Audio profiler");
+
+    ImGui::Text("Near misses: %lld  Over deadline: %lld  Underruns: %lld  Dropped timings: %lld  Dropped events: %lld",
+        (long long)_latest._nearMisses, (long long)_latest._deadlineMisses,
+        (long long)_latest._underruns, (long long)_latest._droppedTimings, (long long)_latest._droppedEvents);
+    ImGui::Text("Pending events: %d (peak %d, far future %d)  Late events: %lld  Overflowed events: %lld",
+        _latest._pendingEvents, _latest._peakPendingEvents, _latest._farFutureEvents, (long long)_latest._lateEvents,
+        (long long)_latest._overflowedEvents);
+
+    ImGui::Checkbox("Pause", &_paused);
+    ImGui::SameLine();
+    ImGui::Checkbox("Log misses", &_logMisses);
+    ImGui::SameLine();
+    static char sCsvFilename[256] = "audio_telemetry.csv";
+    if (ImGui::Button("Dump CSV")) {
+        WriteCsv(sCsvFilename);
+    }
+    ImGui::SameLine();
+    ImGui::InputText("##csv", sCsvFilename, sizeof(sCsvFilename));
+
+    if (_history._count == 0) {
+        ImGui::Text("No timings yet.");
+        ImGui::End();
+        return;
+    }
+
+    char overlay[64];
+    snprintf(overlay, sizeof(overlay), "budget: %.0f us", _latest._budgetUs);
+    ImGui::PlotLines("Total (us)", &GetTotalUs, &_history, (int)_history._count, 0, overlay, 0.f, _latest._budgetUs, ImVec2(0, 80));
+
+    // Average and worst over the history for each stage.
+    struct Stat {
+        char const* name;
+        float avg = 0.f;
+        float max = 0.f;
+    };
+    Stat stats[6 + kNumSynths];
+    char synthNames[kNumSynths][16];
+    int const numStats = 6 + kNumSynths;
+    stats[0].name = "Events";
+    stats[1].name = "PCM";
+    for (int synthIx = 0; synthIx < kNumSynths; ++synthIx) {
+        snprintf(synthNames[synthIx], sizeof(synthNames[synthIx]), "Synth %d", synthIx);
+        stats[2 + synthIx].name = synthNames[synthIx];
+    }
+    stats[2 + kNumSynths].name = "Synths (wall)";
+    stats[3 + kNumSynths].name = "Resample";
+    stats[4 + kNumSynths].name = "Gain";
+    stats[5 + kNumSynths].name = "Total";
+    for (std::size_t i = 0; i < _history._count; ++i) {
+        CallbackTiming const& t = *_history[i];
+        float values[6 + kNumSynths];
+        values[0] = t._eventsUs;
+        values[1] = t._pcmUs;
+        for (int synthIx = 0; synthIx < kNumSynths; ++synthIx) {
+            values[2 + synthIx] = t._synthUs[synthIx];
+        }
+        values[2 + kNumSynths] = t._synthTotalUs;
+        values[3 + kNumSynths] = t._resampleUs;
+        values[4 + kNumSynths] = t._gainUs;
+        values[5 + kNumSynths] = t._totalUs;
+        for (int statIx = 0; statIx < numStats; ++statIx) {
+            stats[statIx].avg += values[statIx];
+            stats[statIx].max = std::max(stats[statIx].max, values[statIx]);
+        }
+    }
+
+    if (ImGui::BeginTable("audio_stages", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+        ImGui::TableSetupColumn("Stage");
+        ImGui::TableSetupColumn("Avg (us)");
+        ImGui::TableSetupColumn("Max (us)");
+        ImGui::TableSetupColumn("Avg % of budget");
+        ImGui::TableHeadersRow();
+        for (int statIx = 0; statIx < numStats; ++statIx) {
+            Stat const& s = stats[statIx];
+            float const avg = s.avg / (float)_history._count;
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(s.name);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.1f", avg);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.1f", s.max);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.1f%%", 100.f * avg / _latest._budgetUs);
+        }
+        ImGui::EndTable();
+    }
+
+    ImGui::End();
+}
+
+}  // namespace audio
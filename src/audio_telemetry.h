@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+
+#include "SPSCQueue.h"
+#include "audio_util.h"
+#include "ring_buffer.h"
+
+namespace audio {
+
+// Where the time went in one audio callback. All times are in microseconds.
+// The counters are running totals as of this callback, so the reader never has
+// to look at anything the audio thread writes other than the queue slots.
+struct CallbackTiming {
+    int64_t _bufferCounter = 0;
+    float _eventsUs = 0.f;  // event queue + pending events
+    float _pcmUs = 0.f;
+    float _synthUs[kNumSynths] = {};  // each synth::Process call
+    float _synthTotalUs = 0.f;  // wall time for all synths (less than the sum when running on workers)
+    float _resampleUs = 0.f;
+    float _gainUs = 0.f;
+    float _totalUs = 0.f;
+    float _budgetUs = 0.f;
+
+    int64_t _nearMisses = 0;  // callbacks that used > 90% of the budget
+    int64_t _deadlineMisses = 0;  // callbacks that used > 100% of the budget
+    int64_t _underruns = 0;  // reported by the audio device
+    int64_t _droppedTimings = 0;  // timings we couldn't push because the reader fell behind
+    int64_t _droppedEvents = 0;  // AddEvent() calls that found the event queue full
+
+    // Events scheduled for later buffers (see EventTimerWheel).
+    int _pendingEvents = 0;
+    int _peakPendingEvents = 0;
+    int _farFutureEvents = 0;  // past the wheel's last level
+    int64_t _lateEvents = 0;  // ran a buffer late because too many were due at once
+    int64_t _overflowedEvents = 0;  // dropped because the wheel's pool was full
+};
+
+// Audio thread side. Fills in a CallbackTiming as the callback runs and pushes
+// it onto a lock-free queue at the end. Nothing here blocks or prints.
+class Telemetry {
+public:
+    typedef rigtorp::SPSCQueue<CallbackTiming> Queue;
+    static int constexpr kQueueLength = 512;
+
+    Telemetry() : _queue(kQueueLength) {}
+
+    // Audio thread only.
+    CallbackTiming& Current() { return _current; }
+    void BeginCallback(int64_t bufferCounter, float budgetUs);
+    void EndCallback(float totalUs);
+    void RecordUnderrun() { ++_underruns; }
+
+    // Game thread only.
+    Queue& GetQueue() { return _queue; }
+
+private:
+    Queue _queue;
+
+    CallbackTiming _current;
+    int64_t _nearMisses = 0;
+    int64_t _deadlineMisses = 0;
+    int64_t _underruns = 0;
+    int64_t _droppedTimings = 0;
+};
+
+// Game thread side. Drains the queue into a history we can plot, and reports
+// near misses/underruns from here instead of from the realtime thread.
+struct TelemetryHistory {
+    static std::size_t constexpr kHistoryLength = 1024;
+    RingBuffer<CallbackTiming, kHistoryLength> _history;
+    CallbackTiming _latest;
+    bool _paused = false;
+    bool _logMisses = true;
+
+    void Update(Telemetry& telemetry);
+    bool WriteCsv(char const* filename) const;
+    void ImGui();
+};
+
+}  // namespace audio
@@ -0,0 +1,197 @@
+#include "audio_timer_wheel.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace audio {
+
+void EventTimerWheel::Init(int capacity) {
+    _nodes.clear();
+    _sortScratch.clear();
+    _freeHead = -1;
+    _nextSeq = 0;
+    std::fill(std::begin(_level0), std::end(_level0), -1);
+    std::fill(std::begin(_level1), std::end(_level1), -1);
+    std::fill(std::begin(_level2), std::end(_level2), -1);
+    _farFuture = -1;
+    _due = -1;
+    _numOverdue = 0;
+    _currentTick = 0;
+    _stats = Stats();
+
+    _nodes.resize(std::max(capacity, 1));
+    for (int i = 0, n = _nodes.size(); i < n; ++i) {
+        _nodes[i]._next = i + 1 < n ? i + 1 : -1;
+    }
+    _freeHead = 0;
+    _sortScratch.reserve(_nodes.size());
+    _stats._capacity = _nodes.size();
+}
+
+void EventTimerWheel::Destroy() {
+    _nodes = std::vector<Node>();
+    _sortScratch = std::vector<int>();
+    _freeHead = -1;
+    _stats = Stats();
+}
+
+int EventTimerWheel::AllocNode() {
+    if (_freeHead < 0) {
+        return -1;
+    }
+    int const nodeIx = _freeHead;
+    _freeHead = _nodes[nodeIx]._next;
+    ++_stats._numPending;
+    _stats._peakPending = std::max(_stats._peakPending, _stats._numPending);
+    return nodeIx;
+}
+
+void EventTimerWheel::FreeNode(int nodeIx) {
+    _nodes[nodeIx]._next = _freeHead;
+    _freeHead = nodeIx;
+    --_stats._numPending;
+}
+
+void EventTimerWheel::Link(int64_t tick, int nodeIx) {
+    int64_t const delta = tick - _currentTick;
+    int* head;
+    if (delta < 0) {
+        head = &_due;
+    } else if (delta < kLevel0Slots) {
+        head = &_level0[tick & (kLevel0Slots - 1)];
+    } else if (delta < (int64_t(kLevel0Slots) << kUpperLevelBits)) {
+        head = &_level1[(tick >> kLevel1Shift) & (kUpperLevelSlots - 1)];
+    } else if (delta < kFarFutureTicks) {
+        head = &_level2[(tick >> kLevel2Shift) & (kUpperLevelSlots - 1)];
+    } else {
+        head = &_farFuture;
+        ++_stats._numFarFuture;
+    }
+    _nodes[nodeIx]._next = *head;
+    *head = nodeIx;
+}
+
+bool EventTimerWheel::Insert(int64_t tick, PendingEvent const& e) {
+    int const nodeIx = AllocNode();
+    if (nodeIx < 0) {
+        ++_stats._numDropped;
+        return false;
+    }
+    Node& node = _nodes[nodeIx];
+    node._e = e;
+    node._tick = tick;
+    node._seq = _nextSeq++;
+    Link(tick, nodeIx);
+    return true;
+}
+
+void EventTimerWheel::Cascade(int& listHead) {
+    // Detach first: entries can land back in the slot they came from.
+    int nodeIx = listHead;
+    listHead = -1;
+    while (nodeIx >= 0) {
+        int const next = _nodes[nodeIx]._next;
+        Link(_nodes[nodeIx]._tick, nodeIx);
+        nodeIx = next;
+    }
+}
+
+void EventTimerWheel::AdvanceTo(int64_t tick) {
+    for (; _currentTick <= tick; ++_currentTick) {
+        if ((_currentTick & (kLevel0Slots - 1)) == 0) {
+            int64_t const level1Ix = _currentTick >> kLevel1Shift;
+            if ((level1Ix & (kUpperLevelSlots - 1)) == 0) {
+                int64_t const level2Ix = _currentTick >> kLevel2Shift;
+                if ((level2Ix & (kUpperLevelSlots - 1)) == 0) {
+                    _stats._numFarFuture = 0;
+                    Cascade(_farFuture);
+                }
+                Cascade(_level2[level2Ix & (kUpperLevelSlots - 1)]);
+            }
+            Cascade(_level1[level1Ix & (kUpperLevelSlots - 1)]);
+        }
+        // Everything in this slot is due now.
+        int& slot = _level0[_currentTick & (kLevel0Slots - 1)];
+        while (slot >= 0) {
+            int const nodeIx = slot;
+            slot = _nodes[nodeIx]._next;
+            _nodes[nodeIx]._next = _due;
+            _due = nodeIx;
+        }
+    }
+}
+
+int EventTimerWheel::ExtractDue(int64_t tick, PendingEvent* out, int maxCount) {
+    AdvanceTo(tick);
+
+    _sortScratch.clear();
+    for (int nodeIx = _due; nodeIx >= 0; nodeIx = _nodes[nodeIx]._next) {
+        _sortScratch.push_back(nodeIx);
+    }
+    _due = -1;
+    std::sort(_sortScratch.begin(), _sortScratch.end(), [this](int lhsIx, int rhsIx) {
+        Node const& lhs = _nodes[lhsIx];
+        Node const& rhs = _nodes[rhsIx];
+        if (lhs._tick != rhs._tick) {
+            return lhs._tick < rhs._tick;
+        }
+        if (lhs._e._sampleOffset != rhs._e._sampleOffset) {
+            return lhs._e._sampleOffset < rhs._e._sampleOffset;
+        }
+        return lhs._seq < rhs._seq;
+    });
+
+    int const numDue = _sortScratch.size();
+    int const numOut = std::min(numDue, maxCount);
+    for (int i = 0; i < numOut; ++i) {
+        out[i] = _nodes[_sortScratch[i]]._e;
+        FreeNode(_sortScratch[i]);
+    }
+    // Keep the rest for next time, in order.
+    for (int i = numDue - 1; i >= numOut; --i) {
+        _nodes[_sortScratch[i]]._next = _due;
+        _due = _sortScratch[i];
+    }
+    _numOverdue = numDue - numOut;
+    _stats._numLate += _numOverdue;
+    return numOut;
+}
+
+int EventTimerWheel::RemoveTaggedFromList(int& listHead, int tag) {
+    int numRemoved = 0;
+    int* link = &listHead;
+    while (*link >= 0) {
+        int const nodeIx = *link;
+        if (_nodes[nodeIx]._e._e.tag == tag) {
+            *link = _nodes[nodeIx]._next;
+            FreeNode(nodeIx);
+            ++numRemoved;
+        } else {
+            link = &_nodes[nodeIx]._next;
+        }
+    }
+    return numRemoved;
+}
+
+// Walks every list. Cancels are rare.
+int EventTimerWheel::RemoveTagged(int tag) {
+    int numRemoved = 0;
+    for (int& slot : _level0) {
+        numRemoved += RemoveTaggedFromList(slot, tag);
+    }
+    for (int& slot : _level1) {
+        numRemoved += RemoveTaggedFromList(slot, tag);
+    }
+    for (int& slot : _level2) {
+        numRemoved += RemoveTaggedFromList(slot, tag);
+    }
+    int const numFarFutureRemoved = RemoveTaggedFromList(_farFuture, tag);
+    _stats._numFarFuture -= numFarFutureRemoved;
+    numRemoved += numFarFutureRemoved;
+    int const numDueRemoved = RemoveTaggedFromList(_due, tag);
+    _numOverdue -= numDueRemoved;
+    numRemoved += numDueRemoved;
+    return numRemoved;
+}
+
+}  // namespace audio
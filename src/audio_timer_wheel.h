@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "audio_util.h"
+
+namespace audio {
+
+// Holds the events waiting for a future buffer. Time is in ticks, one per
+// buffer, so an insert is O(1) and each buffer takes everything due in it at
+// once instead of popping a heap one entry at a time.
+//
+// Three levels of hashed wheels: 256 one-tick slots, then 64 slots of 256
+// ticks, then 64 of 256*64 ticks. At 512-frame buffers that covers ~3 hours;
+// anything further out sits in a far-future list. An entry moves down a level
+// when the wheel below it wraps around to its slot.
+//
+// Entries live in one pool linked by index, sized by Init() and never grown:
+// this runs on the audio thread, which must not allocate. If the pool is
+// full, Insert() drops the event and counts it in Stats::_numDropped, so
+// size it well above the backlog a level ever builds up.
+class EventTimerWheel {
+public:
+    struct Stats {
+        int _numPending = 0;
+        int _peakPending = 0;
+        int _numFarFuture = 0;
+        int _capacity = 0;
+        int64_t _numDropped = 0;  // inserts that found the pool full
+        int64_t _numLate = 0;  // events that ran after their buffer because the output was full
+    };
+
+    void Init(int capacity);
+    void Destroy();
+
+    // tick is the buffer the event runs in. Anything earlier than the next
+    // ExtractDue() tick runs in that one. Returns false if the pool is full
+    // and the event was dropped.
+    bool Insert(int64_t tick, PendingEvent const& e);
+
+    // Call once per buffer, with consecutive ticks. Writes every event due by
+    // tick to out in the order they should run: by buffer, then by frame
+    // within the buffer, then by insertion order. Events that don't fit in
+    // maxCount stay due and come out first next time.
+    int ExtractDue(int64_t tick, PendingEvent* out, int maxCount);
+
+    // Removes every pending event with this tag.
+    int RemoveTagged(int tag);
+
+    // Events that were due but didn't fit in the last ExtractDue().
+    int GetNumOverdue() const { return _numOverdue; }
+    Stats const& GetStats() const { return _stats; }
+
+private:
+    static int constexpr kLevel0Bits = 8;
+    static int constexpr kUpperLevelBits = 6;
+    static int constexpr kLevel0Slots = 1 << kLevel0Bits;
+    static int constexpr kUpperLevelSlots = 1 << kUpperLevelBits;
+    static int constexpr kLevel1Shift = kLevel0Bits;
+    static int constexpr kLevel2Shift = kLevel0Bits + kUpperLevelBits;
+    static int64_t constexpr kFarFutureTicks = int64_t(1) << (kLevel0Bits + 2 * kUpperLevelBits);
+
+    struct Node {
+        PendingEvent _e;
+        int64_t _tick = 0;
+        uint32_t _seq = 0;
+        int _next = -1;
+    };
+
+    int AllocNode();
+    void FreeNode(int nodeIx);
+    void Link(int64_t tick, int nodeIx);
+    void Cascade(int& listHead);
+    void AdvanceTo(int64_t tick);
+    int RemoveTaggedFromList(int& listHead, int tag);
+
+    std::vector<Node> _nodes;
+    std::vector<int> _sortScratch;  // same capacity as _nodes
+    int _freeHead = -1;
+    uint32_t _nextSeq = 0;
+
+    // Heads of singly-linked lists through _nodes, -1 when empty.
+    int _level0[kLevel0Slots];
+    int _level1[kUpperLevelSlots];
+    int _level2[kUpperLevelSlots];
+    int _farFuture = -1;
+    int _due = -1;  // pulled off the wheel, waiting for ExtractDue to output them
+    int _numOverdue = 0;
+
+    int64_t _currentTick = 0;  // next tick ExtractDue() hasn't taken yet
+    Stats _stats;
+};
+
+}  // namespace audio
@@ -0,0 +1,177 @@
+// Checks EventTimerWheel against a plain std::set: random inserts at every
+// distance (including past the last level), cancels, and buffers with more
+// events due than fit. Checks that a full pool drops and counts instead of
+// growing. Then times a phrase-sized backlog.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <set>
+#include <tuple>
+#include <vector>
+
+#include "audio_timer_wheel.h"
+
+namespace {
+
+// Low enough that busy ticks overflow and push events to the next buffer.
+int constexpr kMaxPerBuffer = 8;
+
+// tick, sample offset, insertion order, tag
+typedef std::tuple<int64_t, int, int, int> RefEntry;
+
+// Inserts only happen every insertEvery ticks, to keep the far-out runs small.
+bool RunRandomized(int64_t maxDelta, int numTicks, int insertEvery, uint32_t seed) {
+    std::mt19937 rng(seed);
+    audio::EventTimerWheel wheel;
+    wheel.Init(/*capacity=*/1 << 16);
+    std::set<RefEntry> ref;
+    int nextSeq = 0;
+    std::vector<audio::PendingEvent> out(kMaxPerBuffer);
+    for (int64_t tick = 0; tick < numTicks; ++tick) {
+        bool const insertTick = tick % insertEvery == 0;
+        int const numInserts = insertTick ? std::uniform_int_distribution<int>(0, 12)(rng) : 0;
+        for (int i = 0; i < numInserts; ++i) {
+            int64_t delta = std::uniform_int_distribution<int64_t>(0, maxDelta)(rng);
+            if (rng() % 4 == 0) {
+                delta = std::uniform_int_distribution<int64_t>(0, 3)(rng);
+            }
+            audio::PendingEvent e;
+            e._runBufferCounter = tick + delta;
+            e._sampleOffset = std::uniform_int_distribution<int>(0, 511)(rng);
+            e._e.tag = std::uniform_int_distribution<int>(0, 50)(rng);
+            // Stash the reference seq where we can read it back.
+            e._e.channel = nextSeq;
+            wheel.Insert(e._runBufferCounter, e);
+            ref.emplace(e._runBufferCounter, e._sampleOffset, nextSeq, e._e.tag);
+            ++nextSeq;
+        }
+        if (insertTick && rng() % 64 == 0) {
+            int const tag = std::uniform_int_distribution<int>(1, 50)(rng);
+            int const numRemoved = wheel.RemoveTagged(tag);
+            int refRemoved = 0;
+            for (auto it = ref.begin(); it != ref.end();) {
+                if (std::get<3>(*it) == tag) {
+                    it = ref.erase(it);
+                    ++refRemoved;
+                } else {
+                    ++it;
+                }
+            }
+            if (numRemoved != refRemoved) {
+                printf("tick %lld: RemoveTagged(%d) removed %d, expected %d\n", (long long)tick, tag, numRemoved, refRemoved);
+                return false;
+            }
+        }
+
+        // Overdue events from earlier ticks sort first, same as in the wheel.
+        int const numOut = wheel.ExtractDue(tick, out.data(), kMaxPerBuffer);
+        for (int i = 0; i < numOut; ++i) {
+            if (ref.empty() || std::get<0>(*ref.begin()) > tick) {
+                printf("tick %lld: got %d events, expected %d\n", (long long)tick, numOut, i);
+                return false;
+            }
+            int const expectedSeq = std::get<2>(*ref.begin());
+            if (out[i]._e.channel != expectedSeq) {
+                printf("tick %lld: event %d is #%d, expected #%d\n", (long long)tick, i, out[i]._e.channel, expectedSeq);
+                return false;
+            }
+            ref.erase(ref.begin());
+        }
+        if (numOut < kMaxPerBuffer && !ref.empty() && std::get<0>(*ref.begin()) <= tick) {
+            printf("tick %lld: got %d events, expected more\n", (long long)tick, numOut);
+            return false;
+        }
+        if (wheel.GetStats()._numPending != (int)ref.size()) {
+            printf("tick %lld: %d pending, expected %zu\n", (long long)tick, wheel.GetStats()._numPending, ref.size());
+            return false;
+        }
+    }
+    audio::EventTimerWheel::Stats const& stats = wheel.GetStats();
+    if (stats._numDropped != 0) {
+        printf("max delta %lld: dropped %lld events\n", (long long)maxDelta, (long long)stats._numDropped);
+        return false;
+    }
+    printf("max delta %lld: %d inserts over %d ticks, peak %d pending, %lld late, %d far future at the end\n",
+        (long long)maxDelta, nextSeq, numTicks, stats._peakPending, (long long)stats._numLate, stats._numFarFuture);
+    wheel.Destroy();
+    return true;
+}
+
+// Fill the pool, then make sure extra inserts are dropped and counted, and
+// that freed entries can be used again.
+bool RunOverflow() {
+    int constexpr kCapacity = 16;
+    audio::EventTimerWheel wheel;
+    wheel.Init(kCapacity);
+    audio::PendingEvent e;
+    for (int i = 0; i < kCapacity + 5; ++i) {
+        bool const inserted = wheel.Insert(/*tick=*/i % 3, e);
+        if (inserted != (i < kCapacity)) {
+            printf("overflow: insert %d returned %d\n", i, inserted);
+            return false;
+        }
+    }
+    if (wheel.GetStats()._numDropped != 5 || wheel.GetStats()._capacity != kCapacity) {
+        printf("overflow: %lld dropped, capacity %d\n", (long long)wheel.GetStats()._numDropped, wheel.GetStats()._capacity);
+        return false;
+    }
+    std::vector<audio::PendingEvent> out(kCapacity);
+    int const numOut = wheel.ExtractDue(0, out.data(), kCapacity);
+    if (!wheel.Insert(/*tick=*/10, e) || wheel.GetStats()._numPending != kCapacity - numOut + 1) {
+        printf("overflow: couldn't reuse freed entries\n");
+        return false;
+    }
+    wheel.Destroy();
+    return true;
+}
+
+// A level that schedules a whole phrase up front: lots of inserts, then one
+// extraction per buffer.
+void TimePhrase() {
+    int constexpr kNumEvents = 100000;
+    int constexpr kNumTicks = 20000;
+    std::mt19937 rng(1234);
+    audio::EventTimerWheel wheel;
+    wheel.Init(/*capacity=*/kNumEvents);
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < kNumEvents; ++i) {
+        audio::PendingEvent e;
+        e._runBufferCounter = std::uniform_int_distribution<int64_t>(0, kNumTicks - 1)(rng);
+        e._sampleOffset = std::uniform_int_distribution<int>(0, 511)(rng);
+        wheel.Insert(e._runBufferCounter, e);
+    }
+    auto mid = std::chrono::high_resolution_clock::now();
+    std::vector<audio::PendingEvent> out(1024);
+    int numOut = 0;
+    for (int tick = 0; tick < kNumTicks; ++tick) {
+        numOut += wheel.ExtractDue(tick, out.data(), out.size());
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    double const insertNs = std::chrono::duration<double, std::nano>(mid - start).count() / kNumEvents;
+    double const extractUs = std::chrono::duration<double, std::micro>(end - mid).count() / kNumTicks;
+    printf("%d events over %d buffers: %.1f ns per insert, %.2f us per buffer to extract (%d out)\n",
+        kNumEvents, kNumTicks, insertNs, extractUs, numOut);
+    wheel.Destroy();
+}
+
+}  // namespace
+
+int main() {
+    bool success = true;
+    success = RunRandomized(/*maxDelta=*/300, /*numTicks=*/5000, /*insertEvery=*/1, 1) && success;
+    success = RunRandomized(/*maxDelta=*/20000, /*numTicks=*/40000, /*insertEvery=*/1, 2) && success;
+    // Past the last level (2^20 ticks), so some go through the far-future list.
+    success = RunRandomized(/*maxDelta=*/(int64_t(1) << 20) + 5000, /*numTicks=*/1200000, /*insertEvery=*/100, 3) && success;
+
+    success = RunOverflow() && success;
+
+    TimePhrase();
+
+    if (!success) {
+        printf("FAILED\n");
+        return 1;
+    }
+    return 0;
+}
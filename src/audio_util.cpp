@@ -16,6 +16,7 @@ void audio::Event::Save(serial::Ptree pt) const {
             pt.PutInt("sound_ix", pcmSoundIx);
             pt.PutFloat("velocity", velocity);
             pt.PutBool("loop", loop);
+            pt.PutFloat("pan", pcmPan);
             break;
         case EventType::StopPcm:
             pt.PutInt("sound_ix", pcmSoundIx);
@@ -33,6 +34,12 @@ void audio::Event::Save(serial::Ptree pt) const {
         case EventType::SetGain:
             pt.PutFloat("gain", newGain);
             break;
+        case EventType::SetSendDelay:
+            pt.PutFloat("time_secs", sendDelayTimeSecs);
+            pt.PutFloat("feedback", sendDelayFeedback);
+            pt.PutFloat("return_gain", sendDelayReturnGain);
+            break;
+        case EventType::CancelTagged:
         case EventType::None:
         case EventType::Count:
             break;
@@ -69,6 +76,8 @@ void audio::Event::Load(serial::Ptree pt) {
             pcmVelocity = pt.GetFloat("velocity");
             loop = false;
             pt.TryGetBool("loop", &loop);
+            pcmPan = 0.f;
+            pt.TryGetFloat("pan", &pcmPan);
             break;
         case EventType::StopPcm:
             pcmSoundIx = pt.GetInt("sound_ix");
@@ -87,8 +96,40 @@ void audio::Event::Load(serial::Ptree pt) {
         case EventType::SetGain:
             newGain = pt.GetFloat("gain");
             break;
+        case EventType::SetSendDelay:
+            sendDelayTimeSecs = pt.GetFloat("time_secs");
+            sendDelayFeedback = pt.GetFloat("feedback");
+            sendDelayReturnGain = pt.GetFloat("return_gain");
+            break;
+        case EventType::CancelTagged:
         case EventType::None:
         case EventType::Count:
             break;
     }
 }
+
+audio::Event audio::SendDelaySettings::MakeEvent(double bpm) const {
+    Event e;
+    e.type = EventType::SetSendDelay;
+    e.sendDelayTimeSecs = _timeSecs;
+    if (_timeBeats > 0.f && bpm > 0.0) {
+        e.sendDelayTimeSecs = static_cast<float>(_timeBeats * 60.0 / bpm);
+    }
+    e.sendDelayFeedback = _feedback;
+    e.sendDelayReturnGain = _returnGain;
+    return e;
+}
+
+void audio::SendDelaySettings::Save(serial::Ptree pt) const {
+    pt.PutFloat("time_beats", _timeBeats);
+    pt.PutFloat("time_secs", _timeSecs);
+    pt.PutFloat("feedback", _feedback);
+    pt.PutFloat("return_gain", _returnGain);
+}
+
+void audio::SendDelaySettings::Load(serial::Ptree pt) {
+    pt.TryGetFloat("time_beats", &_timeBeats);
+    pt.TryGetFloat("time_secs", &_timeSecs);
+    pt.TryGetFloat("feedback", &_feedback);
+    pt.TryGetFloat("return_gain", &_returnGain);
+}
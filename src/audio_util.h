@@ -1,6 +1,7 @@
 #pragma once
 
 #include <array>
+#include <cstdint>
 
 #include "enums/audio_EventType.h"
 #include "enums/audio_SynthParamType.h"
@@ -8,6 +9,11 @@
 
 namespace audio {
 
+int constexpr kNumSynths = 5;
+int constexpr kNumPcmVoices = 64;
+// Voices playing a streamed sound also need one of these (see PcmStreamer).
+int constexpr kNumPcmStreamSlots = 8;
+
 struct Event {
     Event() {
         type = EventType::None;
@@ -17,10 +23,24 @@ struct Event {
         primePortaMidiNote = -1;
         velocity = 1.f;
         noteOnId = 0;
+        audioTime = -1.0;
+        tag = 0;
+        pcmPan = 0.f;
     }
     EventType type;
     int channel;
     double delaySecs;
+    // If >= 0, the event runs when the stream reaches this time (same clock as
+    // Context::GetAudioTime()) and delaySecs is ignored. Unlike delaySecs this
+    // doesn't depend on which buffer the audio thread picks the event up in,
+    // so the game can schedule ahead. Not serialized.
+    double audioTime;
+    // If non-zero, a CancelTagged event with the same tag removes this event
+    // if it hasn't run yet. Not serialized.
+    int tag;
+    // PlayPcm only: -1 left, 1 right. Outside the union so every event
+    // starts centered.
+    float pcmPan;
     union {
         struct {
             int midiNote;
@@ -48,20 +68,47 @@ struct Event {
             // valid under SetGain
             float newGain;
         };
+        struct {
+            // valid under SetSendDelay
+            float sendDelayTimeSecs;
+            float sendDelayFeedback;
+            float sendDelayReturnGain;
+        };
     };
 
     void Save(serial::Ptree pt) const;
     void Load(serial::Ptree pt);
 };
 
+// A level's settings for the shared send delay (see SendDelay). If
+// _timeBeats > 0 the delay time follows the tempo and _timeSecs is ignored.
+struct SendDelaySettings {
+    float _timeBeats = 0.f;
+    float _timeSecs = 0.375f;
+    float _feedback = 0.4f;
+    float _returnGain = 1.f;
+
+    // A SetSendDelay event that applies these at the given tempo.
+    Event MakeEvent(double bpm) const;
+
+    void Save(serial::Ptree pt) const;
+    void Load(serial::Ptree pt);
+};
+
 struct PcmSound {
+    // Exactly one of these is set. Streamed sounds only keep their first
+    // _residentLength frames here (as float); the rest comes from PcmStreamer.
     float* _buffer = nullptr;
-    uint64_t _bufferLength = 0;
+    int16_t* _buffer16 = nullptr;
+    uint64_t _bufferLength = 0;  // total length in frames
+    uint64_t _residentLength = 0;
+    bool _streamed = false;
 };
 
 struct PendingEvent {
     Event _e;
     int64_t _runBufferCounter = 0;
+    int _sampleOffset = 0;  // frame within the buffer at _runBufferCounter
 };
 
 }  // namespace audio
@@ -0,0 +1,214 @@
+#include "audio_worker_pool.h"
+
+#include <cassert>
+#include <cstdio>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <climits>
+#include <windows.h>
+#elif defined(__APPLE__)
+#include <dispatch/dispatch.h>
+#elif defined(__linux__)
+#include <cerrno>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#include <immintrin.h>
+#define CPU_PAUSE() _mm_pause()
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define CPU_PAUSE() __asm__ __volatile__("yield")
+#else
+#define CPU_PAUSE()
+#endif
+
+namespace audio {
+
+namespace {
+
+// How many times to spin on the generation counter before parking. A buffer
+// every ~10ms means most of a worker's life is waiting, so this only needs to
+// cover the gap between synths finishing and the next callback showing up
+// when we're running hot.
+int constexpr kSpinCount = 4096;
+
+void PinThreadToCore(std::thread& t, int coreIx) {
+#if defined(_WIN32)
+    DWORD_PTR mask = (DWORD_PTR)1 << coreIx;
+    if (SetThreadAffinityMask((HANDLE)t.native_handle(), mask) == 0) {
+        printf("WorkerPool: failed to pin worker to core %d\n", coreIx);
+    }
+#elif defined(__linux__)
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    CPU_SET(coreIx, &cpuSet);
+    if (pthread_setaffinity_np(t.native_handle(), sizeof(cpu_set_t), &cpuSet) != 0) {
+        printf("WorkerPool: failed to pin worker to core %d\n", coreIx);
+    }
+#else
+    // macOS doesn't let us pin threads. The scheduler does fine on its own.
+    (void)t;
+    (void)coreIx;
+#endif
+}
+
+// Thin wrappers over each platform's semaphore. Posting never takes a lock,
+// unlike notifying a condition variable whose waiters may hold its mutex.
+void* CreateSem() {
+#if defined(_WIN32)
+    return ::CreateSemaphoreA(nullptr, 0, LONG_MAX, nullptr);
+#elif defined(__APPLE__)
+    return (void*)dispatch_semaphore_create(0);
+#else
+    sem_t* sem = new sem_t;
+    sem_init(sem, /*pshared=*/0, 0);
+    return sem;
+#endif
+}
+
+void DestroySem(void* sem) {
+#if defined(_WIN32)
+    ::CloseHandle((HANDLE)sem);
+#elif defined(__APPLE__)
+    dispatch_release((dispatch_semaphore_t)sem);
+#else
+    sem_destroy((sem_t*)sem);
+    delete (sem_t*)sem;
+#endif
+}
+
+void PostSem(void* sem, int count) {
+#if defined(_WIN32)
+    ::ReleaseSemaphore((HANDLE)sem, count, nullptr);
+#elif defined(__APPLE__)
+    for (int i = 0; i < count; ++i) {
+        dispatch_semaphore_signal((dispatch_semaphore_t)sem);
+    }
+#else
+    for (int i = 0; i < count; ++i) {
+        sem_post((sem_t*)sem);
+    }
+#endif
+}
+
+void WaitSem(void* sem) {
+#if defined(_WIN32)
+    ::WaitForSingleObject((HANDLE)sem, INFINITE);
+#elif defined(__APPLE__)
+    dispatch_semaphore_wait((dispatch_semaphore_t)sem, DISPATCH_TIME_FOREVER);
+#else
+    while (sem_wait((sem_t*)sem) != 0 && errno == EINTR) {}
+#endif
+}
+
+}  // namespace
+
+void WorkerPool::Init(int numWorkers, int numJobs) {
+    assert(_threads.empty());
+    _numJobs = numJobs;
+    _generation = 0;
+    _nextJob = numJobs;
+    _jobsDone = numJobs;
+    _quit = false;
+    _numParked = 0;
+    _wakeSem = CreateSem();
+
+    int const numCores = (int)std::thread::hardware_concurrency();
+    _threads.reserve(numWorkers);
+    for (int i = 0; i < numWorkers; ++i) {
+        std::thread& t = _threads.emplace_back(&WorkerPool::WorkerLoop, this);
+        // Leave core 0 for the main thread; the audio callback floats.
+        if (numCores > 1) {
+            PinThreadToCore(t, 1 + (i % (numCores - 1)));
+        }
+    }
+}
+
+void WorkerPool::Destroy() {
+    if (_wakeSem == nullptr) {
+        return;
+    }
+    // One post per worker covers everyone parked now or about to park.
+    _quit.store(true);
+    PostSem(_wakeSem, (int)_threads.size());
+    for (std::thread& t : _threads) {
+        t.join();
+    }
+    _threads.clear();
+    DestroySem(_wakeSem);
+    _wakeSem = nullptr;
+}
+
+void WorkerPool::DoJobs() {
+    while (true) {
+        int jobIx = _nextJob.fetch_add(1, std::memory_order_acq_rel);
+        if (jobIx >= _numJobs) {
+            break;
+        }
+        _fn(_userData, jobIx);
+        _jobsDone.fetch_add(1, std::memory_order_release);
+    }
+}
+
+void WorkerPool::Run(JobFn fn, void* userData) {
+    // The previous Run() only returned once every job was claimed and
+    // finished, so nobody else is touching these right now. A worker that
+    // wakes up late for the previous generation will just see _nextJob past
+    // the end (or pick up a job from this one, which is fine).
+    _fn = fn;
+    _userData = userData;
+    _jobsDone.store(0, std::memory_order_relaxed);
+    _nextJob.store(0, std::memory_order_release);
+    // seq_cst, paired with the parking worker's: either it sees the new
+    // generation before it sleeps, or we see it parked and post for it.
+    _generation.fetch_add(1);
+    if (int const numParked = _numParked.exchange(0); numParked > 0) {
+        PostSem(_wakeSem, numParked);
+    }
+
+    DoJobs();
+
+    // If a worker got preempted mid-job, don't hog the core it needs to finish.
+    int spins = 0;
+    while (_jobsDone.load(std::memory_order_acquire) < _numJobs) {
+        if (spins < kSpinCount) {
+            ++spins;
+            CPU_PAUSE();
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void WorkerPool::WorkerLoop() {
+    uint32_t lastGeneration = 0;
+    while (true) {
+        int spins = 0;
+        uint32_t generation;
+        while ((generation = _generation.load(std::memory_order_acquire)) == lastGeneration) {
+            if (_quit.load(std::memory_order_acquire)) {
+                return;
+            }
+            if (spins < kSpinCount) {
+                ++spins;
+                CPU_PAUSE();
+                continue;
+            }
+            // If Run() already bumped the generation it may or may not have
+            // counted us; skip the wait either way. A post we don't consume
+            // here just makes a later park return early and go around again.
+            _numParked.fetch_add(1);
+            if (_generation.load() == lastGeneration && !_quit.load()) {
+                WaitSem(_wakeSem);
+            }
+        }
+        lastGeneration = generation;
+        DoJobs();
+    }
+}
+
+}  // namespace audio
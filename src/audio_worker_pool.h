@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace audio {
+
+// Fork/join pool for splitting work across cores inside the audio callback.
+// Run() hands out job indices [0, numJobs) to the workers and to the calling
+// thread, and returns once every job is done. Workers spin for a moment after
+// each Run() so back-to-back buffers don't pay for a wakeup, then park on a
+// semaphore. Run() only posts to it when someone is actually parked, i.e.
+// after the pool has sat idle for a while, and never takes a lock, so the
+// audio callback can't end up waiting on a worker that holds one.
+//
+// Jobs must not touch each other's data; which thread runs which job is not
+// deterministic, so callers should combine results in a fixed order afterward.
+class WorkerPool {
+public:
+    typedef void (*JobFn)(void* userData, int jobIx);
+
+    // numWorkers is in addition to the thread calling Run(). Each worker gets
+    // pinned to its own core when the platform lets us.
+    void Init(int numWorkers, int numJobs);
+    void Destroy();
+
+    void Run(JobFn fn, void* userData);
+
+    int NumWorkers() const { return (int)_threads.size(); }
+
+private:
+    void WorkerLoop();
+    void DoJobs();
+
+    std::vector<std::thread> _threads;
+    int _numJobs = 0;
+
+    JobFn _fn = nullptr;
+    void* _userData = nullptr;
+
+    std::atomic<uint32_t> _generation = 0;
+    std::atomic<int> _nextJob = 0;
+    std::atomic<int> _jobsDone = 0;
+    std::atomic<bool> _quit = false;
+
+    // Platform semaphore; see audio_worker_pool.cpp.
+    void* _wakeSem = nullptr;
+    std::atomic<int> _numParked = 0;
+};
+
+}  // namespace audio
@@ -9,8 +9,8 @@ void BeatClock::Init(GameManager& g, double bpm) {
     _currentBeatTime = -1.0;
 }
 
-void BeatClock::Update(GameManager& g) {
-    double audioTime = g._audioContext->GetAudioTime();
+void BeatClock::Update(GameManager& g, double secsBehind) {
+    double audioTime = g._audioContext->GetAudioTime() - secsBehind;
     double dtAudio = audioTime - _currentAudioTime;
     double dtBeat = dtAudio * (_bpm / 60.0);
     double beatTime = _currentBeatTime + dtBeat;
@@ -8,7 +8,9 @@ class BeatClock {
 public:
     void Init(GameManager& g, double bpm);
 
-    void Update(GameManager& g);
+    // secsBehind: how far behind the audio clock's "now" this update should
+    // be. The game loop uses it to give each sim tick its own point in time.
+    void Update(GameManager& g, double secsBehind = 0.0);
 
     bool IsNewBeat() const { return _newBeat; }
 
@@ -42,11 +44,22 @@ public:
     double GetAudioTime() const {
         return _currentAudioTime;
     }
+    // Audio time (Context::GetAudioTime()'s clock) at which the given beat
+    // time happens, extrapolated from this frame's Update().
+    double BeatTimeToAudioTime(double beatTime) const {
+        return _currentAudioTime + BeatTimeToSecs(beatTime - _currentBeatTime);
+    }
+    // Sequencers schedule audio for everything up to this beat time, so notes
+    // keep their timing through frame hitches shorter than _lookaheadSecs.
+    double GetLookaheadBeatTime() const {
+        return _currentBeatTime + SecsToBeatTime(_lookaheadSecs);
+    }
     double const GetBpm() const {
         return _bpm;
     }
 
     double _bpm = 120.0;
+    double _lookaheadSecs = 0.2;
 
 private:
     double _currentBeatTime = -1.0;
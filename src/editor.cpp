@@ -75,8 +75,14 @@ void Editor::Load(serial::Ptree pt) {
     delete[] childrenGroups;
 }
 
+void Editor::Destroy() {
+    // Waits for any save still in flight.
+    _saveWriter.Destroy();
+}
+
 void Editor::Init(GameManager* g) {
     _g = g;
+    _saveWriter.Init();
     _axesMesh = _g->_scene->GetMesh("axes");
     // Collect all our entities, and init the inactive ones (Active ones should
     // already have been init). For example, this sets all dudes' transforms to
@@ -160,6 +166,7 @@ InputMode sInputMode = InputMode::Default;
 bool sSynthWindowVisible = false;
 bool sDemoWindowVisible = false;
 bool sMultiEnemyEditorVisible = false;
+bool sAudioProfilerVisible = false;
 
 } // end namespace
 
@@ -385,6 +392,10 @@ void UpdateDefault(GameManager &g, float const dt, Editor &editor, bool newInput
         sMultiEnemyEditorVisible = !sMultiEnemyEditorVisible;
     }
 
+    if (inputManager.IsAltPressed() && inputManager.IsKeyPressedThisFrame(InputManager::Key::A)) {
+        sAudioProfilerVisible = !sAudioProfilerVisible;
+    }
+
     if (inputManager.IsKeyPressedThisFrame(InputManager::Key::C)) {
         editor._showControllerInputs = !editor._showControllerInputs;
     }
@@ -842,6 +853,19 @@ void UpdateSequencer(GameManager &g, Editor &editor) {
 }
 
 void Editor::Update(float dt, SynthGuiState& synthGuiState) {
+    // Report finished saves even when we're not in edit mode.
+    _saveWriter.PollResults(&_saveResults);
+    for (serial::BackgroundWriter::Result const& result : _saveResults) {
+        char status[512];
+        if (result._success) {
+            snprintf(status, sizeof(status), "Saved script to \"%s\". (format time: %f) (write time: %f)", result._filename.c_str(), result._formatSecs, result._writeSecs);
+        } else {
+            snprintf(status, sizeof(status), "FAILED to save script to \"%s\".", result._filename.c_str());
+        }
+        printf("%s\n", status);
+        _lastSaveStatus = status;
+    }
+
     if (!_g->_editMode) {
         return;
     }
@@ -931,6 +955,10 @@ void Editor::Update(float dt, SynthGuiState& synthGuiState) {
         ImGui::ShowDemoWindow(&sDemoWindowVisible);
     }
 
+    if (sAudioProfilerVisible) {
+        _g->_audioContext->_telemetryHistory.ImGui();
+    }
+
     if (sSeqWindowVisible) {
         DrawSeqWindow();
     }
@@ -973,14 +1001,15 @@ void Editor::DrawWindow() {
 
     imgui_util::InputText<256>("Save filename", &_saveFilename);
     if (ImGui::Button("Save")) {
-        serial::Ptree pt = serial::Ptree::MakeNew();
+        // Snapshot into a binary tree, which is cheap to build. Turning it
+        // into XML and writing it out happens on the writer thread.
+        clock_t t0 = clock();
+        serial::Ptree pt = serial::Ptree::MakeNew(serial::Format::Binary);
         serial::Ptree scriptPt = pt.AddChild("script");
         scriptPt.PutDouble("bpm", _g->_beatClock->GetBpm());
         scriptPt.PutBool("gamma_correction", _g->_scene->IsGammaCorrectionEnabled());
-        clock_t t0 = clock();
+        _g->_audioContext->_sendDelaySettings.Save(scriptPt.AddChild("send_delay"));
         Save(scriptPt);
-        clock_t t1 = clock();
-        float treeBuildTime = TimeElapsed(t0, t1);
         serial::Ptree entitiesPt = scriptPt.AddChild("new_entities");
         for (ne::EntityId id : _entityIds) {
             bool active = false;
@@ -992,15 +1021,31 @@ void Editor::DrawWindow() {
             serial::Ptree entityPt = entitiesPt.AddChild(ne::gkEntityTypeNames[(int)id._type]);
             entity->Save(entityPt);
         }
-        t0 = clock();
-        if (pt.WriteToFile(_saveFilename.c_str())) {
-            t1 = clock();
-            float fileWriteTime = TimeElapsed(t0, t1);
-            printf("Saved script to \"%s\". (build time: %f) (write time: %f)\n", _saveFilename.c_str(), treeBuildTime, fileWriteTime);
-        } else {
-            printf("FAILED to save script to \"%s\".\n", _saveFilename.c_str());
-        }        
-        pt.DeleteData();
+        clock_t t1 = clock();
+        printf("Saving script to \"%s\". (snapshot time: %f)\n", _saveFilename.c_str(), TimeElapsed(t0, t1));
+        _saveWriter.Write(pt, _saveFilename);
+    }
+    switch (_saveWriter.GetStage()) {
+        case serial::BackgroundWriter::Stage::Idle: break;
+        case serial::BackgroundWriter::Stage::Queued: ImGui::SameLine(); ImGui::Text("Saving..."); break;
+        case serial::BackgroundWriter::Stage::Formatting: ImGui::SameLine(); ImGui::Text("Saving (formatting)..."); break;
+        case serial::BackgroundWriter::Stage::Writing: ImGui::SameLine(); ImGui::Text("Saving (writing)..."); break;
+    }
+    if (!_lastSaveStatus.empty()) {
+        ImGui::TextUnformatted(_lastSaveStatus.c_str());
+    }
+
+    if (ImGui::TreeNode("Send delay")) {
+        audio::SendDelaySettings& sendDelay = _g->_audioContext->_sendDelaySettings;
+        bool changed = false;
+        changed = ImGui::InputFloat("Time (beats, 0 = use secs)", &sendDelay._timeBeats) || changed;
+        changed = ImGui::InputFloat("Time (secs)", &sendDelay._timeSecs) || changed;
+        changed = ImGui::SliderFloat("Feedback", &sendDelay._feedback, 0.f, 0.95f) || changed;
+        changed = ImGui::InputFloat("Return gain", &sendDelay._returnGain) || changed;
+        if (changed) {
+            _g->_audioContext->AddEvent(sendDelay.MakeEvent(_g->_beatClock->GetBpm()));
+        }
+        ImGui::TreePop();
     }
 
     ImGui::Checkbox("Filter by flow section ID", &_enableFlowSectionFilter);
@@ -8,6 +8,7 @@
 #include "synth_imgui.h"
 #include "input_manager.h"
 #include "seq_action.h"
+#include "serial_background_writer.h"
 
 class BoundMeshPNU;
 
@@ -16,6 +17,7 @@ struct Editor {
     void Save(serial::Ptree pt) const;
 
     void Init(GameManager* g);
+    void Destroy();
     void Update(float dt, SynthGuiState& synthGuiState);
     void DrawWindow();
     void DrawMultiEnemyWindow();
@@ -47,6 +49,10 @@ struct Editor {
     std::vector<std::unique_ptr<SeqAction>> _heldActions;
     float _heldActionsTimer = -1.f;
 
+    serial::BackgroundWriter _saveWriter;
+    std::vector<serial::BackgroundWriter::Result> _saveResults;  // only to avoid reallocating
+    std::string _lastSaveStatus;
+
 private:
     ne::EntityId _requestedNewSelection;
     std::vector<ne::Entity*> _sameEntities;  // only to avoid reallocating
@@ -3,6 +3,7 @@
 #include <fstream>
 #include <algorithm>
 
+#include "audio_platform.h"
 #include "entities/param_automator.h"
 #include "game_manager.h"
 #include "beat_clock.h"
@@ -79,6 +80,7 @@ void ActionSequencerEntity::InitDerived(GameManager& g) {
     // TODO: maybe allow interpreting times as absolute instead of only relative to init
     double const beatTime = g._beatClock->GetBeatTimeFromEpoch();
     _startTime = g._beatClock->GetNextDownBeatTime(beatTime);  
+    _executedEarly.assign(_actions.size(), false);
 
     // Immediately execute any actions that are < 0
     for (int n = _actions.size(); _currentIx < n; ++_currentIx) {
@@ -100,11 +102,32 @@ void ActionSequencerEntity::Update(GameManager& g, float dt) {
     }
 
     double const beatTime = g._beatClock->GetBeatTimeFromEpoch();
+
+    // Audio-only actions go out ahead of time, stamped with the audio time of
+    // their beat. Everything else waits for its beat like usual.
+    double const lookaheadBeatTime = g._beatClock->GetLookaheadBeatTime();
+    for (int ii = _currentIx, n = _actions.size(); ii < n; ++ii) {
+        BeatTimeAction const& bta = _actions[ii];
+        double const actionBeatTime = _startTime + bta._beatTime;
+        if (actionBeatTime > lookaheadBeatTime) {
+            break;
+        }
+        if (_executedEarly[ii] || actionBeatTime <= beatTime || !bta._pAction->IsAudioOnly()) {
+            continue;
+        }
+        g._audioContext->_scheduleAudioTime = g._beatClock->BeatTimeToAudioTime(actionBeatTime);
+        bta._pAction->Execute(g);
+        g._audioContext->_scheduleAudioTime = -1.0;
+        _executedEarly[ii] = true;
+    }
+
     for (int n = _actions.size(); _currentIx < n; ++_currentIx) {
         BeatTimeAction const& bta = _actions[_currentIx];
         if (beatTime < _startTime + bta._beatTime) {
             break;
         }
-        bta._pAction->Execute(g);
+        if (!_executedEarly[_currentIx]) {
+            bta._pAction->Execute(g);
+        }
     }
 }
@@ -23,6 +23,7 @@ struct ActionSequencerEntity : ne::Entity {
     std::stringstream _actionsString;  // populated at Load() but not fully serialized
     int _currentIx = 0;
     double _startTime = -1.0;
+    std::vector<bool> _executedEarly;  // audio-only actions already scheduled ahead
 
     virtual void InitDerived(GameManager& g) override;
     virtual void Update(GameManager& g, float dt) override;
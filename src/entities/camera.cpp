@@ -92,6 +92,15 @@ void CameraEntity::UpdateDerived(GameManager& g, float dt) {
             renderer::Camera::ProjectionType::Perspective;
 }
 
+void CameraEntity::Draw(GameManager& g, float dt) {
+    ne::Entity::Draw(g, dt);
+    // Update() already did this, but _transform is interpolated for drawing
+    // and the view has to move with everything else.
+    if (!g._editMode) {
+        _camera->_transform = _transform.Mat4NoScale();
+    }
+}
+
 ne::Entity::ImGuiResult CameraEntity::ImGuiDerived(GameManager& g) {
     if (ImGui::Checkbox("Ortho", &_ortho)) {
         _camera->_projectionType = _ortho ? renderer::Camera::ProjectionType::Orthographic : renderer::Camera::ProjectionType::Perspective;
@@ -38,6 +38,7 @@ struct CameraEntity : ne::Entity {
 
     virtual void InitDerived(GameManager& g) override;
     virtual void UpdateDerived(GameManager& g, float dt) override;
+    virtual void Draw(GameManager& g, float dt) override;
 protected:
     virtual void SaveDerived(serial::Ptree pt) const override;
     virtual void LoadDerived(serial::Ptree pt) override;
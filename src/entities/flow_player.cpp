@@ -112,16 +112,45 @@ void FlowPlayerEntity::InitDerived(GameManager& g) {
 namespace {
 
 FlowWallEntity* FindOverlapWithWall(GameManager& g, Transform const& playerTrans, Vec3* penetrationOut) {
-    ne::EntityManager::Iterator wallIter = g._neEntityManager->GetIterator(ne::EntityType::FlowWall);
+    ne::SpatialIndex* wallIndex = g._neEntityManager->GetSpatialIndex(ne::EntityType::FlowWall);
+    assert(wallIndex != nullptr);
+    // Walls get grown by the player's size below, polygons in proportion to
+    // their own size, so look that far out.
+    Vec3 const& playerPos = playerTrans.Pos();
+    float const queryRadius = wallIndex->GetMaxLocalRadius() * std::max(playerTrans.Scale()._x, playerTrans.Scale()._z);
+    ne::SpatialIndex::Bounds queryBox;
+    queryBox._minX = playerPos._x - queryRadius;
+    queryBox._minZ = playerPos._z - queryRadius;
+    queryBox._maxX = playerPos._x + queryRadius;
+    queryBox._maxZ = playerPos._z + queryRadius;
+    static std::vector<int> sNearbyWalls;
+    wallIndex->QueryBox(queryBox, &sNearbyWalls);
+
     std::vector<Vec3> aabbPoly(4);
-    for (; !wallIter.Finished(); wallIter.Next()) {
-        FlowWallEntity* pWall = static_cast<FlowWallEntity*>(wallIter.GetEntity());
-        if (!pWall->_canHit) {
+    for (int entryIx : sNearbyWalls) {
+        ne::SpatialIndex::Entry const& entry = wallIndex->GetEntry(entryIx);
+        FlowWallEntity* pWall = g._neEntityManager->GetEntityAs<FlowWallEntity>(entry._id);
+        if (pWall == nullptr || !pWall->_canHit) {
             continue;
         }
         Transform const& wallTrans = pWall->_transform;
-        Vec3 euler = wallTrans.Quat().EulerAngles();
-        float yRot = -euler._y;
+        Vec3 wallPos = wallTrans.Pos();
+        Vec3 wallScale = wallTrans.Scale();
+        // The box case below is the unit square scaled the same way.
+        Vec3 const polyScale = wallScale + playerTrans.Scale();
+        // The index caches the wall's yaw and outline, unless the wall moved
+        // since the last refit. Most nearby walls aren't touching the player,
+        // so reject those against the cached outline and only do the exact
+        // test (which gives us the penetration) on a hit.
+        float yRot = entry._yaw;
+        if (wallTrans.Quat()._v == entry._quat._v && wallPos == entry._pos && wallScale == entry._scale) {
+            std::vector<Vec3> const& worldPoly = wallIndex->GetWorldPolygon(entryIx, pWall->_polygon, pWall->_polygonVersion, polyScale);
+            if (!geometry::PointInPolygon2D(playerPos, worldPoly.data(), worldPoly.size())) {
+                continue;
+            }
+        } else if (!(wallTrans.Quat()._v == entry._quat._v)) {
+            yRot = -wallTrans.Quat().EulerAngles()._y;
+        }
         Vec3 penetration;
         bool hasOverlap = false;
         if (pWall->_polygon.size() < 3) {
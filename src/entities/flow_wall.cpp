@@ -150,10 +150,23 @@ void FlowWallEntity::LoadDerived(serial::Ptree pt) {
     }
     pt.TryGetFloat("rot_vel", &_rotVel);
     serial::LoadVectorFromChildNode(pt, "polygon", _polygon);
+    ++_polygonVersion;
     SeqAction::LoadActionsFromChildNode(pt, "hit_actions", _hitActions);
     serial::LoadVectorFromChildNode(pt, "children_editor_ids", _childrenEditorIds);
 }
 
+void FlowWallEntity::GetLocalFootprint(float* halfX, float* halfZ) const {
+    if (_polygon.size() < 3) {
+        *halfX = *halfZ = 0.5f;
+        return;
+    }
+    *halfX = *halfZ = 0.f;
+    for (Vec3 const& p : _polygon) {
+        *halfX = std::max(*halfX, std::abs(p._x));
+        *halfZ = std::max(*halfZ, std::abs(p._z));
+    }
+}
+
 FlowWallEntity::ImGuiResult FlowWallEntity::ImGuiDerived(GameManager& g)  {
     ImGuiResult result = ImGuiResult::Done;
 
@@ -181,7 +194,9 @@ FlowWallEntity::ImGuiResult FlowWallEntity::ImGuiDerived(GameManager& g)  {
     }
 
     if (ImGui::CollapsingHeader("Polygon")) {
-        imgui_util::InputVector(_polygon);        
+        if (imgui_util::InputVector(_polygon)) {
+            ++_polygonVersion;
+        }
     }
 
     if (SeqAction::ImGui("Hit actions", _hitActions)) {
@@ -30,6 +30,9 @@ struct FlowWallEntity : public ne::Entity {
     int _hp = -1;
     renderer::Scene::MeshId _meshId;
     std::vector<ne::EntityId> _children;
+    // Bumped whenever _polygon changes, so cached copies (see
+    // SpatialIndex::GetWorldPolygon) know to rebuild.
+    int _polygonVersion = 0;
 
     void OnHit(GameManager& g, Vec3 const& hitDirection);
        
@@ -45,6 +48,7 @@ struct FlowWallEntity : public ne::Entity {
     virtual ImGuiResult MultiImGui(GameManager& g, BaseEntity** entities, size_t entityCount) override;
 
     virtual void Draw(GameManager& g, float dt) override;
+    virtual void GetLocalFootprint(float* halfX, float* halfZ) const override;
 
     FlowWallEntity() = default;
     FlowWallEntity(FlowWallEntity const&) = delete;
@@ -344,6 +344,9 @@ bool StepSequencerEntity::SeqImGui(char const* label, bool drumKit, std::vector<
 }
 
 void StepSequencerEntity::EnqueueChange(SeqStepChange const& change) {
+    // Steps that are scheduled but haven't started yet have to hear about
+    // this change too.
+    CancelScheduledSteps(gGameManager);
     _changeQueue[_changeQueueTailIx] = change;
     _changeQueueTailIx = (_changeQueueTailIx + 1) % kChangeQueueSize;
     if (_changeQueueCount == kChangeQueueSize) {
@@ -356,8 +359,18 @@ void StepSequencerEntity::EnqueueChange(SeqStepChange const& change) {
 
 void StepSequencerEntity::SetNextSeqStep(GameManager& g, SeqStep step, StepSaveType saveType, bool changeNote, bool changeVelocity) {
     if (_enableLateChanges && _changeQueueCount == 0 && saveType == StepSaveType::Temporary && _quantizeTempStepChanges) {
-        double nextStepBeatTime = _loopStartBeatTime + _currentIx * _stepBeatLength;
         double beatTime = gGameManager._beatClock->GetBeatTimeFromEpoch();
+        // _currentIx may be a few steps ahead because of scheduling; what
+        // matters here is the next step that hasn't started yet.
+        int nextStepIx = _currentIx;
+        double nextStepBeatTime = _loopStartBeatTime + _currentIx * _stepBeatLength;
+        for (ScheduledStep const& scheduled : _scheduledSteps) {
+            if (scheduled._beatTime > beatTime) {
+                nextStepIx = scheduled._stepIx;
+                nextStepBeatTime = scheduled._beatTime;
+                break;
+            }
+        }
         double timeSinceLastNote = beatTime - _lastPlayedNoteTime;
         bool longEnoughSinceLast = timeSinceLastNote > 0.75*_stepBeatLength;
         double stepLengthSlackFactor = 0.25;
@@ -368,7 +381,7 @@ void StepSequencerEntity::SetNextSeqStep(GameManager& g, SeqStep step, StepSaveT
             printf("HOWDY! ");
             printf("%f %f %f %f\n", beatTime, nextStepBeatTime, nextStepBeatTime - beatTime, _lastPlayedNoteTime);
 #endif
-            SeqStep toPlay = _tempSequence[_currentIx];
+            SeqStep toPlay = _tempSequence[nextStepIx];
             if (changeNote) {
                 for (int ii = 0; ii < toPlay._notes.size(); ++ii) {
                     toPlay._notes[ii]._note = step._notes[ii]._note;
@@ -445,6 +458,7 @@ void StepSequencerEntity::SetNextSeqStepVelocity(GameManager& g, float v, StepSa
 
 void StepSequencerEntity::SetAllVelocitiesPermanent(float newValue, int trackIx) {
     assert(_permanentSequence.size() == _tempSequence.size());
+    CancelScheduledSteps(gGameManager);
     for (int i = 0, n = _permanentSequence.size(); i < n; ++i) {
         if (trackIx < 0 || trackIx >= SeqStep::kNumNotes) {
             for (int jj = 0; jj < _permanentSequence[i]._notes.size(); ++jj) {
@@ -458,12 +472,14 @@ void StepSequencerEntity::SetAllVelocitiesPermanent(float newValue, int trackIx)
 
 void StepSequencerEntity::SetAllStepsPermanent(SeqStep const& newStep) {
     assert(_permanentSequence.size() == _tempSequence.size());
+    CancelScheduledSteps(gGameManager);
     for (int i = 0, n = _permanentSequence.size(); i < n; ++i) {
         _tempSequence[i] = _permanentSequence[i] = newStep;
     }
 }
 
 void StepSequencerEntity::SetSequencePermanent(std::vector<SeqStep> const& newSequence) {
+    CancelScheduledSteps(gGameManager);
     bool sizeChanged = newSequence.size() != _permanentSequence.size();
     if (sizeChanged) {
         _seqNeedsReset = true;
@@ -474,6 +490,7 @@ void StepSequencerEntity::SetSequencePermanent(std::vector<SeqStep> const& newSe
 void StepSequencerEntity::SetSequencePermanentWithStartOffset(std::vector<SeqStep> const& newSequence) {
     assert(_permanentSequence.size() == _tempSequence.size());
     assert(_permanentSequence.size() == newSequence.size());
+    CancelScheduledSteps(gGameManager);
 
     // HUGE HACK I'M SO SORRY. ASSUMES WE'RE QUANTIZING TO 1 BEAT AND THAT STEPS ARE 16th NOTES.
     // maps to previous beat.
@@ -496,9 +513,13 @@ void StepSequencerEntity::InitDerived(GameManager& g) {
     _seqNeedsReset = true;
 }
 
-void StepSequencerEntity::PlayStep(GameManager& g, SeqStep const& seqStep) {
-    if (_mute || (g._editMode && _editorMute)) {
-        return;
+bool StepSequencerEntity::IsMuted(GameManager& g) const {
+    return _mute || (g._editMode && _editorMute);
+}
+
+bool StepSequencerEntity::PlayStep(GameManager& g, SeqStep const& seqStep, double audioTime, int tag) {
+    if (IsMuted(g)) {
+        return false;
     }
 
     for (int ii = 0; ii < kNumParamTracks; ++ii) {
@@ -511,6 +532,8 @@ void StepSequencerEntity::PlayStep(GameManager& g, SeqStep const& seqStep) {
         }
         audio::Event e;
         e.delaySecs = 0.0;
+        e.audioTime = audioTime;
+        e.tag = tag;
         e.type = audio::EventType::SynthParam;
         e.param = _paramTrackTypes[ii]._type;
         e.paramChangeTimeSecs = 0.0;
@@ -533,14 +556,21 @@ void StepSequencerEntity::PlayStep(GameManager& g, SeqStep const& seqStep) {
         }
     }
 
-    if (midiNotes[0]._note > -1) {
+    bool const hasNotes = midiNotes[0]._note > -1;
+    if (hasNotes && audioTime < 0.0) {
         // TODO: this isn't _quite_ it, but almost
         _lastPlayedNoteTime = g._beatClock->GetBeatTimeFromEpoch();
     }
 
     if (_isSynth) {
+        // Send the NoteOns and NoteOffs as one batch so a full queue can't
+        // drop a NoteOff and leave a note stuck on.
+        std::vector<audio::Event> events;
+        events.reserve(2 * numPlayedNotes * _channels.size());
         audio::Event e;
         e.delaySecs = 0.0;
+        e.audioTime = audioTime;
+        e.tag = tag;
         e.type = audio::EventType::NoteOn; 
         static int sNoteOnId = 1;
         e.noteOnId = sNoteOnId++;
@@ -552,18 +582,27 @@ void StepSequencerEntity::PlayStep(GameManager& g, SeqStep const& seqStep) {
             }
             for (int channel : _channels) {
                 e.channel = channel;
-                g._audioContext->AddEvent(e);
+                events.push_back(e);
             }
         }
+        // NoteOffs are never tagged: if we cancel a step just as the audio
+        // thread starts it, the NoteOn can get through, and it still needs
+        // its NoteOff.
         e.type = audio::EventType::NoteOff;
-        e.delaySecs = g._beatClock->BeatTimeToSecs(_noteLength);
+        e.tag = 0;
+        if (audioTime >= 0.0) {
+            e.audioTime = audioTime + g._beatClock->BeatTimeToSecs(_noteLength);
+        } else {
+            e.delaySecs = g._beatClock->BeatTimeToSecs(_noteLength);
+        }
         for (int i = 0; i < numPlayedNotes; ++i) {
             e.midiNote = midiNotes[i]._note;
             for (int channel : _channels) {
                 e.channel = channel;
-                g._audioContext->AddEvent(e);
+                events.push_back(e);
             }
         }
+        g._audioContext->AddEvents(events.data(), events.size());
 
         if (_primePorta) {
             _primePorta = false;
@@ -571,6 +610,8 @@ void StepSequencerEntity::PlayStep(GameManager& g, SeqStep const& seqStep) {
     } else {
         audio::Event e;
         e.delaySecs = 0.0;
+        e.audioTime = audioTime;
+        e.tag = tag;
         e.type = audio::EventType::PlayPcm;
         e.loop = false;
         for (int i = 0; i < numPlayedNotes; ++i) {
@@ -579,6 +620,47 @@ void StepSequencerEntity::PlayStep(GameManager& g, SeqStep const& seqStep) {
             g._audioContext->AddEvent(e);
         }
     }
+    return hasNotes;
+}
+
+void StepSequencerEntity::CancelScheduledSteps(GameManager& g) {
+    double const beatTime = g._beatClock->GetBeatTimeFromEpoch();
+    int firstCancelIx = 0;
+    while (firstCancelIx < _scheduledSteps.size() && _scheduledSteps[firstCancelIx]._beatTime <= beatTime) {
+        ++firstCancelIx;
+    }
+    if (firstCancelIx == _scheduledSteps.size()) {
+        return;
+    }
+
+    std::vector<audio::Event> cancels;
+    cancels.reserve(_scheduledSteps.size() - firstCancelIx);
+    for (int ii = firstCancelIx; ii < _scheduledSteps.size(); ++ii) {
+        audio::Event e;
+        e.type = audio::EventType::CancelTagged;
+        e.tag = _scheduledSteps[ii]._tag;
+        cancels.push_back(e);
+    }
+    g._audioContext->AddEvents(cancels.data(), cancels.size());
+
+    // Rewind so the next update schedules these steps again, and put back the
+    // changes they used up, newest first so the oldest ends up at the head.
+    ScheduledStep const& first = _scheduledSteps[firstCancelIx];
+    _currentIx = first._stepIx;
+    _loopStartBeatTime = first._loopStartBeatTime;
+    if (first._primedPorta) {
+        _primePorta = true;
+    }
+    for (int ii = _scheduledSteps.size() - 1; ii >= firstCancelIx; --ii) {
+        ScheduledStep const& scheduled = _scheduledSteps[ii];
+        if (!scheduled._consumedChange || _changeQueueCount == kChangeQueueSize) {
+            continue;
+        }
+        _changeQueueHeadIx = (_changeQueueHeadIx + kChangeQueueSize - 1) % kChangeQueueSize;
+        _changeQueue[_changeQueueHeadIx] = scheduled._change;
+        ++_changeQueueCount;
+    }
+    _scheduledSteps.resize(firstCancelIx);
 }
 
 void StepSequencerEntity::UpdateDerived(GameManager& g, float dt) {    
@@ -590,7 +672,29 @@ void StepSequencerEntity::UpdateDerived(GameManager& g, float dt) {
 
     double const beatTime = beatClock.GetBeatTimeFromEpoch();
 
+    // Forget about steps that have started.
+    {
+        int numStarted = 0;
+        while (numStarted < _scheduledSteps.size() && _scheduledSteps[numStarted]._beatTime <= beatTime) {
+            if (_scheduledSteps[numStarted]._hasNotes) {
+                _lastPlayedNoteTime = _scheduledSteps[numStarted]._beatTime;
+            }
+            ++numStarted;
+        }
+        _scheduledSteps.erase(_scheduledSteps.begin(), _scheduledSteps.begin() + numStarted);
+    }
+
+    // Mute and gain get baked into the events, so steps we've already sent
+    // need redoing if those change.
+    if (IsMuted(g) != _scheduledMute || _gain != _scheduledGain) {
+        CancelScheduledSteps(g);
+        _scheduledMute = IsMuted(g);
+        _scheduledGain = _gain;
+    }
+
     if (_seqNeedsReset) {
+        CancelScheduledSteps(g);
+        _scheduledSteps.clear();
         _lastPlayedNoteTime = 0.0;
         _loopStartBeatTime = g._beatClock->GetNextBeatDenomTime(beatTime, _startDenom);
         _changeQueueHeadIx = 0;
@@ -604,57 +708,83 @@ void StepSequencerEntity::UpdateDerived(GameManager& g, float dt) {
         _seqNeedsReset = false;
     }
 
-    // Play sound on the first frame at-or-after the target beat time
-    double nextStepBeatTime = _loopStartBeatTime + _currentIx * _stepBeatLength;
+    double const lookaheadBeatTime = beatClock.GetLookaheadBeatTime();
+    bool playedLateStep = false;
+    while (true) {
+        double nextStepBeatTime = _loopStartBeatTime + _currentIx * _stepBeatLength;
+        if (nextStepBeatTime > lookaheadBeatTime) {
+            break;
+        }
+        // If we fell behind (big hitch, or lookahead turned off), catch up
+        // one step per frame like we always have instead of playing a burst.
+        bool const late = nextStepBeatTime <= beatTime;
+        if (late && playedLateStep) {
+            break;
+        }
+        playedLateStep = playedLateStep || late;
 
-    if (beatTime < nextStepBeatTime) {
-        return;
-    }
+        ScheduledStep scheduled;
+        scheduled._stepIx = _currentIx;
+        scheduled._beatTime = nextStepBeatTime;
+        scheduled._loopStartBeatTime = _loopStartBeatTime;
+        scheduled._primedPorta = _primePorta;
 
-    if (_changeQueueCount > 0) {
-        SeqStepChange const& change = _changeQueue[_changeQueueHeadIx];
-        SeqStep& tempStep = _tempSequence[_currentIx];        
-        if (change._changeNote) {
-            for (int ii = 0; ii < tempStep._notes.size(); ++ii) {
-                tempStep._notes[ii]._note = change._step._notes[ii]._note;
+        if (_changeQueueCount > 0) {
+            SeqStepChange const& change = _changeQueue[_changeQueueHeadIx];
+            SeqStep& tempStep = _tempSequence[_currentIx];        
+            if (change._changeNote) {
+                for (int ii = 0; ii < tempStep._notes.size(); ++ii) {
+                    tempStep._notes[ii]._note = change._step._notes[ii]._note;
+                }
             }
-        }
-        if (change._changeVelocity) {
-            for (int ii = 0; ii < tempStep._notes.size(); ++ii) {
-                tempStep._notes[ii]._v = change._step._notes[ii]._v;
+            if (change._changeVelocity) {
+                for (int ii = 0; ii < tempStep._notes.size(); ++ii) {
+                    tempStep._notes[ii]._v = change._step._notes[ii]._v;
+                }
             }
-        }
-        for (int paramIx = 0; paramIx < kNumParamTracks; ++paramIx) {
-            if (!change._step._params[paramIx]._active) {
-                continue;
+            for (int paramIx = 0; paramIx < kNumParamTracks; ++paramIx) {
+                if (!change._step._params[paramIx]._active) {
+                    continue;
+                }
+                tempStep._params[paramIx] = change._step._params[paramIx];
+            }
+            if (!change._temporary) {
+                _permanentSequence[_currentIx] = tempStep;
+            }
+            scheduled._consumedChange = true;
+            scheduled._change = change;
+            _changeQueueHeadIx = (_changeQueueHeadIx + 1) % kChangeQueueSize;
+            --_changeQueueCount;
+        }   
+
+        // Play the sound. Late steps go out right away; anything else gets
+        // scheduled for exactly when it's due.
+        {
+            static int sTag = 1;
+            SeqStep const& seqStep = _tempSequence[_currentIx];
+            if (late) {
+                PlayStep(g, seqStep);
+            } else {
+                scheduled._tag = sTag++;
+                scheduled._hasNotes = PlayStep(g, seqStep, beatClock.BeatTimeToAudioTime(nextStepBeatTime), scheduled._tag);
+                _scheduledSteps.push_back(scheduled);
             }
-            tempStep._params[paramIx] = change._step._params[paramIx];
-        }
-        if (!change._temporary) {
-            _permanentSequence[_currentIx] = tempStep;
         }
-        _changeQueueHeadIx = (_changeQueueHeadIx + 1) % kChangeQueueSize;
-        --_changeQueueCount;
-    }   
-
-    // Play the sound
-    {
-        SeqStep const& seqStep = _tempSequence[_currentIx];
-        PlayStep(g, seqStep);
-    }
     
-    // After the playing the sound, reset that seq element to the initial
-    // value
-    _tempSequence[_currentIx] = _permanentSequence[_currentIx];
+        // After the playing the sound, reset that seq element to the initial
+        // value
+        _tempSequence[_currentIx] = _permanentSequence[_currentIx];
 
-    ++_currentIx;
+        ++_currentIx;
 
-    if (_currentIx >= _permanentSequence.size()) {
-        if (_oneShot && !g._editMode) {
-            g._neEntityManager->TagForDeactivate(_id);
-        } else {
-            _currentIx = 0;
-            _loopStartBeatTime += _permanentSequence.size() * _stepBeatLength;
+        if (_currentIx >= _permanentSequence.size()) {
+            if (_oneShot && !g._editMode) {
+                g._neEntityManager->TagForDeactivate(_id);
+                break;
+            } else {
+                _currentIx = 0;
+                _loopStartBeatTime += _permanentSequence.size() * _stepBeatLength;
+            }
         }
     }
 }
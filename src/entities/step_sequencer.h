@@ -87,6 +87,24 @@ struct StepSequencerEntity : ne::Entity {
     bool _primePorta = false;
     bool _hasInitEditMode = false;
 
+    // Steps get sent to the audio thread up to BeatClock::_lookaheadSecs
+    // before they're due, stamped with the audio time they should start at.
+    // Until a step's start time passes we can still take it back with
+    // CancelScheduledSteps(), which also undoes whatever it did to our state.
+    struct ScheduledStep {
+        int _stepIx = 0;
+        double _beatTime = 0.0;
+        double _loopStartBeatTime = 0.0;
+        int _tag = 0;
+        bool _hasNotes = false;
+        bool _primedPorta = false;
+        bool _consumedChange = false;
+        SeqStepChange _change;
+    };
+    std::vector<ScheduledStep> _scheduledSteps;  // in start order
+    bool _scheduledMute = false;
+    float _scheduledGain = 1.f;
+
     enum StepSaveType { Temporary, Permanent };
     void SetNextSeqStep(GameManager& g, SeqStep step, StepSaveType saveType, bool changeNote, bool changeVelocity);
     void SetNextSeqStepVelocity(GameManager& g, float v, StepSaveType saveType);
@@ -112,5 +130,8 @@ struct StepSequencerEntity : ne::Entity {
 
 private:
     void EnqueueChange(SeqStepChange const& change);
-    void PlayStep(GameManager& g, SeqStep const& seqStep);
+    bool IsMuted(GameManager& g) const;
+    // Returns true if any notes were played. audioTime < 0 plays right away.
+    bool PlayStep(GameManager& g, SeqStep const& seqStep, double audioTime = -1.0, int tag = 0);
+    void CancelScheduledSteps(GameManager& g);
 };
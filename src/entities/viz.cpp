@@ -1,14 +1,10 @@
 #include "viz.h"
 
 #include "game_manager.h"
+#include "audio_platform.h"
 #include "renderer.h"
 #include "math_util.h"
 
-extern double* gDftLogAvgs;
-extern double* gDftLogAvgsSmooth;
-extern double* gDftLogAvgsScaled;
-extern int gDftLogAvgsCount;
-
 void VizEntity::SaveDerived(serial::Ptree pt) const {
 }
 
@@ -36,11 +32,11 @@ void VizEntity::UpdateDerived(GameManager& g, float dt) {
 }
 
 void VizEntity::Draw(GameManager& g, float dt) {
-    for (int ii = 0; ii < gDftLogAvgsCount; ++ii) {
-        float s = gDftLogAvgsScaled[ii];
+    audio::Spectrum const& spectrum = g._audioContext->_state._spectrum.AcquireLatest();
+    for (int ii = 0, n = spectrum._bandScaled.size(); ii < n; ++ii) {
+        float s = spectrum._bandScaled[ii];
 
-        // float s = gDftLogAvgsSmooth[ii];
-        // float s = gDftLogAvgs[ii];
+        // float s = spectrum._bandDb[ii];
         // s = math_util::InverseLerp(0.f, 0.1f, s);
         s = math_util::Lerp(0.1f, 4.f, s);
 
@@ -0,0 +1,107 @@
+#include "entity_pool.h"
+
+#include <cassert>
+#include <new>
+
+#include "new_entity.h"
+
+namespace ne {
+
+void EntityPool::Init(std::size_t entitySize, std::size_t entityAlign) {
+    Destroy();
+    _entitySize = entitySize;
+    _entityAlign = entityAlign;
+}
+
+void EntityPool::Destroy() {
+    for (int chunkIx = 0; chunkIx < (int)_chunks.size(); ++chunkIx) {
+        Chunk& chunk = _chunks[chunkIx];
+        for (int i = 0; i < kChunkSize; ++i) {
+            if (chunk._states[i] != SlotState::Free) {
+                Get(chunkIx * kChunkSize + i)->~BaseEntity();
+            }
+        }
+        ::operator delete(chunk._data, std::align_val_t(_entityAlign));
+    }
+    _chunks.clear();
+    _freeIxs.clear();
+    _numActive = 0;
+    _numInactive = 0;
+}
+
+void EntityPool::AddChunk() {
+    int const firstIx = GetCapacity();
+    Chunk& chunk = _chunks.emplace_back();
+    chunk._data = static_cast<char*>(::operator new(kChunkSize * _entitySize, std::align_val_t(_entityAlign)));
+    // Backwards, so the lowest index gets handed out first.
+    for (int ix = firstIx + kChunkSize - 1; ix >= firstIx; --ix) {
+        _freeIxs.push_back(ix);
+    }
+}
+
+void EntityPool::Reserve(int numEntities) {
+    while (GetCapacity() < numEntities) {
+        AddChunk();
+    }
+}
+
+void* EntityPool::Allocate(SlotState state, int* outIx) {
+    assert(state != SlotState::Free);
+    assert(_entitySize > 0);
+    if (_freeIxs.empty()) {
+        AddChunk();
+    }
+    int const ix = _freeIxs.back();
+    _freeIxs.pop_back();
+    SetState(ix, state);
+    *outIx = ix;
+    return Get(ix);
+}
+
+void EntityPool::Free(int ix) {
+    assert(GetState(ix) != SlotState::Free);
+    Get(ix)->~BaseEntity();
+    SetState(ix, SlotState::Free);
+    _freeIxs.push_back(ix);
+}
+
+void EntityPool::SetState(int ix, SlotState state) {
+    Chunk& chunk = _chunks[ix / kChunkSize];
+    SlotState& current = chunk._states[ix % kChunkSize];
+    if (current == SlotState::Active) {
+        --chunk._numActive;
+        --_numActive;
+    } else if (current == SlotState::Inactive) {
+        --chunk._numInactive;
+        --_numInactive;
+    }
+    current = state;
+    if (state == SlotState::Active) {
+        ++chunk._numActive;
+        ++_numActive;
+    } else if (state == SlotState::Inactive) {
+        ++chunk._numInactive;
+        ++_numInactive;
+    }
+}
+
+int EntityPool::FindNext(int ix, SlotState state) const {
+    int const capacity = GetCapacity();
+    while (ix < capacity) {
+        Chunk const& chunk = _chunks[ix / kChunkSize];
+        int const numInState = state == SlotState::Active ? chunk._numActive : chunk._numInactive;
+        int const chunkEnd = (ix / kChunkSize + 1) * kChunkSize;
+        if (numInState == 0) {
+            ix = chunkEnd;
+            continue;
+        }
+        for (; ix < chunkEnd; ++ix) {
+            if (chunk._states[ix % kChunkSize] == state) {
+                return ix;
+            }
+        }
+    }
+    return capacity;
+}
+
+}  // namespace ne
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ne {
+
+struct BaseEntity;
+
+// Storage for all the entities of one type. Entities live in fixed-size
+// chunks and never move once constructed, so an Entity* stays good until
+// that entity is removed, and spawning one doesn't copy the others around.
+// Active and inactive entities share the chunks; activating one only
+// changes its slot's state.
+//
+// The pool only hands out memory. EntityManager placement-news the right
+// entity type into it.
+class EntityPool {
+public:
+    static constexpr int kChunkSize = 64;
+    enum class SlotState : uint8_t { Free, Active, Inactive };
+
+    EntityPool() {}
+    ~EntityPool() { Destroy(); }
+    EntityPool(EntityPool const&) = delete;
+    EntityPool& operator=(EntityPool const&) = delete;
+
+    void Init(std::size_t entitySize, std::size_t entityAlign);
+    // Calls the destructor of every entity still in the pool.
+    void Destroy();
+
+    // Makes room for numEntities in total without allocating again.
+    void Reserve(int numEntities);
+
+    // Returns uninitialized memory for one entity at *outIx. Construct it
+    // before anything else touches the pool.
+    void* Allocate(SlotState state, int* outIx);
+    // Calls the entity's destructor and frees its slot.
+    void Free(int ix);
+
+    BaseEntity* Get(int ix) {
+        return reinterpret_cast<BaseEntity*>(_chunks[ix / kChunkSize]._data + (ix % kChunkSize) * _entitySize);
+    }
+    SlotState GetState(int ix) const { return _chunks[ix / kChunkSize]._states[ix % kChunkSize]; }
+    void SetState(int ix, SlotState state);
+
+    int GetCount(SlotState state) const { return state == SlotState::Active ? _numActive : _numInactive; }
+    int GetCapacity() const { return (int)_chunks.size() * kChunkSize; }
+    // First slot at or after ix in the given state, or GetCapacity().
+    int FindNext(int ix, SlotState state) const;
+
+private:
+    struct Chunk {
+        char* _data = nullptr;
+        SlotState _states[kChunkSize] = {};
+        int _numActive = 0;
+        int _numInactive = 0;
+    };
+    void AddChunk();
+
+    std::size_t _entitySize = 0;
+    std::size_t _entityAlign = 0;
+    std::vector<Chunk> _chunks;
+    // Most recently freed last, so spawns reuse memory that's still warm.
+    std::vector<int> _freeIxs;
+    int _numActive = 0;
+    int _numInactive = 0;
+};
+
+}  // namespace ne
@@ -0,0 +1,228 @@
+// Checks EntityPool: FindNext agrees with a slot-by-slot scan when whole
+// chunks are empty, every live entity gets destroyed exactly once, and
+// activating/deactivating through EntityManager leaves entities where they
+// are.
+
+#include <cstdio>
+#include <new>
+#include <random>
+#include <vector>
+
+#include "entity_pool.h"
+#include "game_manager.h"
+#include "new_entity.h"
+
+// Normally defined in game.cpp, which the test doesn't link.
+GameManager gGameManager;
+bool gRandomLetters = false;
+
+namespace {
+
+using ne::EntityPool;
+typedef EntityPool::SlotState SlotState;
+
+int gNumDestroyed = 0;
+
+struct CountedEntity : public ne::BaseEntity {
+    virtual ~CountedEntity() { ++gNumDestroyed; }
+};
+
+void* AllocateCounted(EntityPool& pool, SlotState state, int* outIx) {
+    void* mem = pool.Allocate(state, outIx);
+    new (mem) CountedEntity();
+    return mem;
+}
+
+int FindNextSlow(EntityPool const& pool, int ix, SlotState state) {
+    for (; ix < pool.GetCapacity(); ++ix) {
+        if (pool.GetState(ix) == state) {
+            return ix;
+        }
+    }
+    return pool.GetCapacity();
+}
+
+bool CheckFindNext(EntityPool const& pool, char const* what) {
+    for (SlotState state : { SlotState::Active, SlotState::Inactive }) {
+        int count = 0;
+        for (int ix = 0; ix <= pool.GetCapacity(); ++ix) {
+            int const expected = FindNextSlow(pool, ix, state);
+            int const found = pool.FindNext(ix, state);
+            if (found != expected) {
+                printf("%s: FindNext(%d, %d) = %d, expected %d\n", what, ix, (int)state, found, expected);
+                return false;
+            }
+            if (ix < pool.GetCapacity() && pool.GetState(ix) == state) {
+                ++count;
+            }
+        }
+        if (count != pool.GetCount(state)) {
+            printf("%s: GetCount(%d) = %d, counted %d\n", what, (int)state, pool.GetCount(state), count);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CheckFindNextSkipsEmptyChunks() {
+    int constexpr kNumChunks = 6;
+    EntityPool pool;
+    pool.Init(sizeof(CountedEntity), alignof(CountedEntity));
+    for (int i = 0; i < kNumChunks * EntityPool::kChunkSize; ++i) {
+        int ix;
+        AllocateCounted(pool, SlotState::Active, &ix);
+    }
+
+    // Chunk 1 empty, chunk 2 only inactive, chunk 3 one entity at its very
+    // end, chunk 4 empty, chunk 5 one inactive entity at its start.
+    for (int i = 0; i < EntityPool::kChunkSize; ++i) {
+        pool.Free(1 * EntityPool::kChunkSize + i);
+        pool.SetState(2 * EntityPool::kChunkSize + i, SlotState::Inactive);
+        if (i != EntityPool::kChunkSize - 1) {
+            pool.Free(3 * EntityPool::kChunkSize + i);
+        }
+        pool.Free(4 * EntityPool::kChunkSize + i);
+        if (i == 0) {
+            pool.SetState(5 * EntityPool::kChunkSize + i, SlotState::Inactive);
+        } else {
+            pool.Free(5 * EntityPool::kChunkSize + i);
+        }
+    }
+    if (pool.FindNext(EntityPool::kChunkSize, SlotState::Active) != 4 * EntityPool::kChunkSize - 1) {
+        printf("FindNext didn't skip to the last slot of chunk 3\n");
+        return false;
+    }
+    if (!CheckFindNext(pool, "fixed layout")) {
+        return false;
+    }
+
+    // Then random churn over the same pool.
+    std::mt19937 rng(1);
+    for (int iteration = 0; iteration < 2000; ++iteration) {
+        int const ix = rng() % pool.GetCapacity();
+        SlotState const state = pool.GetState(ix);
+        int const r = rng() % 3;
+        if (state == SlotState::Free) {
+            int newIx;
+            AllocateCounted(pool, r == 0 ? SlotState::Inactive : SlotState::Active, &newIx);
+        } else if (r == 0) {
+            pool.Free(ix);
+        } else {
+            pool.SetState(ix, state == SlotState::Active ? SlotState::Inactive : SlotState::Active);
+        }
+        if (iteration % 100 == 0 && !CheckFindNext(pool, "churn")) {
+            return false;
+        }
+    }
+    return CheckFindNext(pool, "after churn");
+}
+
+bool CheckDestroy() {
+    gNumDestroyed = 0;
+    int numAllocated = 0;
+    int numFreed = 0;
+    {
+        EntityPool pool;
+        pool.Init(sizeof(CountedEntity), alignof(CountedEntity));
+        std::vector<int> ixs;
+        for (int i = 0; i < 3 * EntityPool::kChunkSize + 5; ++i) {
+            int ix;
+            AllocateCounted(pool, i % 3 == 0 ? SlotState::Inactive : SlotState::Active, &ix);
+            ixs.push_back(ix);
+            ++numAllocated;
+        }
+        for (int i = 0; i < (int)ixs.size(); i += 4) {
+            pool.Free(ixs[i]);
+            ++numFreed;
+        }
+        if (gNumDestroyed != numFreed) {
+            printf("Free: %d destructor calls for %d frees\n", gNumDestroyed, numFreed);
+            return false;
+        }
+        // Leave the rest to ~EntityPool.
+    }
+    if (gNumDestroyed != numAllocated) {
+        printf("Destroy: %d destructor calls for %d entities\n", gNumDestroyed, numAllocated);
+        return false;
+    }
+
+    // Init() destroys what was there too.
+    gNumDestroyed = 0;
+    EntityPool pool;
+    pool.Init(sizeof(CountedEntity), alignof(CountedEntity));
+    for (int i = 0; i < 10; ++i) {
+        int ix;
+        AllocateCounted(pool, SlotState::Active, &ix);
+    }
+    pool.Init(sizeof(CountedEntity), alignof(CountedEntity));
+    if (gNumDestroyed != 10 || pool.GetCapacity() != 0 || pool.GetCount(SlotState::Active) != 0) {
+        printf("Init: %d destructor calls for 10 entities, capacity %d\n", gNumDestroyed, pool.GetCapacity());
+        return false;
+    }
+    return true;
+}
+
+// Deactivating and reactivating has to keep the entity at the same address
+// with its data intact, and only move it between the iterators.
+bool CheckActivateKeepsEntities() {
+    GameManager& g = gGameManager;
+    ne::EntityManager mgr;
+    mgr.Init();
+    g._neEntityManager = &mgr;
+
+    std::vector<ne::Entity*> entities;
+    for (int i = 0; i < 100; ++i) {
+        ne::Entity* e = mgr.AddEntity(ne::EntityType::Base);
+        e->_tag = i;
+        entities.push_back(e);
+    }
+    for (int i = 0; i < (int)entities.size(); i += 2) {
+        mgr.TagForDeactivate(entities[i]->_id);
+    }
+    mgr.DeactivateTaggedEntities(g);
+
+    for (int round = 0; round < 2; ++round) {
+        int numActive = 0;
+        int numInactive = 0;
+        mgr.GetIterator(ne::EntityType::Base, &numActive);
+        mgr.GetInactiveIterator(ne::EntityType::Base, &numInactive);
+        int const expectedInactive = round == 0 ? 50 : 0;
+        if (numActive != 100 - expectedInactive || numInactive != expectedInactive) {
+            printf("round %d: %d active, %d inactive\n", round, numActive, numInactive);
+            return false;
+        }
+        for (int i = 0; i < (int)entities.size(); ++i) {
+            ne::Entity* e = entities[i];
+            bool active = false;
+            bool const expectActive = round == 1 || i % 2 == 1;
+            if (mgr.GetActiveOrInactiveEntity(e->_id, &active) != e || e->_tag != i || active != expectActive) {
+                printf("round %d: entity %d moved or changed\n", round, i);
+                return false;
+            }
+            if ((mgr.GetEntity(e->_id) != nullptr) != expectActive) {
+                printf("round %d: entity %d has the wrong state\n", round, i);
+                return false;
+            }
+        }
+        for (int i = 0; i < (int)entities.size(); i += 2) {
+            mgr.TagForActivate(entities[i]->_id, /*initOnActivate=*/false);
+        }
+        mgr.ActivateTaggedEntities(g);
+    }
+    return true;
+}
+
+}  // namespace
+
+int main() {
+    bool success = true;
+    success = CheckFindNextSkipsEmptyChunks() && success;
+    success = CheckDestroy() && success;
+    success = CheckActivateKeepsEntities() && success;
+
+    if (!success) {
+        printf("FAILED\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,116 @@
+// Checks EntityManager's slot table: destroyed entities' IDs stop resolving,
+// their slots aren't reused until kMinFreeSlots are free, and a reused slot
+// hands out a new generation so the old ID never finds the new entity.
+
+#include <cstdio>
+#include <deque>
+#include <vector>
+
+#include "game_manager.h"
+#include "new_entity.h"
+
+// Normally defined in game.cpp, which the test doesn't link.
+GameManager gGameManager;
+bool gRandomLetters = false;
+
+namespace {
+
+using ne::EntityId;
+using ne::EntityManager;
+
+int constexpr kMinFreeSlots = EntityManager::kMinFreeSlots;
+
+void DestroyAll(EntityManager& mgr, GameManager& g, std::vector<EntityId> const& ids) {
+    for (EntityId const& id : ids) {
+        mgr.TagForDestroy(id);
+    }
+    mgr.DestroyTaggedEntities(g);
+}
+
+bool NoneResolve(EntityManager& mgr, std::vector<EntityId> const& ids, char const* what) {
+    for (EntityId const& id : ids) {
+        if (mgr.GetActiveOrInactiveEntity(id) != nullptr) {
+            printf("%s: destroyed entity (slot %d, generation %d) still resolves\n", what, id.GetSlot(), id.GetGeneration());
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CheckReuse() {
+    GameManager& g = gGameManager;
+    EntityManager mgr;
+    mgr.Init();
+    g._neEntityManager = &mgr;
+
+    // One short of the backlog: the next entity has to get a new slot.
+    std::vector<EntityId> ids;
+    for (int i = 0; i < kMinFreeSlots - 1; ++i) {
+        ids.push_back(mgr.AddEntity(ne::EntityType::Base)->_id);
+    }
+    DestroyAll(mgr, g, ids);
+    if (!NoneResolve(mgr, ids, "before reuse")) {
+        return false;
+    }
+    ne::Entity* e = mgr.AddEntity(ne::EntityType::Base);
+    if (e->_id.GetSlot() != kMinFreeSlots - 1 || e->_id.GetGeneration() != 0) {
+        printf("with %d free slots: got slot %d generation %d, expected a new slot %d\n",
+            kMinFreeSlots - 1, e->_id.GetSlot(), e->_id.GetGeneration(), kMinFreeSlots - 1);
+        return false;
+    }
+    DestroyAll(mgr, g, { e->_id });
+    ids.push_back(e->_id);
+
+    // That makes kMinFreeSlots, so each add from here takes the oldest free
+    // slot one generation up, and the destroy before it tops the backlog up
+    // again. None of the destroyed IDs may find the new entities.
+    std::deque<EntityId> freed(ids.begin(), ids.end());
+    EntityId live;
+    for (int i = 0; i < 3 * kMinFreeSlots; ++i) {
+        if (live.IsValid()) {
+            DestroyAll(mgr, g, { live });
+            freed.push_back(live);
+            ids.push_back(live);
+        }
+        EntityId const expected = freed.front();
+        freed.pop_front();
+        e = mgr.AddEntity(ne::EntityType::Base);
+        int const expectedGeneration = (expected.GetGeneration() + 1) & EntityId::kGenerationMask;
+        if (e->_id.GetSlot() != expected.GetSlot() || e->_id.GetGeneration() != expectedGeneration) {
+            printf("reuse %d: got slot %d generation %d, expected slot %d generation %d\n",
+                i, e->_id.GetSlot(), e->_id.GetGeneration(), expected.GetSlot(), expectedGeneration);
+            return false;
+        }
+        live = e->_id;
+        if (mgr.GetEntity(live) != e) {
+            printf("reuse %d: slot %d generation %d doesn't resolve to its entity\n", i, live.GetSlot(), live.GetGeneration());
+            return false;
+        }
+    }
+    if (!NoneResolve(mgr, ids, "after reuse")) {
+        return false;
+    }
+
+    // Taking one more drops the backlog below kMinFreeSlots again.
+    e = mgr.AddEntity(ne::EntityType::Base);
+    if (e->_id.GetSlot() != kMinFreeSlots || e->_id.GetGeneration() != 0) {
+        printf("after reuse: got slot %d generation %d, expected a new slot %d\n",
+            e->_id.GetSlot(), e->_id.GetGeneration(), kMinFreeSlots);
+        return false;
+    }
+    printf("reuse: %d slots, %d stale IDs checked\n", kMinFreeSlots, (int)ids.size());
+    return true;
+}
+
+}  // namespace
+
+int main() {
+    bool success = true;
+    success = CheckReuse() && success;
+
+    if (!success) {
+        printf("FAILED\n");
+        return 1;
+    }
+    return 0;
+}
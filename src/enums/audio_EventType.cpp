@@ -28,7 +28,11 @@ std::unordered_map<std::string, EventType> const gStringToEventType = {
     
     { "StopPcm", EventType::StopPcm },
     
-    { "SetGain", EventType::SetGain }
+    { "SetGain", EventType::SetGain },
+    
+    { "CancelTagged", EventType::CancelTagged },
+    
+    { "SetSendDelay", EventType::SetSendDelay }
     
 };
 
@@ -50,7 +54,11 @@ char const* gEventTypeStrings[] = {
     
     "StopPcm",
     
-    "SetGain"
+    "SetGain",
+    
+    "CancelTagged",
+    
+    "SetSendDelay"
     
 };
 
@@ -22,6 +22,10 @@ enum class EventType : int {
     
     SetGain,
     
+    CancelTagged,
+    
+    SetSendDelay,
+    
     Count
 };
 extern char const* gEventTypeStrings[];
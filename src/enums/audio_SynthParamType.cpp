@@ -86,7 +86,19 @@ std::unordered_map<std::string, SynthParamType> const gStringToSynthParamType =
     
     { "DelayTime", SynthParamType::DelayTime },
     
-    { "DelayFeedback", SynthParamType::DelayFeedback }
+    { "DelayFeedback", SynthParamType::DelayFeedback },
+    
+    { "LookupTables", SynthParamType::LookupTables },
+    
+    { "Polyphony", SynthParamType::Polyphony },
+    
+    { "VoiceSteal", SynthParamType::VoiceSteal },
+    
+    { "Pan", SynthParamType::Pan },
+    
+    { "Send", SynthParamType::Send },
+    
+    { "Wavetables", SynthParamType::Wavetables }
     
 };
 
@@ -166,7 +178,19 @@ char const* gSynthParamTypeStrings[] = {
     
     "DelayTime",
     
-    "DelayFeedback"
+    "DelayFeedback",
+    
+    "LookupTables",
+    
+    "Polyphony",
+    
+    "VoiceSteal",
+    
+    "Pan",
+    
+    "Send",
+    
+    "Wavetables"
     
 };
 
@@ -80,6 +80,18 @@ enum class SynthParamType : int {
     
     DelayFeedback,
     
+    LookupTables,
+    
+    Polyphony,
+    
+    VoiceSteal,
+    
+    Pan,
+    
+    Send,
+    
+    Wavetables,
+    
     Count
 };
 extern char const* gSynthParamTypeStrings[];
@@ -1,7 +1,10 @@
+// Targets that don't link fftw define COMPUTE_FFT=0 themselves.
+#ifndef COMPUTE_FFT
 #if defined __APPLE__
 #define COMPUTE_FFT 0
 #else
 #define COMPUTE_FFT 0
 #endif
+#endif
 
 #define NEW_LIGHTS 0
\ No newline at end of file
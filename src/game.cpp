@@ -1,6 +1,7 @@
 #include <iostream>
 #include <fstream>
 #include <cstdio>
+#include <array>
 #include <cmath>
 #include <cstring>
 #include <limits>
@@ -21,12 +22,6 @@
 #include "backends/imgui_impl_glfw.h"
 #include "backends/imgui_impl_opengl3.h"
 
-#include "features.h"
-
-#if COMPUTE_FFT
-#include <fftw3.h>
-#endif
-
 #include "constants.h"
 #include "game_manager.h"
 #include "audio_platform.h"
@@ -45,17 +40,6 @@
 
 GameManager gGameManager;
 
-double* gDft = nullptr;
-int gDftCount = 0;
-
-double* gDftLogAvgs = nullptr;
-double* gDftLogAvgsMaxFreqs = nullptr;
-double* gDftLogAvgsSmooth = nullptr;
-double* gDftLogAvgsScaled = nullptr;
-int gDftLogAvgsCount = 0;
-
-
-
 void SetViewport(ViewportInfo const& viewport) {
     // glViewport(viewport._offsetX, viewport._offsetY, viewport._width, viewport._height);
     // gGameManager._scene->SetViewport(viewport);
@@ -93,6 +77,8 @@ struct CommandLineInputs {
     std::optional<std::string> _scriptFilename;
     std::optional<std::string> _synthPatchesFilename;
     float _gain = 1.f;
+    int _synthWorkers = 0;
+    audio::ResampleMode _resampleMode = audio::ResampleMode::Polyphase;
     bool _editMode = false;
     bool _drawTerrain = false;
     std::vector<int> _activateEditorIds;
@@ -176,6 +162,31 @@ void ParseCommandLine(CommandLineInputs& inputs, std::vector<std::string> const&
             } catch (std::exception& e) {
                 std::cout << "-g: Failed to parse \"" << gainValueStr << "\" as a float." << std::endl;
             }
+        } else if (argv[argIx] == "-j") {
+            ++argIx;
+            if (argIx >= argv.size()) {
+                std::cout << "Expected an int argument to -j" << std::endl;
+                continue;
+            }
+            std::string numWorkersStr = argv[argIx];
+            try {
+                inputs._synthWorkers = std::stoi(numWorkersStr);
+            } catch (std::exception& e) {
+                std::cout << "-j: Failed to parse \"" << numWorkersStr << "\" as an int." << std::endl;
+            }
+        } else if (argv[argIx] == "-q") {
+            ++argIx;
+            if (argIx >= argv.size()) {
+                std::cout << "Expected polyphase or sinc after -q" << std::endl;
+                continue;
+            }
+            if (argv[argIx] == "polyphase") {
+                inputs._resampleMode = audio::ResampleMode::Polyphase;
+            } else if (argv[argIx] == "sinc") {
+                inputs._resampleMode = audio::ResampleMode::Sinc;
+            } else {
+                std::cout << "-q: Unknown resampler \"" << argv[argIx] << "\". Expected polyphase or sinc." << std::endl;
+            }
         } else if (argv[argIx] == "-t") {
             inputs._drawTerrain = true;
         } else if (argv[argIx] == "-a") {
@@ -387,6 +398,8 @@ int main(int argc, char** argv) {
     audio::Context audioContext;
     // Set gain from command line
     audioContext._state._finalGain = cmdLineInputs._gain;
+    audioContext._state._numSynthWorkers = cmdLineInputs._synthWorkers;
+    audioContext._state._resampleMode = cmdLineInputs._resampleMode;
 
     {
         if (!audioContext.Init(soundBank)) {
@@ -402,6 +415,7 @@ int main(int argc, char** argv) {
         audio::Event e;
         e.type = audio::EventType::SynthParam;
         e.paramChangeTimeSecs = 0.0;
+        std::array<audio::Event, (int)audio::SynthParamType::Count> paramEvents;
         for (int ii = 0; ii < numSynths && ii < synthPatchBank._patches.size(); ++ii) {
             synth::Patch const& patch = synthPatchBank._patches[ii];
             e.channel = ii;
@@ -410,49 +424,12 @@ int main(int argc, char** argv) {
                 float v = patch.Get(paramType);
                 e.param = paramType;
                 e.newParamValue = v;
-                audioContext.AddEvent(e);
+                paramEvents[paramIx] = e;
             }
+            audioContext.AddEvents(paramEvents.data(), paramEvents.size());
         }
     }
 
-    // TODO: figure out how FFT works with internal/output sample rates
-    int const bufferFrameCount = audioContext._state._bufferFrameCount;
-    gDftCount = bufferFrameCount / 2;
-    gDft = new double[gDftCount]();
-    double* dftFreqs = new double[gDftCount]();
-    float sampleRate = (float) audioContext._outputSampleRate;
-    for (int i = 0; i < gDftCount; ++i) {
-        dftFreqs[i] = (i+1) * sampleRate / bufferFrameCount;
-    }
-
-    int startDftBin = 0;
-    int numOctaves = 0;
-    int const minBandwidthPerOctave = 100;
-    int const bandsPerOctave = 1; 
-    {
-        for (int ii = 1; ii < gDftCount; ii = ii << 1) {
-            float f = dftFreqs[ii - 1];
-            if (f >= minBandwidthPerOctave) {
-                startDftBin = ii - 1;
-                int x = ii;
-                int count = 0;
-                while (x <= gDftCount) {
-                    x = x << 1;
-                    ++count;
-                }
-                numOctaves = count;
-                break;
-            }
-
-        }  
-    }
-    gDftLogAvgsCount = numOctaves * bandsPerOctave;
-    gDftLogAvgs = new double[gDftLogAvgsCount]();
-    gDftLogAvgsMaxFreqs = new double[gDftLogAvgsCount]();
-    gDftLogAvgsSmooth = new double[gDftLogAvgsCount]();
-    gDftLogAvgsScaled = new double[gDftLogAvgsCount]();
-
-
     InputManager inputManager(window);
 
     Editor editor;
@@ -516,11 +493,20 @@ int main(int argc, char** argv) {
         }
 
         neEntityManager.Init();
+        // The flow player checks for walls every tick.
+        neEntityManager.EnableSpatialIndex(ne::EntityType::FlowWall);
 
         double bpm = pt.GetChild("root").GetChild("script").GetDouble("bpm");
         beatClock.Init(gGameManager, bpm);
+        pt.GetChild("root").GetChild("script").TryGetDouble("audio_lookahead_secs", &beatClock._lookaheadSecs);
         beatClock.Update(gGameManager);
 
+        serial::Ptree sendDelayPt = pt.GetChild("root").GetChild("script").TryGetChild("send_delay");
+        if (sendDelayPt.IsValid()) {
+            audioContext._sendDelaySettings.Load(sendDelayPt);
+        }
+        audioContext.AddEvent(audioContext._sendDelaySettings.MakeEvent(bpm));
+
         omniSequencer.Init(gGameManager);
         motionManager.Init();
 
@@ -531,6 +517,13 @@ int main(int argc, char** argv) {
             serial::Ptree entitiesPt = pt.GetChild("root").GetChild("script").GetChild("new_entities");
             int numEntities = 0;
             serial::NameTreePair* children = entitiesPt.GetChildren(&numEntities);
+            int numEntitiesOfType[ne::gkNumEntityTypes] = {};
+            for (int i = 0; i < numEntities; ++i) {
+                ++numEntitiesOfType[(int)ne::StringToEntityType(children[i]._name)];
+            }
+            for (int typeIx = 0; typeIx < ne::gkNumEntityTypes; ++typeIx) {
+                gGameManager._neEntityManager->Reserve((ne::EntityType)typeIx, numEntitiesOfType[typeIx]);
+            }
             int64_t nextEditorId = 0;
             for (int i = 0; i < numEntities; ++i) {
                 ne::EntityType entityType = ne::StringToEntityType(children[i]._name);
@@ -573,105 +566,26 @@ int main(int argc, char** argv) {
 
     editor.Init(&gGameManager);
 
-#if COMPUTE_FFT
-    double* fftIn = (double*) fftw_malloc(sizeof(double) * bufferFrameCount);
-    fftw_complex* fftOut = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * bufferFrameCount);
-    fftw_plan fftwPlan = fftw_plan_dft_r2c_1d(bufferFrameCount, fftIn, fftOut, FFTW_ESTIMATE);
-#endif
-
-    float const fixedTimeStep = 1.f / static_cast<float>(refreshRate);
+    // Outside the editor, the game simulates at a fixed rate no matter what
+    // the display runs at, so gameplay doesn't change with the monitor and a
+    // slow frame doesn't lose a tick. Each tick sees the beat time of its own
+    // point in sim time, and rendering interpolates entity transforms between
+    // the last two ticks. The editor reads input once per rendered frame, so
+    // it keeps ticking once per frame.
+    double constexpr kSimTimeStep = 1.0 / 240.0;
+    // If we fall further behind than this, drop the time instead of catching
+    // up, since catching up only makes the next frame slower.
+    int constexpr kMaxSimTicksPerFrame = 8;
+    float const displayTimeStep = 1.f / static_cast<float>(refreshRate);
+    double simTimeAccumulator = 0.0;
+    double prevFrameTime = glfwGetTime();
     bool paused = false;
-    while(!glfwWindowShouldClose(window)) {
-
-        // IS IT OKAY THAT I'M USING SCREEN COORDS HERE?!?!?!?!
-        glfwGetWindowSize(window, &gGameManager._windowWidth, &gGameManager._windowHeight);
-        glfwGetFramebufferSize(window, &gGameManager._fbWidth, &gGameManager._fbHeight);
-        gGameManager._viewportInfo = CalculateViewport(gGameManager._aspectRatio, gGameManager._fbWidth, gGameManager._fbHeight, gGameManager._windowWidth, gGameManager._windowHeight);
-
-        beatClock.Update(gGameManager);        
-
-#if COMPUTE_FFT
-        {
-            audioContext._state._recentBufferMutex.lock();
-            for (int i = 0; i < bufferFrameCount; ++i) {
-                fftIn[i] = audioContext._state._recentBuffer[i];
-            }
-            audioContext._state._recentBufferMutex.unlock();
-
-            fftw_execute(fftwPlan);
-
-            for (int i = 0; i < gDftCount; ++i) {
-                float r = fftOut[i+1][0];
-                float img = fftOut[i+1][1];
-                float v = 2 * sqrt(r*r + img*img) / bufferFrameCount;
-                gDft[i] = v;
-            }
-
-            // DFT LOG AVERAGES
-            memset(gDftLogAvgs, 0, sizeof(*gDftLogAvgs) * gDftLogAvgsCount);
-            float octaveMinFreq = 0.f;
-            float octaveMaxFreq = dftFreqs[startDftBin];
-            int dftIx = startDftBin;
-            float const dftBinHalfBw = (1.f / bufferFrameCount) * sampleRate / 2.f;
-            for (int octaveIx = 0; octaveIx < numOctaves; ++octaveIx) {
-                float octaveBw = octaveMaxFreq - octaveMinFreq;
-                float logBinBw = octaveBw / bandsPerOctave;
-                float logBinMinFreq = octaveMinFreq;
-                for (int bandIx = 0; bandIx < bandsPerOctave; ++bandIx) {
-                    float logBinMaxFreq = logBinMinFreq + logBinBw;
-                    
-                    // logAvgBinMinFreqs[octaveIx*bandsPerOctave + bandIx] = logBinMinFreq;
-                    gDftLogAvgsMaxFreqs[octaveIx*bandsPerOctave + bandIx] = logBinMaxFreq;
-
-                    int count = 0;
-                    while (dftIx < gDftCount) {
-                        float dftCenter = dftFreqs[dftIx];
-                        float dftBinMaxFreq = dftCenter + dftBinHalfBw;
-                        gDftLogAvgs[octaveIx * bandsPerOctave + bandIx] += gDft[dftIx];
-                        ++count;
-                        if (dftBinMaxFreq < logBinMaxFreq) {
-                            ++dftIx;
-                        } else {
-                            break;
-                        }
-                    }
-                    if (count > 1) {
-                        gDftLogAvgs[octaveIx*bandsPerOctave + bandIx] /= count;          
-                    }
-
-                    logBinMinFreq = logBinMaxFreq;
-                }
-
-                octaveMinFreq = octaveMaxFreq;
-                octaveMaxFreq *= 2.f; 
-            }
-
-            float minVal = 999999.f, maxVal = -9999999.f;
-            for (int ii = 0; ii < gDftLogAvgsCount; ++ii) {
-                float curr = gDftLogAvgs[ii];
-                if (curr > 0.f) {
-                    curr = 10.f * log10(curr * curr);
-                }
-                gDftLogAvgsSmooth[ii] += fixedTimeStep * 50.f * (curr - gDftLogAvgsSmooth[ii]);
-                minVal = std::min((float)gDftLogAvgsSmooth[ii], minVal);
-                maxVal = std::max((float)gDftLogAvgsSmooth[ii], maxVal);
-                // gDftLogAvgsSmooth[ii] += fixedTimeStep * 20.f * (gDftLogAvgs[ii] - gDftLogAvgsSmooth[ii]);
-            }
-
-            float range = maxVal - minVal;
-            float scaleFactor = range + 0.00001f;
-            for (int ii = 0; ii < gDftLogAvgsCount; ++ii) {
-                gDftLogAvgsScaled[ii] = (gDftLogAvgsSmooth[ii] - minVal) / scaleFactor;
-            }
-            // printf("(%f, %f)\n", minVal, maxVal);
-
-        } 
-#endif // COMPUTE_FFT
 
+    auto simTick = [&](float const tickTimeStep) {
         {
             ImGuiIO& io = ImGui::GetIO();
             bool inputEnabled = !io.WantCaptureMouse && !io.WantCaptureKeyboard;
-            inputManager.Update(inputEnabled, fixedTimeStep);
+            inputManager.Update(inputEnabled, tickTimeStep);
         }
 
         // if (!cmdLineInputs._editMode && inputManager.IsKeyPressedThisFrame(InputManager::Key::Space)) {
@@ -681,19 +595,29 @@ int main(int argc, char** argv) {
         float dt = 0.f;
         if (paused) {
             if (inputManager.IsKeyPressedThisFrame(InputManager::Key::Right)) {
-                dt = fixedTimeStep;
+                dt = tickTimeStep;
             } else {
                 dt = 0.f;
             }
         } else {
-            dt = fixedTimeStep;
+            dt = tickTimeStep;
         }
 
-        MaybeToggleMute(fixedTimeStep);
+        MaybeToggleMute(tickTimeStep);
+
+        if (!gGameManager._editMode) {
+            for (auto iter = gGameManager._neEntityManager->GetAllIterator(); !iter.Finished(); iter.Next()) {
+                ne::Entity* e = iter.GetEntity();
+                e->_prevTransform = e->_transform;
+                e->_hasPrevTransform = true;
+            }
+        }
 
         gGameManager._motionManager->Update(dt, gGameManager);
         TypingEnemyMgr_Update(*gGameManager._typingEnemyMgr, gGameManager);
 
+        neEntityManager.UpdateSpatialIndices();
+
         if (gGameManager._editMode) {
             for (auto iter = gGameManager._neEntityManager->GetAllIterator(); !iter.Finished(); iter.Next()) {
                 ne::Entity* e = iter.GetEntity();
@@ -722,15 +646,53 @@ int main(int argc, char** argv) {
 
         omniSequencer.Update(gGameManager);
 
-        gGameManager._particleMgr->Update(fixedTimeStep);
-        
+        gGameManager._particleMgr->Update(tickTimeStep);
+    };
+
+    while(!glfwWindowShouldClose(window)) {
+
+        // IS IT OKAY THAT I'M USING SCREEN COORDS HERE?!?!?!?!
+        glfwGetWindowSize(window, &gGameManager._windowWidth, &gGameManager._windowHeight);
+        glfwGetFramebufferSize(window, &gGameManager._fbWidth, &gGameManager._fbHeight);
+        gGameManager._viewportInfo = CalculateViewport(gGameManager._aspectRatio, gGameManager._fbWidth, gGameManager._fbHeight, gGameManager._windowWidth, gGameManager._windowHeight);
+
+        double const frameTime = glfwGetTime();
+        float frameDt = displayTimeStep;
+        int numSimTicks = 1;
+        if (!gGameManager._editMode) {
+            simTimeAccumulator += frameTime - prevFrameTime;
+            double const maxAccumulator = kMaxSimTicksPerFrame * kSimTimeStep;
+            if (simTimeAccumulator > maxAccumulator) {
+                simTimeAccumulator = maxAccumulator;
+            }
+            numSimTicks = static_cast<int>(simTimeAccumulator / kSimTimeStep);
+            frameDt = static_cast<float>(std::min(frameTime - prevFrameTime, maxAccumulator));
+        } else {
+            simTimeAccumulator = 0.0;
+        }
+        prevFrameTime = frameTime;
+
+        audioContext.UpdateTelemetry();
+
+
+        if (gGameManager._editMode) {
+            beatClock.Update(gGameManager);
+            simTick(displayTimeStep);
+        } else {
+            for (int tickIx = 0; tickIx < numSimTicks; ++tickIx) {
+                simTimeAccumulator -= kSimTimeStep;
+                beatClock.Update(gGameManager, /*secsBehind=*/simTimeAccumulator);
+                simTick(static_cast<float>(kSimTimeStep));
+            }
+        }
+
         if (gGameManager._editMode) {
             for (auto iter = gGameManager._neEntityManager->GetAllIterator(); !iter.Finished(); iter.Next()) {
                 ne::Entity* e = iter.GetEntity();
                 if (editor._enableFlowSectionFilter && e->_flowSectionId >= 0 && editor._flowSectionFilterId != e->_flowSectionId) {
                     continue;
                 }
-                e->Draw(gGameManager, dt);
+                e->Draw(gGameManager, frameDt);
             }
 
             for (auto iter = gGameManager._neEntityManager->GetAllInactiveIterator(); !iter.Finished(); iter.Next()) {
@@ -738,12 +700,22 @@ int main(int argc, char** argv) {
                 if (editor._enableFlowSectionFilter && e->_flowSectionId >= 0 && editor._flowSectionFilterId != e->_flowSectionId) {
                     continue;
                 }
-                e->Draw(gGameManager, dt);
+                e->Draw(gGameManager, frameDt);
             }
         } else {
+            // Draw everything part of the way from the previous tick to the
+            // latest one, according to how much time is left over.
+            float const alpha = static_cast<float>(simTimeAccumulator / kSimTimeStep);
             for (auto iter = gGameManager._neEntityManager->GetAllIterator(); !iter.Finished(); iter.Next()) {
                 ne::Entity* e = iter.GetEntity();                
-                e->Draw(gGameManager, dt);
+                if (!e->_hasPrevTransform) {
+                    e->Draw(gGameManager, frameDt);
+                    continue;
+                }
+                Transform const current = e->_transform;
+                e->_transform = Transform::Lerp(e->_prevTransform, current, alpha);
+                e->Draw(gGameManager, frameDt);
+                e->_transform = current;
             }
         }
 
@@ -755,7 +727,7 @@ int main(int argc, char** argv) {
         ImGui_ImplGlfw_NewFrame();
         ImGui::NewFrame();
 
-        editor.Update(dt, synthGuiState);
+        editor.Update(frameDt, synthGuiState);
         ImGui::Render();
 
         // Rendering
@@ -764,7 +736,7 @@ int main(int argc, char** argv) {
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         float timeInSecs = (float) glfwGetTime();
-        sceneManager.Draw(gGameManager._windowWidth, gGameManager._windowHeight, gGameManager._fbWidth, gGameManager._fbHeight, timeInSecs, fixedTimeStep);
+        sceneManager.Draw(gGameManager._windowWidth, gGameManager._windowHeight, gGameManager._fbWidth, gGameManager._fbHeight, timeInSecs, frameDt);
 
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 
@@ -781,12 +753,7 @@ int main(int argc, char** argv) {
 
     }
 
-#if COMPUTE_FFT
-    fftw_destroy_plan(fftwPlan);
-    fftw_free(fftIn);
-    fftw_free(fftOut);
-#endif
-    
+    editor.Destroy();
     motionManager.Destroy();
 
     ShutDown(audioContext, soundBank);    
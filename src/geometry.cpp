@@ -95,22 +95,60 @@ bool SegmentBoxIntersection2d(
     return false;
 }
 
+namespace {
+// TODO: handle rotated walls. For now we assume AABB and ignore rotation.
+// (Types with a spatial index already do.)
+bool SegmentHitsUnrotatedBox(Vec3 const& p0, Vec3 const& p1, Transform const& wallTrans) {
+    Vec3 const& wallPos = wallTrans.Pos();
+    Vec3 const& scale = wallTrans.Scale();
+    float wallMinX = wallPos._x - 0.5f*scale._x;
+    float wallMaxX = wallPos._x + 0.5f*scale._x;
+    float wallMinZ = wallPos._z - 0.5f*scale._z;
+    float wallMaxZ = wallPos._z + 0.5f*scale._z;
+    return SegmentBoxIntersection2d(
+        p0._x, p0._z, p1._x, p1._z,
+        wallMinX, wallMinZ, wallMaxX, wallMaxZ);
+}
+}
+
 bool IsSegmentCollisionFree2D(GameManager& g, Vec3 const& playerPos, Vec3 const& enemyPos, ne::EntityType entityTypeToCheck) {
+    if (ne::SpatialIndex* index = g._neEntityManager->GetSpatialIndex(entityTypeToCheck)) {
+        // Indexed types get tested against their footprint, rotated by yaw.
+        static std::vector<int> sCandidates;
+        index->QuerySegment(playerPos, enemyPos, &sCandidates);
+        for (int entryIx : sCandidates) {
+            ne::SpatialIndex::Entry const& entry = index->GetEntry(entryIx);
+            ne::Entity* e = g._neEntityManager->GetEntity(entry._id);
+            if (e == nullptr) {
+                continue;
+            }
+            Transform const& wallTrans = e->_transform;
+            float yaw = entry._yaw;
+            if (!(wallTrans.Quat()._v == entry._quat._v)) {
+                yaw = -wallTrans.Quat().EulerAngles()._y;
+            }
+            // Into the wall's frame, same as PointInConvexPolygon2D.
+            float const c = cos(-yaw);
+            float const s = sin(-yaw);
+            Vec3 const wallPos = wallTrans.Pos();
+            float const dx0 = playerPos._x - wallPos._x, dz0 = playerPos._z - wallPos._z;
+            float const dx1 = enemyPos._x - wallPos._x, dz1 = enemyPos._z - wallPos._z;
+            float const halfX = entry._localHalfX * std::abs(wallTrans.Scale()._x);
+            float const halfZ = entry._localHalfZ * std::abs(wallTrans.Scale()._z);
+            bool hit = SegmentBoxIntersection2d(
+                c * dx0 - s * dz0, s * dx0 + c * dz0, c * dx1 - s * dz1, s * dx1 + c * dz1,
+                -halfX, -halfZ, halfX, halfZ);
+            if (hit) {
+                return false;
+            }
+        }
+        return true;
+    }
+
     int numEntities = 0;
     ne::EntityManager::Iterator wallIter = g._neEntityManager->GetIterator(entityTypeToCheck, &numEntities);
     for (; !wallIter.Finished(); wallIter.Next()) {
-        // TODO: handle rotated walls. For now we assume AABB and ignore rotation.
-        Transform const& wallTrans = wallIter.GetEntity()->_transform;
-        Vec3 const& wallPos = wallTrans.Pos();
-        Vec3 const& scale = wallTrans.Scale();
-        float wallMinX = wallPos._x - 0.5f*scale._x;
-        float wallMaxX = wallPos._x + 0.5f*scale._x;
-        float wallMinZ = wallPos._z - 0.5f*scale._z;
-        float wallMaxZ = wallPos._z + 0.5f*scale._z;
-        bool hit = SegmentBoxIntersection2d(
-            playerPos._x, playerPos._z, enemyPos._x, enemyPos._z,
-            wallMinX, wallMinZ, wallMaxX, wallMaxZ);
-        if (hit) {
+        if (SegmentHitsUnrotatedBox(playerPos, enemyPos, wallIter.GetEntity()->_transform)) {
             return false;
         }
     }
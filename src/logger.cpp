@@ -0,0 +1,261 @@
+#include "logger.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <unordered_map>
+
+#include "mpsc_queue.h"
+
+namespace logger {
+
+namespace {
+
+int constexpr kQueueCapacity = 1024;
+int constexpr kFormatBufferSize = 512;
+
+// Each call site (format string) gets this many lines per window. The rest get
+// counted and summarized when the window ends.
+int constexpr kMaxLinesPerWindow = 10;
+auto constexpr kRateLimitWindow = std::chrono::seconds(1);
+
+auto constexpr kLoggerThreadSleep = std::chrono::milliseconds(10);
+
+MpscQueue<Record> gQueue(kQueueCapacity);
+std::atomic<bool> gRunning = false;
+std::atomic<bool> gQuit = false;
+std::atomic<int64_t> gDroppedCount = 0;
+std::thread gThread;
+FILE* gOutputFile = nullptr;
+
+int64_t AsInt(Arg const& a) {
+    switch (a._type) {
+        case Arg::Type::Int: return a._i;
+        case Arg::Type::UInt: return static_cast<int64_t>(a._u);
+        case Arg::Type::Double: return static_cast<int64_t>(a._d);
+        case Arg::Type::String: return 0;
+    }
+    return 0;
+}
+
+double AsDouble(Arg const& a) {
+    switch (a._type) {
+        case Arg::Type::Int: return static_cast<double>(a._i);
+        case Arg::Type::UInt: return static_cast<double>(a._u);
+        case Arg::Type::Double: return a._d;
+        case Arg::Type::String: return 0.0;
+    }
+    return 0.0;
+}
+
+// printf, except each conversion takes the next Arg regardless of the length
+// modifiers in fmt (we widen everything to 64 bits ourselves).
+void Format(Record const& r, char* out, int outSize) {
+    int len = 0;
+    auto append = [&](char const* s, int n) {
+        n = std::min(n, outSize - 1 - len);
+        if (n > 0) {
+            memcpy(out + len, s, n);
+            len += n;
+        }
+    };
+    int argIx = 0;
+    char const* p = r._fmt;
+    while (*p != '\0') {
+        if (*p != '%') {
+            char const* next = strchr(p, '%');
+            int const n = next != nullptr ? static_cast<int>(next - p) : static_cast<int>(strlen(p));
+            append(p, n);
+            p += n;
+            continue;
+        }
+        if (p[1] == '%') {
+            append("%", 1);
+            p += 2;
+            continue;
+        }
+
+        // Keep flags, width and precision; drop length modifiers.
+        char spec[32];
+        int specLen = 0;
+        spec[specLen++] = *p++;
+        while (*p != '\0' && strchr("-+ #0123456789.", *p) != nullptr && specLen < 24) {
+            spec[specLen++] = *p++;
+        }
+        while (*p != '\0' && strchr("hlLqjzt", *p) != nullptr) {
+            ++p;
+        }
+        char const conv = *p;
+        if (conv != '\0') {
+            ++p;
+        }
+        if (argIx >= r._numArgs) {
+            append("<?>", 3);
+            continue;
+        }
+        Arg const& a = r._args[argIx++];
+
+        char piece[128];
+        int n = -1;
+        switch (conv) {
+            case 'd': case 'i':
+                spec[specLen++] = 'l'; spec[specLen++] = 'l'; spec[specLen++] = conv; spec[specLen] = '\0';
+                n = snprintf(piece, sizeof(piece), spec, static_cast<long long>(AsInt(a)));
+                break;
+            case 'u': case 'x': case 'X': case 'o':
+                spec[specLen++] = 'l'; spec[specLen++] = 'l'; spec[specLen++] = conv; spec[specLen] = '\0';
+                n = snprintf(piece, sizeof(piece), spec, static_cast<unsigned long long>(AsInt(a)));
+                break;
+            case 'c':
+                spec[specLen++] = conv; spec[specLen] = '\0';
+                n = snprintf(piece, sizeof(piece), spec, static_cast<int>(AsInt(a)));
+                break;
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+                spec[specLen++] = conv; spec[specLen] = '\0';
+                n = snprintf(piece, sizeof(piece), spec, AsDouble(a));
+                break;
+            case 's':
+                spec[specLen++] = conv; spec[specLen] = '\0';
+                n = snprintf(piece, sizeof(piece), spec, a._type == Arg::Type::String ? a._s : "<?>");
+                break;
+            default:
+                break;
+        }
+        if (n < 0) {
+            append("<?>", 3);
+        } else {
+            append(piece, std::min(n, static_cast<int>(sizeof(piece)) - 1));
+        }
+    }
+    out[len] = '\0';
+}
+
+void Write(char const* line) {
+    fputs(line, stdout);
+    if (gOutputFile != nullptr) {
+        fputs(line, gOutputFile);
+    }
+}
+
+struct CallSite {
+    std::chrono::steady_clock::time_point _windowStart;
+    int _numLines = 0;
+    int _numSuppressed = 0;
+};
+
+void ReportSuppressed(char const* fmt, CallSite& site) {
+    if (site._numSuppressed == 0) {
+        return;
+    }
+    char line[kFormatBufferSize];
+    // Only the first line of the format, without its newline.
+    int const fmtLen = static_cast<int>(strcspn(fmt, "\n"));
+    snprintf(line, sizeof(line), "(suppressed %d more of \"%.*s\")\n", site._numSuppressed, std::min(fmtLen, 200), fmt);
+    Write(line);
+    site._numSuppressed = 0;
+}
+
+void LoggerThreadLoop() {
+    std::unordered_map<char const*, CallSite> callSites;
+    int64_t reportedDropCount = 0;
+    Record batch[64];
+    char line[kFormatBufferSize];
+    while (true) {
+        // Read quit before draining so whatever was pushed before Logger
+        // went away still gets written.
+        bool const quit = gQuit.load();
+        bool wroteAnything = false;
+        auto const now = std::chrono::steady_clock::now();
+        while (true) {
+            std::size_t const numPopped = gQueue.TryPopBatch(batch, 64);
+            for (std::size_t i = 0; i < numPopped; ++i) {
+                Record const& r = batch[i];
+                CallSite& site = callSites[r._fmt];
+                if (now - site._windowStart >= kRateLimitWindow) {
+                    ReportSuppressed(r._fmt, site);
+                    site._windowStart = now;
+                    site._numLines = 0;
+                }
+                if (site._numLines >= kMaxLinesPerWindow) {
+                    ++site._numSuppressed;
+                    continue;
+                }
+                ++site._numLines;
+                Format(r, line, sizeof(line));
+                Write(line);
+                wroteAnything = true;
+            }
+            if (numPopped < 64) {
+                break;
+            }
+        }
+
+        int64_t const dropCount = gDroppedCount.load(std::memory_order_relaxed);
+        if (dropCount != reportedDropCount) {
+            snprintf(line, sizeof(line), "logger: queue full, dropped %lld messages\n", static_cast<long long>(dropCount - reportedDropCount));
+            Write(line);
+            reportedDropCount = dropCount;
+            wroteAnything = true;
+        }
+
+        // Flush summaries for call sites that went quiet (or all of them on
+        // the way out).
+        for (auto& [fmt, site] : callSites) {
+            if (site._numSuppressed > 0 && (quit || now - site._windowStart >= kRateLimitWindow)) {
+                ReportSuppressed(fmt, site);
+                wroteAnything = true;
+            }
+        }
+
+        if (wroteAnything) {
+            fflush(stdout);
+            if (gOutputFile != nullptr) {
+                fflush(gOutputFile);
+            }
+        }
+        if (quit) {
+            break;
+        }
+        std::this_thread::sleep_for(kLoggerThreadSleep);
+    }
+}
+
+}  // namespace
+
+Logger::Logger() {
+    gOutputFile = fopen("log.txt", "w");
+    gQuit = false;
+    gThread = std::thread(&LoggerThreadLoop);
+    gRunning = true;
+}
+
+Logger::~Logger() {
+    gRunning = false;
+    gQuit = true;
+    gThread.join();
+    if (gOutputFile != nullptr) {
+        fclose(gOutputFile);
+        gOutputFile = nullptr;
+    }
+}
+
+void Push(Record const& record) {
+    if (!gRunning.load(std::memory_order_acquire)) {
+        char line[kFormatBufferSize];
+        Format(record, line, sizeof(line));
+        fputs(line, stdout);
+        return;
+    }
+    if (!gQueue.TryPush(record)) {
+        gDroppedCount.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+int64_t GetDroppedCount() {
+    return gDroppedCount.load(std::memory_order_relaxed);
+}
+
+}  // namespace logger
@@ -1,40 +1,90 @@
 #pragma once
 
-#include <cstdio>
-#include <cstdarg>
+#include <cstdint>
+#include <type_traits>
+
+// Logging that's safe to call from the audio thread (or anywhere per-frame).
+//
+// Log() doesn't format or touch any I/O: it packs the format string pointer
+// and the raw arguments into a fixed-size record and pushes it onto a
+// lock-free queue. A background thread owned by Logger formats the records,
+// writes them to stdout and log.txt, and rate-limits each call site so a
+// message that fires every buffer can't flood the console.
+//
+// Rules for callers:
+// - fmt must be a string literal (we keep the pointer, not a copy).
+// - Up to kMaxArgs arguments, each an integer, floating point, or a string
+//   literal. %s arguments have the same lifetime rule as fmt.
+// - If the queue is full the message gets counted and dropped.
+//
+// Without a running Logger (tools, tests), Log() prints right away.
 
 namespace logger {
 
-    struct Logger {
-        Logger();
-        ~Logger();
-        FILE* _outputFile = nullptr;
+int constexpr kMaxArgs = 6;
+
+struct Arg {
+    enum class Type : uint8_t { Int, UInt, Double, String };
+    Type _type = Type::Int;
+    union {
+        int64_t _i;
+        uint64_t _u;
+        double _d;
+        char const* _s;
     };
+};
 
-    void Log(Logger& logger, char const* fmt, ...) {
-        {
-            va_list args;
-            va_start(args, fmt);
-            vfprintf(logger._outputFile, fmt, args);
-            va_end(args);
-        }
-
-        {
-            va_list args;
-            va_start(args, fmt);
-            vprintf(fmt, args);
-            va_end(args);
-        }
-    }
+struct Record {
+    char const* _fmt = nullptr;
+    int _numArgs = 0;
+    Arg _args[kMaxArgs];
+};
 
-    Logger::Logger() {
-        _outputFile = fopen("log.txt", "w");
-    }
+// Owns the background thread. Make exactly one, for the lifetime of main().
+struct Logger {
+    Logger();
+    ~Logger();
+    Logger(Logger const&) = delete;
+    Logger& operator=(Logger const&) = delete;
+};
 
-    Logger::~Logger() {
-        if (_outputFile != nullptr) {
-            fclose(_outputFile);
-        }
+void Push(Record const& record);
+
+namespace internal {
+template <typename T>
+Arg MakeArg(T v) {
+    Arg a;
+    if constexpr (std::is_floating_point_v<T>) {
+        a._type = Arg::Type::Double;
+        a._d = v;
+    } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+        a._type = Arg::Type::Int;
+        a._i = v;
+    } else if constexpr (std::is_integral_v<T> || std::is_enum_v<T>) {
+        a._type = Arg::Type::UInt;
+        a._u = static_cast<uint64_t>(v);
+    } else {
+        static_assert(std::is_convertible_v<T, char const*>, "logger::Log only takes numbers and string literals");
+        a._type = Arg::Type::String;
+        a._s = v;
     }
+    return a;
+}
+}  // namespace internal
+
+template <typename... Args>
+void Log(char const* fmt, Args... args) {
+    static_assert(sizeof...(Args) <= kMaxArgs, "Too many arguments for logger::Log");
+    Record r;
+    r._fmt = fmt;
+    r._numArgs = sizeof...(Args);
+    int ix = 0;
+    ((r._args[ix++] = internal::MakeArg(args)), ...);
+    (void)ix;
+    Push(r);
+}
+
+// Messages dropped because the queue was full.
+int64_t GetDroppedCount();
 
-};
\ No newline at end of file
+}  // namespace logger
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Bounded lock-free queue with any number of producers and a single consumer.
+// Each slot carries a sequence number (Vyukov's bounded queue), so producers
+// only contend on one atomic add/CAS and never wait on each other's copies.
+//
+// Pushes never block: if there's no room they return false and the caller
+// decides what to do (usually count a drop). TryPushBatch is all-or-nothing so
+// related events (e.g. a NoteOn and its NoteOff) can't get split up.
+template <typename T>
+class MpscQueue {
+public:
+    // capacity gets rounded up to a power of 2.
+    explicit MpscQueue(std::size_t capacity) {
+        _capacity = 1;
+        while (_capacity < capacity) {
+            _capacity *= 2;
+        }
+        _mask = _capacity - 1;
+        _slots = std::make_unique<Slot[]>(_capacity);
+        for (std::size_t i = 0; i < _capacity; ++i) {
+            _slots[i]._seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MpscQueue(MpscQueue const&) = delete;
+    MpscQueue& operator=(MpscQueue const&) = delete;
+
+    // Any thread.
+    bool TryPush(T const& v) {
+        return TryPushBatch(&v, 1);
+    }
+
+    // Any thread. Pushes all count items contiguously or none of them.
+    bool TryPushBatch(T const* items, std::size_t count) {
+        return TryPushBatch(items, count, [](T&) {});
+    }
+
+    // Same, but calls fixup(item) on each copy in the queue before the
+    // consumer can see it, so callers can adjust items without copying the
+    // batch somewhere first.
+    template <typename Fixup>
+    bool TryPushBatch(T const* items, std::size_t count, Fixup&& fixup) {
+        if (count == 0) {
+            return true;
+        }
+        if (count > _capacity) {
+            return false;
+        }
+        std::size_t pos = _writePos.load(std::memory_order_relaxed);
+        while (true) {
+            // The consumer frees slots in order, so if the last slot we need is
+            // free then so is everything before it.
+            Slot& last = _slots[(pos + count - 1) & _mask];
+            std::size_t const seq = last._seq.load(std::memory_order_acquire);
+            intptr_t const diff = (intptr_t)seq - (intptr_t)(pos + count - 1);
+            if (diff == 0) {
+                if (_writePos.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                // Full.
+                return false;
+            } else {
+                pos = _writePos.load(std::memory_order_relaxed);
+            }
+        }
+        for (std::size_t i = 0; i < count; ++i) {
+            Slot& slot = _slots[(pos + i) & _mask];
+            slot._item = items[i];
+            fixup(slot._item);
+            slot._seq.store(pos + i + 1, std::memory_order_release);
+        }
+        return true;
+    }
+
+    // Consumer only. Returns nullptr if the next item isn't ready yet.
+    T* Front() {
+        Slot& slot = _slots[_readPos & _mask];
+        if (slot._seq.load(std::memory_order_acquire) != _readPos + 1) {
+            return nullptr;
+        }
+        return &slot._item;
+    }
+
+    // Consumer only. Only call after Front() returned non-null.
+    void Pop() {
+        Slot& slot = _slots[_readPos & _mask];
+        assert(slot._seq.load(std::memory_order_relaxed) == _readPos + 1);
+        slot._seq.store(_readPos + _capacity, std::memory_order_release);
+        ++_readPos;
+    }
+
+    // Consumer only. Pops up to maxCount items into out and returns how many.
+    // Stops early at a slot a producer is still writing.
+    std::size_t TryPopBatch(T* out, std::size_t maxCount) {
+        std::size_t numPopped = 0;
+        while (numPopped < maxCount) {
+            T* item = Front();
+            if (item == nullptr) {
+                break;
+            }
+            out[numPopped++] = *item;
+            Pop();
+        }
+        return numPopped;
+    }
+
+    std::size_t Capacity() const { return _capacity; }
+
+private:
+    static std::size_t constexpr kCacheLineSize = 64;
+
+    struct Slot {
+        std::atomic<std::size_t> _seq;
+        T _item;
+    };
+
+    std::unique_ptr<Slot[]> _slots;
+    std::size_t _capacity = 0;
+    std::size_t _mask = 0;
+
+    alignas(kCacheLineSize) std::atomic<std::size_t> _writePos = 0;
+    alignas(kCacheLineSize) std::size_t _readPos = 0;  // consumer only
+};
@@ -0,0 +1,112 @@
+// Stress test for MpscQueue: several producers push single items and batches
+// while one consumer pops. Checks that nothing is lost or duplicated, that
+// each producer's items come out in order, and that batches stay contiguous.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "mpsc_queue.h"
+
+namespace {
+
+struct Item {
+    int _producer = -1;
+    int _seq = -1;
+    int _batchIx = 0;  // position within its batch
+    int _batchSize = 1;
+};
+
+int constexpr kNumProducers = 4;
+int constexpr kItemsPerProducer = 50000;
+int constexpr kBatchSize = 5;
+
+}  // namespace
+
+int main() {
+    MpscQueue<Item> queue(256);
+
+    std::atomic<int64_t> numDropped = 0;
+    std::vector<std::thread> producers;
+    for (int p = 0; p < kNumProducers; ++p) {
+        producers.emplace_back([&queue, &numDropped, p]() {
+            int seq = 0;
+            while (seq < kItemsPerProducer) {
+                // Odd producers push batches, even ones push one at a time.
+                int const batchSize = (p % 2 == 1) ? std::min(kBatchSize, kItemsPerProducer - seq) : 1;
+                Item batch[kBatchSize];
+                for (int i = 0; i < batchSize; ++i) {
+                    batch[i]._producer = p;
+                    batch[i]._seq = seq + i;
+                    batch[i]._batchIx = i;
+                    batch[i]._batchSize = batchSize;
+                }
+                if (queue.TryPushBatch(batch, batchSize)) {
+                    seq += batchSize;
+                } else {
+                    numDropped += batchSize;
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+
+    int nextSeq[kNumProducers] = {};
+    int64_t numPopped = 0;
+    int64_t const numExpected = (int64_t)kNumProducers * kItemsPerProducer;
+    bool failed = false;
+    Item popped[64];
+    int pendingBatchItems = 0;
+    int pendingBatchProducer = -1;
+    while (numPopped < numExpected && !failed) {
+        std::size_t n = queue.TryPopBatch(popped, 64);
+        for (std::size_t i = 0; i < n; ++i) {
+            Item const& item = popped[i];
+            if (item._producer < 0 || item._producer >= kNumProducers) {
+                printf("FAILED: bad producer %d\n", item._producer);
+                failed = true;
+                break;
+            }
+            if (item._seq != nextSeq[item._producer]) {
+                printf("FAILED: producer %d expected seq %d, got %d\n", item._producer, nextSeq[item._producer], item._seq);
+                failed = true;
+                break;
+            }
+            ++nextSeq[item._producer];
+            if (pendingBatchItems > 0) {
+                if (item._producer != pendingBatchProducer) {
+                    printf("FAILED: batch from producer %d interleaved with producer %d\n", pendingBatchProducer, item._producer);
+                    failed = true;
+                    break;
+                }
+                --pendingBatchItems;
+            } else if (item._batchSize > 1) {
+                if (item._batchIx != 0) {
+                    printf("FAILED: batch from producer %d started mid-batch\n", item._producer);
+                    failed = true;
+                    break;
+                }
+                pendingBatchItems = item._batchSize - 1;
+                pendingBatchProducer = item._producer;
+            }
+        }
+        numPopped += n;
+    }
+
+    for (std::thread& t : producers) {
+        t.join();
+    }
+
+    if (!failed && queue.Front() != nullptr) {
+        printf("FAILED: queue not empty after popping everything\n");
+        failed = true;
+    }
+    if (failed) {
+        return 1;
+    }
+    printf("PASSED: %lld items from %d producers (%lld pushes rejected while full)\n",
+        (long long)numPopped, kNumProducers, (long long)numDropped.load());
+    return 0;
+}
@@ -2,7 +2,11 @@
 
 #include <cassert>
 #include <vector>
+#include <unordered_map>
 #include <cinttypes>
+#include <algorithm>
+#include <cmath>
+#include <new>
 
 #include "imgui/imgui.h"
 #include "imgui_util.h"
@@ -55,6 +59,14 @@ std::size_t const gkEntitySizes[] = {
 #   undef X
 };
 
+namespace {
+std::size_t const gkEntityAlignments[] = {
+#   define X(a) alignof(a##Entity),
+    M_ENTITY_TYPES
+#   undef X
+};
+}
+
 char const* const gkEntityTypeNames[] = {
 #   define X(name) #name,
     M_ENTITY_TYPES
@@ -66,15 +78,8 @@ EntityType StringToEntityType(char const* s) {
 }
 
 struct EntityManager::Internal {
-    // Entity lists
-#   define X(NAME) std::vector<NAME##Entity> _entities##NAME;
-    M_ENTITY_TYPES
-#   undef X
-
-    // Inactive entity lists
-#   define X(NAME) std::vector<NAME##Entity> _inactiveEntities##NAME;
-    M_ENTITY_TYPES
-#   undef X    
+    // Active and inactive entities of each type, indexed by type.
+    EntityPool _pools[gkNumEntityTypes];
 };
 
 EntityManager::EntityManager() {}
@@ -84,20 +89,24 @@ EntityManager::~EntityManager() {}
 
 void EntityManager::Init() {
     _p = std::make_unique<Internal>();
-    // _p->_entitiesBase.reserve(100);
-    // _p->_entitiesLight.reserve(1);
+    for (int typeIx = 0; typeIx < gkNumEntityTypes; ++typeIx) {
+        _p->_pools[typeIx].Init(gkEntitySizes[typeIx], gkEntityAlignments[typeIx]);
+    }
+}
+
+void EntityManager::Reserve(EntityType entityType, int numEntities) {
+    _p->_pools[(int)entityType].Reserve(numEntities);
 }
 
 Entity* EntityManager::AddEntity(EntityType entityType, bool const active) {
     Entity* e = nullptr;
     int entityIx = -1;
+    EntityPool::SlotState const state = active ? EntityPool::SlotState::Active : EntityPool::SlotState::Inactive;
     switch (entityType) {
 #       define X(NAME) \
         case EntityType::NAME: { \
-            auto& entities = active ? _p->_entities##NAME : _p->_inactiveEntities##NAME; \
-            entities.emplace_back(); \
-            e = &(entities.back()); \
-            entityIx = entities.size() - 1; \
+            void* mem = _p->_pools[(int)entityType].Allocate(state, &entityIx); \
+            e = new (mem) NAME##Entity(); \
             break; \
         }
         M_ENTITY_TYPES
@@ -107,65 +116,49 @@ Entity* EntityManager::AddEntity(EntityType entityType, bool const active) {
             return nullptr;
         }
     }
-    e->_id._id = _nextId++;
+    int slotIx = -1;
+    if (_freeSlots.size() >= kMinFreeSlots) {
+        slotIx = _freeSlots.front();
+        _freeSlots.pop_front();
+    } else {
+        slotIx = _slots.size();
+        assert(slotIx <= EntityId::kSlotMask);
+        _slots.emplace_back();
+    }
+    Slot& slot = _slots[slotIx];
+    slot._typeIx = (int)entityType;
+    slot._entityIx = entityIx;
+    e->_id._id = EntityId::Make(slotIx, slot._generation);
     e->_id._type = entityType;
     assert(e->Type() == entityType);
-    MapEntry entry;
-    entry._typeIx = (int)entityType;
-    entry._entityIx = entityIx;
-    entry._active = active;
-    bool newEntry = _entityIdMap.emplace(e->_id._id, entry).second;
-    assert(newEntry);
     return e; 
 }
 
-std::pair<Entity*, int> EntityManager::GetEntitiesOfType(EntityType type, bool active) {
-    switch (type) {
-#       define X(NAME) \
-        case EntityType::NAME: { \
-            if (active) { \
-                auto& entities = _p->_entities##NAME; \
-                return std::make_pair(entities.data(), static_cast<int>(entities.size())); \
-            } else { \
-                auto& entities = _p->_inactiveEntities##NAME; \
-                return std::make_pair(entities.data(), static_cast<int>(entities.size())); \
-            } \
-        }
-        M_ENTITY_TYPES
-#       undef X
-        case EntityType::Count: {
-            assert(false);
-            return std::make_pair(nullptr, 0);
-        }
-    }
-    assert(false);
-    return std::make_pair(nullptr, 0);
+void EntityManager::FreeSlot(EntityId id) {
+    Slot& slot = _slots[id.GetSlot()];
+    slot._generation = (slot._generation + 1) & EntityId::kGenerationMask;
+    slot._typeIx = -1;
+    slot._entityIx = -1;
+    _freeSlots.push_back(id.GetSlot());
 }
 
 ne::EntityManager::EntityInfo EntityManager::GetEntityInfo(EntityId id, bool includeActive, bool includeInactive) {
     if (!id.IsValid()) {
         return EntityInfo();
     }
-    auto result = _entityIdMap.find(id._id);
-    if (result == _entityIdMap.end()) {
-        return EntityInfo();
-    }
-    MapEntry const& entry = result->second;
-    assert(entry._typeIx == (int)id._type);
-    if (entry._active && !includeActive) {
+    Slot const* slot = GetSlot(id);
+    if (slot == nullptr) {
         return EntityInfo();
     }
-    if (!entry._active && !includeInactive) {
+    assert(slot->_typeIx == (int)id._type);
+    EntityPool& pool = _p->_pools[slot->_typeIx];
+    bool const active = pool.GetState(slot->_entityIx) == EntityPool::SlotState::Active;
+    if (active ? !includeActive : !includeInactive) {
         return EntityInfo();
     }
-    auto [pEntityList, numEntities] = GetEntitiesOfType(id._type, entry._active);
-    assert(entry._entityIx < numEntities);
-    Entity* e = (Entity*) (((char*)pEntityList) + (entry._entityIx * gkEntitySizes[(int)id._type]));
-    if (e->_id._id == id._id) {
-        assert(e->_id._type == id._type);
-        return EntityInfo{e, entry._entityIx, entry._active};
-    }
-    return EntityInfo();
+    Entity* e = pool.Get(slot->_entityIx);
+    assert(e->_id._id == id._id && e->_id._type == id._type);
+    return EntityInfo{e, slot->_entityIx, active};
 }
 
 Entity* EntityManager::GetEntity(EntityId id) {
@@ -354,132 +347,29 @@ Entity* EntityManager::FindEntityByEditorIdAndType(EditorId editorId, EntityType
 
 bool EntityManager::RemoveEntity(EntityId idToRemove) {
     EntityInfo entityInfo = GetEntityInfo(idToRemove, true, true);
-    Entity* toRemove = entityInfo._e;
-    int toRemoveIx = entityInfo._ix;
-    bool active = entityInfo._active;
-    
-    if (toRemove == nullptr) {
+    if (entityInfo._e == nullptr) {
         return false;
     }
-
-    // Do a swap remove from entity list, remove from id map, and update swapped entry in id map.
-    Entity* entryToUpdate = nullptr;
-    switch (idToRemove._type) {
-#       define X(NAME) \
-        case EntityType::NAME: { \
-            NAME##Entity* e = (NAME##Entity*)toRemove; \
-            auto& entities = active ? _p->_entities##NAME : _p->_inactiveEntities##NAME; \
-            if (entities.size() > 1) { \
-                *e = std::move(entities.back()); \
-                entryToUpdate = e; \
-            } \
-            entities.pop_back(); \
-            break; \
-        }
-        M_ENTITY_TYPES
-#       undef X        
-        case EntityType::Count: {
-            assert(false);
-            break;
-        }
-    }
-
-    if (entryToUpdate != nullptr) {
-        MapEntry& entry = _entityIdMap.at(entryToUpdate->_id._id);
-        entry._entityIx = toRemoveIx;
-    }
-
-    int numErased = _entityIdMap.erase(idToRemove._id);
-    assert(numErased == 1);
-
+    _p->_pools[(int)idToRemove._type].Free(entityInfo._ix);
+    FreeSlot(idToRemove);
     return true;
 }
 
-bool EntityManager::DeactivateEntity(EntityId idToDeactivate) {    
+bool EntityManager::DeactivateEntity(EntityId idToDeactivate) {
     EntityInfo info = GetEntityInfo(idToDeactivate, true, false);
     if (info._e == nullptr) {
         return false;
     }
-
-    Entity* entryToUpdate = nullptr;
-    int inactiveEntitiesIx = -1;
-    switch (idToDeactivate._type) {
-#       define X(NAME) \
-        case EntityType::NAME: { \
-            NAME##Entity* entity = (NAME##Entity*)info._e; \
-            auto& entities = _p->_entities##NAME; \
-            auto& inactiveEntities = _p->_inactiveEntities##NAME; \
-            inactiveEntities.push_back(std::move(*entity)); \
-            inactiveEntitiesIx = inactiveEntities.size() - 1; \
-            if (entities.size() > 1) { \
-                *entity = std::move(entities.back()); \
-                entryToUpdate = entity; \
-            } \
-            entities.pop_back(); \
-            break; \
-        }
-        M_ENTITY_TYPES
-#       undef X        
-        case EntityType::Count: {
-            assert(false);
-            break;
-        }
-    }   
-
-    if (entryToUpdate != nullptr) {
-        MapEntry& entry = _entityIdMap.at(entryToUpdate->_id._id);
-        entry._entityIx = info._ix;   
-    }
-
-    // TODO we shouldn't need to do this; we've already done this lookup in GetEntityInfo.
-    MapEntry& entry = _entityIdMap.at(idToDeactivate._id);
-    entry._active = false;
-    assert(inactiveEntitiesIx >= 0);
-    entry._entityIx = inactiveEntitiesIx;
+    _p->_pools[(int)idToDeactivate._type].SetState(info._ix, EntityPool::SlotState::Inactive);
     return true;
 }
 
-bool EntityManager::ActivateEntity(EntityId idToActivate) {    
+bool EntityManager::ActivateEntity(EntityId idToActivate) {
     EntityInfo info = GetEntityInfo(idToActivate, false, true);
     if (info._e == nullptr) {
         return false;
     }
-
-    Entity* entryToUpdate = nullptr;
-    int entitiesIx = -1;
-    switch (idToActivate._type) {
-#       define X(NAME) \
-        case EntityType::NAME: { \
-            NAME##Entity* entity = (NAME##Entity*)info._e; \
-            auto& entities = _p->_entities##NAME; \
-            auto& inactiveEntities = _p->_inactiveEntities##NAME; \
-            entities.push_back(std::move(*entity)); \
-            entitiesIx = entities.size() - 1; \
-            if (inactiveEntities.size() > 1) { \
-                *entity = std::move(inactiveEntities.back()); \
-                entryToUpdate = entity; \
-            } \
-            inactiveEntities.pop_back(); \
-            break; \
-        }
-        M_ENTITY_TYPES
-#       undef X        
-        case EntityType::Count: {
-            assert(false);
-            break;
-        }
-    }   
-
-    if (entryToUpdate != nullptr) {
-        MapEntry& entry = _entityIdMap.at(entryToUpdate->_id._id);
-        entry._entityIx = info._ix;   
-    }
-
-    // TODO we shouldn't need to do this; we've already done this lookup in GetEntityInfo.
-    MapEntry& entry = _entityIdMap.at(idToActivate._id);
-    entry._active = true;
-    assert(entitiesIx >= 0);
-    entry._entityIx = entitiesIx;
+    _p->_pools[(int)idToActivate._type].SetState(info._ix, EntityPool::SlotState::Active);
     return true;
 }
 
@@ -601,48 +491,62 @@ void EntityManager::GetEntitiesOfType(ne::EntityType entityType, bool includeAct
     }
 }
 
-EntityManager::Iterator EntityManager::GetIterator(EntityType type, int* outNumEntities) {
-    Iterator iter;
-    auto [entityList, numEntities] = GetEntitiesOfType(type, /*active=*/true);
-    iter._stride = gkEntitySizes[(int)type];
-    iter._current = entityList;
-    char* p = (char*) entityList;
-    char* end = p + numEntities * iter._stride;
-    iter._end = (Entity*)end;
-    if (outNumEntities != nullptr) {
-        *outNumEntities = numEntities;
+void EntityManager::EnableSpatialIndex(EntityType entityType, float cellSize) {
+    std::unique_ptr<SpatialIndex>& index = _spatialIndices[(int)entityType];
+    if (index == nullptr) {
+        index = std::make_unique<SpatialIndex>();
     }
-    return iter;
+    index->Init(cellSize);
 }
 
-EntityManager::Iterator EntityManager::GetInactiveIterator(EntityType type, int* outNumEntities) {
+void EntityManager::UpdateSpatialIndices() {
+    for (int typeIx = 0; typeIx < gkNumEntityTypes; ++typeIx) {
+        SpatialIndex* index = _spatialIndices[typeIx].get();
+        if (index == nullptr) {
+            continue;
+        }
+        index->BeginRefit();
+        for (Iterator iter = GetIterator((EntityType)typeIx); !iter.Finished(); iter.Next()) {
+            Entity* e = iter.GetEntity();
+            float halfX, halfZ;
+            e->GetLocalFootprint(&halfX, &halfZ);
+            index->Refit(e->_id, e->_transform, halfX, halfZ);
+        }
+        index->EndRefit();
+    }
+}
+
+EntityManager::Iterator EntityManager::MakeIterator(EntityType type, EntityPool::SlotState state, int* outNumEntities) {
     Iterator iter;
-    auto [entityList, numEntities] = GetEntitiesOfType(type, /*active=*/false);
-    iter._stride = gkEntitySizes[(int)type];
-    iter._current = entityList;
-    char* p = (char*) entityList;
-    char* end = p + numEntities * iter._stride;
-    iter._end = (Entity*)end;
+    iter._pool = &_p->_pools[(int)type];
+    iter._state = state;
+    iter._ix = iter._pool->FindNext(0, state);
     if (outNumEntities != nullptr) {
-        *outNumEntities = numEntities;
+        *outNumEntities = iter._pool->GetCount(state);
     }
     return iter;
 }
 
+EntityManager::Iterator EntityManager::GetIterator(EntityType type, int* outNumEntities) {
+    return MakeIterator(type, EntityPool::SlotState::Active, outNumEntities);
+}
+
+EntityManager::Iterator EntityManager::GetInactiveIterator(EntityType type, int* outNumEntities) {
+    return MakeIterator(type, EntityPool::SlotState::Inactive, outNumEntities);
+}
+
 bool EntityManager::Iterator::Finished() const {
-    return _current >= _end;
+    return _pool == nullptr || _ix >= _pool->GetCapacity();
 }
 
 Entity* EntityManager::Iterator::GetEntity() {
     assert(!Finished());
-    return _current;
+    return _pool->Get(_ix);
 }
 
 void EntityManager::Iterator::Next() {
     assert(!Finished());
-    char* p = (char*)_current;
-    p += _stride;
-    _current = (Entity*)p;
+    _ix = _pool->FindNext(_ix + 1, _state);
 }
 
 EntityManager::AllIterator EntityManager::GetAllIterator() {
@@ -702,7 +606,7 @@ void EntityManager::AllIterator::Next() {
 
 BaseEntity* EntityManager::AllIterator::GetEntity() {
     assert(!Finished());
-    return _typeIter._current;
+    return _typeIter.GetEntity();
 }
 
 void BaseEntity::Init(GameManager& g) {
@@ -711,6 +615,7 @@ void BaseEntity::Init(GameManager& g) {
     _model = g._scene->GetMesh(_modelName);
     _textureId = g._scene->GetTextureId(_textureName);
     _wpFollower.Init(g, *this, _wpProps);
+    _hasPrevTransform = false;
     InitDerived(g);
 }
 void BaseEntity::Update(GameManager& g, float dt) {
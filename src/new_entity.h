@@ -1,13 +1,15 @@
 #pragma once
 
-#include <unordered_map>
+#include <deque>
 #include <vector>
 #include <memory>
 #include <string_view>
 
 #include "new_entity_id.h"
 #include "editor_id.h"
+#include "entity_pool.h"
 #include "serial.h"
+#include "spatial_index.h"
 #include "transform.h"
 #include "waypoint_follower.h"
 
@@ -49,6 +51,10 @@ struct BaseEntity {
     unsigned int _textureId = 0;
     Vec4 _modelColor = Vec4(0.8f, 0.8f, 0.8f, 1.f);
     WaypointFollower _wpFollower;
+    // _transform as of the start of the latest sim tick. The game loop draws
+    // entities interpolated between this and _transform.
+    Transform _prevTransform;
+    bool _hasPrevTransform = false;
     
     void Save(serial::Ptree pt) const;
     void Load(serial::Ptree pt);
@@ -76,6 +82,9 @@ struct BaseEntity {
     
     virtual void Draw(GameManager& g, float dt);
 
+    // XZ half extents of the entity at unit scale, for types with a spatial
+    // index (see EntityManager::EnableSpatialIndex).
+    virtual void GetLocalFootprint(float* halfX, float* halfZ) const { *halfX = *halfZ = 0.5f; }
 
     virtual ImGuiResult MultiImGui(GameManager& g, BaseEntity** entities, size_t entityCount) { return ImGuiResult::Done; }
 
@@ -92,10 +101,18 @@ protected:
 typedef BaseEntity Entity;
 
 struct EntityManager {
+    // Destroyed entities' slots aren't reused until at least this many are
+    // free.
+    static constexpr int kMinFreeSlots = 1024;
+
     EntityManager();
     ~EntityManager();
 
     void Init();
+    // Entities never move once added, so an Entity* stays valid until that
+    // entity is destroyed. Reserve() just saves a few allocations while the
+    // level loads.
+    void Reserve(EntityType entityType, int numEntities);
     Entity* AddEntity(EntityType entityType) {
         return AddEntity(entityType, /*active=*/true);
     }
@@ -138,15 +155,24 @@ struct EntityManager {
 
     void GetEntitiesOfType(ne::EntityType entityType, bool includeActive, bool includeInactive, std::vector<Entity*>& entitiesOut);
 
-    // Iterates over all entities of a given type.
+    // Spatial queries over the active entities of a type. Types have to opt
+    // in; GetSpatialIndex() returns nullptr for the rest.
+    void EnableSpatialIndex(EntityType entityType, float cellSize = 8.f);
+    SpatialIndex* GetSpatialIndex(EntityType entityType) { return _spatialIndices[(int)entityType].get(); }
+    // Refits every enabled index to the entities' current transforms. Call
+    // once per sim tick.
+    void UpdateSpatialIndices();
+
+    // Iterates over all entities of a given type. Entities added while
+    // iterating may or may not be visited.
     struct Iterator {
         Entity* GetEntity();
         bool Finished() const;
         void Next();
     private:
-        Entity* _current = nullptr;
-        Entity* _end = nullptr;
-        std::size_t _stride = 0;
+        EntityPool* _pool = nullptr;
+        int _ix = 0;
+        EntityPool::SlotState _state = EntityPool::SlotState::Active;
         Iterator() {}
         friend EntityManager;
     };
@@ -170,13 +196,27 @@ struct EntityManager {
     AllIterator GetAllInactiveIterator();
 
 private:
-    struct MapEntry {
-        int _typeIx;
-        int _entityIx;
-        bool _active = true;
+    // Indexed by EntityId::GetSlot(). A slot only resolves IDs with its
+    // current _generation, which goes up every time the slot is freed.
+    // Whether the entity is active lives in its pool's SlotState.
+    struct Slot {
+        int _typeIx = -1;
+        int _entityIx = -1;
+        int _generation = 0;
     };
-    std::unordered_map<int, MapEntry> _entityIdMap;
-    int _nextId = 0;
+    std::vector<Slot> _slots;
+    // Freed slots, oldest first. Reusing them in FIFO order with a backlog
+    // of kMinFreeSlots spreads the generations out, so a stale ID needs a
+    // lot of churn before it could alias a live one.
+    std::deque<int> _freeSlots;
+    Slot* GetSlot(EntityId id) {
+        int const slotIx = id.GetSlot();
+        if (slotIx >= (int)_slots.size() || _slots[slotIx]._generation != id.GetGeneration()) {
+            return nullptr;
+        }
+        return &_slots[slotIx];
+    }
+    void FreeSlot(EntityId id);
     std::vector<EntityId> _toDestroy;
     std::vector<EntityId> _toDeactivate;
     // {entityId, initOnActivate}
@@ -185,8 +225,9 @@ private:
     struct Internal;
     std::unique_ptr<Internal> _p;
 
-    // THIS IS UNSAFE! CAN'T ITERATE OVER THIS LIKE YOU THINK
-    std::pair<Entity*, int> GetEntitiesOfType(EntityType entityType, bool active);
+    std::unique_ptr<SpatialIndex> _spatialIndices[gkNumEntityTypes];
+
+    Iterator MakeIterator(EntityType type, EntityPool::SlotState state, int* outNumEntities);
 
     struct EntityInfo {
         Entity* _e = nullptr;
@@ -196,7 +237,6 @@ private:
     EntityInfo GetEntityInfo(EntityId id, bool includeActive, bool includeInactive);
 
     // Returns true if the given ID was indeed found and deleted.
-    // Does not preserve ordering.
     // Does NOT call Destroy() on entity.
     bool RemoveEntity(EntityId idToRemove);
 
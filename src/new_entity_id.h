@@ -39,8 +39,20 @@ namespace ne {
         Count
     };
 
+    // _id packs the EntityManager slot the entity lives in (low bits) and
+    // that slot's generation (high bits). Slots get reused after their
+    // entity is destroyed, but with a new generation, so stale IDs stop
+    // resolving instead of finding whoever moved in.
     struct EntityId {
+        static constexpr int kSlotBits = 20;
+        static constexpr int kSlotMask = (1 << kSlotBits) - 1;
+        static constexpr int kGenerationMask = (1 << (31 - kSlotBits)) - 1;
+
         bool IsValid() const { return _id >= 0; }
+        int GetSlot() const { return _id & kSlotMask; }
+        int GetGeneration() const { return _id >> kSlotBits; }
+        static int Make(int slot, int generation) { return (generation << kSlotBits) | slot; }
+
         int _id = -1;
         EntityType _type;
         bool operator==(EntityId const& rhs) const {
@@ -2,6 +2,7 @@
 
 #include <renderer.h>
 #include <math_util.h>
+#include <logger.h>
 
 namespace {
 // returns true if swapped something else in
@@ -19,7 +20,7 @@ bool SwapRemove(Particle* particles, int* count, int removeIx) {
 
 Particle* ParticleMgr::SpawnParticle() {
     if (_particleCount >= MAX_PARTICLE_COUNT) {
-        printf("Ran out of particles!\n");
+        logger::Log("Ran out of particles!\n");
         return nullptr;
     }
     Particle* p = &_particles[_particleCount++];
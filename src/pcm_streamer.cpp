@@ -0,0 +1,174 @@
+#include "pcm_streamer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#include "sound_bank.h"
+
+namespace audio {
+
+namespace {
+
+static_assert((PcmStreamer::kRingFrames & (PcmStreamer::kRingFrames - 1)) == 0, "ring size must be a power of 2");
+uint64_t constexpr kRingMask = PcmStreamer::kRingFrames - 1;
+
+// How long the disk thread naps when every ring is full. A full ring holds
+// way more than this, so there's no risk of starving a voice.
+auto constexpr kDiskThreadSleep = std::chrono::milliseconds(2);
+
+}  // namespace
+
+void PcmStreamer::Init(SoundBank const& soundBank, int numSlots) {
+    _soundBank = &soundBank;
+    if (!soundBank.HasStreamedSounds()) {
+        return;
+    }
+    _numSlots = numSlots;
+    _slots = std::make_unique<Slot[]>(numSlots);
+    for (int i = 0; i < _numSlots; ++i) {
+        _slots[i]._ring = new float[kRingFrames];
+    }
+    _quit = false;
+    _diskThread = std::thread(&PcmStreamer::DiskThreadLoop, this);
+}
+
+void PcmStreamer::Destroy() {
+    if (_diskThread.joinable()) {
+        _quit.store(true, std::memory_order_release);
+        _diskThread.join();
+    }
+    for (int i = 0; i < _numSlots; ++i) {
+        CloseWav(_slots[i]);
+        delete[] _slots[i]._ring;
+    }
+    _slots.reset();
+    _numSlots = 0;
+}
+
+void PcmStreamer::Start(int slotIx, int soundIx, bool loop) {
+    if (slotIx >= _numSlots) {
+        return;
+    }
+    Slot& slot = _slots[slotIx];
+    slot._requestSoundIx.store(soundIx, std::memory_order_relaxed);
+    slot._requestLoop.store(loop, std::memory_order_relaxed);
+    slot._audioGen = slot._requestGen.fetch_add(1, std::memory_order_release) + 1;
+    slot._skipFrames = 0;
+}
+
+void PcmStreamer::Stop(int slotIx) {
+    Start(slotIx, -1, false);
+}
+
+int PcmStreamer::ReadFrames(int slotIx, float* out, int numFrames) {
+    if (slotIx < 0 || slotIx >= _numSlots) {
+        memset(out, 0, numFrames * sizeof(float));
+        return 0;
+    }
+    Slot& slot = _slots[slotIx];
+    if (slot._filledGen.load(std::memory_order_acquire) != slot._audioGen) {
+        // Disk thread hasn't even seen this request yet.
+        slot._skipFrames += numFrames;
+        memset(out, 0, numFrames * sizeof(float));
+        return 0;
+    }
+    uint64_t readIx = slot._readIx.load(std::memory_order_relaxed);
+    uint64_t const writeIx = slot._writeIx.load(std::memory_order_acquire);
+    if (slot._skipFrames > 0) {
+        uint64_t skip = std::min(slot._skipFrames, writeIx - readIx);
+        readIx += skip;
+        slot._skipFrames -= skip;
+    }
+    int const numAvailable = static_cast<int>(std::min<uint64_t>(numFrames, writeIx - readIx));
+    // At most two copies: up to the end of the ring, then from its start.
+    int const ringPos = static_cast<int>(readIx & kRingMask);
+    int const firstCopy = std::min(numAvailable, kRingFrames - ringPos);
+    memcpy(out, slot._ring + ringPos, firstCopy * sizeof(float));
+    memcpy(out + firstCopy, slot._ring, (numAvailable - firstCopy) * sizeof(float));
+    readIx += numAvailable;
+    if (numAvailable < numFrames) {
+        memset(out + numAvailable, 0, (numFrames - numAvailable) * sizeof(float));
+        slot._skipFrames += numFrames - numAvailable;
+    }
+    slot._readIx.store(readIx, std::memory_order_release);
+    return numAvailable;
+}
+
+void PcmStreamer::CloseWav(Slot& slot) {
+    if (slot._wavOpen) {
+        drwav_uninit(&slot._wav);
+        slot._wavOpen = false;
+    }
+}
+
+bool PcmStreamer::ServiceSlot(Slot& slot) {
+    uint32_t const requestGen = slot._requestGen.load(std::memory_order_acquire);
+    if (requestGen != slot._diskGen) {
+        // New request. The audio thread won't touch the ring until we bump
+        // _filledGen, so it's safe to reset it here.
+        slot._diskGen = requestGen;
+        slot._soundIx = slot._requestSoundIx.load(std::memory_order_relaxed);
+        slot._loop = slot._requestLoop.load(std::memory_order_relaxed);
+        CloseWav(slot);
+        if (slot._soundIx >= 0) {
+            PcmSound const& sound = _soundBank->_sounds[slot._soundIx];
+            assert(sound._streamed);
+            std::string const& path = _soundBank->_soundPaths[slot._soundIx];
+            if (drwav_init_file(&slot._wav, path.c_str(), NULL)) {
+                slot._wavOpen = true;
+                drwav_seek_to_pcm_frame(&slot._wav, sound._residentLength);
+            } else {
+                printf("PcmStreamer: failed to open \"%s\"\n", path.c_str());
+            }
+        }
+        slot._writeIx.store(slot._readIx.load(std::memory_order_acquire), std::memory_order_relaxed);
+        slot._filledGen.store(requestGen, std::memory_order_release);
+    }
+
+    if (!slot._wavOpen) {
+        return false;
+    }
+
+    uint64_t writeIx = slot._writeIx.load(std::memory_order_relaxed);
+    uint64_t const readIx = slot._readIx.load(std::memory_order_acquire);
+    uint64_t const freeFrames = kRingFrames - (writeIx - readIx);
+    if (freeFrames < kReadChunkFrames) {
+        return false;
+    }
+
+    // Don't wrap inside a single read; just do the part up to the end of the ring.
+    uint64_t const ringIx = writeIx & kRingMask;
+    uint64_t const numFrames = std::min<uint64_t>(kReadChunkFrames, kRingFrames - ringIx);
+    drwav_uint64 framesRead = drwav_read_pcm_frames_f32(&slot._wav, numFrames, slot._ring + ringIx);
+    writeIx += framesRead;
+    slot._writeIx.store(writeIx, std::memory_order_release);
+
+    if (framesRead < numFrames) {
+        // End of file. Looping voices go back to the start of the resident
+        // head in memory, so we pick up right after it again.
+        if (slot._loop) {
+            PcmSound const& sound = _soundBank->_sounds[slot._soundIx];
+            drwav_seek_to_pcm_frame(&slot._wav, sound._residentLength);
+        } else {
+            CloseWav(slot);
+        }
+    }
+    return framesRead > 0;
+}
+
+void PcmStreamer::DiskThreadLoop() {
+    while (!_quit.load(std::memory_order_acquire)) {
+        bool didWork = false;
+        for (int i = 0; i < _numSlots; ++i) {
+            didWork |= ServiceSlot(_slots[i]);
+        }
+        if (!didWork) {
+            std::this_thread::sleep_for(kDiskThreadSleep);
+        }
+    }
+}
+
+}  // namespace audio
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+#include "dr_wav.h"
+
+class SoundBank;
+
+namespace audio {
+
+// Streams the non-resident tail of long PCM sounds (PcmSound::_streamed) from
+// disk into a fixed set of slots, one ring buffer each. A voice playing a
+// streamed sound holds a slot; it plays the resident head of the sound out of
+// memory while the disk thread fills the slot's ring with whatever comes
+// after the head, so starting a streamed sound never waits on disk.
+//
+// Start/Stop/ReadFrames are audio thread only and never block. Everything
+// that touches files happens on the disk thread.
+class PcmStreamer {
+public:
+    static int constexpr kRingFrames = 1 << 15;  // ~0.7s at 48kHz
+    static int constexpr kReadChunkFrames = 4096;
+
+    // Only starts the disk thread if the sound bank has any streamed sounds.
+    void Init(SoundBank const& soundBank, int numSlots);
+    void Destroy();
+
+    // Audio thread.
+    void Start(int slotIx, int soundIx, bool loop);
+    void Stop(int slotIx);
+    // Copies up to numFrames frames into out and zeroes the rest. Frames the
+    // disk thread hasn't caught up with are still counted as played, so the
+    // voice stays in sync once data shows up. Returns the number of real
+    // frames copied.
+    int ReadFrames(int slotIx, float* out, int numFrames);
+
+private:
+    struct Slot {
+        // Audio thread -> disk thread.
+        std::atomic<uint32_t> _requestGen = 0;
+        std::atomic<int> _requestSoundIx = -1;
+        std::atomic<bool> _requestLoop = false;
+
+        // Ring. Indices count frames forever and get masked on access.
+        // _writeIx is owned by the disk thread, _readIx by the audio thread.
+        float* _ring = nullptr;
+        std::atomic<uint64_t> _writeIx = 0;
+        std::atomic<uint64_t> _readIx = 0;
+        // Which request the ring's contents belong to.
+        std::atomic<uint32_t> _filledGen = 0;
+
+        // Audio thread only.
+        uint32_t _audioGen = 0;
+        uint64_t _skipFrames = 0;
+
+        // Disk thread only.
+        uint32_t _diskGen = 0;
+        int _soundIx = -1;
+        bool _loop = false;
+        bool _wavOpen = false;
+        drwav _wav;
+    };
+
+    void DiskThreadLoop();
+    // Returns true if it wrote anything.
+    bool ServiceSlot(Slot& slot);
+    void CloseWav(Slot& slot);
+
+    SoundBank const* _soundBank = nullptr;
+    std::unique_ptr<Slot[]> _slots;
+    int _numSlots = 0;
+    std::thread _diskThread;
+    std::atomic<bool> _quit = false;
+};
+
+}  // namespace audio
@@ -0,0 +1,239 @@
+#include "resampler.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <numeric>
+
+#include "samplerate.h"
+
+#include "logger.h"
+
+namespace audio {
+
+namespace {
+
+// Input frames each output frame looks at. With the Kaiser window below that's
+// a ~3kHz transition band at 48kHz and ~70dB of stopband.
+int constexpr kPolyphaseTaps = 64;
+double constexpr kKaiserBeta = 7.0;
+// Passband edge as a fraction of the lower of the two Nyquist rates.
+double constexpr kPassbandFraction = 0.92;
+
+// Past this many phases the coefficient table gets silly (44.1k -> 48k is
+// 147, and a rate like 44056 would be 5507).
+int constexpr kMaxPolyphasePhases = 1024;
+
+double const kPi = 3.14159265358979323846;
+
+// Zeroth-order modified Bessel function of the first kind, for the Kaiser window.
+double BesselI0(double x) {
+    double sum = 1.0;
+    double term = 1.0;
+    double const halfX = 0.5 * x;
+    for (int k = 1; k < 50; ++k) {
+        term *= (halfX / k) * (halfX / k);
+        sum += term;
+        if (term < 1e-12 * sum) {
+            break;
+        }
+    }
+    return sum;
+}
+
+}  // namespace
+
+void Resampler::Init(int inputRate, int outputRate, int numChannels, int renderFrames, int maxOutputFrames, ResampleMode mode) {
+    _mode = mode;
+    _numChannels = numChannels;
+    _renderFrames = renderFrames;
+
+    int const g = std::gcd(inputRate, outputRate);
+    _upFactor = outputRate / g;
+    _downFactor = inputRate / g;
+    if (_mode == ResampleMode::Polyphase && _upFactor > kMaxPolyphasePhases) {
+        printf("Resampler: %d -> %d doesn't reduce to a small enough ratio for polyphase. Using sinc.\n", inputRate, outputRate);
+        _mode = ResampleMode::Sinc;
+    }
+
+    // Enough room for one Process() worth of input plus the filter's history
+    // plus the chunk we're about to render, rounded up to whole chunks.
+    int const maxInputPerProcess = static_cast<int>(std::ceil(static_cast<double>(maxOutputFrames) * inputRate / outputRate)) + 1;
+    int const minRingFrames = maxInputPerProcess + kPolyphaseTaps + 2 * renderFrames;
+    _ringFrames = renderFrames * ((minRingFrames + renderFrames - 1) / renderFrames);
+    _guardFrames = kPolyphaseTaps - 1;
+    _storage.assign(static_cast<size_t>(_guardFrames + _ringFrames) * numChannels, 0.f);
+    _writeFrameIx = 0;
+    _readFrameIx = 0;
+    _phase = 0;
+
+    if (_mode == ResampleMode::Polyphase) {
+        // Windowed-sinc lowpass at the upsampled rate (inputRate * L), cut
+        // off below the lower Nyquist. Row p of the table is every L'th tap
+        // starting at p, reversed so it lines up with the input frames in
+        // memory order.
+        int const numProtoTaps = kPolyphaseTaps * _upFactor;
+        double const upRate = static_cast<double>(inputRate) * _upFactor;
+        double const cutoff = kPassbandFraction * 0.5 * std::min(inputRate, outputRate) / upRate;
+        double const center = 0.5 * (numProtoTaps - 1);
+        double const windowNorm = 1.0 / BesselI0(kKaiserBeta);
+        std::vector<double> proto(numProtoTaps);
+        for (int n = 0; n < numProtoTaps; ++n) {
+            double const t = n - center;
+            double const sinc = (t == 0.0) ? 2.0 * cutoff : std::sin(2.0 * kPi * cutoff * t) / (kPi * t);
+            double const r = 2.0 * n / (numProtoTaps - 1) - 1.0;
+            double const window = BesselI0(kKaiserBeta * std::sqrt(std::max(0.0, 1.0 - r * r))) * windowNorm;
+            proto[n] = sinc * window;
+        }
+        _coeffs.resize(static_cast<size_t>(_upFactor) * kPolyphaseTaps);
+        for (int p = 0; p < _upFactor; ++p) {
+            // Unity gain at DC for every phase, so a constant input comes out
+            // constant.
+            double rowSum = 0.0;
+            for (int k = 0; k < kPolyphaseTaps; ++k) {
+                rowSum += proto[p + k * _upFactor];
+            }
+            float* row = &_coeffs[static_cast<size_t>(p) * kPolyphaseTaps];
+            for (int k = 0; k < kPolyphaseTaps; ++k) {
+                row[kPolyphaseTaps - 1 - k] = static_cast<float>(proto[p + k * _upFactor] / rowSum);
+            }
+        }
+    } else {
+        int srcErr = 0;
+        _srcState = src_new(SRC_SINC_FASTEST, numChannels, &srcErr);
+        if (srcErr) {
+            printf("Audio error in creating SRC state: %s\n", src_strerror(srcErr));
+        }
+        _srcRatio = static_cast<double>(outputRate) / inputRate;
+    }
+}
+
+void Resampler::Destroy() {
+    if (_srcState != nullptr) {
+        src_delete(_srcState);
+        _srcState = nullptr;
+    }
+    _storage.clear();
+    _coeffs.clear();
+}
+
+int Resampler::GetBufferedInputFrames() const {
+    return static_cast<int>(_writeFrameIx - _readFrameIx);
+}
+
+float const* Resampler::GetFrame(int64_t frameIx) const {
+    // frameIx can be a little negative (silence before the first chunk) and
+    // can be up to _guardFrames from the end of the ring, in which case we
+    // start in the guard copy and keep reading contiguously into the ring.
+    int64_t pos = frameIx % _ringFrames;
+    if (pos < 0) {
+        pos += _ringFrames;
+    }
+    if (pos > _ringFrames - kPolyphaseTaps) {
+        pos -= _ringFrames;
+    }
+    assert(pos >= -_guardFrames);
+    return &_storage[static_cast<size_t>(_guardFrames + pos) * _numChannels];
+}
+
+bool Resampler::CanWriteChunk() const {
+    int64_t const oldestNeededIx = (_mode == ResampleMode::Polyphase) ? _readFrameIx - (kPolyphaseTaps - 1) : _readFrameIx;
+    return _writeFrameIx + _renderFrames - oldestNeededIx <= _ringFrames;
+}
+
+float* Resampler::GetWriteChunk() {
+    int64_t const pos = _writeFrameIx % _ringFrames;
+    return &_storage[static_cast<size_t>(_guardFrames + pos) * _numChannels];
+}
+
+void Resampler::CommitWriteChunk() {
+    _writeFrameIx += _renderFrames;
+    if (_writeFrameIx % _ringFrames == 0) {
+        // Just finished a lap: refresh the guard with the ring's tail.
+        size_t const guardSize = static_cast<size_t>(_guardFrames) * _numChannels;
+        memcpy(_storage.data(), _storage.data() + static_cast<size_t>(_ringFrames) * _numChannels, guardSize * sizeof(float));
+    }
+}
+
+void Resampler::OnUnderrun(float* output, int numFrames) {
+    memset(output, 0, sizeof(float) * numFrames * _numChannels);
+    logger::Log("Resampler: ran out of input, %d frames of silence\n", numFrames);
+}
+
+int Resampler::ProduceFromBuffered(float* output, int numFrames) {
+    if (numFrames <= 0) {
+        return 0;
+    }
+    return _mode == ResampleMode::Polyphase ? ProducePolyphase(output, numFrames) : ProduceSinc(output, numFrames);
+}
+
+int Resampler::ProducePolyphase(float* output, int numFrames) {
+    int numDone = 0;
+    for (; numDone < numFrames && _readFrameIx < _writeFrameIx; ++numDone) {
+        float const* row = &_coeffs[static_cast<size_t>(_phase) * kPolyphaseTaps];
+        float const* in = GetFrame(_readFrameIx - (kPolyphaseTaps - 1));
+        float* out = output + numDone * _numChannels;
+        if (_numChannels == 1) {
+            float acc0 = 0.f, acc1 = 0.f, acc2 = 0.f, acc3 = 0.f;
+            for (int k = 0; k < kPolyphaseTaps; k += 4) {
+                acc0 += row[k] * in[k];
+                acc1 += row[k + 1] * in[k + 1];
+                acc2 += row[k + 2] * in[k + 2];
+                acc3 += row[k + 3] * in[k + 3];
+            }
+            out[0] = (acc0 + acc1) + (acc2 + acc3);
+        } else if (_numChannels == 2) {
+            float accL0 = 0.f, accL1 = 0.f, accR0 = 0.f, accR1 = 0.f;
+            for (int k = 0; k < kPolyphaseTaps; k += 2) {
+                accL0 += row[k] * in[2 * k];
+                accR0 += row[k] * in[2 * k + 1];
+                accL1 += row[k + 1] * in[2 * k + 2];
+                accR1 += row[k + 1] * in[2 * k + 3];
+            }
+            out[0] = accL0 + accL1;
+            out[1] = accR0 + accR1;
+        } else {
+            for (int c = 0; c < _numChannels; ++c) {
+                float acc = 0.f;
+                for (int k = 0; k < kPolyphaseTaps; ++k) {
+                    acc += row[k] * in[k * _numChannels + c];
+                }
+                out[c] = acc;
+            }
+        }
+
+        _phase += _downFactor;
+        _readFrameIx += _phase / _upFactor;
+        _phase %= _upFactor;
+    }
+    return numDone;
+}
+
+int Resampler::ProduceSinc(float* output, int numFrames) {
+    int numDone = 0;
+    while (numDone < numFrames) {
+        int64_t const pos = _readFrameIx % _ringFrames;
+        int64_t const numContiguous = std::min(_writeFrameIx - _readFrameIx, _ringFrames - pos);
+        SRC_DATA data = {0};
+        data.data_in = &_storage[static_cast<size_t>(_guardFrames + pos) * _numChannels];
+        data.input_frames = static_cast<long>(numContiguous);
+        data.data_out = output + numDone * _numChannels;
+        data.output_frames = numFrames - numDone;
+        data.src_ratio = _srcRatio;
+        int const srcErr = src_process(_srcState, &data);
+        if (srcErr) {
+            logger::Log("Audio error: src_process error: %s\n", src_strerror(srcErr));
+            break;
+        }
+        _readFrameIx += data.input_frames_used;
+        numDone += static_cast<int>(data.output_frames_gen);
+        if (data.input_frames_used == 0 && data.output_frames_gen == 0) {
+            break;
+        }
+    }
+    return numDone;
+}
+
+}  // namespace audio
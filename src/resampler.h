@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+typedef struct SRC_STATE_tag SRC_STATE;
+
+namespace audio {
+
+enum class ResampleMode {
+    // Windowed-sinc FIR split into one filter per output phase. Needs the
+    // output/input ratio to reduce to a fraction with a small numerator
+    // (44.1k, 96k, 32k, ... all do); anything else falls back to Sinc.
+    Polyphase,
+    // libsamplerate's SRC_SINC_FASTEST. Any ratio, more CPU.
+    Sinc
+};
+
+// Converts the engine's output (rendered in fixed-size chunks at the internal
+// rate) to the device rate.
+//
+// Rendered chunks go straight into a ring, and the resampler reads its taps
+// out of the ring in place. The ring is a whole number of chunks long so a
+// chunk never wraps. For polyphase, the ratio reduces to L/M at Init, and an
+// integer phase accumulator decides exactly when the next chunk is needed,
+// so no float rounding from callback to callback.
+class Resampler {
+public:
+    // maxOutputFrames is the largest Process() request we'll ever see.
+    void Init(int inputRate, int outputRate, int numChannels, int renderFrames, int maxOutputFrames, ResampleMode mode);
+    void Destroy();
+
+    // Fills numFrames frames of output, calling render(float* chunk) to
+    // render renderFrames more input frames whenever it runs out.
+    template <typename RenderFn>
+    void Process(float* output, int numFrames, RenderFn&& render) {
+        int numDone = 0;
+        while (true) {
+            numDone += ProduceFromBuffered(output + numDone * _numChannels, numFrames - numDone);
+            if (numDone >= numFrames || !CanWriteChunk()) {
+                break;
+            }
+            render(GetWriteChunk());
+            CommitWriteChunk();
+        }
+        if (numDone < numFrames) {
+            OnUnderrun(output + numDone * _numChannels, numFrames - numDone);
+        }
+    }
+
+    // Input frames rendered but not yet played.
+    int GetBufferedInputFrames() const;
+
+    ResampleMode GetMode() const { return _mode; }
+
+private:
+    int ProduceFromBuffered(float* output, int numFrames);
+    int ProducePolyphase(float* output, int numFrames);
+    int ProduceSinc(float* output, int numFrames);
+    bool CanWriteChunk() const;
+    float* GetWriteChunk();
+    void CommitWriteChunk();
+    void OnUnderrun(float* output, int numFrames);
+    float const* GetFrame(int64_t frameIx) const;
+
+    ResampleMode _mode = ResampleMode::Polyphase;
+    int _numChannels = 1;
+    int _renderFrames = 0;
+
+    // Interleaved. The first _guardFrames frames mirror the last ones of the
+    // ring so a filter can read back across the wrap point contiguously.
+    std::vector<float> _storage;
+    int _ringFrames = 0;
+    int _guardFrames = 0;
+    int64_t _writeFrameIx = 0;  // input frames rendered so far
+
+    // Polyphase. Output frame j is centered on input frame j * M / L; _readFrameIx
+    // and _phase hold that position for the next output frame.
+    int _upFactor = 1;    // L
+    int _downFactor = 1;  // M
+    std::vector<float> _coeffs;  // _upFactor rows of kPolyphaseTaps, reversed
+    int64_t _readFrameIx = 0;
+    int _phase = 0;
+
+    // Sinc.
+    SRC_STATE* _srcState = nullptr;
+    double _srcRatio = 1.0;
+};
+
+}  // namespace audio
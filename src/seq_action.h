@@ -50,6 +50,11 @@ struct SeqAction {
     }
     virtual void ExecuteRelease(GameManager& g) {}
 
+    // True if all Execute() does is send audio events relative to "now".
+    // ActionSequencer runs these ahead of time with
+    // audio::Context::_scheduleAudioTime set, so they land exactly on the beat.
+    virtual bool IsAudioOnly() const { return false; }
+
     virtual ~SeqAction() {}
 
     static void LoadAndInitActions(GameManager& g, std::istream& input, std::vector<BeatTimeAction>& actions);
@@ -5,6 +5,7 @@
 
 struct ChangePatchSeqAction : public SeqAction {
     virtual SeqActionType Type() const override { return SeqActionType::ChangePatch; }
+    virtual bool IsAudioOnly() const override { return true; }
 
     struct Props {
         int _channelIx = 0;
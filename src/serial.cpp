@@ -2,7 +2,9 @@
 
 #include <fstream>
 #include <cassert>
+#include <cstring>
 
+#include "serial_binary.h"
 #include "tinyxml2/tinyxml2.h"
 
 using namespace tinyxml2;
@@ -16,25 +18,69 @@ namespace {
     XMLDocument* GetDoc(void* p) {
         return (XMLDocument*)p;
     }
+    binary::Node* GetNode(void* p) {
+        return (binary::Node*)p;
+    }
+
+    // Picks the narrowest type that prints back to exactly this text, so the
+    // binary tree gives the same answer as the XML one for every Get.
+    void SetInferredValue(binary::Doc* doc, binary::Node* node, char const* text) {
+        char buffer[64];
+        int i;
+        int64_t i64;
+        float f;
+        double d;
+        if (strcmp(text, "true") == 0 || strcmp(text, "false") == 0) {
+            binary::SetBool(node, text[0] == 't');
+        } else if (XMLUtil::ToInt(text, &i) && (XMLUtil::ToStr(i, buffer, sizeof(buffer)), strcmp(buffer, text) == 0)) {
+            binary::SetInt(node, i);
+        } else if (XMLUtil::ToInt64(text, &i64) && (XMLUtil::ToStr(i64, buffer, sizeof(buffer)), strcmp(buffer, text) == 0)) {
+            binary::SetInt64(node, i64);
+        } else if (XMLUtil::ToFloat(text, &f) && (XMLUtil::ToStr(f, buffer, sizeof(buffer)), strcmp(buffer, text) == 0)) {
+            binary::SetFloat(node, f);
+        } else if (XMLUtil::ToDouble(text, &d) && (XMLUtil::ToStr(d, buffer, sizeof(buffer)), strcmp(buffer, text) == 0)) {
+            binary::SetDouble(node, d);
+        } else {
+            binary::SetString(doc, node, text);
+        }
+    }
 
     int const kBinaryVersion = 14;
 }
 
+Format FormatForFilename(char const* filename) {
+    size_t const length = strlen(filename);
+    char const kExtension[] = ".bser";
+    size_t const extLength = sizeof(kExtension) - 1;
+    if (length >= extLength && strcmp(filename + length - extLength, kExtension) == 0) {
+        return Format::Binary;
+    }
+    return Format::Xml;
+}
+
 Ptree Ptree::AddChild(char const* name) {
     assert(IsValid());
-    XMLElement *internalChildPt = GetInternal(_internal)->InsertNewChildElement(name);
     Ptree childPt;
-    childPt._internal = (void*)(internalChildPt);
+    if (_binaryDoc) {
+        childPt._internal = (void*)binary::AddChild(_binaryDoc, GetNode(_internal), name);
+    } else {
+        childPt._internal = (void*)GetInternal(_internal)->InsertNewChildElement(name);
+    }
     childPt._version = _version;
+    childPt._binaryDoc = _binaryDoc;
     return childPt;
 }
 
 Ptree Ptree::GetChild(char const* name) {
     assert(IsValid());
-    XMLElement *internalChildPt = GetInternal(_internal)->FirstChildElement(name);
     Ptree childPt;
-    childPt._internal = (void*)(internalChildPt);
+    if (_binaryDoc) {
+        childPt._internal = (void*)binary::FindChild(GetNode(_internal), name);
+    } else {
+        childPt._internal = (void*)GetInternal(_internal)->FirstChildElement(name);
+    }
     childPt._version = _version;
+    childPt._binaryDoc = _binaryDoc;
     return childPt;
 }
 
@@ -44,9 +90,18 @@ Ptree Ptree::TryGetChild(char const* name) {
 
 void Ptree::PutString(char const* name, char const* v) {
     assert(IsValid());
+    if (_binaryDoc) {
+        binary::SetString(_binaryDoc, binary::AddChild(_binaryDoc, GetNode(_internal), name), v);
+        return;
+    }
     GetInternal(_internal)->InsertNewChildElement(name)->SetText(v);
 }
 std::string Ptree::GetString(char const* name) {
+    if (_binaryDoc) {
+        char buffer[64];
+        char const* text = binary::GetText(binary::FindChild(GetNode(_internal), name), buffer, sizeof(buffer));
+        return text ? std::string(text) : std::string();
+    }
     XMLElement *element = GetInternal(_internal)->FirstChildElement(name);
     char const *text = element->GetText();
     if (text) {
@@ -57,6 +112,16 @@ std::string Ptree::GetString(char const* name) {
 }
 bool Ptree::TryGetString(char const* name, std::string* v) {
     assert(IsValid());
+    if (_binaryDoc) {
+        binary::Node const* node = binary::FindChild(GetNode(_internal), name);
+        if (node == nullptr) {
+            return false;
+        }
+        char buffer[64];
+        char const* text = binary::GetText(node, buffer, sizeof(buffer));
+        *v = text ? std::string(text) : std::string();
+        return true;
+    }
     XMLElement *e = GetInternal(_internal)->FirstChildElement(name);
     if (e) {
         if (e->GetText()) {
@@ -71,14 +136,28 @@ bool Ptree::TryGetString(char const* name, std::string* v) {
 
 void Ptree::PutBool(char const* name, bool b) {
     assert(IsValid());
+    if (_binaryDoc) {
+        binary::SetBool(binary::AddChild(_binaryDoc, GetNode(_internal), name), b);
+        return;
+    }
     GetInternal(_internal)->InsertNewChildElement(name)->SetText(b);
 }
 bool Ptree::GetBool(char const* name) {
     assert(IsValid());
+    if (_binaryDoc) {
+        return binary::GetBool(binary::FindChild(GetNode(_internal), name));
+    }
     return GetInternal(_internal)->FirstChildElement(name)->BoolText();
 }
 bool Ptree::TryGetBool(char const* name, bool* v) {
     assert(IsValid());
+    if (_binaryDoc) {
+        if (binary::Node const* node = binary::FindChild(GetNode(_internal), name)) {
+            *v = binary::GetBool(node);
+            return true;
+        }
+        return false;
+    }
     XMLElement *e = GetInternal(_internal)->FirstChildElement(name);
     if (e) {
         *v = e->BoolText();
@@ -88,12 +167,20 @@ bool Ptree::TryGetBool(char const* name, bool* v) {
 }
 
 void Ptree::PutChar(char const* name, char v) {
-    assert(IsValid());
     char buf[2] = { v, '\0' };
-    GetInternal(_internal)->InsertNewChildElement(name)->SetText(buf);
+    PutString(name, buf);
 }
 bool Ptree::TryGetChar(char const* name, char* v) {
     assert(IsValid());
+    if (_binaryDoc) {
+        binary::Node const* node = binary::FindChild(GetNode(_internal), name);
+        if (node == nullptr) {
+            return false;
+        }
+        char buffer[64];
+        *v = binary::GetText(node, buffer, sizeof(buffer))[0];
+        return true;
+    }
     XMLElement *e = GetInternal(_internal)->FirstChildElement(name);
     if (e) {
         char const* text = e->GetText();
@@ -105,14 +192,28 @@ bool Ptree::TryGetChar(char const* name, char* v) {
 
 void Ptree::PutInt(char const* name, int v) {
     assert(IsValid());
+    if (_binaryDoc) {
+        binary::SetInt(binary::AddChild(_binaryDoc, GetNode(_internal), name), v);
+        return;
+    }
     GetInternal(_internal)->InsertNewChildElement(name)->SetText(v);;
 }
 int Ptree::GetInt(char const* name) {
     assert(IsValid());
+    if (_binaryDoc) {
+        return binary::GetInt(binary::FindChild(GetNode(_internal), name));
+    }
     return GetInternal(_internal)->FirstChildElement(name)->IntText();
 }
 bool Ptree::TryGetInt(char const* name, int* v) {
     assert(IsValid());
+    if (_binaryDoc) {
+        if (binary::Node const* node = binary::FindChild(GetNode(_internal), name)) {
+            *v = binary::GetInt(node);
+            return true;
+        }
+        return false;
+    }
     if (XMLElement *e = GetInternal(_internal)->FirstChildElement(name)) {
         *v = e->IntText();
         return true;
@@ -122,14 +223,28 @@ bool Ptree::TryGetInt(char const* name, int* v) {
 
 void Ptree::PutInt64(char const* name, int64_t v) {
     assert(IsValid());
+    if (_binaryDoc) {
+        binary::SetInt64(binary::AddChild(_binaryDoc, GetNode(_internal), name), v);
+        return;
+    }
     GetInternal(_internal)->InsertNewChildElement(name)->SetText(v);
 }
 int64_t Ptree::GetInt64(char const* name) {
     assert(IsValid());
+    if (_binaryDoc) {
+        return binary::GetInt64(binary::FindChild(GetNode(_internal), name));
+    }
     return GetInternal(_internal)->FirstChildElement(name)->Int64Text();
 }
 bool Ptree::TryGetInt64(char const* name, int64_t* v) {
     assert(IsValid());
+    if (_binaryDoc) {
+        if (binary::Node const* node = binary::FindChild(GetNode(_internal), name)) {
+            *v = binary::GetInt64(node);
+            return true;
+        }
+        return false;
+    }
     if (XMLElement *e = GetInternal(_internal)->FirstChildElement(name)) {
         *v = e->Int64Text();
         return true;
@@ -139,14 +254,28 @@ bool Ptree::TryGetInt64(char const* name, int64_t* v) {
 
 void Ptree::PutFloat(char const* name, float v) {
     assert(IsValid());
+    if (_binaryDoc) {
+        binary::SetFloat(binary::AddChild(_binaryDoc, GetNode(_internal), name), v);
+        return;
+    }
     GetInternal(_internal)->InsertNewChildElement(name)->SetText(v);
 }
 float Ptree::GetFloat(char const* name) {
     assert(IsValid());
+    if (_binaryDoc) {
+        return binary::GetFloat(binary::FindChild(GetNode(_internal), name));
+    }
     return GetInternal(_internal)->FirstChildElement(name)->FloatText();
 }
 bool Ptree::TryGetFloat(char const* name, float* v) {
     assert(IsValid());
+    if (_binaryDoc) {
+        if (binary::Node const* node = binary::FindChild(GetNode(_internal), name)) {
+            *v = binary::GetFloat(node);
+            return true;
+        }
+        return false;
+    }
     if (XMLElement *e = GetInternal(_internal)->FirstChildElement(name)) {
         *v = e->FloatText();
         return true;
@@ -156,14 +285,28 @@ bool Ptree::TryGetFloat(char const* name, float* v) {
 
 void Ptree::PutDouble(char const* name, double v) {
     assert(IsValid());
+    if (_binaryDoc) {
+        binary::SetDouble(binary::AddChild(_binaryDoc, GetNode(_internal), name), v);
+        return;
+    }
     GetInternal(_internal)->InsertNewChildElement(name)->SetText(v);
 }
 double Ptree::GetDouble(char const* name) {
     assert(IsValid());
+    if (_binaryDoc) {
+        return binary::GetDouble(binary::FindChild(GetNode(_internal), name));
+    }
     return GetInternal(_internal)->FirstChildElement(name)->DoubleText();
 }
 bool Ptree::TryGetDouble(char const* name, double* v) {
     assert(IsValid());
+    if (_binaryDoc) {
+        if (binary::Node const* node = binary::FindChild(GetNode(_internal), name)) {
+            *v = binary::GetDouble(node);
+            return true;
+        }
+        return false;
+    }
     if (XMLElement *e = GetInternal(_internal)->FirstChildElement(name)) {
         *v = e->DoubleText();
         return true;
@@ -173,66 +316,126 @@ bool Ptree::TryGetDouble(char const* name, double* v) {
 
 void Ptree::PutStringValue(char const* value) {
     assert(IsValid());
+    if (_binaryDoc) {
+        binary::SetString(_binaryDoc, GetNode(_internal), value);
+        return;
+    }
     GetInternal(_internal)->SetText(value);
 }
 
 void Ptree::PutIntValue(int value) {
     assert(IsValid());
+    if (_binaryDoc) {
+        binary::SetInt(GetNode(_internal), value);
+        return;
+    }
     GetInternal(_internal)->SetText(value);
 }
 
 void Ptree::PutInt64Value(int64_t value) {
     assert(IsValid());
+    if (_binaryDoc) {
+        binary::SetInt64(GetNode(_internal), value);
+        return;
+    }
     GetInternal(_internal)->SetText(value);
 }
 
 void Ptree::PutBoolValue(bool value) {
     assert(IsValid());
+    if (_binaryDoc) {
+        binary::SetBool(GetNode(_internal), value);
+        return;
+    }
     GetInternal(_internal)->SetText(value);
 }
 
 void Ptree::PutFloatValue(float value) {
     assert(IsValid());
+    if (_binaryDoc) {
+        binary::SetFloat(GetNode(_internal), value);
+        return;
+    }
     GetInternal(_internal)->SetText(value);
 }
 
 void Ptree::PutDoubleValue(double value) {
     assert(IsValid());
+    if (_binaryDoc) {
+        binary::SetDouble(GetNode(_internal), value);
+        return;
+    }
     GetInternal(_internal)->SetText(value);
 }
 
 std::string Ptree::GetStringValue() {
     assert(IsValid());
+    if (_binaryDoc) {
+        char buffer[64];
+        char const* text = binary::GetText(GetNode(_internal), buffer, sizeof(buffer));
+        return text ? std::string(text) : std::string();
+    }
     return GetInternal(_internal)->GetText();
 }
 
 int Ptree::GetIntValue() {
     assert(IsValid());
+    if (_binaryDoc) {
+        return binary::GetInt(GetNode(_internal));
+    }
     return GetInternal(_internal)->IntText();
 }
 
 int64_t Ptree::GetInt64Value() {
     assert(IsValid());
+    if (_binaryDoc) {
+        return binary::GetInt64(GetNode(_internal));
+    }
     return GetInternal(_internal)->Int64Text();
 }
 
 bool Ptree::GetBoolValue() {
     assert(IsValid());
+    if (_binaryDoc) {
+        return binary::GetBool(GetNode(_internal));
+    }
     return GetInternal(_internal)->BoolText();
 }
 
 float Ptree::GetFloatValue() {
     assert(IsValid());
+    if (_binaryDoc) {
+        return binary::GetFloat(GetNode(_internal));
+    }
     return GetInternal(_internal)->FloatText();
 }
 
 double Ptree::GetDoubleValue() {
     assert(IsValid());
+    if (_binaryDoc) {
+        return binary::GetDouble(GetNode(_internal));
+    }
     return GetInternal(_internal)->DoubleText();
 }
 
 NameTreePair* Ptree::GetChildren(int* numChildren) {
     assert(IsValid());
+    if (_binaryDoc) {
+        binary::Node const* node = GetNode(_internal);
+        *numChildren = node->_numChildren;
+        NameTreePair* children = new NameTreePair[*numChildren];
+        int index = 0;
+        for (binary::Node* child = node->_firstChild; child != nullptr; child = child->_nextSibling) {
+            NameTreePair &c = children[index];
+            c._name = child->_name;
+            c._pt._internal = (void*)(child);
+            c._pt._version = _version;
+            c._pt._binaryDoc = _binaryDoc;
+            ++index;
+        }
+        assert(index == *numChildren);
+        return children;
+    }
     *numChildren = GetInternal(_internal)->ChildElementCount();
     NameTreePair* children = new NameTreePair[*numChildren];
     int index = 0;
@@ -252,42 +455,136 @@ NameTreePair* Ptree::GetChildren(int* numChildren) {
 Ptree::Ptree(Ptree const& other) {
     _internal = other._internal;
     _version = other._version;
+    _binaryDoc = other._binaryDoc;
 }
 
 Ptree& Ptree::operator=(Ptree const& other) {
     _internal = other._internal;
     _version = other._version;
+    _binaryDoc = other._binaryDoc;
     return *this;
 }
 
-Ptree Ptree::MakeNew() {
+Ptree Ptree::MakeNew(Format format) {
     Ptree pt;
-    pt._internal = (void*)(new XMLDocument);
+    if (format == Format::Binary) {
+        pt._binaryDoc = new binary::Doc;
+        pt._internal = (void*)(pt._binaryDoc->_root);
+    } else {
+        pt._internal = (void*)(new XMLDocument);
+    }
     pt._version = kBinaryVersion;
     return pt;
 }
 
 void Ptree::DeleteData() {
-    delete GetDoc(_internal);
+    if (_binaryDoc) {
+        delete _binaryDoc;
+        _binaryDoc = nullptr;
+    } else {
+        delete GetDoc(_internal);
+    }
     _internal = nullptr;
 }
 
 bool Ptree::WriteToFile(char const* filename) {
+    if (_binaryDoc) {
+        return binary::WriteToFile(*_binaryDoc, _version, filename);
+    }
+
     XMLDocument versionedDoc;
     versionedDoc.InsertEndChild(versionedDoc.NewElement("root"));
     versionedDoc.RootElement()->InsertNewChildElement("version")->SetText(_version);
     XMLNode *treeCopy = GetDoc(_internal)->RootElement()->DeepClone(&versionedDoc);
     versionedDoc.RootElement()->InsertEndChild(treeCopy);
 
-    versionedDoc.SaveFile(filename);
-    return true;
+    return versionedDoc.SaveFile(filename) == XML_SUCCESS;
 }
 
 bool Ptree::LoadFromFile(char const* filename) {
     assert(_internal != nullptr);
-    GetDoc(_internal)->LoadFile(filename);
+    if (binary::IsBinaryFile(filename)) {
+        if (_binaryDoc == nullptr) {
+            delete GetDoc(_internal);
+            _binaryDoc = new binary::Doc;
+        }
+        int const version = binary::LoadFromFile(_binaryDoc, filename);
+        _internal = (void*)(_binaryDoc->_root);
+        if (version < 0) {
+            return false;
+        }
+        _version = version;
+        return true;
+    }
+
+    if (_binaryDoc) {
+        delete _binaryDoc;
+        _binaryDoc = nullptr;
+        _internal = (void*)(new XMLDocument);
+    }
+    if (GetDoc(_internal)->LoadFile(filename) != tinyxml2::XML_SUCCESS) {
+        printf("serial: failed to parse \"%s\": %s\n", filename, GetDoc(_internal)->ErrorStr());
+        return false;
+    }
     _version = GetDoc(_internal)->FirstChildElement()->FirstChildElement("version")->IntText();
     return true;
 }
 
+void Ptree::CopyTree(Ptree src, Ptree dst) {
+    char buffer[64];
+    char const* text = src._binaryDoc ?
+        binary::GetText(GetNode(src._internal), buffer, sizeof(buffer)) :
+        GetInternal(src._internal)->GetText();
+    if (text != nullptr) {
+        if (dst._binaryDoc) {
+            SetInferredValue(dst._binaryDoc, GetNode(dst._internal), text);
+        } else {
+            GetInternal(dst._internal)->SetText(text);
+        }
+    }
+
+    int numChildren = 0;
+    NameTreePair* children = src.GetChildren(&numChildren);
+    for (int i = 0; i < numChildren; ++i) {
+        CopyTree(children[i]._pt, dst.AddChild(children[i]._name));
+    }
+    delete[] children;
+}
+
+Ptree Ptree::MakeCopy(Format format) {
+    Ptree copy = MakeNew(format);
+    copy._version = _version;
+    int numChildren = 0;
+    NameTreePair* children = GetChildren(&numChildren);
+    for (int i = 0; i < numChildren; ++i) {
+        CopyTree(children[i]._pt, copy.AddChild(children[i]._name));
+    }
+    delete[] children;
+    return copy;
+}
+
+bool Ptree::ConvertFile(char const* inFilename, char const* outFilename) {
+    Ptree in = MakeNew();
+    if (!in.LoadFromFile(inFilename)) {
+        in.DeleteData();
+        return false;
+    }
+    // Skip the root/version wrapper; WriteToFile adds it back.
+    int numChildren = 0;
+    NameTreePair* children = in.GetChild("root").GetChildren(&numChildren);
+    bool success = numChildren == 2;
+    if (success) {
+        Ptree out = MakeNew(FormatForFilename(outFilename));
+        out._version = in._version;
+        CopyTree(children[1]._pt, out.AddChild(children[1]._name));
+        success = out.WriteToFile(outFilename);
+        out.DeleteData();
+    } else {
+        printf("serial: expected \"%s\" to hold a version and one tree, found %d nodes\n", inFilename, numChildren);
+    }
+    delete[] children;
+    in.DeleteData();
+    return success;
+}
+
 } // namespace serial
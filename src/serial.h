@@ -6,6 +6,17 @@ namespace serial {
 
 struct NameTreePair;
 
+namespace binary {
+struct Doc;
+}
+
+// Xml is what we edit and diff. Binary (see serial_binary.h) holds the same
+// tree with typed values and no text parsing, for fast loads.
+enum class Format { Xml, Binary };
+
+// ".bser" files are binary; everything else is XML.
+Format FormatForFilename(char const* filename);
+
 class Ptree {
 public:
     Ptree() {}
@@ -63,17 +74,33 @@ public:
 
     Ptree(Ptree const& other);
     Ptree& operator=(Ptree const& other);
-    static Ptree MakeNew();
+    static Ptree MakeNew(Format format = Format::Xml);
     void DeleteData();
 
     bool IsValid() { return _internal != nullptr; }
+    Format GetFormat() const { return _binaryDoc != nullptr ? Format::Binary : Format::Xml; }
 
+    // Writes in this tree's format, whatever the filename says.
     bool WriteToFile(char const* filename);
+    // Reads either format (binary files start with a magic number) and
+    // switches this tree over to it. Only call on a tree from MakeNew().
     bool LoadFromFile(char const* filename);
 
+    // A new tree with the same contents in the given format. Up to the caller
+    // to DeleteData() it. Call on a tree from MakeNew().
+    Ptree MakeCopy(Format format);
+
+    // Loads inFilename and writes the same tree to outFilename in the format
+    // FormatForFilename() picks for it. Values keep their exact text either
+    // way, so converting back gives the same XML.
+    static bool ConvertFile(char const* inFilename, char const* outFilename);
+
 private:
+    static void CopyTree(Ptree src, Ptree dst);
+
     int _version = 0;
-    void* _internal = nullptr;
+    void* _internal = nullptr;  // XMLElement (or XMLDocument at the top), or binary::Node
+    binary::Doc* _binaryDoc = nullptr;  // set if this is a binary tree
 };
 
 struct NameTreePair {    
@@ -100,7 +127,7 @@ inline bool LoadFromChildOf(Ptree pt, char const* childName, T& v) {
 
 template <typename T>
 inline bool SaveToFile(char const* filename, char const* rootName, T const& v) {
-    serial::Ptree pt = serial::Ptree::MakeNew();
+    serial::Ptree pt = serial::Ptree::MakeNew(FormatForFilename(filename));
     serial::Ptree root = pt.AddChild(rootName);
     v.Save(root);
     bool success = pt.WriteToFile(filename);
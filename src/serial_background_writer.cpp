@@ -0,0 +1,126 @@
+#include "serial_background_writer.h"
+
+#include <chrono>
+#include <cstdio>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+namespace serial {
+
+namespace {
+
+// std::rename won't replace an existing file on Windows.
+bool ReplaceFile(char const* from, char const* to) {
+#if defined(_WIN32)
+    return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return std::rename(from, to) == 0;
+#endif
+}
+
+float SecsSince(std::chrono::steady_clock::time_point t) {
+    return std::chrono::duration<float>(std::chrono::steady_clock::now() - t).count();
+}
+
+}  // namespace
+
+void BackgroundWriter::Init() {
+    _quit = false;
+    _thread = std::thread(&BackgroundWriter::ThreadLoop, this);
+}
+
+void BackgroundWriter::Destroy() {
+    if (!_thread.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _quit = true;
+    }
+    _cv.notify_one();
+    _thread.join();
+}
+
+void BackgroundWriter::Write(Ptree pt, std::string filename) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_hasJob) {
+            printf("BackgroundWriter: dropping queued save to \"%s\" for a newer one\n", _jobFilename.c_str());
+            _jobPt.DeleteData();
+        }
+        _hasJob = true;
+        _jobPt = pt;
+        _jobFilename = std::move(filename);
+        _stage = Stage::Queued;
+    }
+    _cv.notify_one();
+}
+
+void BackgroundWriter::PollResults(std::vector<Result>* results) {
+    results->clear();
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::swap(*results, _results);
+}
+
+BackgroundWriter::Result BackgroundWriter::WriteNow(Ptree pt, std::string const& filename) {
+    Result result;
+    result._filename = filename;
+
+    _stage = Stage::Formatting;
+    auto start = std::chrono::steady_clock::now();
+    Format const format = FormatForFilename(filename.c_str());
+    bool const convert = pt.GetFormat() != format;
+    Ptree toWrite = convert ? pt.MakeCopy(format) : pt;
+    result._formatSecs = SecsSince(start);
+
+    _stage = Stage::Writing;
+    start = std::chrono::steady_clock::now();
+    std::string const tmpFilename = filename + ".tmp";
+    result._success = toWrite.WriteToFile(tmpFilename.c_str());
+    if (result._success) {
+        result._success = ReplaceFile(tmpFilename.c_str(), filename.c_str());
+        if (!result._success) {
+            printf("BackgroundWriter: failed to move \"%s\" to \"%s\"\n", tmpFilename.c_str(), filename.c_str());
+        }
+    } else {
+        std::remove(tmpFilename.c_str());
+    }
+    result._writeSecs = SecsSince(start);
+
+    if (convert) {
+        toWrite.DeleteData();
+    }
+    return result;
+}
+
+void BackgroundWriter::ThreadLoop() {
+    while (true) {
+        Ptree pt;
+        std::string filename;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _cv.wait(lock, [this] { return _hasJob || _quit; });
+            if (!_hasJob) {
+                // Only quit once the queue is empty.
+                return;
+            }
+            pt = _jobPt;
+            filename = std::move(_jobFilename);
+            _jobPt = Ptree();
+            _hasJob = false;
+        }
+
+        Result result = WriteNow(pt, filename);
+        pt.DeleteData();
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        _results.push_back(std::move(result));
+        _stage = _hasJob ? Stage::Queued : Stage::Idle;
+    }
+}
+
+}  // namespace serial
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "serial.h"
+
+namespace serial {
+
+// Writes Ptrees to disk on its own thread, so saving a big level doesn't
+// hitch the frame. The caller snapshots into a Format::Binary tree, which is
+// only typed values appended to a flat node array, and hands it over. Turning
+// that into XML text (if the filename asks for XML), writing it and swapping
+// it in for the old file all happen on the writer thread.
+//
+// Each file is written to "<filename>.tmp" and then renamed over the old
+// one, so a crash or a full disk mid-save never leaves a half-written level.
+class BackgroundWriter {
+public:
+    enum class Stage { Idle, Queued, Formatting, Writing };
+
+    struct Result {
+        std::string _filename;
+        bool _success = false;
+        float _formatSecs = 0.f;
+        float _writeSecs = 0.f;
+    };
+
+    void Init();
+    // Finishes whatever is in flight or queued before returning.
+    void Destroy();
+
+    // Takes ownership of pt, which must come from Ptree::MakeNew(). The file's
+    // format comes from FormatForFilename(). If an earlier write is still
+    // queued (not started), this one replaces it.
+    void Write(Ptree pt, std::string filename);
+
+    // Main thread. What the writer is doing right now, for a progress display.
+    Stage GetStage() const { return _stage.load(); }
+
+    // Main thread. Moves out the results of every write finished since the
+    // last call.
+    void PollResults(std::vector<Result>* results);
+
+private:
+    void ThreadLoop();
+    Result WriteNow(Ptree pt, std::string const& filename);
+
+    std::thread _thread;
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    // Guarded by _mutex.
+    bool _quit = false;
+    bool _hasJob = false;
+    Ptree _jobPt;
+    std::string _jobFilename;
+    std::vector<Result> _results;
+
+    std::atomic<Stage> _stage = Stage::Idle;
+};
+
+}  // namespace serial
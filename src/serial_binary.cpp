@@ -0,0 +1,398 @@
+#include "serial_binary.h"
+
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include "tinyxml2/tinyxml2.h"
+
+using tinyxml2::XMLUtil;
+
+namespace serial {
+namespace binary {
+
+namespace {
+
+char const kMagic[4] = { 'B', 'S', 'E', 'R' };
+uint32_t const kFormatVersion = 1;
+
+class Writer {
+public:
+    template <typename T>
+    void Put(T const& v) {
+        char const* bytes = reinterpret_cast<char const*>(&v);
+        _data.insert(_data.end(), bytes, bytes + sizeof(T));
+    }
+    void PutBytes(char const* bytes, uint32_t length) {
+        Put(length);
+        _data.insert(_data.end(), bytes, bytes + length);
+        _data.push_back('\0');
+    }
+    std::vector<char> _data;
+};
+
+class Reader {
+public:
+    Reader(char* data, size_t size) : _data(data), _size(size) {}
+
+    template <typename T>
+    bool Get(T* v) {
+        if (_pos + sizeof(T) > _size) {
+            return false;
+        }
+        memcpy(v, _data + _pos, sizeof(T));
+        _pos += sizeof(T);
+        return true;
+    }
+    // Points into the buffer; the writer left a '\0' after the bytes.
+    bool GetBytes(char const** v) {
+        uint32_t length;
+        if (!Get(&length) || _pos + length + 1 > _size || _data[_pos + length] != '\0') {
+            return false;
+        }
+        *v = _data + _pos;
+        _pos += length + 1;
+        return true;
+    }
+
+private:
+    char* _data;
+    size_t _size;
+    size_t _pos = 0;
+};
+
+struct NameTable {
+    std::unordered_map<std::string, uint32_t> _ixs;
+    std::vector<std::string const*> _names;
+
+    uint32_t Intern(char const* name) {
+        auto result = _ixs.emplace(name, static_cast<uint32_t>(_names.size()));
+        if (result.second) {
+            _names.push_back(&result.first->first);
+        }
+        return result.first->second;
+    }
+};
+
+struct TreeWriter {
+    Writer _w;
+    NameTable _names;
+    uint32_t _numNodes = 0;
+
+    // Header and value only; the caller writes numChildren nodes after it.
+    void WriteNodeHeader(Node const& node, int numChildren) {
+        _w.Put(_names.Intern(node._name));
+        _w.Put(node._type);
+        _w.Put(static_cast<uint32_t>(numChildren));
+        switch (node._type) {
+            case ValueType::None: break;
+            case ValueType::String: _w.PutBytes(node._string, strlen(node._string)); break;
+            case ValueType::Int: _w.Put(static_cast<int32_t>(node._int)); break;
+            case ValueType::Int64: _w.Put(node._int64); break;
+            case ValueType::Bool: _w.Put(static_cast<uint8_t>(node._bool)); break;
+            case ValueType::Float: _w.Put(node._float); break;
+            case ValueType::Double: _w.Put(node._double); break;
+        }
+        ++_numNodes;
+    }
+
+    void WriteNode(Node const& node) {
+        WriteNodeHeader(node, node._numChildren);
+        for (Node const* child = node._firstChild; child != nullptr; child = child->_nextSibling) {
+            WriteNode(*child);
+        }
+    }
+};
+
+// Reads the node at the reader's position and its whole subtree.
+bool ReadNode(Reader& r, Doc* doc, std::vector<char const*> const& names, Node* parent) {
+    uint32_t nameIx;
+    ValueType type;
+    uint32_t numChildren;
+    if (!r.Get(&nameIx) || !r.Get(&type) || !r.Get(&numChildren) || nameIx >= names.size()) {
+        return false;
+    }
+    doc->_nodes.emplace_back();
+    Node* node = &doc->_nodes.back();
+    node->_name = names[nameIx];
+    node->_type = type;
+    bool ok = true;
+    switch (type) {
+        case ValueType::None: break;
+        case ValueType::String: ok = r.GetBytes(&node->_string); break;
+        case ValueType::Int: {
+            int32_t v = 0;
+            ok = r.Get(&v);
+            node->_int = v;
+            break;
+        }
+        case ValueType::Int64: ok = r.Get(&node->_int64); break;
+        case ValueType::Bool: {
+            uint8_t v = 0;
+            ok = r.Get(&v);
+            node->_bool = v != 0;
+            break;
+        }
+        case ValueType::Float: ok = r.Get(&node->_float); break;
+        case ValueType::Double: ok = r.Get(&node->_double); break;
+        default: ok = false; break;
+    }
+    if (!ok) {
+        return false;
+    }
+    if (parent->_lastChild) {
+        parent->_lastChild->_nextSibling = node;
+    } else {
+        parent->_firstChild = node;
+    }
+    parent->_lastChild = node;
+    ++parent->_numChildren;
+    for (uint32_t i = 0; i < numChildren; ++i) {
+        if (!ReadNode(r, doc, names, node)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace
+
+Doc::Doc() {
+    _nodes.emplace_back();
+    _root = &_nodes.back();
+}
+
+bool IsBinaryFile(char const* filename) {
+    FILE* f = fopen(filename, "rb");
+    if (f == nullptr) {
+        return false;
+    }
+    char magic[4];
+    bool const isBinary = fread(magic, 1, 4, f) == 4 && memcmp(magic, kMagic, 4) == 0;
+    fclose(f);
+    return isBinary;
+}
+
+Node* AddChild(Doc* doc, Node* parent, char const* name) {
+    doc->_nodes.emplace_back();
+    Node* child = &doc->_nodes.back();
+    auto result = doc->_names.emplace(name);
+    child->_name = result.first->c_str();
+    if (parent->_lastChild) {
+        parent->_lastChild->_nextSibling = child;
+    } else {
+        parent->_firstChild = child;
+    }
+    parent->_lastChild = child;
+    ++parent->_numChildren;
+    return child;
+}
+
+Node* FindChild(Node* parent, char const* name) {
+    for (Node* child = parent->_firstChild; child != nullptr; child = child->_nextSibling) {
+        if (child->_name[0] == name[0] && strcmp(child->_name, name) == 0) {
+            return child;
+        }
+    }
+    return nullptr;
+}
+
+void SetString(Doc* doc, Node* node, char const* v) {
+    doc->_strings.emplace_back(v);
+    node->_type = ValueType::String;
+    node->_string = doc->_strings.back().c_str();
+}
+void SetInt(Node* node, int v) {
+    node->_type = ValueType::Int;
+    node->_int = v;
+}
+void SetInt64(Node* node, int64_t v) {
+    node->_type = ValueType::Int64;
+    node->_int64 = v;
+}
+void SetBool(Node* node, bool v) {
+    node->_type = ValueType::Bool;
+    node->_bool = v;
+}
+void SetFloat(Node* node, float v) {
+    node->_type = ValueType::Float;
+    node->_float = v;
+}
+void SetDouble(Node* node, double v) {
+    node->_type = ValueType::Double;
+    node->_double = v;
+}
+
+char const* GetText(Node const* node, char* buffer, int bufferSize) {
+    switch (node->_type) {
+        case ValueType::None: return nullptr;
+        case ValueType::String: return node->_string;
+        case ValueType::Int: XMLUtil::ToStr(node->_int, buffer, bufferSize); break;
+        case ValueType::Int64: XMLUtil::ToStr(node->_int64, buffer, bufferSize); break;
+        case ValueType::Bool: XMLUtil::ToStr(node->_bool, buffer, bufferSize); break;
+        case ValueType::Float: XMLUtil::ToStr(node->_float, buffer, bufferSize); break;
+        case ValueType::Double: XMLUtil::ToStr(node->_double, buffer, bufferSize); break;
+    }
+    return buffer;
+}
+
+// Same-type reads (and ints, which print and parse back exactly) skip the
+// text. Everything else parses the text, defaulting to 0 like the XML
+// *Text() calls do.
+int GetInt(Node const* node) {
+    if (node->_type == ValueType::Int) {
+        return node->_int;
+    }
+    char buffer[64];
+    int v = 0;
+    if (char const* text = GetText(node, buffer, sizeof(buffer))) {
+        XMLUtil::ToInt(text, &v);
+    }
+    return v;
+}
+int64_t GetInt64(Node const* node) {
+    if (node->_type == ValueType::Int64) {
+        return node->_int64;
+    }
+    if (node->_type == ValueType::Int) {
+        return node->_int;
+    }
+    char buffer[64];
+    int64_t v = 0;
+    if (char const* text = GetText(node, buffer, sizeof(buffer))) {
+        XMLUtil::ToInt64(text, &v);
+    }
+    return v;
+}
+bool GetBool(Node const* node) {
+    if (node->_type == ValueType::Bool) {
+        return node->_bool;
+    }
+    char buffer[64];
+    bool v = false;
+    if (char const* text = GetText(node, buffer, sizeof(buffer))) {
+        XMLUtil::ToBool(text, &v);
+    }
+    return v;
+}
+float GetFloat(Node const* node) {
+    if (node->_type == ValueType::Float) {
+        return node->_float;
+    }
+    char buffer[64];
+    float v = 0.f;
+    if (char const* text = GetText(node, buffer, sizeof(buffer))) {
+        XMLUtil::ToFloat(text, &v);
+    }
+    return v;
+}
+double GetDouble(Node const* node) {
+    if (node->_type == ValueType::Double) {
+        return node->_double;
+    }
+    char buffer[64];
+    double v = 0.0;
+    if (char const* text = GetText(node, buffer, sizeof(buffer))) {
+        XMLUtil::ToDouble(text, &v);
+    }
+    return v;
+}
+
+bool WriteToFile(Doc const& doc, int version, char const* filename) {
+    Node const* tree = doc._root->_firstChild;
+    if (tree == nullptr) {
+        printf("serial: nothing to write to \"%s\"\n", filename);
+        return false;
+    }
+
+    // Same wrapper as the XML files: root -> { version, tree }.
+    TreeWriter nodes;
+    Node root;
+    root._name = "root";
+    nodes.WriteNodeHeader(root, 2);
+    Node versionNode;
+    versionNode._name = "version";
+    SetInt(&versionNode, version);
+    nodes.WriteNode(versionNode);
+    nodes.WriteNode(*tree);
+
+    Writer header;
+    header._data.insert(header._data.end(), kMagic, kMagic + 4);
+    header.Put(kFormatVersion);
+    header.Put(static_cast<uint32_t>(nodes._names._names.size()));
+    for (std::string const* name : nodes._names._names) {
+        header.PutBytes(name->c_str(), name->size());
+    }
+    header.Put(nodes._numNodes);
+
+    FILE* f = fopen(filename, "wb");
+    if (f == nullptr) {
+        printf("serial: failed to open \"%s\" for writing\n", filename);
+        return false;
+    }
+    bool const success =
+        fwrite(header._data.data(), 1, header._data.size(), f) == header._data.size() &&
+        fwrite(nodes._w._data.data(), 1, nodes._w._data.size(), f) == nodes._w._data.size();
+    fclose(f);
+    return success;
+}
+
+int LoadFromFile(Doc* doc, char const* filename) {
+    FILE* f = fopen(filename, "rb");
+    if (f == nullptr) {
+        printf("serial: failed to open \"%s\"\n", filename);
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    long const size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    std::unique_ptr<char[]> data(new char[size > 0 ? size : 1]);
+    bool const readOk = size > 0 && fread(data.get(), 1, size, f) == static_cast<size_t>(size);
+    fclose(f);
+    if (!readOk) {
+        printf("serial: failed to read \"%s\"\n", filename);
+        return -1;
+    }
+
+    *doc = Doc();
+    doc->_fileData = std::move(data);
+    Reader r(doc->_fileData.get(), size);
+    char magic[4];
+    uint32_t formatVersion;
+    if (!r.Get(&magic) || memcmp(magic, kMagic, 4) != 0 || !r.Get(&formatVersion)) {
+        printf("serial: \"%s\" is not a binary ptree\n", filename);
+        return -1;
+    }
+    if (formatVersion != kFormatVersion) {
+        printf("serial: \"%s\" has binary format %u, expected %u\n", filename, formatVersion, kFormatVersion);
+        return -1;
+    }
+    uint32_t numNames;
+    if (!r.Get(&numNames)) {
+        return -1;
+    }
+    std::vector<char const*> names(numNames);
+    for (uint32_t i = 0; i < numNames; ++i) {
+        if (!r.GetBytes(&names[i])) {
+            printf("serial: \"%s\" is truncated\n", filename);
+            return -1;
+        }
+    }
+    uint32_t numNodes;
+    if (!r.Get(&numNodes) || !ReadNode(r, doc, names, doc->_root) || doc->_nodes.size() != numNodes + 1) {
+        printf("serial: \"%s\" is truncated or corrupt\n", filename);
+        return -1;
+    }
+
+    Node* root = FindChild(doc->_root, "root");
+    Node* versionNode = root ? FindChild(root, "version") : nullptr;
+    if (versionNode == nullptr) {
+        printf("serial: \"%s\" has no version\n", filename);
+        return -1;
+    }
+    return GetInt(versionNode);
+}
+
+}  // namespace binary
+}  // namespace serial
@@ -0,0 +1,93 @@
+#pragma once
+
+// Internal to serial.cpp: the binary backend behind serial::Ptree.
+//
+// A binary tree is the same shape as the XML one (named nodes, each with an
+// optional value and any number of children), but values keep the type they
+// were Put with and names are interned, so loading is a handful of memcpys
+// instead of a text parse.
+//
+// Reading a value as a different type than it was written goes through the
+// text XML would have stored, so every Get behaves exactly like it does on an
+// XML tree.
+//
+// File layout, all little-endian:
+//   "BSER" u32 formatVersion
+//   u32 numNames, then each name: u32 length, bytes, '\0'
+//   u32 numNodes, then each node in preorder:
+//     u32 nameIx, u8 ValueType, u32 numChildren, payload
+//   payload is i64 (Int64), i32 (Int), f32 (Float), f64 (Double), u8 (Bool),
+//   u32 length + bytes + '\0' (String), or nothing (None).
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_set>
+
+namespace serial {
+namespace binary {
+
+enum class ValueType : uint8_t { None, String, Int, Int64, Bool, Float, Double };
+
+struct Node {
+    char const* _name = "";
+    ValueType _type = ValueType::None;
+    union {
+        int _int;
+        int64_t _int64;
+        bool _bool;
+        float _float;
+        double _double;
+    };
+    char const* _string = nullptr;
+    Node* _firstChild = nullptr;
+    Node* _lastChild = nullptr;
+    Node* _nextSibling = nullptr;
+    int _numChildren = 0;
+
+    Node() : _int64(0) {}
+};
+
+struct Doc {
+    // deque so nodes never move once handed out.
+    std::deque<Node> _nodes;
+    Node* _root = nullptr;  // nameless; the tree's top-level nodes are its children
+
+    // Names and strings either point into _fileData (loaded docs) or into
+    // these (built docs).
+    std::unique_ptr<char[]> _fileData;
+    std::unordered_set<std::string> _names;
+    std::deque<std::string> _strings;
+
+    Doc();
+};
+
+bool IsBinaryFile(char const* filename);
+
+Node* AddChild(Doc* doc, Node* parent, char const* name);
+Node* FindChild(Node* parent, char const* name);
+
+void SetString(Doc* doc, Node* node, char const* v);
+void SetInt(Node* node, int v);
+void SetInt64(Node* node, int64_t v);
+void SetBool(Node* node, bool v);
+void SetFloat(Node* node, float v);
+void SetDouble(Node* node, double v);
+
+// The text an XML tree would hold for this value. Uses buffer for numbers.
+char const* GetText(Node const* node, char* buffer, int bufferSize);
+int GetInt(Node const* node);
+int64_t GetInt64(Node const* node);
+bool GetBool(Node const* node);
+float GetFloat(Node const* node);
+double GetDouble(Node const* node);
+
+// Writes the tree under doc->_root's first child, wrapped in a "root" node
+// with a "version" child, same as the XML files.
+bool WriteToFile(Doc const& doc, int version, char const* filename);
+// Replaces doc's contents. Returns the version, or -1 on failure.
+int LoadFromFile(Doc* doc, char const* filename);
+
+}  // namespace binary
+}  // namespace serial
@@ -0,0 +1,52 @@
+// Converts a serial file between XML and binary (.bser), then times loading
+// both versions.
+//
+// Usage:
+//   serial_convert <in> <out>
+//
+// The output format comes from out's extension, so
+//   serial_convert level.xml level.bser
+// bakes a level for shipping, and
+//   serial_convert level.bser level.xml
+// turns it back into the same XML.
+
+#include <chrono>
+#include <cstdio>
+
+#include "serial.h"
+
+namespace {
+
+double TimeLoadMs(char const* filename, int numLoads) {
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < numLoads; ++i) {
+        serial::Ptree pt = serial::Ptree::MakeNew();
+        if (!pt.LoadFromFile(filename)) {
+            pt.DeleteData();
+            return -1.0;
+        }
+        pt.DeleteData();
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count() / numLoads;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        printf("Usage: serial_convert <in> <out>\n");
+        return 1;
+    }
+    char const* inFilename = argv[1];
+    char const* outFilename = argv[2];
+    if (!serial::Ptree::ConvertFile(inFilename, outFilename)) {
+        printf("Failed to convert \"%s\" to \"%s\"\n", inFilename, outFilename);
+        return 1;
+    }
+
+    int constexpr kNumLoads = 20;
+    printf("%s: %.3f ms to load\n", inFilename, TimeLoadMs(inFilename, kNumLoads));
+    printf("%s: %.3f ms to load\n", outFilename, TimeLoadMs(outFilename, kNumLoads));
+    return 0;
+}
@@ -1,107 +1,299 @@
 #include "sound_bank.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <thread>
+
 #define DR_WAV_IMPLEMENTATION
 #include "dr_wav.h"
 
-// TODO: need to convert the following properly to 44100Hz:
-// kick_deep, snare, liquid_dnb, liquid_chords, liquid_dnb_drums, tech_chords, tech_drum_groove, feel_vox_*, check_it_out_g
+#include "samplerate.h"
+#include "serial.h"
+#include "serial_vector_util.h"
+
+namespace {
+
+// data/sounds/manifest.xml. The order of the sounds matters: levels save
+// PlayPcm events by sound index, so only ever append to the list.
+struct ManifestEntry {
+    std::string _file;  // relative to data/sounds/
+    int _exclusiveGroup = -1;
+
+    void Save(serial::Ptree pt) const {
+        pt.PutString("file", _file.c_str());
+        if (_exclusiveGroup >= 0) {
+            pt.PutInt("exclusive_group", _exclusiveGroup);
+        }
+    }
+    void Load(serial::Ptree pt) {
+        _file = pt.GetString("file");
+        _exclusiveGroup = -1;
+        pt.TryGetInt("exclusive_group", &_exclusiveGroup);
+    }
+};
+
+struct Manifest {
+    std::vector<ManifestEntry> _sounds;
+
+    void Save(serial::Ptree pt) const {
+        serial::SaveVectorInChildNode(pt, "sounds", "sound", _sounds);
+    }
+    void Load(serial::Ptree pt) {
+        serial::LoadVectorFromChildNode(pt, "sounds", _sounds);
+    }
+};
+
+char const* const kSoundDir = "data/sounds/";
+char const* const kCacheDir = "data/sounds/cache/";
+
+// FNV-1a over the whole file. Returns false if the file couldn't be read.
+bool HashFile(char const* path, uint64_t* hash) {
+    FILE* f = fopen(path, "rb");
+    if (f == nullptr) {
+        return false;
+    }
+    uint64_t h = 14695981039346656037ull;
+    unsigned char chunk[64 * 1024];
+    size_t numRead;
+    while ((numRead = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+        for (size_t i = 0; i < numRead; ++i) {
+            h ^= chunk[i];
+            h *= 1099511628211ull;
+        }
+    }
+    fclose(f);
+    *hash = h;
+    return true;
+}
+
+// Decodes srcPath, mixes it down to mono, resamples it to sampleRate, and
+// writes the result to cachePath as a 32-bit float WAV.
+bool ConvertToCache(char const* srcPath, char const* cachePath, int sampleRate) {
+    unsigned int numChannels;
+    unsigned int srcSampleRate;
+    drwav_uint64 numFrames;
+    float* interleaved = drwav_open_file_and_read_pcm_frames_f32(srcPath, &numChannels, &srcSampleRate, &numFrames, NULL);
+    if (interleaved == nullptr) {
+        printf("SoundBank: failed to decode \"%s\"\n", srcPath);
+        return false;
+    }
+
+    std::vector<float> mono(numFrames);
+    for (drwav_uint64 frameIx = 0; frameIx < numFrames; ++frameIx) {
+        float sum = 0.f;
+        for (unsigned int channelIx = 0; channelIx < numChannels; ++channelIx) {
+            sum += interleaved[frameIx * numChannels + channelIx];
+        }
+        mono[frameIx] = sum / numChannels;
+    }
+    drwav_free(interleaved, NULL);
+
+    std::vector<float> resampled;
+    if (srcSampleRate != (unsigned int)sampleRate) {
+        double const ratio = (double)sampleRate / srcSampleRate;
+        resampled.resize((size_t)(numFrames * ratio) + 1);
+        SRC_DATA data;
+        data.data_in = mono.data();
+        data.data_out = resampled.data();
+        data.input_frames = (long)numFrames;
+        data.output_frames = (long)resampled.size();
+        data.src_ratio = ratio;
+        data.end_of_input = 1;
+        int srcErr = src_simple(&data, SRC_SINC_MEDIUM_QUALITY, 1);
+        if (srcErr != 0) {
+            printf("SoundBank: failed to resample \"%s\": %s\n", srcPath, src_strerror(srcErr));
+            return false;
+        }
+        resampled.resize(data.output_frames_gen);
+    } else {
+        resampled = std::move(mono);
+    }
+
+    // Write to a temp file and rename so a crash mid-write can't leave a
+    // truncated file that looks like a valid cache entry.
+    std::string tmpPath = cachePath;
+    tmpPath += ".tmp";
+    drwav_data_format format;
+    format.container = drwav_container_riff;
+    format.format = DR_WAVE_FORMAT_IEEE_FLOAT;
+    format.channels = 1;
+    format.sampleRate = sampleRate;
+    format.bitsPerSample = 32;
+    drwav wav;
+    if (!drwav_init_file_write(&wav, tmpPath.c_str(), &format, NULL)) {
+        printf("SoundBank: failed to open \"%s\" for writing\n", tmpPath.c_str());
+        return false;
+    }
+    drwav_uint64 framesWritten = drwav_write_pcm_frames(&wav, resampled.size(), resampled.data());
+    drwav_uninit(&wav);
+    std::error_code ec;
+    if (framesWritten != resampled.size()) {
+        printf("SoundBank: failed to write \"%s\"\n", tmpPath.c_str());
+        std::filesystem::remove(tmpPath, ec);
+        return false;
+    }
+    std::filesystem::rename(tmpPath, cachePath, ec);
+    if (ec && !std::filesystem::exists(cachePath)) {
+        printf("SoundBank: failed to move \"%s\" into the cache: %s\n", tmpPath.c_str(), ec.message().c_str());
+        return false;
+    }
+    return true;
+}
+
+}  // namespace
+
 void SoundBank::LoadSounds(int sampleRate) {
-    _soundNames = {
-        "kick_deep.wav"
-        , "woodblock_reverb_mono.wav"
-        , "snare.wav"
-        , "liquid_dnb.wav"
-        , "liquid_chords.wav"
-        , "liquid_dnb_drums.wav"
-        , "tech_chords.wav"
-        , "tech_drum_groove.wav"
-        , "hihat_open_909.wav"
-        , "clap_909.wav"
-        , "feeling_vocals/v1.wav"
-        , "feeling_vocals/v2.wav"
-        , "feeling_vocals/v3.wav"
-        , "feeling_vocals/v4.wav"
-        , "feeling_vocals/v5.wav"
-        , "feeling_vocals/v6.wav"
-        , "feeling_vocals/v7.wav"
-        , "feeling_vocals/v8.wav"
-        , "feeling_vocals/v9.wav"
-        , "kick_909.wav"
-        , "snare_909.wav"
-        , "hihat_closed_909.wav"
-        , "biar_bunny_cbb.wav"
-        , "biar_is_a_dbb.wav"
-        , "biar_satell_dc.wav"
-        , "biar_ite_cant_dbb.wav"
-        , "check_it_out.wav"
-        , "crash_909.wav"
-        , "cymbal_roll.wav"
-        , "wood_block_low.wav"
-        , "rim_808.wav"
-        , "gong.wav"
-    };
-    _exclusiveGroups = {
-        -1,
-        -1,
-        -1,
-        -1,
-        -1,
-        -1,
-        -1,
-        -1,
-        -1,
-        -1,
-        0,
-        0,
-        0,
-        0,
-        0,
-        0,
-        0,
-        0,
-        0,
-        -1,
-        -1,
-        -1,
-        1,
-        1,
-        1,
-        1,
-        -1,
-        -1,
-        -1,
-        -1,
-        -1,
-        -1
+    auto startTime = std::chrono::steady_clock::now();
+
+    Destroy();
+    Manifest manifest;
+    if (!serial::LoadFromFile(_manifestFilename, manifest)) {
+        printf("SoundBank: failed to load sound manifest \"%s\"\n", _manifestFilename);
+        return;
+    }
+    int const numSounds = (int)manifest._sounds.size();
+    _soundFiles.resize(numSounds);
+    _soundNames.resize(numSounds);
+    _soundPaths.resize(numSounds);
+    _exclusiveGroups.resize(numSounds);
+    _sounds.resize(numSounds);
+    for (int i = 0; i < numSounds; ++i) {
+        _soundFiles[i] = manifest._sounds[i]._file;
+        _soundNames[i] = _soundFiles[i].c_str();
+        _exclusiveGroups[i] = manifest._sounds[i]._exclusiveGroup;
+    }
+
+    if (_useCache) {
+        std::error_code ec;
+        std::filesystem::create_directories(kCacheDir, ec);
+        if (ec) {
+            printf("SoundBank: failed to create cache dir \"%s\": %s\n", kCacheDir, ec.message().c_str());
+        }
+    }
+
+    // Each sound is independent, so just have every thread grab the next one.
+    int numThreads = _numLoadThreads;
+    if (numThreads <= 0) {
+        numThreads = std::max(1, (int)std::thread::hardware_concurrency());
+    }
+    numThreads = std::min(numThreads, numSounds);
+    std::atomic<int> nextSoundIx = 0;
+    std::atomic<int64_t> residentBytes = 0;
+    auto loadLoop = [&]() {
+        for (int i = nextSoundIx++; i < numSounds; i = nextSoundIx++) {
+            residentBytes += LoadSound(i, sampleRate);
+        }
     };
-    assert(_soundNames.size() == _exclusiveGroups.size());
-    char filename[1024];
-    strcpy(filename, "data/sounds/");
-    int nameStartIx = strlen(filename);
-    char* nameStart = &(filename[nameStartIx]);
-    for (int i = 0, n = _soundNames.size(); i < n; ++i) {        
-        strcpy(nameStart, _soundNames[i]);
-        audio::PcmSound sound;
-        unsigned int numChannels;
-        unsigned int thisSampleRate;
-        sound._buffer = drwav_open_file_and_read_pcm_frames_f32(
-            filename, &numChannels, &thisSampleRate, &sound._bufferLength, /*???*/NULL);
-        if (sound._buffer == nullptr) {
-            printf("SoundBank: error loading sample \"%s\"\n", _soundNames[i]);
+    std::vector<std::thread> threads;
+    for (int threadIx = 1; threadIx < numThreads; ++threadIx) {
+        threads.emplace_back(loadLoop);
+    }
+    loadLoop();
+    for (std::thread& t : threads) {
+        t.join();
+    }
+
+    double const ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+    printf("SoundBank: %d sounds, %lld KB resident, loaded in %.0f ms on %d threads\n", numSounds, (long long)(residentBytes / 1024), ms, std::max(numThreads, 1));
+}
+
+int64_t SoundBank::LoadSound(int soundIx, int sampleRate) {
+    audio::PcmSound& sound = _sounds[soundIx];
+    std::string& path = _soundPaths[soundIx];
+    path = kSoundDir;
+    path += _soundFiles[soundIx];
+
+    drwav_uint32 const wantedSampleRate = (drwav_uint32)sampleRate;
+    drwav wav;
+    if (!drwav_init_file(&wav, path.c_str(), NULL)) {
+        printf("SoundBank: error loading sample \"%s\"\n", _soundNames[soundIx]);
+        return 0;
+    }
+
+    // Anything that isn't already mono at our rate gets converted once and
+    // read from the cache after that. Everything past this point (including
+    // the streamer) just sees a mono file at the right rate.
+    if (wav.channels != 1 || wav.sampleRate != wantedSampleRate) {
+        drwav_uninit(&wav);
+        if (!_useCache) {
+            printf("SoundBank: sample \"%s\" needs conversion but the cache is disabled\n", _soundNames[soundIx]);
+            return 0;
+        }
+        uint64_t hash;
+        if (!HashFile(path.c_str(), &hash)) {
+            printf("SoundBank: failed to read \"%s\"\n", path.c_str());
+            return 0;
         }
-        assert(numChannels == 1);
-        if (thisSampleRate != sampleRate) {
-            printf("SoundBank: WARNING expected sample rate of %d, but sample \"%s\" is %u\n", sampleRate, _soundNames[i], thisSampleRate);
+        char cacheName[64];
+        snprintf(cacheName, sizeof(cacheName), "%016llx_%d.wav", (unsigned long long)hash, sampleRate);
+        std::string cachePath = kCacheDir;
+        cachePath += cacheName;
+        if (!std::filesystem::exists(cachePath)) {
+            if (!ConvertToCache(path.c_str(), cachePath.c_str(), sampleRate)) {
+                return 0;
+            }
+            printf("SoundBank: converted \"%s\" to %d Hz mono\n", _soundNames[soundIx], sampleRate);
         }
-        assert(sound._buffer != nullptr);
-        _sounds.push_back(std::move(sound));
+        path = std::move(cachePath);
+        if (!drwav_init_file(&wav, path.c_str(), NULL)) {
+            printf("SoundBank: error loading cached sample \"%s\"\n", path.c_str());
+            return 0;
+        }
+        assert(wav.channels == 1 && wav.sampleRate == wantedSampleRate);
+    }
+
+    int64_t residentBytes = 0;
+    sound._bufferLength = wav.totalPCMFrameCount;
+    uint64_t const streamMinFrames = (uint64_t)(_streamMinSecs * wav.sampleRate);
+    uint64_t const streamHeadFrames = (uint64_t)(kStreamHeadSecs * wav.sampleRate);
+    if (_streamMinSecs > 0.f && sound._bufferLength > streamMinFrames && sound._bufferLength > streamHeadFrames) {
+        sound._streamed = true;
+        sound._residentLength = streamHeadFrames;
+    } else {
+        sound._residentLength = sound._bufferLength;
     }
+
+    drwav_uint64 framesRead = 0;
+    if (_int16Resident && !sound._streamed) {
+        sound._buffer16 = new int16_t[sound._residentLength];
+        framesRead = drwav_read_pcm_frames_s16(&wav, sound._residentLength, sound._buffer16);
+        residentBytes += sound._residentLength * sizeof(int16_t);
+    } else {
+        sound._buffer = new float[sound._residentLength];
+        framesRead = drwav_read_pcm_frames_f32(&wav, sound._residentLength, sound._buffer);
+        residentBytes += sound._residentLength * sizeof(float);
+    }
+    if (framesRead != sound._residentLength) {
+        printf("SoundBank: WARNING only read %llu of %llu frames from \"%s\"\n", (unsigned long long)framesRead, (unsigned long long)sound._residentLength, _soundNames[soundIx]);
+        sound._residentLength = framesRead;
+        if (!sound._streamed) {
+            sound._bufferLength = framesRead;
+        }
+    }
+    drwav_uninit(&wav);
+    return residentBytes;
 }
 
 void SoundBank::Destroy() {
     for (audio::PcmSound& sound : _sounds) {
-        drwav_free(sound._buffer, /*???*/NULL);
+        delete[] sound._buffer;
+        delete[] sound._buffer16;
+    }
+    _sounds.clear();
+}
+
+bool SoundBank::HasStreamedSounds() const {
+    for (audio::PcmSound const& sound : _sounds) {
+        if (sound._streamed) {
+            return true;
+        }
     }
+    return false;
 }
 
 int SoundBank::GetSoundIx(char const* soundName) const {
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdint>
+#include <string>
 #include <vector>
 
 #include "audio_util.h"
@@ -9,7 +11,33 @@ public:
     void LoadSounds(int sampleRate);
     void Destroy();    
     int GetSoundIx(char const* soundName) const;  // returns -1 if not found
+    bool HasStreamedSounds() const;
     std::vector<audio::PcmSound> _sounds;
-    std::vector<char const*> _soundNames;
+    std::vector<char const*> _soundNames;  // points into _soundFiles
+    std::vector<std::string> _soundFiles;  // from the manifest, relative to data/sounds/
+    std::vector<std::string> _soundPaths;  // what we actually load/stream from (might be in the cache)
     std::vector<int> _exclusiveGroups;
+
+    // Set these before LoadSounds().
+    char const* _manifestFilename = "data/sounds/manifest.xml";
+    // Decode on this many threads. <= 0 uses one per core.
+    int _numLoadThreads = 0;
+    // Samples that aren't mono at the requested sample rate get converted
+    // once and saved under data/sounds/cache/, keyed by a hash of the source
+    // file. Without the cache they fail to load.
+    bool _useCache = true;
+    // Sounds longer than this only keep their first kStreamHeadSecs in memory
+    // and stream the rest from disk while playing. <= 0 keeps everything resident.
+    float _streamMinSecs = 4.f;
+    // Store resident sounds as int16 instead of float. Half the memory, and
+    // our samples are 16-bit on disk anyway.
+    bool _int16Resident = false;
+
+    // Long enough to cover the disk thread getting to a newly started voice.
+    static float constexpr kStreamHeadSecs = 0.5f;
+
+private:
+    // Returns how many bytes of it are resident. Thread safe across
+    // different soundIx.
+    int64_t LoadSound(int soundIx, int sampleRate);
 };
@@ -0,0 +1,332 @@
+#include "spatial_index.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "transform.h"
+
+namespace ne {
+
+namespace {
+
+// Slab test. Touching counts.
+bool SegmentOverlapsBounds(float x0, float z0, float x1, float z1, SpatialIndex::Bounds const& b) {
+    float tMin = 0.f;
+    float tMax = 1.f;
+    float const p[2] = { x0, z0 };
+    float const d[2] = { x1 - x0, z1 - z0 };
+    float const lo[2] = { b._minX, b._minZ };
+    float const hi[2] = { b._maxX, b._maxZ };
+    for (int axis = 0; axis < 2; ++axis) {
+        if (d[axis] == 0.f) {
+            if (p[axis] < lo[axis] || p[axis] > hi[axis]) {
+                return false;
+            }
+            continue;
+        }
+        float const inv = 1.f / d[axis];
+        float t0 = (lo[axis] - p[axis]) * inv;
+        float t1 = (hi[axis] - p[axis]) * inv;
+        if (t0 > t1) {
+            std::swap(t0, t1);
+        }
+        tMin = std::max(tMin, t0);
+        tMax = std::min(tMax, t1);
+        if (tMin > tMax) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace
+
+void SpatialIndex::Init(float cellSize) {
+    assert(cellSize > 0.f);
+    _cellSize = cellSize;
+    _invCellSize = 1.f / cellSize;
+    _entries.clear();
+    _entryIxById.clear();
+    _cells.clear();
+    _refitStamp = 0;
+    _queryStamp = 0;
+    _nextRefitIx = 0;
+    _maxLocalRadius = 0.f;
+}
+
+int SpatialIndex::ToCell(float x) const {
+    return static_cast<int>(std::floor(x * _invCellSize));
+}
+
+void SpatialIndex::AddToCells(int entryIx) {
+    Entry const& entry = _entries[entryIx];
+    for (int cellX = entry._cellMinX; cellX <= entry._cellMaxX; ++cellX) {
+        for (int cellZ = entry._cellMinZ; cellZ <= entry._cellMaxZ; ++cellZ) {
+            _cells[MakeCellKey(cellX, cellZ)].push_back(entryIx);
+        }
+    }
+}
+
+void SpatialIndex::RemoveFromCells(int entryIx) {
+    Entry const& entry = _entries[entryIx];
+    for (int cellX = entry._cellMinX; cellX <= entry._cellMaxX; ++cellX) {
+        for (int cellZ = entry._cellMinZ; cellZ <= entry._cellMaxZ; ++cellZ) {
+            auto cellIter = _cells.find(MakeCellKey(cellX, cellZ));
+            assert(cellIter != _cells.end());
+            std::vector<int>& cell = cellIter->second;
+            auto it = std::find(cell.begin(), cell.end(), entryIx);
+            assert(it != cell.end());
+            *it = cell.back();
+            cell.pop_back();
+            if (cell.empty()) {
+                _cells.erase(cellIter);
+            }
+        }
+    }
+}
+
+void SpatialIndex::UpdateEntry(Entry& entry, Transform const& t, float localHalfX, float localHalfZ) {
+    entry._pos = t.Pos();
+    entry._quat = t.Quat();
+    entry._scale = t.Scale();
+    entry._localHalfX = localHalfX;
+    entry._localHalfZ = localHalfZ;
+    entry._yaw = -entry._quat.EulerAngles()._y;
+    entry._localRadius = std::sqrt(localHalfX * localHalfX + localHalfZ * localHalfZ);
+    entry._worldPolygonVersion = -1;
+
+    // Bounds of the footprint rotated by yaw.
+    float const c = std::abs(std::cos(entry._yaw));
+    float const s = std::abs(std::sin(entry._yaw));
+    float const hx = localHalfX * std::abs(entry._scale._x);
+    float const hz = localHalfZ * std::abs(entry._scale._z);
+    float const extentX = c * hx + s * hz;
+    float const extentZ = s * hx + c * hz;
+    entry._bounds._minX = entry._pos._x - extentX;
+    entry._bounds._maxX = entry._pos._x + extentX;
+    entry._bounds._minZ = entry._pos._z - extentZ;
+    entry._bounds._maxZ = entry._pos._z + extentZ;
+}
+
+void SpatialIndex::BeginRefit() {
+    ++_refitStamp;
+    _nextRefitIx = 0;
+    _maxLocalRadius = 0.f;
+}
+
+void SpatialIndex::Refit(EntityId id, Transform const& t, float localHalfX, float localHalfZ) {
+    // Entities usually come in the same order every refit, so try the next
+    // entry before the map.
+    int entryIx = -1;
+    if (_nextRefitIx < (int)_entries.size() && _entries[_nextRefitIx]._id._id == id._id) {
+        entryIx = _nextRefitIx;
+    } else {
+        auto it = _entryIxById.find(id._id);
+        if (it != _entryIxById.end()) {
+            entryIx = it->second;
+        }
+    }
+
+    bool needsCells = false;
+    if (entryIx < 0) {
+        entryIx = _entries.size();
+        _entries.emplace_back();
+        _entries.back()._id = id;
+        _entryIxById.emplace(id._id, entryIx);
+        UpdateEntry(_entries.back(), t, localHalfX, localHalfZ);
+        needsCells = true;
+    } else {
+        Entry& entry = _entries[entryIx];
+        Vec3 const pos = t.Pos();
+        bool const moved =
+            !(entry._pos == pos) || !(entry._quat._v == t.Quat()._v) || !(entry._scale == t.Scale()) ||
+            entry._localHalfX != localHalfX || entry._localHalfZ != localHalfZ;
+        if (moved) {
+            UpdateEntry(entry, t, localHalfX, localHalfZ);
+            // Keep at least half the margin as slack, so the next refit
+            // can't be too late.
+            Bounds const& b = entry._bounds;
+            Bounds const& fat = entry._fatBounds;
+            float const slack = 0.5f * kMargin;
+            needsCells = b._minX - slack < fat._minX || b._minZ - slack < fat._minZ || b._maxX + slack > fat._maxX || b._maxZ + slack > fat._maxZ;
+        }
+    }
+    _nextRefitIx = entryIx + 1;
+
+    Entry& entry = _entries[entryIx];
+    entry._refitStamp = _refitStamp;
+    _maxLocalRadius = std::max(_maxLocalRadius, entry._localRadius);
+    if (!needsCells) {
+        return;
+    }
+
+    entry._fatBounds._minX = entry._bounds._minX - kMargin;
+    entry._fatBounds._minZ = entry._bounds._minZ - kMargin;
+    entry._fatBounds._maxX = entry._bounds._maxX + kMargin;
+    entry._fatBounds._maxZ = entry._bounds._maxZ + kMargin;
+    int const cellMinX = ToCell(entry._fatBounds._minX);
+    int const cellMinZ = ToCell(entry._fatBounds._minZ);
+    int const cellMaxX = ToCell(entry._fatBounds._maxX);
+    int const cellMaxZ = ToCell(entry._fatBounds._maxZ);
+    if (cellMinX == entry._cellMinX && cellMinZ == entry._cellMinZ && cellMaxX == entry._cellMaxX && cellMaxZ == entry._cellMaxZ) {
+        return;
+    }
+    RemoveFromCells(entryIx);
+    entry._cellMinX = cellMinX;
+    entry._cellMinZ = cellMinZ;
+    entry._cellMaxX = cellMaxX;
+    entry._cellMaxZ = cellMaxZ;
+    AddToCells(entryIx);
+}
+
+void SpatialIndex::EndRefit() {
+    for (int entryIx = _entries.size() - 1; entryIx >= 0; --entryIx) {
+        if (_entries[entryIx]._refitStamp == _refitStamp) {
+            continue;
+        }
+        // Swap the last entry into this one's place.
+        RemoveFromCells(entryIx);
+        _entryIxById.erase(_entries[entryIx]._id._id);
+        int const lastIx = _entries.size() - 1;
+        if (entryIx != lastIx) {
+            RemoveFromCells(lastIx);
+            _entries[entryIx] = _entries[lastIx];
+            _entryIxById[_entries[entryIx]._id._id] = entryIx;
+            AddToCells(entryIx);
+        }
+        _entries.pop_back();
+    }
+}
+
+std::vector<Vec3> const& SpatialIndex::GetWorldPolygon(int entryIx, std::vector<Vec3> const& localPolygon, int localPolygonVersion, Vec3 const& polyScale) {
+    assert(localPolygonVersion >= 0);
+    Entry& entry = _entries[entryIx];
+    if (entry._worldPolygonVersion == localPolygonVersion && entry._worldPolygonScale == polyScale) {
+        return entry._worldPolygon;
+    }
+    entry._worldPolygonVersion = localPolygonVersion;
+    entry._worldPolygonScale = polyScale;
+    entry._worldPolygon.clear();
+    float const c = std::cos(entry._yaw);
+    float const s = std::sin(entry._yaw);
+    auto addPoint = [&](float localX, float localZ) {
+        float const x = localX * polyScale._x;
+        float const z = localZ * polyScale._z;
+        entry._worldPolygon.emplace_back(entry._pos._x + c * x - s * z, entry._pos._y, entry._pos._z + s * x + c * z);
+    };
+    if (localPolygon.size() < 3) {
+        addPoint(entry._localHalfX, entry._localHalfZ);
+        addPoint(entry._localHalfX, -entry._localHalfZ);
+        addPoint(-entry._localHalfX, -entry._localHalfZ);
+        addPoint(-entry._localHalfX, entry._localHalfZ);
+    } else {
+        for (Vec3 const& p : localPolygon) {
+            addPoint(p._x, p._z);
+        }
+    }
+    return entry._worldPolygon;
+}
+
+void SpatialIndex::AddCandidates(CellKey key, Bounds const& box, std::vector<int>* out) {
+    auto cellIter = _cells.find(key);
+    if (cellIter == _cells.end()) {
+        return;
+    }
+    for (int entryIx : cellIter->second) {
+        Entry& entry = _entries[entryIx];
+        if (entry._queryStamp != _queryStamp && entry._fatBounds.Overlaps(box)) {
+            entry._queryStamp = _queryStamp;
+            out->push_back(entryIx);
+        }
+    }
+}
+
+void SpatialIndex::QueryBox(Bounds const& box, std::vector<int>* out) {
+    out->clear();
+    ++_queryStamp;
+    int const cellMinX = ToCell(box._minX);
+    int const cellMinZ = ToCell(box._minZ);
+    int const cellMaxX = ToCell(box._maxX);
+    int const cellMaxZ = ToCell(box._maxZ);
+    int64_t const numQueryCells = int64_t(cellMaxX - cellMinX + 1) * (cellMaxZ - cellMinZ + 1);
+    if (numQueryCells > (int64_t)_cells.size()) {
+        // Big box: cheaper to look at every occupied cell.
+        for (auto const& cell : _cells) {
+            AddCandidates(cell.first, box, out);
+        }
+    } else {
+        for (int cellX = cellMinX; cellX <= cellMaxX; ++cellX) {
+            for (int cellZ = cellMinZ; cellZ <= cellMaxZ; ++cellZ) {
+                AddCandidates(MakeCellKey(cellX, cellZ), box, out);
+            }
+        }
+    }
+    std::sort(out->begin(), out->end());
+}
+
+void SpatialIndex::QueryRadius(Vec3 const& center, float radius, std::vector<int>* out) {
+    Bounds box;
+    box._minX = center._x - radius;
+    box._minZ = center._z - radius;
+    box._maxX = center._x + radius;
+    box._maxZ = center._z + radius;
+    QueryBox(box, out);
+    float const radius2 = radius * radius;
+    out->erase(std::remove_if(out->begin(), out->end(), [&](int entryIx) {
+        Bounds const& b = _entries[entryIx]._fatBounds;
+        float const dx = std::max(b._minX - center._x, std::max(0.f, center._x - b._maxX));
+        float const dz = std::max(b._minZ - center._z, std::max(0.f, center._z - b._maxZ));
+        return dx * dx + dz * dz > radius2;
+    }), out->end());
+}
+
+void SpatialIndex::QuerySegment(Vec3 const& p0, Vec3 const& p1, std::vector<int>* out) {
+    out->clear();
+    ++_queryStamp;
+    Bounds segBox;
+    segBox._minX = std::min(p0._x, p1._x);
+    segBox._minZ = std::min(p0._z, p1._z);
+    segBox._maxX = std::max(p0._x, p1._x);
+    segBox._maxZ = std::max(p0._z, p1._z);
+    int const cellMinX = ToCell(segBox._minX);
+    int const cellMinZ = ToCell(segBox._minZ);
+    int const cellMaxX = ToCell(segBox._maxX);
+    int const cellMaxZ = ToCell(segBox._maxZ);
+    auto addCell = [&](CellKey key) {
+        auto cellIter = _cells.find(key);
+        if (cellIter == _cells.end()) {
+            return;
+        }
+        for (int entryIx : cellIter->second) {
+            Entry& entry = _entries[entryIx];
+            if (entry._queryStamp != _queryStamp && SegmentOverlapsBounds(p0._x, p0._z, p1._x, p1._z, entry._fatBounds)) {
+                entry._queryStamp = _queryStamp;
+                out->push_back(entryIx);
+            }
+        }
+    };
+    int64_t const numQueryCells = int64_t(cellMaxX - cellMinX + 1) * (cellMaxZ - cellMinZ + 1);
+    if (numQueryCells > (int64_t)_cells.size()) {
+        for (auto const& cell : _cells) {
+            addCell(cell.first);
+        }
+    } else {
+        for (int cellX = cellMinX; cellX <= cellMaxX; ++cellX) {
+            for (int cellZ = cellMinZ; cellZ <= cellMaxZ; ++cellZ) {
+                // Skip the cells of the segment's box that it doesn't cross.
+                Bounds cellBounds;
+                cellBounds._minX = cellX * _cellSize;
+                cellBounds._minZ = cellZ * _cellSize;
+                cellBounds._maxX = cellBounds._minX + _cellSize;
+                cellBounds._maxZ = cellBounds._minZ + _cellSize;
+                if (SegmentOverlapsBounds(p0._x, p0._z, p1._x, p1._z, cellBounds)) {
+                    addCell(MakeCellKey(cellX, cellZ));
+                }
+            }
+        }
+    }
+    std::sort(out->begin(), out->end());
+}
+
+}  // namespace ne
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "matrix.h"
+#include "new_entity_id.h"
+#include "quaternion.h"
+
+struct Transform;
+
+namespace ne {
+
+// Uniform grid over the XZ plane, hashed so it doesn't need world bounds up
+// front. EntityManager keeps one per entity type that asks for it (see
+// EntityManager::EnableSpatialIndex) and refits it once per sim tick.
+//
+// Each entry caches the entity's yaw and its world-space XZ bounds, so
+// queries only touch the entities near them and don't redo the
+// quaternion -> euler conversion for each one. Exact tests can also get the
+// footprint's world-space outline from GetWorldPolygon(), which is only
+// rebuilt when the entity moves.
+//
+// Entries are bucketed by their bounds grown by kMargin, and only move to
+// new cells when their real bounds get within kMargin / 2 of that fat box's
+// edge. Queries return every entry whose fat box overlaps, so an entity that
+// moved less than kMargin / 2 since the last refit is still found. Callers
+// do the exact test against the entity's current transform.
+class SpatialIndex {
+public:
+    static float constexpr kMargin = 1.f;
+
+    struct Bounds {
+        float _minX = 0.f;
+        float _minZ = 0.f;
+        float _maxX = 0.f;
+        float _maxZ = 0.f;
+
+        bool Overlaps(Bounds const& b) const {
+            return _minX <= b._maxX && b._minX <= _maxX && _minZ <= b._maxZ && b._minZ <= _maxZ;
+        }
+    };
+
+    struct Entry {
+        EntityId _id;
+        // Transform as of the last refit, to spot what moved.
+        Vec3 _pos;
+        Quaternion _quat;
+        Vec3 _scale;
+        float _localHalfX = 0.5f;
+        float _localHalfZ = 0.5f;
+
+        float _yaw = 0.f;  // -_quat.EulerAngles()._y, like the flow collision code wants
+        float _localRadius = 0.f;  // of the footprint at unit scale
+        Bounds _bounds;  // real
+        Bounds _fatBounds;
+        int _cellMinX = 0, _cellMinZ = 0, _cellMaxX = -1, _cellMaxZ = -1;
+
+        uint32_t _refitStamp = 0;
+        uint32_t _queryStamp = 0;
+
+        // See GetWorldPolygon(). Cleared whenever the entry moves.
+        std::vector<Vec3> _worldPolygon;
+        Vec3 _worldPolygonScale;
+        int _worldPolygonVersion = -1;
+    };
+
+    void Init(float cellSize);
+
+    // Call BeginRefit(), then Refit() on every entity that should be in the
+    // index, then EndRefit() to drop the ones that weren't. The footprint is
+    // the entity's XZ half extents at unit scale, rotated and scaled with its
+    // transform.
+    void BeginRefit();
+    void Refit(EntityId id, Transform const& t, float localHalfX, float localHalfZ);
+    void EndRefit();
+
+    // These append entry indices to out, in entry order and without
+    // duplicates. out is cleared first.
+    void QueryBox(Bounds const& box, std::vector<int>* out);
+    void QueryRadius(Vec3 const& center, float radius, std::vector<int>* out);
+    void QuerySegment(Vec3 const& p0, Vec3 const& p1, std::vector<int>* out);
+
+    Entry const& GetEntry(int entryIx) const { return _entries[entryIx]; }
+    // The entry's outline in world space as of the last refit: localPolygon
+    // (or the entry's footprint box if that has fewer than 3 points) scaled
+    // by polyScale, rotated by _yaw and moved to _pos. Same transform as
+    // geometry::PointInConvexPolygon2D. Cached until the entry moves, or gets
+    // asked for a different polyScale or localPolygonVersion. Callers bump
+    // the version (>= 0) whenever localPolygon's points change.
+    std::vector<Vec3> const& GetWorldPolygon(int entryIx, std::vector<Vec3> const& localPolygon, int localPolygonVersion, Vec3 const& polyScale);
+    int GetNumEntries() const { return _entries.size(); }
+    // Largest _localRadius of any entry, for callers that grow shapes by
+    // something proportional to them.
+    float GetMaxLocalRadius() const { return _maxLocalRadius; }
+
+private:
+    typedef uint64_t CellKey;
+    CellKey MakeCellKey(int cellX, int cellZ) const {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(cellX)) << 32) | static_cast<uint32_t>(cellZ);
+    }
+    int ToCell(float x) const;
+    void AddToCells(int entryIx);
+    void RemoveFromCells(int entryIx);
+    void UpdateEntry(Entry& entry, Transform const& t, float localHalfX, float localHalfZ);
+    void AddCandidates(CellKey key, Bounds const& box, std::vector<int>* out);
+
+    float _cellSize = 8.f;
+    float _invCellSize = 1.f / 8.f;
+    std::vector<Entry> _entries;
+    std::unordered_map<int, int> _entryIxById;
+    std::unordered_map<CellKey, std::vector<int>> _cells;
+    uint32_t _refitStamp = 0;
+    uint32_t _queryStamp = 0;
+    int _nextRefitIx = 0;
+    float _maxLocalRadius = 0.f;
+};
+
+}  // namespace ne
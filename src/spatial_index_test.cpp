@@ -0,0 +1,311 @@
+// Checks SpatialIndex against brute force: random boxes that move, turn,
+// appear and disappear between refits, queried with boxes, circles and
+// segments. Checks the cached world-space outlines follow the entities. Then
+// times point queries over an obstacle-heavy layout.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "spatial_index.h"
+#include "transform.h"
+
+namespace {
+
+struct TestEntity {
+    ne::EntityId _id;
+    Transform _t;
+    float _halfX = 0.5f;
+    float _halfZ = 0.5f;
+};
+
+typedef ne::SpatialIndex::Bounds Bounds;
+
+// Real bounds of the entity right now, computed the long way.
+Bounds GetBounds(TestEntity const& e) {
+    float const yaw = -e._t.Quat().EulerAngles()._y;
+    float const hx = e._halfX * e._t.Scale()._x;
+    float const hz = e._halfZ * e._t.Scale()._z;
+    Bounds b;
+    b._minX = b._minZ = 1e30f;
+    b._maxX = b._maxZ = -1e30f;
+    for (int corner = 0; corner < 4; ++corner) {
+        float const lx = (corner & 1) ? hx : -hx;
+        float const lz = (corner & 2) ? hz : -hz;
+        float const x = e._t.Pos()._x + std::cos(yaw) * lx - std::sin(yaw) * lz;
+        float const z = e._t.Pos()._z + std::sin(yaw) * lx + std::cos(yaw) * lz;
+        b._minX = std::min(b._minX, x);
+        b._maxX = std::max(b._maxX, x);
+        b._minZ = std::min(b._minZ, z);
+        b._maxZ = std::max(b._maxZ, z);
+    }
+    return b;
+}
+
+bool SegmentHitsBounds(Vec3 const& p0, Vec3 const& p1, Bounds const& b) {
+    // Sample densely; only used to find what the index must not miss.
+    int constexpr kSteps = 256;
+    for (int i = 0; i <= kSteps; ++i) {
+        float const t = (float)i / kSteps;
+        float const x = p0._x + t * (p1._x - p0._x);
+        float const z = p0._z + t * (p1._z - p0._z);
+        if (x >= b._minX && x <= b._maxX && z >= b._minZ && z <= b._maxZ) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void RandomizeTransform(std::mt19937& rng, TestEntity& e) {
+    std::uniform_real_distribution<float> pos(-100.f, 100.f);
+    std::uniform_real_distribution<float> scale(0.2f, 12.f);
+    std::uniform_real_distribution<float> angle(-3.14f, 3.14f);
+    e._t.SetPos(Vec3(pos(rng), 0.f, pos(rng)));
+    e._t.SetScale(Vec3(scale(rng), 1.f, scale(rng)));
+    Quaternion q;
+    q.SetFromAngleAxis(angle(rng), Vec3(0.f, 1.f, 0.f));
+    e._t.SetQuat(q);
+}
+
+// Every entity whose bounds pass the test has to show up in the results.
+template <typename HitFn>
+bool CheckNoMisses(char const* what, int iteration, std::vector<TestEntity> const& entities,
+    ne::SpatialIndex const& index, std::vector<int> const& results, HitFn hit) {
+    for (TestEntity const& e : entities) {
+        if (!hit(GetBounds(e))) {
+            continue;
+        }
+        bool found = false;
+        for (int entryIx : results) {
+            found = found || index.GetEntry(entryIx)._id._id == e._id._id;
+        }
+        if (!found) {
+            printf("iteration %d: %s missed entity %d\n", iteration, what, e._id._id);
+            return false;
+        }
+    }
+    for (size_t i = 1; i < results.size(); ++i) {
+        if (results[i - 1] >= results[i]) {
+            printf("iteration %d: %s results not sorted and unique\n", iteration, what);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool RunRandomized(uint32_t seed) {
+    std::mt19937 rng(seed);
+    ne::SpatialIndex index;
+    index.Init(/*cellSize=*/8.f);
+    std::vector<TestEntity> entities;
+    int nextId = 0;
+    std::vector<int> results;
+    std::uniform_real_distribution<float> pos(-120.f, 120.f);
+    std::uniform_real_distribution<float> small(-0.2f, 0.2f);
+    for (int iteration = 0; iteration < 500; ++iteration) {
+        // Churn: add, remove, teleport, and nudge.
+        int const numAdds = std::uniform_int_distribution<int>(0, 10)(rng);
+        for (int i = 0; i < numAdds; ++i) {
+            TestEntity e;
+            e._id._id = nextId++;
+            e._id._type = ne::EntityType::FlowWall;
+            if (rng() % 3 == 0) {
+                e._halfX = std::uniform_real_distribution<float>(0.1f, 2.f)(rng);
+                e._halfZ = std::uniform_real_distribution<float>(0.1f, 2.f)(rng);
+            }
+            RandomizeTransform(rng, e);
+            entities.push_back(e);
+        }
+        int const numRemoves = std::uniform_int_distribution<int>(0, 8)(rng);
+        for (int i = 0; i < numRemoves && !entities.empty(); ++i) {
+            int const ix = rng() % entities.size();
+            entities[ix] = entities.back();
+            entities.pop_back();
+        }
+        for (TestEntity& e : entities) {
+            int const r = rng() % 16;
+            if (r == 0) {
+                RandomizeTransform(rng, e);
+            } else if (r < 8) {
+                e._t.Translate(Vec3(small(rng), 0.f, small(rng)));
+            }
+        }
+
+        index.BeginRefit();
+        for (TestEntity const& e : entities) {
+            index.Refit(e._id, e._t, e._halfX, e._halfZ);
+        }
+        index.EndRefit();
+        if (index.GetNumEntries() != (int)entities.size()) {
+            printf("iteration %d: %d entries, expected %zu\n", iteration, index.GetNumEntries(), entities.size());
+            return false;
+        }
+
+        // Move things a little after the refit, like entities updating
+        // before a query in the same tick. Less than half the margin, so
+        // nothing should get lost.
+        for (TestEntity& e : entities) {
+            if (rng() % 4 == 0) {
+                float const d = 0.45f * ne::SpatialIndex::kMargin;
+                e._t.Translate(Vec3(d * (rng() % 2 ? 1.f : -1.f), 0.f, d * (rng() % 2 ? 1.f : -1.f)));
+            }
+        }
+
+        for (int q = 0; q < 20; ++q) {
+            Vec3 const c(pos(rng), 0.f, pos(rng));
+            float const extent = std::uniform_real_distribution<float>(0.f, 30.f)(rng);
+            Bounds box;
+            box._minX = c._x - extent;
+            box._minZ = c._z - extent * 0.5f;
+            box._maxX = c._x + extent;
+            box._maxZ = c._z + extent * 0.5f;
+            index.QueryBox(box, &results);
+            if (!CheckNoMisses("box", iteration, entities, index, results, [&](Bounds const& b) { return b.Overlaps(box); })) {
+                return false;
+            }
+
+            index.QueryRadius(c, extent, &results);
+            bool const radiusOk = CheckNoMisses("radius", iteration, entities, index, results, [&](Bounds const& b) {
+                float const dx = std::max(b._minX - c._x, std::max(0.f, c._x - b._maxX));
+                float const dz = std::max(b._minZ - c._z, std::max(0.f, c._z - b._maxZ));
+                return dx * dx + dz * dz <= extent * extent;
+            });
+            if (!radiusOk) {
+                return false;
+            }
+
+            Vec3 const p1(pos(rng), 0.f, pos(rng));
+            index.QuerySegment(c, p1, &results);
+            if (!CheckNoMisses("segment", iteration, entities, index, results, [&](Bounds const& b) { return SegmentHitsBounds(c, p1, b); })) {
+                return false;
+            }
+        }
+    }
+    printf("seed %u: %d entities at the end, max local radius %f\n", seed, index.GetNumEntries(), index.GetMaxLocalRadius());
+    return true;
+}
+
+// The box outline at the entity's own scale has to cover exactly its bounds,
+// including after it moves.
+bool CheckWorldPolygons() {
+    std::mt19937 rng(7);
+    std::vector<TestEntity> entities(100);
+    for (int i = 0; i < (int)entities.size(); ++i) {
+        entities[i]._id._id = i;
+    }
+    ne::SpatialIndex index;
+    index.Init(/*cellSize=*/8.f);
+    std::vector<Vec3> const noPolygon;
+    for (int iteration = 0; iteration < 3; ++iteration) {
+        index.BeginRefit();
+        for (TestEntity& e : entities) {
+            RandomizeTransform(rng, e);
+            index.Refit(e._id, e._t, e._halfX, e._halfZ);
+        }
+        index.EndRefit();
+        for (int entryIx = 0; entryIx < index.GetNumEntries(); ++entryIx) {
+            TestEntity const& e = entities[index.GetEntry(entryIx)._id._id];
+            std::vector<Vec3> const& poly = index.GetWorldPolygon(entryIx, noPolygon, /*localPolygonVersion=*/0, e._t.Scale());
+            Bounds b;
+            b._minX = b._minZ = 1e30f;
+            b._maxX = b._maxZ = -1e30f;
+            for (Vec3 const& p : poly) {
+                b._minX = std::min(b._minX, p._x);
+                b._maxX = std::max(b._maxX, p._x);
+                b._minZ = std::min(b._minZ, p._z);
+                b._maxZ = std::max(b._maxZ, p._z);
+            }
+            Bounds const expected = GetBounds(e);
+            float const err = std::max(
+                std::max(std::abs(b._minX - expected._minX), std::abs(b._maxX - expected._maxX)),
+                std::max(std::abs(b._minZ - expected._minZ), std::abs(b._maxZ - expected._maxZ)));
+            if (poly.size() != 4 || err > 1e-3f) {
+                printf("iteration %d: world polygon of entity %d is off by %f\n", iteration, e._id._id, err);
+                return false;
+            }
+        }
+    }
+
+    // Editing the points has to show up as soon as the version changes.
+    std::vector<Vec3> triangle = { Vec3(1.f, 0.f, 0.f), Vec3(0.f, 0.f, 1.f), Vec3(-1.f, 0.f, 0.f) };
+    Vec3 const one(1.f, 1.f, 1.f);
+    float const before = index.GetWorldPolygon(0, triangle, /*localPolygonVersion=*/1, one)[0]._x;
+    triangle[0]._x = 2.f;
+    float const after = index.GetWorldPolygon(0, triangle, /*localPolygonVersion=*/2, one)[0]._x;
+    if (std::abs(after - before) < 0.5f) {
+        printf("world polygon didn't follow an edited point\n");
+        return false;
+    }
+    printf("World polygons: ok\n");
+    return true;
+}
+
+// A few thousand walls spread over a long level, and a point query from
+// somewhere along it, like FindOverlapWithWall does every tick.
+void TimePointQueries() {
+    int constexpr kNumWalls = 4000;
+    int constexpr kNumQueries = 100000;
+    std::mt19937 rng(99);
+    std::vector<TestEntity> entities(kNumWalls);
+    for (int i = 0; i < kNumWalls; ++i) {
+        entities[i]._id._id = i;
+        RandomizeTransform(rng, entities[i]);
+        entities[i]._t.SetPos(Vec3(std::uniform_real_distribution<float>(-40.f, 40.f)(rng), 0.f, -i * 2.f));
+    }
+    ne::SpatialIndex index;
+    index.Init(/*cellSize=*/8.f);
+    auto start = std::chrono::high_resolution_clock::now();
+    index.BeginRefit();
+    for (TestEntity const& e : entities) {
+        index.Refit(e._id, e._t, e._halfX, e._halfZ);
+    }
+    index.EndRefit();
+    auto mid = std::chrono::high_resolution_clock::now();
+    // A refit where nothing moved, which is most ticks for most walls.
+    index.BeginRefit();
+    for (TestEntity const& e : entities) {
+        index.Refit(e._id, e._t, e._halfX, e._halfZ);
+    }
+    index.EndRefit();
+    auto mid2 = std::chrono::high_resolution_clock::now();
+    std::vector<int> results;
+    long long numResults = 0;
+    for (int q = 0; q < kNumQueries; ++q) {
+        Vec3 const p(std::uniform_real_distribution<float>(-40.f, 40.f)(rng), 0.f, std::uniform_real_distribution<float>(-2.f * kNumWalls, 0.f)(rng));
+        float const r = index.GetMaxLocalRadius();
+        Bounds box;
+        box._minX = p._x - r;
+        box._minZ = p._z - r;
+        box._maxX = p._x + r;
+        box._maxZ = p._z + r;
+        index.QueryBox(box, &results);
+        numResults += results.size();
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    printf("%d walls: first refit %.1f us, idle refit %.1f us, %.0f ns per point query (%.1f candidates on average)\n",
+        kNumWalls,
+        std::chrono::duration<double, std::micro>(mid - start).count(),
+        std::chrono::duration<double, std::micro>(mid2 - mid).count(),
+        std::chrono::duration<double, std::nano>(end - mid2).count() / kNumQueries,
+        (double)numResults / kNumQueries);
+}
+
+}  // namespace
+
+int main() {
+    bool success = true;
+    success = RunRandomized(1) && success;
+    success = RunRandomized(2) && success;
+    success = CheckWorldPolygons() && success;
+
+    TimePointQueries();
+
+    if (!success) {
+        printf("FAILED\n");
+        return 1;
+    }
+    return 0;
+}
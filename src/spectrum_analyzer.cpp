@@ -0,0 +1,253 @@
+#include "spectrum_analyzer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+#include "features.h"
+
+#if COMPUTE_FFT
+#include <fftw3.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define SPECTRUM_SIMD_X86 1
+#include <immintrin.h>
+#else
+#define SPECTRUM_SIMD_X86 0
+#endif
+
+namespace audio {
+
+namespace {
+
+// How long the analysis thread naps when there's no new hop to analyze. A hop
+// is ~10ms at 48kHz.
+auto constexpr kAnalysisThreadSleep = std::chrono::milliseconds(2);
+
+// Lowest band covers everything up to the first power-of-two bin at or above
+// this; every band after that is an octave.
+float constexpr kMinFirstBandFreq = 100.f;
+
+// Same feel as the old per-frame smoothing in game.cpp.
+float constexpr kSmoothingTimeSecs = 0.02f;
+
+float constexpr kSilenceDb = -120.f;
+
+// Largest buffer the audio thread pushes at once. We don't read anything the
+// next Push could be overwriting.
+int constexpr kMaxPushFrames = 4096;
+static_assert(SpectrumAnalyzer::kRingFrames >= SpectrumAnalyzer::kFftSize + 2 * kMaxPushFrames);
+
+#if COMPUTE_FFT
+// out[i] = window[i] * in[i], converting to double for fftw.
+void ApplyWindow(float const* in, double const* window, double* out, int n) {
+    int i = 0;
+#if SPECTRUM_SIMD_X86
+    for (; i + 4 <= n; i += 4) {
+        __m128 const x = _mm_loadu_ps(in + i);
+        __m128d const lo = _mm_cvtps_pd(x);
+        __m128d const hi = _mm_cvtps_pd(_mm_movehl_ps(x, x));
+        _mm_storeu_pd(out + i, _mm_mul_pd(lo, _mm_loadu_pd(window + i)));
+        _mm_storeu_pd(out + i + 2, _mm_mul_pd(hi, _mm_loadu_pd(window + i + 2)));
+    }
+#endif
+    for (; i < n; ++i) {
+        out[i] = window[i] * in[i];
+    }
+}
+
+// mags[k] = |bins[k]| for interleaved (re, im) pairs.
+void ComputeMagnitudes(double const* bins, float* mags, int n) {
+    int k = 0;
+#if SPECTRUM_SIMD_X86
+    for (; k + 2 <= n; k += 2) {
+        __m128d const a = _mm_loadu_pd(bins + 2 * k);
+        __m128d const b = _mm_loadu_pd(bins + 2 * k + 2);
+        __m128d const a2 = _mm_mul_pd(a, a);
+        __m128d const b2 = _mm_mul_pd(b, b);
+        __m128d const sum = _mm_add_pd(_mm_unpacklo_pd(a2, b2), _mm_unpackhi_pd(a2, b2));
+        __m128 const m = _mm_cvtpd_ps(_mm_sqrt_pd(sum));
+        _mm_storel_pi(reinterpret_cast<__m64*>(mags + k), m);
+    }
+#endif
+    for (; k < n; ++k) {
+        double const re = bins[2 * k];
+        double const im = bins[2 * k + 1];
+        mags[k] = static_cast<float>(std::sqrt(re * re + im * im));
+    }
+}
+#endif  // COMPUTE_FFT
+
+}  // namespace
+
+void SpectrumAnalyzer::Init(int sampleRate) {
+    _sampleRate = sampleRate;
+
+    // Bins 1..kFftSize/2 (skipping DC). Bin k is centered on k * sr / N.
+    float const binWidth = static_cast<float>(sampleRate) / kFftSize;
+    int firstBandLastBin = 1;
+    while (firstBandLastBin * binWidth < kMinFirstBandFreq && firstBandLastBin < kFftSize / 2) {
+        firstBandLastBin <<= 1;
+    }
+    _bandEndBins.clear();
+    for (int lastBin = firstBandLastBin; lastBin <= kFftSize / 2; lastBin <<= 1) {
+        _bandEndBins.push_back(lastBin + 1);
+    }
+    int const numBands = static_cast<int>(_bandEndBins.size());
+    for (Spectrum& s : _spectra) {
+        s._frameIx = -1;
+        s._bandMaxFreqs.resize(numBands);
+        s._bandDb.assign(numBands, 0.f);
+        s._bandScaled.assign(numBands, 0.f);
+        for (int b = 0; b < numBands; ++b) {
+            s._bandMaxFreqs[b] = (_bandEndBins[b] - 1) * binWidth;
+        }
+    }
+
+#if COMPUTE_FFT
+    _ring.assign(kRingFrames, 0.f);
+    _writeIx = 0;
+
+    double windowSum = 0.0;
+    _window.resize(kFftSize);
+    for (int i = 0; i < kFftSize; ++i) {
+        _window[i] = 0.5 - 0.5 * std::cos(2.0 * 3.14159265358979323846 * i / kFftSize);
+        windowSum += _window[i];
+    }
+    // Same as the old 2|X|/N for a sine, corrected for the window's gain.
+    _magnitudeScale = static_cast<float>(2.0 / windowSum);
+    _smoothingFactor = 1.f - std::exp(-static_cast<float>(kHopSize) / (sampleRate * kSmoothingTimeSecs));
+    _smoothDb.assign(numBands, kSilenceDb);
+
+    _fftIn = static_cast<double*>(fftw_malloc(sizeof(double) * kFftSize));
+    fftw_complex* fftOut = static_cast<fftw_complex*>(fftw_malloc(sizeof(fftw_complex) * (kFftSize / 2 + 1)));
+    _fftOut = fftOut;
+    _fftPlan = fftw_plan_dft_r2c_1d(kFftSize, _fftIn, fftOut, FFTW_ESTIMATE);
+
+    _quit = false;
+    _running = true;
+    _thread = std::thread(&SpectrumAnalyzer::AnalysisThreadLoop, this);
+#endif
+}
+
+void SpectrumAnalyzer::Destroy() {
+    if (!_running) {
+        return;
+    }
+    _quit = true;
+    _thread.join();
+    _running = false;
+#if COMPUTE_FFT
+    fftw_destroy_plan(static_cast<fftw_plan>(_fftPlan));
+    fftw_free(_fftIn);
+    fftw_free(_fftOut);
+    _fftPlan = nullptr;
+    _fftIn = nullptr;
+    _fftOut = nullptr;
+#endif
+}
+
+void SpectrumAnalyzer::Push(float const* buffer, int numFrames, int numChannels) {
+    if (!_running) {
+        return;
+    }
+    assert(numFrames <= kMaxPushFrames);
+    uint64_t writeIx = _writeIx.load(std::memory_order_relaxed);
+    float const channelScale = 1.f / numChannels;
+    for (int i = 0; i < numFrames; ++i, ++writeIx) {
+        float sample = 0.f;
+        for (int c = 0; c < numChannels; ++c) {
+            sample += buffer[i * numChannels + c];
+        }
+        _ring[writeIx & (kRingFrames - 1)] = sample * channelScale;
+    }
+    _writeIx.store(writeIx, std::memory_order_release);
+}
+
+Spectrum const& SpectrumAnalyzer::AcquireLatest() {
+    if (_middleIx.load(std::memory_order_relaxed) & kNewBit) {
+        int const prevMiddle = _middleIx.exchange(_frontIx, std::memory_order_acq_rel);
+        _frontIx = prevMiddle & ~kNewBit;
+    }
+    return _spectra[_frontIx];
+}
+
+void SpectrumAnalyzer::Publish() {
+    int const prevMiddle = _middleIx.exchange(_backIx | kNewBit, std::memory_order_acq_rel);
+    _backIx = prevMiddle & ~kNewBit;
+}
+
+void SpectrumAnalyzer::AnalysisThreadLoop() {
+    uint64_t nextWindowEndIx = kFftSize;
+    while (!_quit) {
+        uint64_t const writeIx = _writeIx.load(std::memory_order_acquire);
+        if (writeIx < nextWindowEndIx) {
+            std::this_thread::sleep_for(kAnalysisThreadSleep);
+            continue;
+        }
+        // Fell behind (or the window is about to be overwritten): skip ahead
+        // to the newest full window instead of analyzing stale audio.
+        if (writeIx - nextWindowEndIx > kRingFrames - kFftSize - kMaxPushFrames) {
+            nextWindowEndIx = writeIx;
+        }
+        if (AnalyzeWindow(nextWindowEndIx)) {
+            Publish();
+        }
+        nextWindowEndIx += kHopSize;
+    }
+}
+
+bool SpectrumAnalyzer::AnalyzeWindow(uint64_t windowEndIx) {
+#if COMPUTE_FFT
+    // Copy the window out of the ring (it may wrap), then make sure the audio
+    // thread didn't lap us while we were at it.
+    uint64_t const windowStartIx = windowEndIx - kFftSize;
+    float samples[kFftSize];
+    for (int i = 0; i < kFftSize; ++i) {
+        samples[i] = _ring[(windowStartIx + i) & (kRingFrames - 1)];
+    }
+    uint64_t const writeIx = _writeIx.load(std::memory_order_acquire);
+    if (writeIx - windowStartIx > kRingFrames - kMaxPushFrames) {
+        return false;
+    }
+
+    ApplyWindow(samples, _window.data(), _fftIn, kFftSize);
+    fftw_execute(static_cast<fftw_plan>(_fftPlan));
+
+    int constexpr kNumBins = kFftSize / 2;
+    float mags[kNumBins + 1];
+    ComputeMagnitudes(reinterpret_cast<double const*>(_fftOut), mags, kNumBins + 1);
+
+    Spectrum& s = _spectra[_backIx];
+    s._frameIx = static_cast<int64_t>(windowEndIx);
+    int const numBands = static_cast<int>(_bandEndBins.size());
+    float minDb = std::numeric_limits<float>::max();
+    float maxDb = std::numeric_limits<float>::lowest();
+    int bin = 1;
+    for (int b = 0; b < numBands; ++b) {
+        float sum = 0.f;
+        int const startBin = bin;
+        for (; bin < _bandEndBins[b]; ++bin) {
+            sum += mags[bin];
+        }
+        float const avg = _magnitudeScale * sum / (bin - startBin);
+        float const db = avg > 0.f ? std::max(kSilenceDb, 20.f * std::log10(avg)) : kSilenceDb;
+        _smoothDb[b] += _smoothingFactor * (db - _smoothDb[b]);
+        s._bandDb[b] = _smoothDb[b];
+        minDb = std::min(minDb, _smoothDb[b]);
+        maxDb = std::max(maxDb, _smoothDb[b]);
+    }
+    float const scale = 1.f / (maxDb - minDb + 0.00001f);
+    for (int b = 0; b < numBands; ++b) {
+        s._bandScaled[b] = (s._bandDb[b] - minDb) * scale;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+}  // namespace audio
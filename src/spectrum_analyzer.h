@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace audio {
+
+// Log-band energies of the recent output, for visualizers.
+struct Spectrum {
+    // Output frame just past the analyzed window. -1 until the first one.
+    int64_t _frameIx = -1;
+    std::vector<float> _bandMaxFreqs;
+    std::vector<float> _bandDb;      // smoothed energy per band
+    std::vector<float> _bandScaled;  // _bandDb mapped to [0,1] over the current min/max
+};
+
+// Analyzes the output on its own thread so visualization costs the game
+// thread nothing and never contends with the audio thread.
+//
+// The audio thread copies each output buffer into a ring (Push, never
+// blocks). The analysis thread takes Hann-windowed FFTs of kFftSize frames
+// every kHopSize frames (50% overlap), bins them into octave bands, and
+// publishes the result through a triple buffer, so the writer never waits on
+// the reader and the reader never sees a half-written Spectrum.
+//
+// The FFT only runs with COMPUTE_FFT (features.h). Without it the bands are
+// still laid out but stay at zero.
+class SpectrumAnalyzer {
+public:
+    static int constexpr kFftSize = 1024;
+    static int constexpr kHopSize = kFftSize / 2;
+    static int constexpr kRingFrames = 1 << 14;
+
+    void Init(int sampleRate);
+    void Destroy();
+
+    // Audio thread. Mixes interleaved channels down to mono.
+    void Push(float const* buffer, int numFrames, int numChannels);
+
+    // Game thread. Returns the newest published spectrum; the reference stays
+    // valid (and unchanged) until the next call.
+    Spectrum const& AcquireLatest();
+
+private:
+    void AnalysisThreadLoop();
+    // Returns false if the audio thread overwrote the window while we were
+    // copying it out.
+    bool AnalyzeWindow(uint64_t windowEndIx);
+    void Publish();
+
+    int _sampleRate = 0;
+    std::vector<int> _bandEndBins;  // one past the last FFT bin of each band
+
+    // Audio thread -> analysis thread. Indices count frames forever and get
+    // masked on access; only the audio thread writes _writeIx.
+    std::vector<float> _ring;
+    std::atomic<uint64_t> _writeIx = 0;
+    bool _running = false;
+
+    // Analysis thread only.
+    std::vector<double> _window;
+    float _magnitudeScale = 0.f;
+    float _smoothingFactor = 0.f;
+    std::vector<float> _smoothDb;
+    double* _fftIn = nullptr;
+    void* _fftOut = nullptr;  // fftw_complex*
+    void* _fftPlan = nullptr;  // fftw_plan
+
+    // Triple buffer. The analysis thread fills _spectra[_backIx], then swaps
+    // it with the middle one; the game thread swaps the middle one into
+    // _frontIx if it's newer than what it has.
+    static int constexpr kNewBit = 4;
+    Spectrum _spectra[3];
+    int _backIx = 0;
+    std::atomic<int> _middleIx = 1;
+    int _frontIx = 2;
+
+    std::thread _thread;
+    std::atomic<bool> _quit = false;
+};
+
+}  // namespace audio
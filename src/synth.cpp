@@ -1,86 +1,43 @@
 #include "synth.h"
 
-#include <iostream>
+#include <cmath>
+#include <limits>
 
 #include "audio_util.h"
 #include "constants.h"
+#include "logger.h"
 #include "math_util.h"
 #include "rng.h"
 
 using audio::SynthParamType;
 
-#define POLYBLEP 1
-
 namespace synth {
 namespace {
 
 int constexpr kSamplesPerCutoffEnvModulate = 64;
 
-#if POLYBLEP
-float Polyblep(float t, float dt) {
-    if (t < dt) {
-        t /= dt;
-        return t+t - t*t - 1.0f;
-    } else if (t > 1.0f - dt) {
-        t = (t - 1.0f) / dt;
-        return t*t + t+t + 1.0f;
-    }
-    else {
-        return 0.0f;
-    }
-}
-#endif
-
-float GenerateSquare(float const phase, float const phaseChange) {
-    float v = 0.0f;
-    if (phase < kPi) {
-        v = 1.0f;
-    } else {
-        v = -1.0f;
-    }
-#if POLYBLEP
-    // polyblep
-     float dt = phaseChange * k1_2Pi;
-     float t = phase * k1_2Pi;
-     v += Polyblep(t, dt);
-
-     //v -= Polyblep(fmod(t + 0.5f, 1.0f), dt);
-
-     /*float unused;
-     float tFrac = modf(t + 0.5f, &unused);
-     v -= Polyblep(tFrac, dt);*/
-
-     float tFrac = t + 0.5f;
-     if (tFrac >= 1.f) {
-         tFrac -= 1.f;
-     }
-#endif
-    return v;
-}
-
-float GenerateSaw(float const phase, float const phaseChange) {
-    float v = (phase * k1_Pi) - 1.0f;
-#if POLYBLEP
-    // polyblep
-     float dt = phaseChange * k1_2Pi;
-     float t = phase * k1_2Pi;
-     v -= Polyblep(t, dt);
-#endif
-    return v;
-}
+// Time constant of the gain/cutoff smoothing. Short enough that automation
+// and patch changes still feel immediate.
+float constexpr kParamSmoothingSecs = 0.005f;
 
 float GenerateNoise(rng::State& rng) {
     return rng::GetFloat(rng, -1.f, 1.f);
 }
 
 int constexpr kDelayBufferCount = 2 * 65536;
+
+static_assert(kMaxUnison <= kMaxOscUnison);
+static_assert(kMaxVoices % kOscLaneGroupSize == 0);
 }  // namespace
 
 void InitStateData(StateData& state, int channel, int const sampleRate, int const framesPerBuffer, int const numBufferChannels) {
+    InitTables();
     state = StateData();
     state.channel = channel;
     state.voiceScratchBuffer = new float[framesPerBuffer * numBufferChannels];
     state.synthScratchBuffer = new float[framesPerBuffer * numBufferChannels];
+    state.oscKernel = GetBestSupportedOscKernel();
+    state.oscLaneBuffer = new float[kNumAnalogOscillators * kMaxVoices * framesPerBuffer];
     state.sampleRate = sampleRate;
     state.framesPerBuffer = framesPerBuffer;
     
@@ -105,8 +62,10 @@ void DestroyStateData(StateData& state) {
     delete[] state.voiceScratchBuffer;
     delete[] state.synthScratchBuffer;
     delete[] state.delayBuffer;
+    delete[] state.oscLaneBuffer;
     state.voiceScratchBuffer = nullptr;
     state.synthScratchBuffer = nullptr;
+    state.oscLaneBuffer = nullptr;
     state.delayBuffer = nullptr;
 }
 
@@ -175,6 +134,8 @@ struct ADSREnvSpecInTicks {
     float minValue = 0.01f;
 };
 
+// Blocks can be any length (Process() splits them at events), so the decay
+// and release multipliers are per sample and get raised to the block length.
 void adsrEnvelope(ADSREnvSpecInTicks const& spec, int const framesPerBuffer, ADSREnvState& state) {
     switch (state.phase) {
         case ADSRPhase::Closed:
@@ -219,14 +180,15 @@ void adsrEnvelope(ADSREnvSpecInTicks const& spec, int const framesPerBuffer, ADS
                     state.multiplier = 1.f;
                 } else {
                     state.currentValue = 1.f;
-                    state.multiplier = calcMultiplier(1.f, spec.sustainLevel, spec.decayTime / framesPerBuffer);
+                    state.multiplier = calcMultiplier(1.f, spec.sustainLevel, spec.decayTime);
                 }
             }
-            state.currentValue *= state.multiplier;
+            state.currentValue *= std::pow(state.multiplier, (float)framesPerBuffer);
             state.ticksSincePhaseStart += framesPerBuffer;
             if (state.ticksSincePhaseStart >= spec.decayTime) {
                 state.phase = ADSRPhase::Sustain;
                 state.ticksSincePhaseStart = 0;
+                state.currentValue = spec.sustainLevel;
             }
             break;
         case ADSRPhase::Sustain:
@@ -242,10 +204,10 @@ void adsrEnvelope(ADSREnvSpecInTicks const& spec, int const framesPerBuffer, ADS
                     //
                     // TODO: calculate release from sustain to 0, or from
                     // current level to 0? I like sustain better.
-                    state.multiplier = calcMultiplier(spec.sustainLevel, spec.minValue, spec.releaseTime / framesPerBuffer);
+                    state.multiplier = calcMultiplier(spec.sustainLevel, spec.minValue, spec.releaseTime);
                 }
             }
-            state.currentValue *= state.multiplier;
+            state.currentValue *= std::pow(state.multiplier, (float)framesPerBuffer);
             state.ticksSincePhaseStart += framesPerBuffer;
             if (state.ticksSincePhaseStart >= spec.releaseTime) {
                 state.phase = ADSRPhase::Closed;
@@ -283,14 +245,58 @@ float UpdateFilter(float const a1, float const a2, float const a3, float const k
     return 0.f;
 }
 
-// NOTE: This assumes oscFaderGains's size is the same as kNumAnalogOscillators.
-void ProcessVoice(Voice& voice, int const sampleRate, float pitchLFOValue,
-    float modulatedCutoff, ADSREnvSpecInternal const& ampEnvSpec,
-    ADSREnvSpecInternal const& cutoffEnvSpec,
-    ADSREnvSpecInTicks const& pitchEnvSpec,
-    Patch const& patch, float* outputBuffer, int const numChannels, int const framesPerBuffer, int const samplesPerMoogCutoffUpdate,
-    float const* oscFaderGains) {
-    float const dt = 1.f / sampleRate;
+namespace {
+
+// Patches with LookupTables on get the table/approximation versions; everyone
+// else gets libm so their output doesn't change.
+bool UseTables(Patch const& patch) {
+    return patch.GetLookupTables() != LookupTables::Off;
+}
+
+inline float Exp2(bool useTables, float x) {
+    return useTables ? FastExp2(x) : powf(2.f, x);
+}
+
+inline float Sin(bool useTables, float x) {
+    return useTables ? FastSin(x) : sinf(x);
+}
+
+// Map from linear [0,1] to exponential from -40db to 0db.
+float PatchGainToAmp(Patch const& patch, bool useTables) {
+    float const startAmp = 0.01f;
+    float const factor = 1.0f / startAmp;
+    float gain = 0.f;
+    float const patchGain = patch.Get(SynthParamType::Gain);
+    if (patchGain > 0.f) {
+        if (useTables) {
+            float constexpr kLog2Factor = 6.64385619f;  // log2(1 / startAmp)
+            gain = startAmp * FastExp2(kLog2Factor * patchGain);
+        } else {
+            gain = startAmp * powf(factor, patchGain);
+        }
+    }
+    return gain;
+}
+
+// Moves p a block's worth toward target. The first call jumps straight there.
+ControlRamp StepSmoothedParam(SmoothedParam& p, float target, float coeff) {
+    if (!p._started) {
+        p._value = target;
+        p._started = true;
+    }
+    ControlRamp ramp;
+    ramp._start = p._value;
+    p._value += coeff * (target - p._value);
+    ramp._end = p._value;
+    return ramp;
+}
+
+}  // namespace
+
+// Portamento, pitch LFO and pitch envelope. Returns the voice's modulated center frequency.
+float UpdateVoicePitch(Voice& voice, int const sampleRate, float pitchLFOValue,
+    ADSREnvSpecInTicks const& pitchEnvSpec, Patch const& patch, int const framesPerBuffer) {
+    bool const useTables = UseTables(patch);
 
     // portamento
     if (voice.postPortamentoF <= 0.f) {
@@ -302,7 +308,7 @@ void ProcessVoice(Voice& voice, int const sampleRate, float pitchLFOValue,
         voice.postPortamentoF = voice.oscillators[0].f;
     }
     else {
-        float const kPortamentoFactor = powf(2.f, 1.f / framesPerOctave);
+        float const kPortamentoFactor = Exp2(useTables, 1.f / framesPerOctave);
         if (voice.postPortamentoF > voice.oscillators[0].f) {
             voice.postPortamentoF /= kPortamentoFactor;
             voice.postPortamentoF = std::max(voice.oscillators[0].f, voice.postPortamentoF);
@@ -314,127 +320,131 @@ void ProcessVoice(Voice& voice, int const sampleRate, float pitchLFOValue,
     }
 
     // Now use the LFO value to get a new frequency.
-    float modulatedF = voice.postPortamentoF * powf(2.0f, pitchLFOValue);
+    float modulatedF = voice.postPortamentoF * Exp2(useTables, pitchLFOValue);
 
     // Modulate by pitch envelope.
     adsrEnvelope(pitchEnvSpec, framesPerBuffer, voice.pitchEnvState);
-    modulatedF *= powf(2.f, patch.Get(audio::SynthParamType::PitchEnvGain) * voice.pitchEnvState.currentValue);
+    modulatedF *= Exp2(useTables, patch.Get(audio::SynthParamType::PitchEnvGain) * voice.pitchEnvState.currentValue);
     // TODO: clamp F?
+    return modulatedF;
+}
 
-    // final gain. Map from linear [0,1] to exponential from -80db to 0db.
-    float const startAmp = 0.01f;
-    float const factor = 1.0f / startAmp;
-    float gain = 0.f;
-    float const patchGain = patch.Get(SynthParamType::Gain);
-    if (patchGain > 0.f) {
-        gain = startAmp * powf(factor, patch.Get(SynthParamType::Gain));
-    }    
-
-    // float lpfA1, lpfA2, lpfA3, lpfK;  // filter shit
-    // {
-    //     float res = patch.Get(SynthParamType::Peak) / 4.f;
-    //     float g = tan(kPi * modulatedCutoff * dt);
-    //     lpfK = 2 - 2 * res;
-    //     assert((1 + g * (g + lpfK)) != 0.f);
-    //     lpfA1 = 1 / (1 + g * (g + lpfK));
-    //     lpfA2 = g * lpfA1;
-    //     lpfA3 = g * lpfA2;
-    // }
+// Renders the analog oscillators of every active voice into
+// state.oscLaneBuffer. Row (oscIx * lanesPerOsc + activeIx) holds that
+// oscillator's output for state.activeVoices[activeIx], already scaled by
+// unison and fader gains. modulatedFs is indexed by activeIx too. Returns
+// lanesPerOsc, which is numActiveVoices padded up to kOscLaneGroupSize; the
+// padding lanes render silence.
+//
+// NOTE: This assumes oscFaderGains's size is the same as kNumAnalogOscillators.
+int ProcessOscillators(StateData& state, float const* modulatedFs, float const* oscFaderGains, int const sampleRate, int const framesPerBuffer) {
+    Patch const& patch = state.patch;
+    bool const useTables = UseTables(patch);
 
-    // TODO: only run this if cutoff has changed.
-    float hpfA1, hpfA2, hpfA3, hpfK;  // filter shit
-    {
-        float res = patch.Get(SynthParamType::HpfPeak) / 4.f;
-        float g = tan(kPi * patch.Get(SynthParamType::HpfCutoff) * dt);
-        hpfK = 2 - 2 * res;
-        assert((1 + g * (g + hpfK)) != 0.f);
-        hpfA1 = 1 / (1 + g * (g + hpfK));
-        hpfA2 = g * hpfA1;
-        hpfA3 = g * hpfA2;
-    }    
-    
     int unisonLevels = static_cast<int>(patch.Get(audio::SynthParamType::Unison));
     unisonLevels = std::min(unisonLevels, (kMaxUnison - 1) / 2);
     int const unison = 2 * unisonLevels + 1;
-    float detuneCents = patch.Get(audio::SynthParamType::UnisonDetune);
-    for (int oscIx = 0; oscIx < kNumAnalogOscillators; ++oscIx) {
-        Oscillator& osc = voice.oscillators[oscIx];
-        float oscF = modulatedF;
-        if (oscIx > 0) {
-            oscF = modulatedF * powf(2.f, patch.Get(SynthParamType::Detune));
+    float unisonGain = 1.f;
+    float unisonRatios[kMaxUnison];
+    unisonRatios[0] = 1.f;
+    if (unisonLevels > 0) {
+        unisonGain = sqrt(1.f / unison);
+        float detuneCents = patch.Get(audio::SynthParamType::UnisonDetune);
+        float dCents = detuneCents / unisonLevels;
+        float detuneLevelCents = 0.f;
+        int detuneIx = 1;
+        for (int ii = 0; ii < unisonLevels; ++ii) {
+            detuneLevelCents += dCents;
+            unisonRatios[detuneIx] = Exp2(useTables, detuneLevelCents / 1200.f);
+            detuneIx += 2;
         }
-
-        float freqs[kMaxUnison];
-        freqs[0] = oscF;
-        float unisonGain = 1.f;
-        if (unisonLevels > 0) {
-            unisonGain = sqrt(1.f / unison);
-            float dCents = detuneCents / unisonLevels;
-            float detuneLevelCents = 0.f;
-            int detuneIx = 1;
-            for (int ii = 0; ii < unisonLevels; ++ii) {
-                detuneLevelCents += dCents;
-                float ratio = std::powf(2.f, detuneLevelCents / 1200.f);
-                freqs[detuneIx] = oscF * ratio;
-                freqs[detuneIx + 1] = oscF / ratio;
-                detuneIx += 2;
+    }
+    float const osc2Ratio = Exp2(useTables, patch.Get(SynthParamType::Detune));
+
+    int const numActive = state.numActiveVoices;
+    int const lanesPerOsc = (numActive + kOscLaneGroupSize - 1) / kOscLaneGroupSize * kOscLaneGroupSize;
+    int constexpr kNumLanes = kNumAnalogOscillators * kMaxVoices;
+    float phases[kMaxUnison][kNumLanes];
+    float phaseChanges[kMaxUnison][kNumLanes];
+    float oscGains[kNumLanes];
+    float isSquare[kNumLanes];
+    Waveform waveforms[kNumAnalogOscillators];
+    waveforms[0] = patch.GetOsc1Waveform();
+    waveforms[1] = patch.GetOsc2Waveform();
+    for (int oscIx = 0; oscIx < kNumAnalogOscillators; ++oscIx) {
+        for (int activeIx = 0; activeIx < numActive; ++activeIx) {
+            int const laneIx = oscIx * lanesPerOsc + activeIx;
+            Oscillator const& osc = state.voices[state.activeVoices[activeIx]].oscillators[oscIx];
+            float oscF = modulatedFs[activeIx];
+            if (oscIx > 0) {
+                oscF = modulatedFs[activeIx] * osc2Ratio;
             }
+            float freqs[kMaxUnison];
+            freqs[0] = oscF;
+            for (int ii = 1; ii < unison; ii += 2) {
+                freqs[ii] = oscF * unisonRatios[ii];
+                freqs[ii + 1] = oscF / unisonRatios[ii];
+            }
+            for (int ii = 0; ii < unison; ++ii) {
+                phases[ii][laneIx] = osc.phases[ii];
+                phaseChanges[ii][laneIx] = k2Pi * freqs[ii] / sampleRate;
+            }
+            oscGains[laneIx] = oscFaderGains[oscIx];
+            isSquare[laneIx] = (waveforms[oscIx] == Waveform::Square) ? 1.f : 0.f;
         }
-        
-        float oscGain = oscFaderGains[oscIx];
-        float phaseChanges[kMaxUnison];
-        for (int ii = 0; ii < unison; ++ii) {
-            phaseChanges[ii] = k2Pi * freqs[ii] / sampleRate;
-        }
-        Waveform const waveform = (oscIx == 0) ? patch.GetOsc1Waveform() : patch.GetOsc2Waveform();
-        switch (waveform) {
-            case Waveform::Saw: {
-                int outputIx = 0;                
-                for (int sampleIx = 0; sampleIx < framesPerBuffer; ++sampleIx) {
-                    float oscV = 0.f;
-                    for (int ii = 0; ii < unison; ++ii) {
-                        if (osc.phases[ii] >= k2Pi) {
-                            osc.phases[ii] -= k2Pi;
-                        }
-                        float v = GenerateSaw(osc.phases[ii], phaseChanges[ii]);
-                        oscV += unisonGain * v;                        
-
-                        osc.phases[ii] += phaseChanges[ii];
-                    }
-                    float oscWithGain = oscV * oscGain;
-                    for (int channelIx = 0; channelIx < numChannels; ++channelIx) {
-                        outputBuffer[outputIx++] += oscWithGain;
-                    }
-                }
-                break;
+        // Padding lanes get zero gain. Their phase change just has to be
+        // nonzero so the polyblep's 1/dt stays finite.
+        for (int activeIx = numActive; activeIx < lanesPerOsc; ++activeIx) {
+            int const laneIx = oscIx * lanesPerOsc + activeIx;
+            for (int ii = 0; ii < unison; ++ii) {
+                phases[ii][laneIx] = 0.f;
+                phaseChanges[ii][laneIx] = k2Pi * 0.01f;
             }
+            oscGains[laneIx] = 0.f;
+            isSquare[laneIx] = 0.f;
+        }
+    }
+
+    // Saw/square lanes for every voice go through the SIMD kernel together.
+    // Noise stays scalar since each oscillator has its own RNG.
+    for (int oscIx = 0; oscIx < kNumAnalogOscillators; ++oscIx) {
+        int const firstLaneIx = oscIx * lanesPerOsc;
+        float* oscOutput = state.oscLaneBuffer + firstLaneIx * framesPerBuffer;
+        switch (waveforms[oscIx]) {
+            case Waveform::Saw:
             case Waveform::Square: {
-                int outputIx = 0;
-                for (int sampleIx = 0; sampleIx < framesPerBuffer; ++sampleIx) {
-                    float oscV = 0.f;
-                    for (int ii = 0; ii < unison; ++ii) {
-                        if (osc.phases[ii] >= k2Pi) {
-                            osc.phases[ii] -= k2Pi;
-                        }
-                        float v = GenerateSquare(osc.phases[ii], phaseChanges[ii]);
-                        oscV += unisonGain * v;
-
-                        osc.phases[ii] += phaseChanges[ii];
-                    }
-                    float oscWithGain = oscV * oscGain;
-                    for (int channelIx = 0; channelIx < numChannels; ++channelIx) {
-                        outputBuffer[outputIx++] += oscWithGain;
-                    }
+                // If the next oscillator is also saw/square, do both in one call so AVX gets full registers.
+                int numLanes = lanesPerOsc;
+                if (oscIx + 1 < kNumAnalogOscillators && waveforms[oscIx + 1] != Waveform::Noise) {
+                    numLanes += lanesPerOsc;
+                }
+                OscLanes lanes;
+                lanes.numLanes = numLanes;
+                lanes.unison = unison;
+                lanes.unisonGain = unisonGain;
+                for (int ii = 0; ii < unison; ++ii) {
+                    lanes.phases[ii] = &phases[ii][firstLaneIx];
+                    lanes.phaseChanges[ii] = &phaseChanges[ii][firstLaneIx];
                 }
+                lanes.oscGains = &oscGains[firstLaneIx];
+                lanes.isSquare = &isSquare[firstLaneIx];
+                if (patch.GetWavetables()) {
+                    RenderWavetableLanes(lanes, oscOutput, framesPerBuffer, framesPerBuffer);
+                } else {
+                    RenderOscLanes(state.oscKernel, lanes, oscOutput, framesPerBuffer, framesPerBuffer);
+                }
+                oscIx += (numLanes / lanesPerOsc) - 1;
                 break;
             }
             case Waveform::Noise: {
-                int outputIx = 0;
-                for (int sampleIx = 0; sampleIx < framesPerBuffer; ++sampleIx) {
-                    float oscV = GenerateNoise(osc.rng);
-                    oscV *= oscGain;
-                    for (int channelIx = 0; channelIx < numChannels; ++channelIx) {
-                        outputBuffer[outputIx++] += oscV;
+                for (int activeIx = 0; activeIx < numActive; ++activeIx) {
+                    Oscillator& osc = state.voices[state.activeVoices[activeIx]].oscillators[oscIx];
+                    float const oscGain = oscFaderGains[oscIx];
+                    float* out = oscOutput + activeIx * framesPerBuffer;
+                    for (int sampleIx = 0; sampleIx < framesPerBuffer; ++sampleIx) {
+                        float oscV = GenerateNoise(osc.rng);
+                        oscV *= oscGain;
+                        out[sampleIx] = oscV;
                     }
                 }
                 break;
@@ -446,19 +456,68 @@ void ProcessVoice(Voice& voice, int const sampleRate, float pitchLFOValue,
         }
     }
 
+    for (int oscIx = 0; oscIx < kNumAnalogOscillators; ++oscIx) {
+        for (int activeIx = 0; activeIx < numActive; ++activeIx) {
+            int const laneIx = oscIx * lanesPerOsc + activeIx;
+            Oscillator& osc = state.voices[state.activeVoices[activeIx]].oscillators[oscIx];
+            for (int ii = 0; ii < unison; ++ii) {
+                osc.phases[ii] = phases[ii][laneIx];
+            }
+        }
+    }
+
+    return lanesPerOsc;
+}
+
+// Takes the voice's oscillator rows from ProcessOscillators, runs them through
+// the filters and amp envelope and adds the result into outputBuffer.
+void ProcessVoice(Voice& voice, int const sampleRate, float const* oscRows, int const oscRowStride,
+    ControlRamp const& cutoff, ControlRamp const& gain, ADSREnvSpecInternal const& ampEnvSpec,
+    ADSREnvSpecInternal const& cutoffEnvSpec,
+    Patch const& patch, float* outputBuffer, int const numChannels, int const framesPerBuffer, int const samplesPerMoogCutoffUpdate) {
+    float const dt = 1.f / sampleRate;
+
+    // float lpfA1, lpfA2, lpfA3, lpfK;  // filter shit
+    // {
+    //     float res = patch.Get(SynthParamType::Peak) / 4.f;
+    //     float g = tan(kPi * modulatedCutoff * dt);
+    //     lpfK = 2 - 2 * res;
+    //     assert((1 + g * (g + lpfK)) != 0.f);
+    //     lpfA1 = 1 / (1 + g * (g + lpfK));
+    //     lpfA2 = g * lpfA1;
+    //     lpfA3 = g * lpfA2;
+    // }
+
+    // TODO: only run this if cutoff has changed.
+    float hpfA1, hpfA2, hpfA3, hpfK;  // filter shit
+    {
+        float res = patch.Get(SynthParamType::HpfPeak) / 4.f;
+        float g = tan(kPi * patch.Get(SynthParamType::HpfCutoff) * dt);
+        hpfK = 2 - 2 * res;
+        assert((1 + g * (g + hpfK)) != 0.f);
+        hpfA1 = 1 / (1 + g * (g + hpfK));
+        hpfA2 = g * hpfA1;
+        hpfA3 = g * hpfA2;
+    }    
+
     // Apply filters and some more gains
     {
         int outputIx = 0;
-        int cutoffModulateCounter = 0;
-        float gainFactor = voice.velocity * gain;
+        int& cutoffModulateCounter = voice.cutoffModulateCounter;
+        float const cutoffStep = (cutoff._end - cutoff._start) / framesPerBuffer;
+        float const gainStep = voice.velocity * (gain._end - gain._start) / framesPerBuffer;
+        float gainFactor = voice.velocity * gain._start;
         for (int sampleIx = 0; sampleIx < framesPerBuffer; ++sampleIx) {
-            float v = outputBuffer[outputIx];
+            float v = 0.f;
+            for (int oscIx = 0; oscIx < kNumAnalogOscillators; ++oscIx) {
+                v += oscRows[oscIx * oscRowStride + sampleIx];
+            }
 
             // Cutoff envelope
             if (cutoffModulateCounter <= 0) {
                 cutoffModulateCounter = samplesPerMoogCutoffUpdate;
                 AdsrTick(cutoffEnvSpec, &voice.cutoffEnvState);
-                float c = modulatedCutoff + patch.Get(SynthParamType::CutoffEnvGain) * voice.cutoffEnvState.value;
+                float c = cutoff._start + cutoffStep * sampleIx + patch.Get(SynthParamType::CutoffEnvGain) * voice.cutoffEnvState.value;
                 c = math_util::Clamp(c, 0.f, 20000.f);
                 float peak = patch.Get(SynthParamType::Peak);
                 voice.moogLpfState.setFilterParams(c, peak);
@@ -476,16 +535,17 @@ void ProcessVoice(Voice& voice, int const sampleRate, float pitchLFOValue,
             }
             v *= voice.ampEnvState.value;
             v *= gainFactor;
+            gainFactor += gainStep;
 
             for (int channelIx = 0; channelIx < numChannels; ++channelIx) {
-                outputBuffer[outputIx++] = v;
+                outputBuffer[outputIx++] += v;
             }
         }
     }
 }
 
 void ProcessFmVoice(Voice& voice, int const sampleRate, float pitchLFOValue,
-    float modulatedCutoff, ADSREnvSpecInternal const& ampEnvSpec,
+    ControlRamp const& gain, ADSREnvSpecInternal const& ampEnvSpec,
     ADSREnvSpecInternal const& cutoffEnvSpec,
     ADSREnvSpecInTicks const& pitchEnvSpec,
     Patch const& patch, float* outputBuffer, int const numChannels, int const framesPerBuffer, int const samplesPerMoogCutoffUpdate) {
@@ -523,14 +583,7 @@ void ProcessFmVoice(Voice& voice, int const sampleRate, float pitchLFOValue,
     float modulatedF = voice.oscillators[0].f;
     */
 
-    // final gain. Map from linear [0,1] to exponential from -80db to 0db.
-    float const startAmp = 0.01f;
-    float const factor = 1.0f / startAmp;
-    float gain = 0.f;
-    float const patchGain = patch.Get(SynthParamType::Gain);
-    if (patchGain > 0.f) {
-        gain = startAmp * powf(factor, patch.Get(SynthParamType::Gain));
-    }
+    bool const useTables = UseTables(patch);
 
     // float lpfA1, lpfA2, lpfA3, lpfK;  // filter shit
     // {
@@ -586,7 +639,7 @@ void ProcessFmVoice(Voice& voice, int const sampleRate, float pitchLFOValue,
                 break;
             }
             case Waveform::Count: {
-                std::cout << "Invalid waveform" << std::endl;
+                logger::Log("Invalid waveform\n");
                 assert(false);
             }
             }
@@ -603,7 +656,7 @@ void ProcessFmVoice(Voice& voice, int const sampleRate, float pitchLFOValue,
     // Apply filters and some more gains
     {
         int outputIx = 0;
-        int cutoffModulateCounter = 0;
+        int& cutoffModulateCounter = voice.cutoffModulateCounter;
         for (int sampleIx = 0; sampleIx < samplesPerFrame; ++sampleIx) {
             float v = outputBuffer[outputIx];
 
@@ -650,7 +703,7 @@ void ProcessFmVoice(Voice& voice, int const sampleRate, float pitchLFOValue,
             if (osc.phases[0] >= k2Pi) {
                 osc.phases[0] -= k2Pi;
             }
-            float oscV = sin(osc.phases[0]);
+            float oscV = useTables ? FastSin(osc.phases[0]) : sin(osc.phases[0]);
             oscV *= level;
             outputBuffer[outputIx] = oscV;
             outputIx += numChannels;
@@ -662,6 +715,8 @@ void ProcessFmVoice(Voice& voice, int const sampleRate, float pitchLFOValue,
     Oscillator& osc = voice.oscillators[0];
     float oscF = osc.f;
     float phaseChange = 2 * kPi * oscF / sampleRate;
+    float const gainStep = (gain._end - gain._start) / framesPerBuffer;
+    float sampleGain = gain._start;
     int outputIx = 0;
     for (int sampleIx = 0; sampleIx < framesPerBuffer; ++sampleIx) {
         if (osc.phases[0] >= 2 * kPi) {
@@ -676,8 +731,9 @@ void ProcessFmVoice(Voice& voice, int const sampleRate, float pitchLFOValue,
         float phaseOffset = outputBuffer[outputIx];
         float phase = osc.phases[0] + phaseOffset;
 
-        float oscV = sin(phase);
-        oscV *= gain;
+        float oscV = useTables ? FastSin(phase) : sin(phase);
+        oscV *= sampleGain;
+        sampleGain += gainStep;
         oscV *= voice.velocity;
         oscV *= voice.ampEnvState.value;
         for (int channelIx = 0; channelIx < numChannels; ++channelIx) {
@@ -703,26 +759,60 @@ namespace {
 }
 
 Voice* FindVoiceForNoteOn(StateData& state, int const midiNote) {
-    int bestIx = -1;
-    std::pair<int, int64_t> bestPhaseAgePair = std::make_pair(-1, -1);
-    int numVoices = 1;
-    if (!state.patch.Get(SynthParamType::Mono)) {
-        numVoices = state.voices.size();
-    }
+    int const numVoices = state.patch.GetPolyphony();
+    VoiceSteal const policy = state.patch.GetVoiceSteal();
+
+    // A voice already on this note gets retriggered. Otherwise take the first
+    // idle voice, and only steal if there isn't one.
+    int idleIx = -1;
     for (int i = 0; i < numVoices; ++i) {
         Voice& v = state.voices[i];
         if (v.currentMidiNote == midiNote) {
             return &v;
         }
-        int thisPhaseScore = ADSRPhaseScore(v.ampEnvState.phase);
-        if (thisPhaseScore > bestPhaseAgePair.first) {
-            bestIx = i;
-            bestPhaseAgePair = std::make_pair(thisPhaseScore, v.ampEnvState.ticksSincePhaseStart);
-        } else if (thisPhaseScore == bestPhaseAgePair.first) {
-            if (v.ampEnvState.ticksSincePhaseStart > bestPhaseAgePair.second) {
-                bestIx = i;
-                bestPhaseAgePair = std::make_pair(thisPhaseScore, v.ampEnvState.ticksSincePhaseStart);
+        if (idleIx < 0 && v.ampEnvState.phase == ADSRPhase::Closed) {
+            idleIx = i;
+        }
+    }
+    if (idleIx >= 0) {
+        return &state.voices[idleIx];
+    }
+
+    int bestIx = -1;
+    switch (policy) {
+        case VoiceSteal::ReleasedFirst: {
+            std::pair<int, int64_t> bestPhaseAgePair = std::make_pair(-1, -1);
+            for (int i = 0; i < numVoices; ++i) {
+                Voice const& v = state.voices[i];
+                std::pair<int, int64_t> thisPair = std::make_pair(ADSRPhaseScore(v.ampEnvState.phase), v.ampEnvState.ticksSincePhaseStart);
+                if (thisPair > bestPhaseAgePair) {
+                    bestIx = i;
+                    bestPhaseAgePair = thisPair;
+                }
             }
+            break;
+        }
+        case VoiceSteal::Oldest: {
+            int64_t bestOrder = std::numeric_limits<int64_t>::max();
+            for (int i = 0; i < numVoices; ++i) {
+                if (state.voices[i].noteOnOrder < bestOrder) {
+                    bestIx = i;
+                    bestOrder = state.voices[i].noteOnOrder;
+                }
+            }
+            break;
+        }
+        case VoiceSteal::Quietest: {
+            float bestLevel = std::numeric_limits<float>::max();
+            for (int i = 0; i < numVoices; ++i) {
+                Voice const& v = state.voices[i];
+                float const level = v.ampEnvState.value * v.velocity;
+                if (level < bestLevel) {
+                    bestIx = i;
+                    bestLevel = level;
+                }
+            }
+            break;
         }
     }
     if (bestIx >= 0) {
@@ -795,6 +885,7 @@ void NoteOn(StateData& state, int midiNote, float velocity, int noteOnId, int pr
         v->currentMidiNote = midiNote;
         v->velocity = velocity;
         v->noteOnId = noteOnId;
+        v->noteOnOrder = ++state.noteOnCounter;
 
         if (primePortaMidiNote >= 0) {
             float f = MidiToFreq(primePortaMidiNote);
@@ -807,7 +898,7 @@ void NoteOn(StateData& state, int midiNote, float velocity, int noteOnId, int pr
         v->pitchEnvState.phase = synth::ADSRPhase::Attack;
         v->pitchEnvState.ticksSincePhaseStart = v->ampEnvState.ticksSincePhaseStart;
     } else {
-        std::cout << "couldn't find a note for noteon" << std::endl;
+        logger::Log("couldn't find a note for noteon\n");
     }
 }
 
@@ -839,7 +930,8 @@ void AllNotesOff(StateData& state) {
     }
 }
 
-void OnParamChange(StateData& state, audio::SynthParamType paramType, float newValue, Voice* v) {
+// Updates whatever is derived from the patch param. None of it is per-voice.
+void OnParamChange(StateData& state, audio::SynthParamType paramType, float newValue) {
     switch (paramType) {
     case audio::SynthParamType::AmpEnvAttack:
     case audio::SynthParamType::AmpEnvDecay:
@@ -898,139 +990,137 @@ void OnParamChange(StateData& state, audio::SynthParamType paramType, float newV
     }
 }
 
-void Process(StateData* state, audio::PendingEvent *eventsThisBuffer, int eventsThisBufferCount,
-    float* outputBuffer, int const numChannels, int const framesPerBuffer,
-    int const sampleRate, int64_t currentBufferCounter) {
-    
-    Patch& patch = state->patch;
-
-    // Handle all the events that will happen in this buffer frame.
-    int64_t bufferStartTickTime = currentBufferCounter * framesPerBuffer;
-    for (int eventIx = 0; eventIx < eventsThisBufferCount; ++eventIx) {
-        audio::Event const& e = eventsThisBuffer[eventIx]._e; 
-        if (e.channel != state->channel) {
-            // Not meant for this channel. Skip this message.
-            continue;
-        }
-        switch (e.type) {
-            case audio::EventType::NoteOn: {
-                NoteOn(*state, e.midiNote, e.velocity, e.noteOnId, e.primePortaMidiNote);
-                break;
-            }
-            case audio::EventType::NoteOff: {
-                NoteOff(*state, e.midiNote, e.noteOnId);
-                break;
-            }
-            case audio::EventType::AllNotesOff: {
-                AllNotesOff(*state);
-                break;
-            }
-            case audio::EventType::SynthParam: {
-                // Ensure that there's no existing automation on this param.
-                // TODO: maybe have a "clear all automations" event that gets triggered by ChangePatch to avoid doing this for every param?
-                for (Automation& a : state->automations) {
-                    if (a._active && a._synthParamType == e.param) {
-                        a._active = false;
-                    }
-                }
-                if (e.paramChangeTimeSecs > 0.0) {
-                    // Find a free automation.                    
-                    Automation* pA = nullptr;
-                    for (Automation& a : state->automations) {
-                        if (!a._active) {
-                            pA = &a;
-                            break;
-                        }
-                    }
+void StopAutomation(StateData& state, audio::SynthParamType param) {
+    Automation& a = state.automations[static_cast<int>(param)];
+    if (a._activeIx < 0) {
+        return;
+    }
+    // Swap the last active one into this one's place.
+    audio::SynthParamType const lastParam = state.activeAutomations[--state.numActiveAutomations];
+    state.activeAutomations[a._activeIx] = lastParam;
+    state.automations[static_cast<int>(lastParam)]._activeIx = a._activeIx;
+    a._activeIx = -1;
+}
 
-                    if (pA == nullptr) {
-                        printf("Failed to find a free automation!\n");
-                        break;
-                    }
-                    pA->_active = true;
-                    pA->_synthParamType = e.param;
-                    pA->_startValue = patch.Get(e.param);
-                    pA->_desiredValue = e.newParamValue;
-                    pA->_startTickTime = bufferStartTickTime;
-                    int64_t changeTimeInTicks = (int64_t) (e.paramChangeTimeSecs * sampleRate);
-                    pA->_endTickTime = pA->_startTickTime + changeTimeInTicks;
-                    for (Voice& v : state->voices) {
-                        OnParamChange(*state, e.param, e.newParamValue, &v);
-                    }
-                    break;
-                }
-                patch.Get(e.param) = e.newParamValue;
-                for (Voice& v : state->voices) {
-                    OnParamChange(*state, e.param, e.newParamValue, &v);
-                }
-                break;
-            }
-            default: {
+void HandleEvent(StateData& state, audio::Event const& e, int64_t tickTime, int const sampleRate) {
+    Patch& patch = state.patch;
+    switch (e.type) {
+        case audio::EventType::NoteOn: {
+            NoteOn(state, e.midiNote, e.velocity, e.noteOnId, e.primePortaMidiNote);
+            break;
+        }
+        case audio::EventType::NoteOff: {
+            NoteOff(state, e.midiNote, e.noteOnId);
+            break;
+        }
+        case audio::EventType::AllNotesOff: {
+            AllNotesOff(state);
+            break;
+        }
+        case audio::EventType::SynthParam: {
+            // A new value or ramp replaces whatever ramp was running on this param.
+            StopAutomation(state, e.param);
+            if (e.paramChangeTimeSecs > 0.0) {
+                Automation& a = state.automations[static_cast<int>(e.param)];
+                a._startValue = patch.Get(e.param);
+                a._desiredValue = e.newParamValue;
+                a._startTickTime = tickTime;
+                int64_t changeTimeInTicks = (int64_t) (e.paramChangeTimeSecs * sampleRate);
+                a._endTickTime = a._startTickTime + changeTimeInTicks;
+                a._activeIx = state.numActiveAutomations;
+                state.activeAutomations[state.numActiveAutomations++] = e.param;
+                OnParamChange(state, e.param, e.newParamValue);
                 break;
             }
+            patch.Get(e.param) = e.newParamValue;
+            OnParamChange(state, e.param, e.newParamValue);
+            break;
+        }
+        default: {
+            break;
         }
     }
+}
 
-    // Now apply automations!
-    for (Automation& a : state->automations) {
-        if (!a._active) {
-            continue;
-        }
-        if (bufferStartTickTime > a._endTickTime) {
-            patch.Get(a._synthParamType) = a._desiredValue;
-            a._active = false;
+void ApplyAutomations(StateData& state, int64_t tickTime) {
+    Patch& patch = state.patch;
+    for (int activeIx = 0; activeIx < state.numActiveAutomations; ) {
+        audio::SynthParamType const param = state.activeAutomations[activeIx];
+        Automation const& a = state.automations[static_cast<int>(param)];
+        float& currentValue = patch.Get(param);
+        if (tickTime > a._endTickTime) {
+            currentValue = a._desiredValue;
+            OnParamChange(state, param, currentValue);
+            // Don't advance; StopAutomation moves another one into this slot.
+            StopAutomation(state, param);
             continue;
         }
         double totalTime = (double) (a._endTickTime - a._startTickTime);
         assert(totalTime != 0.0);
-        double timeSoFar = (double) (bufferStartTickTime - a._startTickTime);
+        double timeSoFar = (double) (tickTime - a._startTickTime);
         double factor = std::min(timeSoFar / totalTime, 1.0);
-        float& currentValue = patch.Get(a._synthParamType);
-        float newValue = -1.f;
-        if (a._synthParamType == audio::SynthParamType::Cutoff || a._synthParamType == audio::SynthParamType::CutoffEnvGain) {
+        if (param == audio::SynthParamType::Cutoff || param == audio::SynthParamType::CutoffEnvGain) {
             if (factor != 0.0) {
                 factor = std::pow(2, 10.0 * factor - 10.0);
             }
         }
-        newValue = a._startValue + factor * (a._desiredValue - a._startValue);
-        currentValue = newValue;
-
-        for (Voice& v : state->voices) {
-            OnParamChange(*state, a._synthParamType, newValue, &v);
-        }
+        currentValue = a._startValue + factor * (a._desiredValue - a._startValue);
+        OnParamChange(state, param, currentValue);
+        ++activeIx;
     }
+}
+
+// Renders numFrames of this synth with no events in between, adding into outputBuffer.
+void ProcessBlock(StateData& state, float* outputBuffer, int const numChannels, int const numFrames, int const sampleRate) {
+    Patch& patch = state.patch;
+    bool const useTables = UseTables(patch);
 
     // Get pitch LFO value
-    if (state->pitchLFOPhase >= k2Pi) {
-        state->pitchLFOPhase -= k2Pi;
+    if (state.pitchLFOPhase >= k2Pi) {
+        state.pitchLFOPhase -= k2Pi;
     }
     // Make LFO a sine wave.
-    float const pitchLFOValue = patch.Get(SynthParamType::PitchLFOGain) * sinf(state->pitchLFOPhase);
-    state->pitchLFOPhase += (patch.Get(SynthParamType::PitchLFOFreq) * 2 * kPi * framesPerBuffer / sampleRate);
+    float const pitchLFOValue = patch.Get(SynthParamType::PitchLFOGain) * Sin(useTables, state.pitchLFOPhase);
+    state.pitchLFOPhase += (patch.Get(SynthParamType::PitchLFOFreq) * 2 * kPi * numFrames / sampleRate);
 
     // Get cutoff LFO value
-    if (state->cutoffLFOPhase >= k2Pi) {
-        state->cutoffLFOPhase -= k2Pi;
+    if (state.cutoffLFOPhase >= k2Pi) {
+        state.cutoffLFOPhase -= k2Pi;
     }
     // Make LFO a sine wave for now.
-    float const cutoffLFOValue = patch.Get(SynthParamType::CutoffLFOGain) * sinf(state->cutoffLFOPhase);
-    state->cutoffLFOPhase += (patch.Get(SynthParamType::CutoffLFOFreq) * 2 * kPi * framesPerBuffer / sampleRate);
+    float const cutoffLFOValue = patch.Get(SynthParamType::CutoffLFOGain) * Sin(useTables, state.cutoffLFOPhase);
+    state.cutoffLFOPhase += (patch.Get(SynthParamType::CutoffLFOFreq) * 2 * kPi * numFrames / sampleRate);
     // float const modulatedCutoff = patch.cutoffFreq * powf(2.0f, cutoffLFOValue);
     float const modulatedCutoff = math_util::Clamp(patch.Get(SynthParamType::Cutoff) + 10000 * cutoffLFOValue, 0.f, 20000.f);
 
+    float const smoothingCoeff = 1.f - std::exp(-numFrames / (kParamSmoothingSecs * sampleRate));
+    ControlRamp const cutoffRamp = StepSmoothedParam(state.smoothedCutoff, modulatedCutoff, smoothingCoeff);
+    ControlRamp const gainRamp = StepSmoothedParam(state.smoothedGain, PatchGainToAmp(patch, useTables), smoothingCoeff);
+
     ADSREnvSpecInTicks pitchEnvSpec;
     ConvertADSREnvSpec(patch.GetPitchEnvSpec(), pitchEnvSpec, sampleRate);
 
     // zero out the synth scratch buffer
-    memset(state->synthScratchBuffer, 0, numChannels * framesPerBuffer * sizeof(float));
+    memset(state.synthScratchBuffer, 0, numChannels * numFrames * sizeof(float));
 
-    if (patch.GetIsFm()) {
-        for (Voice& voice : state->voices) {
+    // Idle voices cost nothing: only the ones that are sounding get processed.
+    state.numActiveVoices = 0;
+    for (int voiceIx = 0; voiceIx < kMaxVoices; ++voiceIx) {
+        if (state.voices[voiceIx].ampEnvState.phase != ADSRPhase::Closed) {
+            state.activeVoices[state.numActiveVoices++] = voiceIx;
+        }
+    }
+
+    if (state.numActiveVoices == 0) {
+        // Nothing to render, but the delay tail below still has to play out.
+    } else if (patch.GetIsFm()) {
+        for (int activeIx = 0; activeIx < state.numActiveVoices; ++activeIx) {
+            Voice& voice = state.voices[state.activeVoices[activeIx]];
             // zero out the voice scratch buffer.
-            memset(state->voiceScratchBuffer, 0, numChannels * framesPerBuffer * sizeof(float));
-            ProcessFmVoice(voice, sampleRate, pitchLFOValue, modulatedCutoff, state->ampEnvSpecInternal, state->cutoffEnvSpecInternal, pitchEnvSpec, patch, state->voiceScratchBuffer, numChannels, framesPerBuffer, state->samplesPerMoogCutoffUpdate);
-            for (int outputIx = 0; outputIx < numChannels * framesPerBuffer; ++outputIx) {
-                state->synthScratchBuffer[outputIx] += state->voiceScratchBuffer[outputIx];
+            memset(state.voiceScratchBuffer, 0, numChannels * numFrames * sizeof(float));
+            ProcessFmVoice(voice, sampleRate, pitchLFOValue, gainRamp, state.ampEnvSpecInternal, state.cutoffEnvSpecInternal, pitchEnvSpec, patch, state.voiceScratchBuffer, numChannels, numFrames, state.samplesPerMoogCutoffUpdate);
+            for (int outputIx = 0; outputIx < numChannels * numFrames; ++outputIx) {
+                state.synthScratchBuffer[outputIx] += state.voiceScratchBuffer[outputIx];
             }
         }
     } else {
@@ -1039,63 +1129,118 @@ void Process(StateData* state, audio::PendingEvent *eventsThisBuffer, int events
         oscFaderGains[0] = sqrt(1.f - patch.Get(SynthParamType::OscFader));
         oscFaderGains[1] = sqrt(patch.Get(SynthParamType::OscFader));               
 
-        for (Voice& voice : state->voices) {
-            // zero out the voice scratch buffer.
-            memset(state->voiceScratchBuffer, 0, numChannels * framesPerBuffer * sizeof(float));
-            ProcessVoice(voice, sampleRate, pitchLFOValue, modulatedCutoff, state->ampEnvSpecInternal, state->cutoffEnvSpecInternal, pitchEnvSpec, patch, state->voiceScratchBuffer, numChannels, framesPerBuffer, state->samplesPerMoogCutoffUpdate, oscFaderGains);
-            for (int outputIx = 0; outputIx < numChannels * framesPerBuffer; ++outputIx) {
-                state->synthScratchBuffer[outputIx] += state->voiceScratchBuffer[outputIx];
-            }     
+        float modulatedFs[kMaxVoices];
+        for (int activeIx = 0; activeIx < state.numActiveVoices; ++activeIx) {
+            modulatedFs[activeIx] = UpdateVoicePitch(state.voices[state.activeVoices[activeIx]], sampleRate, pitchLFOValue, pitchEnvSpec, patch, numFrames);
+        }
+
+        int const lanesPerOsc = ProcessOscillators(state, modulatedFs, oscFaderGains, sampleRate, numFrames);
+
+        int const oscRowStride = lanesPerOsc * numFrames;
+        for (int activeIx = 0; activeIx < state.numActiveVoices; ++activeIx) {
+            float const* oscRows = state.oscLaneBuffer + activeIx * numFrames;
+            ProcessVoice(state.voices[state.activeVoices[activeIx]], sampleRate, oscRows, oscRowStride, cutoffRamp, gainRamp, state.ampEnvSpecInternal, state.cutoffEnvSpecInternal, patch, state.synthScratchBuffer, numChannels, numFrames, state.samplesPerMoogCutoffUpdate);
         }        
     }
 
+    // A released voice that has decayed below hearing is done; closing it now
+    // frees it for the next NoteOn and stops us processing its long tail.
+    for (int activeIx = 0; activeIx < state.numActiveVoices; ++activeIx) {
+        Voice& voice = state.voices[state.activeVoices[activeIx]];
+        if (voice.ampEnvState.phase == ADSRPhase::Release && voice.ampEnvState.value < kSmallAmplitude) {
+            voice.ampEnvState.phase = ADSRPhase::Closed;
+            voice.ampEnvState.value = 0.f;
+            voice.ampEnvState.ticksSincePhaseStart = 0;
+            voice.currentMidiNote = -1;
+        }
+    }
+
     // DELAY
     float const delayTime = math_util::Clamp(patch.Get(SynthParamType::DelayTime), 0.001f, 0.5f);
     float const delayGain = math_util::Clamp(patch.Get(SynthParamType::DelayGain), 0.f, 1.f);
     float const delayFeedback = std::min(1.f, patch.Get(SynthParamType::DelayFeedback));
     int const delaySamples = static_cast<int>(delayTime * sampleRate);
-    int delayBufferReadIx = state->delayBufferWriteIx - (numChannels * delaySamples);
+    int delayBufferReadIx = state.delayBufferWriteIx - (numChannels * delaySamples);
     if (delayBufferReadIx < 0) {
         delayBufferReadIx = kDelayBufferCount + delayBufferReadIx;
     }
     assert(delayBufferReadIx >= 0);
     assert(delayBufferReadIx < kDelayBufferCount);
     {
-        int writeIx = state->delayBufferWriteIx;
-        for (int outputIx = 0; outputIx < numChannels * framesPerBuffer; ++outputIx) {
+        int writeIx = state.delayBufferWriteIx;
+        for (int outputIx = 0; outputIx < numChannels * numFrames; ++outputIx) {
             if (writeIx >= kDelayBufferCount) {
                 writeIx = 0;
             }
-            state->delayBuffer[writeIx] = 0.f;
+            state.delayBuffer[writeIx] = 0.f;
             ++writeIx;
         }
     }
     if (delayGain == 0.f) {
-        for (int outputIx = 0; outputIx < numChannels * framesPerBuffer; ++outputIx) {
-            outputBuffer[outputIx] += state->synthScratchBuffer[outputIx];
+        for (int outputIx = 0; outputIx < numChannels * numFrames; ++outputIx) {
+            outputBuffer[outputIx] += state.synthScratchBuffer[outputIx];
         }
     } else {
-        int writeIx = state->delayBufferWriteIx;
+        int writeIx = state.delayBufferWriteIx;
         int readIx = delayBufferReadIx;
-        for (int outputIx = 0; outputIx < numChannels * framesPerBuffer; ++outputIx) {
+        for (int outputIx = 0; outputIx < numChannels * numFrames; ++outputIx) {
             if (writeIx >= kDelayBufferCount) {
                 writeIx = 0;
             }
             if (readIx >= kDelayBufferCount) {
                 readIx = 0;
             }
-            state->delayBuffer[writeIx] += state->synthScratchBuffer[outputIx] + delayFeedback * state->delayBuffer[readIx];
-            outputBuffer[outputIx] += state->synthScratchBuffer[outputIx] + delayGain * state->delayBuffer[readIx];
+            state.delayBuffer[writeIx] += state.synthScratchBuffer[outputIx] + delayFeedback * state.delayBuffer[readIx];
+            outputBuffer[outputIx] += state.synthScratchBuffer[outputIx] + delayGain * state.delayBuffer[readIx];
             ++writeIx;
             ++readIx;
         }
     }
 
-    state->delayBufferWriteIx += numChannels * framesPerBuffer;
-    if (state->delayBufferWriteIx >= kDelayBufferCount) {
-        state->delayBufferWriteIx = 0;
+    // Blocks can be any size now, so wrap properly instead of snapping to 0.
+    state.delayBufferWriteIx += numChannels * numFrames;
+    if (state.delayBufferWriteIx >= kDelayBufferCount) {
+        state.delayBufferWriteIx -= kDelayBufferCount;
     }
+}
+
+void Process(StateData* state, audio::PendingEvent *eventsThisBuffer, int eventsThisBufferCount,
+    float* outputBuffer, int const numChannels, int const framesPerBuffer,
+    int const sampleRate, int64_t currentBufferCounter) {
+
+    int64_t const bufferStartTickTime = currentBufferCounter * framesPerBuffer;
+    int eventIx = 0;
+    int frameIx = 0;
+    while (frameIx < framesPerBuffer) {
+        // Handle all of our events that land on this frame.
+        for (; eventIx < eventsThisBufferCount; ++eventIx) {
+            audio::PendingEvent const& pe = eventsThisBuffer[eventIx];
+            if (pe._sampleOffset > frameIx) {
+                break;
+            }
+            if (pe._e.channel == state->channel) {
+                HandleEvent(*state, pe._e, bufferStartTickTime + frameIx, sampleRate);
+            }
+        }
 
+        // Render up to our next event. Events for other channels don't split the block.
+        int blockEndFrameIx = framesPerBuffer;
+        for (int nextIx = eventIx; nextIx < eventsThisBufferCount; ++nextIx) {
+            audio::PendingEvent const& pe = eventsThisBuffer[nextIx];
+            if (pe._e.channel == state->channel) {
+                blockEndFrameIx = std::min(pe._sampleOffset, framesPerBuffer);
+                break;
+            }
+        }
+
+        if (state->modulationBlockFrames > 0) {
+            blockEndFrameIx = std::min(blockEndFrameIx, frameIx + state->modulationBlockFrames);
+        }
+
+        ApplyAutomations(*state, bufferStartTickTime + frameIx);
+        ProcessBlock(*state, outputBuffer + frameIx * numChannels, numChannels, blockEndFrameIx - frameIx, sampleRate);
+        frameIx = blockEndFrameIx;
+    }
 }
 
 }
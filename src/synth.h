@@ -10,6 +10,8 @@
 #include "serial.h"
 #include "enums/synth_Waveform.h"
 #include "synth_patch.h"
+#include "synth_simd.h"
+#include "synth_tables.h"
 #include "filter.h"
 
 namespace synth {
@@ -18,12 +20,6 @@ static inline float const kFifthRatio = 1.49830703f;
 
 static inline float const kSmallAmplitude = 0.0001f;
 
-// TODO: use a lookup table!!!
-inline float MidiToFreq(int midi) {
-    int const a4 = 69;  // 440Hz
-    return 440.0f * pow(2.0f, (midi - a4) / 12.0f);
-}
-
 enum class ADSRPhase {
     Closed, Attack, Decay, Sustain, Release
 };
@@ -31,7 +27,7 @@ enum class ADSRPhase {
 struct ADSREnvState {
     ADSRPhase phase = ADSRPhase::Closed;
     float currentValue = 0.f;
-    float multiplier = 0.f;
+    float multiplier = 0.f;  // per sample
     int64_t ticksSincePhaseStart = -1;
 };
 
@@ -78,20 +74,45 @@ struct Voice {
     int currentMidiNote = -1;
     float velocity = 1.f;
     int noteOnId = 0;
+    int64_t noteOnOrder = 0;  // from StateData::noteOnCounter, for VoiceSteal::Oldest
     float postPortamentoF = 0.f;  // latest output of applying porta to center freq.
+    // Samples until the next cutoff envelope tick. Lives here so the tick rate
+    // stays steady when Process() splits a buffer at event boundaries.
+    int cutoffModulateCounter = 0;
 
     FilterState hpfState;
 
     filter::VAMoogFilter moogLpfState;
 };
 
+// A ramp on one patch param. StateData keeps one per param, so a new ramp just
+// overwrites the old one.
 struct Automation {
-    bool _active = false;
-    audio::SynthParamType _synthParamType;
+    // Index into StateData::activeAutomations, or -1 if not running.
+    int _activeIx = -1;
     float _startValue = 0.f;
     float _desiredValue = 0.f;
     int64_t _startTickTime = 0;
-    int64_t _endTickTime = 0;    
+    int64_t _endTickTime = 0;
+};
+
+int constexpr kNumSynthParams = static_cast<int>(audio::SynthParamType::Count);
+
+// Process renders in blocks no longer than this, whatever the hardware buffer
+// size. LFOs, pitch and automations update once per block.
+int constexpr kDefaultModulationBlockFrames = 32;
+
+// A control value that moves linearly from _start to _end over one block.
+struct ControlRamp {
+    float _start = 0.f;
+    float _end = 0.f;
+};
+
+// One-pole smoothing for params that zipper when they jump (gain, cutoff).
+// Stepped once per block; the voices ramp between consecutive values.
+struct SmoothedParam {
+    float _value = 0.f;
+    bool _started = false;
 };
 
 // All times are in "modulation steps". Could be samples, buffers, whatever the caller wants.
@@ -118,8 +139,24 @@ struct ADSREnvSpecInternal {
 struct StateData {
     int channel = -1;
 
-    std::array<Voice, 4> voices;
-    std::array<Automation, 64> automations;
+    // Preallocated; the patch's polyphony decides how many of these NoteOn
+    // hands out. Only voices that are sounding get processed, and those are
+    // listed in activeVoices at the start of each block.
+    std::array<Voice, kMaxVoices> voices;
+    int activeVoices[kMaxVoices];
+    int numActiveVoices = 0;
+    int64_t noteOnCounter = 0;
+    // Indexed by SynthParamType. The running ones are listed densely in
+    // activeAutomations so a block only touches those.
+    std::array<Automation, kNumSynthParams> automations;
+    audio::SynthParamType activeAutomations[kNumSynthParams];
+    int numActiveAutomations = 0;
+
+    // Can be changed any time after InitStateData. Smaller is smoother and
+    // costs more per-block overhead.
+    int modulationBlockFrames = kDefaultModulationBlockFrames;
+    SmoothedParam smoothedGain;  // after PatchGainToAmp
+    SmoothedParam smoothedCutoff;  // with the cutoff LFO applied
 
     Patch patch;
 
@@ -129,6 +166,12 @@ struct StateData {
     float* voiceScratchBuffer = nullptr;
     float* synthScratchBuffer = nullptr;
 
+    // Analog oscillators render all voices at once through this kernel.
+    // Output is one row per (oscillator, active voice) lane, with the active
+    // voices padded up to kOscLaneGroupSize: at most kNumAnalogOscillators * kMaxVoices rows of framesPerBuffer.
+    OscKernel oscKernel = OscKernel::Scalar;
+    float* oscLaneBuffer = nullptr;
+
     int sampleRate;
     int framesPerBuffer;
 
@@ -144,10 +187,13 @@ struct StateData {
 void InitStateData(StateData& state, int channel, int const sampleRate, int const samplesPerFrame, int const numBufferChannels);
 void DestroyStateData(StateData& state);
 
-void NoteOn(StateData& state, int midiNote, float velocity, int noteOnId = 0);
+void NoteOn(StateData& state, int midiNote, float velocity, int noteOnId = 0, int primePortaMidiNote = -1);
 void NoteOff(StateData& state, int midiNote, int noteOffId = 0);
 void AllNotesOff(StateData& state);
 
+// eventsThisBuffer must be sorted by _sampleOffset. Rendering is split at
+// every event for this synth's channel so each one lands on its exact sample,
+// and into blocks of at most modulationBlockFrames.
 void Process(
     StateData* state, audio::PendingEvent *eventsThisBuffer, int eventsThisBufferCount,
     float* outputBuffer, int numChannels, int framesPerBuffer,
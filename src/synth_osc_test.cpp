@@ -0,0 +1,124 @@
+// Renders the same notes through every oscillator kernel the CPU supports and
+// checks the SIMD kernels against the scalar one. Also prints timings for the
+// worst case we care about: 5 synths x 4 voices (the default polyphony) x 5 unison.
+
+#include <cstdio>
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+#include "synth.h"
+#include "synth_test_util.h"
+
+namespace {
+
+using synth_test::kFramesPerBuffer;
+using synth_test::kSampleRate;
+
+int constexpr kNumChannels = 1;
+int constexpr kNumSynths = 5;
+int constexpr kNumBuffers = 2000;
+
+void MakePatch(synth::Patch& patch, int synthIx) {
+    using audio::SynthParamType;
+    synth_test::ClearPatch(patch);
+    patch.Get(SynthParamType::Gain) = 0.6f;
+    // Alternate waveform combos across synths so both masks get exercised.
+    patch.Get(SynthParamType::Osc1Waveform) = (synthIx % 2 == 0) ? 1.f : 0.f;  // saw : square
+    patch.Get(SynthParamType::Osc2Waveform) = (synthIx % 3 == 0) ? 0.f : 1.f;
+    patch.Get(SynthParamType::Detune) = 0.01f;
+    patch.Get(SynthParamType::OscFader) = 0.4f;
+    patch.Get(SynthParamType::Unison) = 2.f;
+    patch.Get(SynthParamType::UnisonDetune) = 15.f;
+    patch.Get(SynthParamType::Cutoff) = 3000.f;
+    patch.Get(SynthParamType::Peak) = 0.3f;
+    patch.Get(SynthParamType::HpfCutoff) = 20.f;
+    patch.Get(SynthParamType::PitchLFOGain) = 0.01f;
+    patch.Get(SynthParamType::PitchLFOFreq) = 5.f;
+    patch.Get(SynthParamType::AmpEnvAttack) = 0.01f;
+    patch.Get(SynthParamType::AmpEnvDecay) = 0.2f;
+    patch.Get(SynthParamType::AmpEnvSustain) = 0.7f;
+    patch.Get(SynthParamType::AmpEnvRelease) = 0.3f;
+    patch.Get(SynthParamType::CutoffEnvGain) = 2000.f;
+    patch.Get(SynthParamType::CutoffEnvAttack) = 0.05f;
+    patch.Get(SynthParamType::CutoffEnvDecay) = 0.3f;
+    patch.Get(SynthParamType::CutoffEnvSustain) = 0.2f;
+    patch.Get(SynthParamType::CutoffEnvRelease) = 0.3f;
+}
+
+// Returns seconds spent in synth::Process.
+double Render(synth::OscKernel kernel, std::vector<float>& output) {
+    std::vector<synth::StateData> synths(kNumSynths);
+    for (int i = 0; i < kNumSynths; ++i) {
+        synth::StateData& s = synths[i];
+        synth::InitStateData(s, /*channel=*/i, kSampleRate, kFramesPerBuffer, kNumChannels);
+        s.oscKernel = kernel;
+        MakePatch(s.patch, i);
+        audio::SynthParamType const envParams[] = {
+            audio::SynthParamType::AmpEnvAttack, audio::SynthParamType::CutoffEnvAttack,
+            audio::SynthParamType::AmpEnvRelease, audio::SynthParamType::CutoffEnvRelease };
+        synth_test::SendParams(s, envParams, 4, kNumChannels);
+    }
+
+    output.assign(kNumBuffers * kFramesPerBuffer * kNumChannels, 0.f);
+    int const chord[] = { 48, 55, 60, 63, 67, 70 };
+    double secs = 0.0;
+    for (int bufferIx = 0; bufferIx < kNumBuffers; ++bufferIx) {
+        // New chord every ~half second, released halfway through.
+        if (bufferIx % 48 == 0) {
+            for (int i = 0; i < kNumSynths; ++i) {
+                for (int v = 0; v < synth::kDefaultPolyphony; ++v) {
+                    synth::NoteOn(synths[i], chord[(v + i + bufferIx / 48) % 6] + 12 * (i % 2), 0.8f);
+                }
+            }
+        } else if (bufferIx % 48 == 24) {
+            for (int i = 0; i < kNumSynths; ++i) {
+                synth::AllNotesOff(synths[i]);
+            }
+        }
+        float* out = output.data() + bufferIx * kFramesPerBuffer * kNumChannels;
+        auto t0 = std::chrono::high_resolution_clock::now();
+        for (synth::StateData& s : synths) {
+            synth::Process(&s, nullptr, 0, out, kNumChannels, kFramesPerBuffer, kSampleRate, bufferIx + 1);
+        }
+        auto t1 = std::chrono::high_resolution_clock::now();
+        secs += std::chrono::duration<double>(t1 - t0).count();
+    }
+
+    for (synth::StateData& s : synths) {
+        synth::DestroyStateData(s);
+    }
+    return secs;
+}
+
+}  // namespace
+
+int main() {
+    std::vector<float> scalarOutput;
+    double scalarSecs = Render(synth::OscKernel::Scalar, scalarOutput);
+    double const audioSecs = (double)kNumBuffers * kFramesPerBuffer / kSampleRate;
+    printf("%s: %f s (%.1fx realtime)\n", synth::OscKernelToString(synth::OscKernel::Scalar), scalarSecs, audioSecs / scalarSecs);
+
+    synth::OscKernel best = synth::GetBestSupportedOscKernel();
+    bool success = true;
+    for (synth::OscKernel kernel : { synth::OscKernel::Sse, synth::OscKernel::Avx }) {
+        if ((int)kernel > (int)best) {
+            printf("%s: not supported on this CPU, skipping\n", synth::OscKernelToString(kernel));
+            continue;
+        }
+        std::vector<float> output;
+        double secs = Render(kernel, output);
+        float maxDiff = 0.f;
+        for (size_t i = 0; i < output.size(); ++i) {
+            maxDiff = std::max(maxDiff, std::abs(output[i] - scalarOutput[i]));
+        }
+        printf("%s: %f s (%.1fx realtime), max diff from scalar: %g\n", synth::OscKernelToString(kernel), secs, audioSecs / secs, maxDiff);
+        // Kernels are written to be bit-exact. Leave a tiny bit of room for compilers that contract into FMAs.
+        if (maxDiff > 1e-5f) {
+            printf("FAILED: %s output doesn't match scalar\n", synth::OscKernelToString(kernel));
+            success = false;
+        }
+    }
+
+    return success ? 0 : 1;
+}
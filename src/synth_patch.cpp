@@ -1,5 +1,7 @@
 #include "synth_patch.h"
 
+#include <algorithm>
+
 #include "imgui/imgui.h"
 
 namespace synth {
@@ -79,6 +81,12 @@ bool IsFmParam(audio::SynthParamType const paramType) {
         case audio::SynthParamType::DelayGain:
         case audio::SynthParamType::DelayTime:
         case audio::SynthParamType::DelayFeedback:
+        case audio::SynthParamType::LookupTables:
+        case audio::SynthParamType::Polyphony:
+        case audio::SynthParamType::VoiceSteal:
+        case audio::SynthParamType::Pan:
+        case audio::SynthParamType::Send:
+        case audio::SynthParamType::Wavetables:
         case audio::SynthParamType::Count:
             return false;
     }
@@ -117,6 +125,37 @@ bool Patch::GetIsFm() const {
     return FloatToIsFm(isFmAsFloat);
 }
 
+LookupTables Patch::GetLookupTables() const {
+    float const v = Get(audio::SynthParamType::LookupTables);
+    return v < 0.5f ? LookupTables::Off : LookupTables::FastMath;
+}
+
+bool Patch::GetWavetables() const {
+    return Get(audio::SynthParamType::Wavetables) > 0.5f;
+}
+
+int Patch::GetPolyphony() const {
+    if (Get(audio::SynthParamType::Mono)) {
+        return 1;
+    }
+    int const polyphony = static_cast<int>(Get(audio::SynthParamType::Polyphony));
+    if (polyphony <= 0) {
+        return kDefaultPolyphony;
+    }
+    return std::min(polyphony, kMaxVoices);
+}
+
+VoiceSteal Patch::GetVoiceSteal() const {
+    float const v = Get(audio::SynthParamType::VoiceSteal);
+    if (v < 0.5f) {
+        return VoiceSteal::ReleasedFirst;
+    } else if (v < 1.5f) {
+        return VoiceSteal::Oldest;
+    } else {
+        return VoiceSteal::Quietest;
+    }
+}
+
 ADSREnvSpec Patch::GetAmpEnvSpec() const {
     ADSREnvSpec spec;
     spec.attackTime = Get(audio::SynthParamType::AmpEnvAttack);
@@ -234,6 +273,15 @@ void Patch::Load(serial::Ptree pt) {
                         if (IsFmParam(paramType) && !GetIsFm()) {
                             break;
                         }
+                        if (paramType == audio::SynthParamType::LookupTables ||
+                            paramType == audio::SynthParamType::Polyphony ||
+                            paramType == audio::SynthParamType::VoiceSteal ||
+                            paramType == audio::SynthParamType::Pan ||
+                            paramType == audio::SynthParamType::Send ||
+                            paramType == audio::SynthParamType::Wavetables) {
+                            // Added later; 0 keeps the old behavior.
+                            break;
+                        }
                         printf("Note: patch had no param \"%s\"\n", paramName);
                     }
                     break;
@@ -405,6 +453,60 @@ Patch::ImGuiResult Patch::ImGui() {
                 changed = ImGui::SliderFloat(paramName, &_data[i], 0.f, 1.f);
                 break;
             }
+            case audio::SynthParamType::LookupTables: {
+                char const* modes[] = { "Off", "Fast math" };
+                int mode = static_cast<int>(GetLookupTables());
+                changed = ImGui::Combo(paramName, &mode, modes, 2);
+                if (changed) {
+                    _data[i] = static_cast<float>(mode);
+                }
+                if (ImGui::IsItemHovered()) {
+                    ImGui::SetTooltip("Table sin and polynomial exp2. Much cheaper FM; analog patches only use these once per buffer, so it makes no real difference there.");
+                }
+                break;
+            }
+            case audio::SynthParamType::Polyphony: {
+                int polyphony = static_cast<int>(_data[i]);
+                if (polyphony <= 0) {
+                    polyphony = kDefaultPolyphony;
+                }
+                changed = ImGui::SliderInt(paramName, &polyphony, 1, kMaxVoices);
+                if (changed) {
+                    _data[i] = static_cast<float>(polyphony);
+                }
+                break;
+            }
+            case audio::SynthParamType::VoiceSteal: {
+                char const* policies[] = { "Released first", "Oldest", "Quietest" };
+                int policy = static_cast<int>(GetVoiceSteal());
+                changed = ImGui::Combo(paramName, &policy, policies, 3);
+                if (changed) {
+                    _data[i] = static_cast<float>(policy);
+                }
+                break;
+            }
+            case audio::SynthParamType::Pan: {
+                changed = ImGui::SliderFloat(paramName, &_data[i], -1.f, 1.f);
+                break;
+            }
+            case audio::SynthParamType::Send: {
+                changed = ImGui::SliderFloat(paramName, &_data[i], 0.f, 1.f);
+                if (ImGui::IsItemHovered()) {
+                    ImGui::SetTooltip("Level into the shared send delay (separate from this patch's own Delay).");
+                }
+                break;
+            }
+            case audio::SynthParamType::Wavetables: {
+                bool wavetables = GetWavetables();
+                changed = ImGui::Checkbox(paramName, &wavetables);
+                if (changed) {
+                    _data[i] = wavetables ? 1.f : 0.f;
+                }
+                if (ImGui::IsItemHovered()) {
+                    ImGui::SetTooltip("Band-limited wavetable saw/square: no aliasing at high pitches, but slower than polyblep.");
+                }
+                break;
+            }
             case audio::SynthParamType::Count:
                 assert(false);
                 break;
@@ -17,6 +17,27 @@ struct ADSREnvSpec {
     void Load(serial::Ptree pt);
 };
 
+// Values of SynthParamType::LookupTables. See synth_tables.h. Only FM
+// patches call sin/exp2 per sample, so that's where FastMath pays off.
+enum class LookupTables {
+    Off,  // libm everywhere
+    FastMath  // table sin and polynomial exp2
+};
+
+// Voices are preallocated per synth; SynthParamType::Polyphony picks how many
+// of them a patch can use. Patches saved before Polyphony existed load it as 0,
+// which means kDefaultPolyphony.
+int constexpr kMaxVoices = 32;
+int constexpr kDefaultPolyphony = 4;
+
+// Values of SynthParamType::VoiceSteal: which voice a NoteOn takes when every
+// voice is busy. Idle voices always go first.
+enum class VoiceSteal {
+    ReleasedFirst,  // released voices, then sustaining, decaying, attacking; oldest within each
+    Oldest,  // the voice whose note started longest ago
+    Quietest  // the voice with the lowest amp envelope * velocity
+};
+
 struct Patch {
     float const& Get(audio::SynthParamType paramType) const {
         return _data[static_cast<int>(paramType)];
@@ -27,6 +48,10 @@ struct Patch {
     synth::Waveform GetOsc1Waveform() const;
     synth::Waveform GetOsc2Waveform() const;
     bool GetIsFm() const;
+    LookupTables GetLookupTables() const;
+    bool GetWavetables() const;  // band-limited oscillators instead of polyblep
+    int GetPolyphony() const;  // 1 if Mono
+    VoiceSteal GetVoiceSteal() const;
 
     ADSREnvSpec GetAmpEnvSpec() const;
     ADSREnvSpec GetCutoffEnvSpec() const;
@@ -1,135 +1,333 @@
-#include <fstream>
+// Offline renderer: runs the game's audio engine (audio::FillBuffer) without
+// PortAudio or a window and writes the result to a WAV file. Meant for
+// rendering stems, bisecting DSP changes, and regression-testing the synth in
+// CI against a known-good render.
+//
+// Usage:
+//   synth_render <patches.xml> <script.xml> <out.wav> [-b framesPerBuffer] [-m modulationBlockFrames] [-r outputRate] [-q polyphase|sinc] [-j synthWorkers] [-c reference.wav] [-t tolerance] [-p telemetry.csv]
+//
+// The script file looks like:
+//   <root>
+//       <version>14</version>
+//       <render>
+//           <length_secs>4</length_secs>
+//           <synth_patches>           (optional. Defaults to the first N patches in the bank, like the game.)
+//               <name>bass0</name>
+//           </synth_patches>
+//           <events>
+//               <event> ...audio::Event... </event>
+//           </events>
+//       </render>
+//   </root>
+// Each event's delay_secs is its absolute start time in the render.
+//
+// -p writes per-buffer stage timings (same as the in-game audio profiler) for
+// the last TelemetryHistory::kHistoryLength buffers.
+//
+// -r renders through the same resampler a device at that rate would get, with
+// -q picking the resampler. Events still go in per output buffer, so they can
+// land up to a buffer off from the unresampled render.
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
 #include <vector>
 
-#define DR_WAV_IMPLEMENTATION
 #include "dr_wav.h"
 
-#include "synth.h"
+#include "audio.h"
+#include "audio_util.h"
 #include "serial.h"
+#include "serial_vector_util.h"
+#include "sound_bank.h"
 #include "synth_patch_bank.h"
-#include "constants.h"
-#include "midi_util.h"
 
-struct MidiEvent {
-    bool _on = true;
-    int _midiNote = 0;
-    float _t = 0.f;
+namespace {
+
+struct RenderScript {
+    double _lengthSecs = 0.0;
+    std::vector<std::string> _synthPatchNames;
+    std::vector<audio::Event> _events;
+
+    void Save(serial::Ptree pt) const {
+        pt.PutDouble("length_secs", _lengthSecs);
+        serial::SaveVectorInChildNode(pt, "synth_patches", "name", _synthPatchNames);
+        serial::SaveVectorInChildNode(pt, "events", "event", _events);
+    }
+    void Load(serial::Ptree pt) {
+        _lengthSecs = pt.GetDouble("length_secs");
+        serial::LoadVectorFromChildNode(pt, "synth_patches", _synthPatchNames);
+        serial::LoadVectorFromChildNode(pt, "events", _events);
+    }
 };
 
-void ProcessEvent(synth::StateData& state, MidiEvent const& event) {
-    if (event._on) {
-        synth::NoteOn(state, event._midiNote, 1.f);
+void PrintUsage() {
+    printf("Usage: synth_render <patches.xml> <script.xml> <out.wav> [-b framesPerBuffer] [-m modulationBlockFrames] [-r outputRate] [-q polyphase|sinc] [-j synthWorkers] [-c reference.wav] [-t tolerance] [-p telemetry.csv]\n");
+}
+
+// Same as what game.cpp does at startup: push every param of each synth's patch through the event queue.
+bool SendInitialPatches(synth::PatchBank& patchBank, std::vector<std::string> const& patchNames) {
+    audio::Event e;
+    e.type = audio::EventType::SynthParam;
+    e.delaySecs = 0.0;
+    e.paramChangeTimeSecs = 0.0;
+    for (int synthIx = 0; synthIx < audio::kNumSynths; ++synthIx) {
+        synth::Patch const* patch = nullptr;
+        if (patchNames.empty()) {
+            if (synthIx < (int)patchBank._patches.size()) {
+                patch = &patchBank._patches[synthIx];
+            }
+        } else if (synthIx < (int)patchNames.size()) {
+            patch = patchBank.GetPatch(patchNames[synthIx]);
+            if (patch == nullptr) {
+                printf("Failed to find patch \"%s\" in patch bank.\n", patchNames[synthIx].c_str());
+                return false;
+            }
+        }
+        if (patch == nullptr) {
+            continue;
+        }
+        e.channel = synthIx;
+        std::array<audio::Event, (int)audio::SynthParamType::Count> paramEvents;
+        for (int paramIx = 0, n = (int)audio::SynthParamType::Count; paramIx < n; ++paramIx) {
+            audio::SynthParamType paramType = (audio::SynthParamType) paramIx;
+            e.param = paramType;
+            e.newParamValue = patch->Get(paramType);
+            paramEvents[paramIx] = e;
+        }
+        if (!audio::AddEvents(paramEvents.data(), paramEvents.size())) {
+            printf("Audio event queue is full\n");
+            return false;
+        }
+    }
+    return true;
+}
+
+// Returns max absolute difference, or a negative number if the reference couldn't be compared.
+float CompareToReference(char const* filename, std::vector<float> const& output, int numChannels, int sampleRate) {
+    unsigned int refChannels;
+    unsigned int refSampleRate;
+    drwav_uint64 refFrameCount;
+    float* ref = drwav_open_file_and_read_pcm_frames_f32(filename, &refChannels, &refSampleRate, &refFrameCount, NULL);
+    if (ref == nullptr) {
+        printf("Failed to open reference \"%s\"\n", filename);
+        return -1.f;
+    }
+    float maxDiff = -1.f;
+    if (refChannels != (unsigned int)numChannels || refSampleRate != (unsigned int)sampleRate) {
+        printf("Reference format mismatch: %u channels at %u Hz, expected %d channels at %d Hz\n", refChannels, refSampleRate, numChannels, sampleRate);
+    } else if (refFrameCount * numChannels != output.size()) {
+        printf("Reference length mismatch: %llu frames, expected %zu\n", (unsigned long long)refFrameCount, output.size() / numChannels);
     } else {
-        synth::NoteOff(state, event._midiNote);
+        maxDiff = 0.f;
+        for (size_t i = 0; i < output.size(); ++i) {
+            maxDiff = std::max(maxDiff, std::abs(output[i] - ref[i]));
+        }
     }
+    drwav_free(ref, NULL);
+    return maxDiff;
 }
 
+}  // namespace
+
 int main(int argc, char** argv) {
-    // Accept a patches XML file, and a patch name to use, and then a sequence file (TBD).    
-    if (argc != 1 + 3) {
-        printf("Expected 3 arguments, only got %d\n", argc - 1);
+    if (argc < 1 + 3) {
+        PrintUsage();
+        return 1;
+    }
+    char const* patchBankFilename = argv[1];
+    char const* scriptFilename = argv[2];
+    char const* outFilename = argv[3];
+    int framesPerBuffer = 512;
+    int modulationBlockFrames = synth::kDefaultModulationBlockFrames;
+    int outputRate = audio::InternalSampleRate();
+    audio::ResampleMode resampleMode = audio::ResampleMode::Polyphase;
+    int numSynthWorkers = 0;
+    char const* refFilename = nullptr;
+    float tolerance = 1e-5f;
+    char const* telemetryFilename = nullptr;
+    for (int argIx = 4; argIx < argc; ++argIx) {
+        std::string arg = argv[argIx];
+        if (argIx + 1 >= argc) {
+            printf("Missing value for argument \"%s\"\n", arg.c_str());
+            PrintUsage();
+            return 1;
+        }
+        char const* value = argv[++argIx];
+        if (arg == "-b") {
+            framesPerBuffer = atoi(value);
+        } else if (arg == "-m") {
+            modulationBlockFrames = atoi(value);
+        } else if (arg == "-r") {
+            outputRate = atoi(value);
+        } else if (arg == "-q") {
+            if (strcmp(value, "polyphase") == 0) {
+                resampleMode = audio::ResampleMode::Polyphase;
+            } else if (strcmp(value, "sinc") == 0) {
+                resampleMode = audio::ResampleMode::Sinc;
+            } else {
+                printf("Unrecognized resampler \"%s\"\n", value);
+                PrintUsage();
+                return 1;
+            }
+        } else if (arg == "-j") {
+            numSynthWorkers = atoi(value);
+        } else if (arg == "-c") {
+            refFilename = value;
+        } else if (arg == "-t") {
+            tolerance = (float) atof(value);
+        } else if (arg == "-p") {
+            telemetryFilename = value;
+        } else {
+            printf("Unrecognized argument \"%s\"\n", arg.c_str());
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (framesPerBuffer <= 0) {
+        printf("Invalid buffer size %d\n", framesPerBuffer);
+        return 1;
+    }
+    if (outputRate <= 0) {
+        printf("Invalid output rate %d\n", outputRate);
         return 1;
     }
-    std::string patchBankFilename = argv[1];
-    std::string patchName = argv[2];
-    std::string seqFilename = argv[3];
 
     synth::PatchBank patchBank;
-    if (!serial::LoadFromFile(patchBankFilename.c_str(), patchBank)) {
-        printf("Failed to open patch bank at \"%s\"\n", patchBankFilename.c_str());
+    if (!serial::LoadFromFile(patchBankFilename, patchBank)) {
+        printf("Failed to open patch bank at \"%s\"\n", patchBankFilename);
         return 1;
     }
 
-    synth::Patch* patch = patchBank.GetPatch(patchName);
-    if (patch == nullptr) {
-        printf("Failed to find patch \"%s\" in patch bank.\n", patchName.c_str());
+    RenderScript script;
+    if (!serial::LoadFromFile(scriptFilename, script)) {
+        printf("Failed to open render script at \"%s\"\n", scriptFilename);
         return 1;
     }
+    std::stable_sort(script._events.begin(), script._events.end(), [](audio::Event const& a, audio::Event const& b) {
+        return a.delaySecs < b.delaySecs;
+    });
+
+    int const sampleRate = audio::InternalSampleRate();
+    int const numChannels = audio::NumOutputChannels();
+
+    // Samples take a while to load, so only bother if the script plays any.
+    SoundBank soundBank;
+    bool const needsSounds = std::any_of(script._events.begin(), script._events.end(), [](audio::Event const& e) {
+        return e.type == audio::EventType::PlayPcm;
+    });
+    if (needsSounds) {
+        // We render way faster than realtime, so the disk thread couldn't keep
+        // up with streamed sounds. Keep everything in memory instead.
+        soundBank._streamMinSecs = 0.f;
+        soundBank.LoadSounds(sampleRate);
+    }
+
+    audio::StateData* state = new audio::StateData();
+    state->_numSynthWorkers = numSynthWorkers;
+    state->_resampleMode = resampleMode;
+    audio::InitStateData(*state, soundBank, outputRate, framesPerBuffer);
+    for (synth::StateData& synth : state->synths) {
+        synth.modulationBlockFrames = modulationBlockFrames;
+    }
 
-    /*std::ifstream seqFile(seqFilename.c_str());
-    if (!seqFile.is_open()) {
-        printf("Failed to open seq file \"%s\"\n", seqFilename.c_str());
+    if (!SendInitialPatches(patchBank, script._synthPatchNames)) {
         return 1;
-    }*/
-
-    int constexpr kSampleRate = 48000;
-    int constexpr kBufferSize = 512;
-    int constexpr kNumChannels = 2;
-
-    synth::StateData synthState;
-    synth::InitStateData(synthState, /*channel=*/0, kBufferSize, /*numBufferChannels=*/kNumChannels);
-    synthState.patch = *patch;
-
-    int note = GetMidiNote("A3");
-    
-    /*std::vector<MidiEvent> midiEvents = {
-        {true, note, 0.f},
-        {false, note, 0.5f},
-        {true, note, 1.f},
-        {false, note, 1.5f},
-        {true, note, 2.f},
-        {false, note, 2.5f},
-        {true, note, 3.f},
-        {false, note, 3.5f},
-        {true, note, 4.f},
-        {false, note, 4.5f}
-    };*/
-    std::vector<MidiEvent> midiEvents;
-    for (float t = 0.f; t < 5.f; t += 0.5f) {
-        MidiEvent e;
-        e._midiNote = note;
-        e._on = true;
-        e._t = t;
-        midiEvents.push_back(e);
-
-        e._on = false;
-        e._t += 0.25f;
-        midiEvents.push_back(e);
     }
 
-    {
-        drwav_data_format format;
-        format.container = drwav_container_riff;
-        format.format = DR_WAVE_FORMAT_PCM;
-        format.channels = kNumChannels;
-        format.sampleRate = kSampleRate;
-        format.bitsPerSample = 32;
-        drwav wav;
-        drwav_init_file_write(&wav, "howdy.wav", &format, nullptr);
-
-        float const totalTimeSecs = 5.f;
-        int const numBuffers = static_cast<int>(std::ceil(totalTimeSecs * static_cast<float>(kSampleRate) / static_cast<float>(kBufferSize)));
-        float const kSecsPerBuffer = static_cast<float>(kBufferSize) / static_cast<float>(kSampleRate);
-        boost::circular_buffer<audio::PendingEvent> events;
-        float currentTime = 0.f;
-        int currentEventIx = 0;
-        for (int bufferIx = 0; bufferIx < numBuffers; ++bufferIx) {
-            if (currentEventIx < midiEvents.size()) {
-                if (currentTime >= midiEvents[currentEventIx]._t) {
-                    ProcessEvent(synthState, midiEvents[currentEventIx]);
-                    ++currentEventIx;
-                }
-            }
+    int64_t const numBuffers = (int64_t) std::ceil(script._lengthSecs * outputRate / framesPerBuffer);
+    double const secsPerBuffer = (double) framesPerBuffer / outputRate;
+    std::vector<float> output(numBuffers * framesPerBuffer * numChannels);
 
-            float buffer[kBufferSize * kNumChannels];
-            for (int i = 0; i < kBufferSize * kNumChannels; ++i) {
-                buffer[i] = 0.f;
+    // Feed events to the engine one buffer ahead of when they're due, with
+    // delays relative to the start of that buffer. This keeps us well within
+    // the event queue's capacity no matter how long the script is.
+    size_t nextEventIx = 0;
+    double renderSecs = 0.0;
+    audio::TelemetryHistory telemetryHistory;
+    float const budgetUs = (float) (1000000.0 * secsPerBuffer);
+    for (int64_t bufferIx = 0; bufferIx < numBuffers; ++bufferIx) {
+        double const bufferStartTime = bufferIx * secsPerBuffer;
+        double const bufferEndTime = bufferStartTime + secsPerBuffer;
+        for (; nextEventIx < script._events.size(); ++nextEventIx) {
+            audio::Event e = script._events[nextEventIx];
+            if (e.delaySecs >= bufferEndTime) {
+                break;
             }
-            synth::Process(&synthState, events, buffer, kNumChannels, kBufferSize, kSampleRate, bufferIx);
-            for (int i = 0; i < kBufferSize; ++i) {
-                printf("%f\n", buffer[kNumChannels * i]);
+            e.delaySecs = std::max(0.0, e.delaySecs - bufferStartTime);
+            if (!audio::AddEvent(e)) {
+                printf("Audio event queue is full\n");
+                return 1;
             }
-            int32_t buffer32[kBufferSize * kNumChannels];
-            drwav_f32_to_s32(buffer32, buffer, kBufferSize * kNumChannels);
-            drwav_write_pcm_frames(&wav, kBufferSize, buffer32);
+        }
 
-            currentTime += kSecsPerBuffer;
+        float* out = output.data() + bufferIx * framesPerBuffer * numChannels;
+        auto t0 = std::chrono::high_resolution_clock::now();
+        if (outputRate != sampleRate) {
+            // Same as the device callback: render at the internal rate, resample, and record telemetry.
+            audio::AudioCallback(nullptr, out, framesPerBuffer, state);
+        } else {
+            state->_telemetry.BeginCallback(state->_bufferCounter, budgetUs);
+            audio::FillBuffer(state, out, framesPerBuffer, sampleRate);
         }
+        auto t1 = std::chrono::high_resolution_clock::now();
+        double const bufferSecs = std::chrono::duration<double>(t1 - t0).count();
+        renderSecs += bufferSecs;
+        if (outputRate == sampleRate) {
+            state->_telemetry.EndCallback((float) (1000000.0 * bufferSecs));
+        }
+        telemetryHistory._logMisses = false;
+        telemetryHistory.Update(state->_telemetry);
+    }
+
+    if (telemetryFilename != nullptr) {
+        telemetryHistory.WriteCsv(telemetryFilename);
+    }
+
+    audio::DestroyStateData(*state);
+    delete state;
+    if (needsSounds) {
+        soundBank.Destroy();
+    }
+
+    double const audioSecs = numBuffers * secsPerBuffer;
+    printf("Rendered %f s of audio in %f s (%.1fx realtime)\n", audioSecs, renderSecs, renderSecs > 0.0 ? audioSecs / renderSecs : 0.0);
 
+    {
+        drwav_data_format format;
+        format.container = drwav_container_riff;
+        format.format = DR_WAVE_FORMAT_IEEE_FLOAT;
+        format.channels = numChannels;
+        format.sampleRate = outputRate;
+        format.bitsPerSample = 32;
+        drwav wav;
+        if (!drwav_init_file_write(&wav, outFilename, &format, nullptr)) {
+            printf("Failed to open \"%s\" for writing\n", outFilename);
+            return 1;
+        }
+        drwav_uint64 framesWritten = drwav_write_pcm_frames(&wav, output.size() / numChannels, output.data());
         drwav_uninit(&wav);
+        if (framesWritten * numChannels != output.size()) {
+            printf("Failed to write all frames to \"%s\"\n", outFilename);
+            return 1;
+        }
     }
 
-    synth::DestroyStateData(synthState);
+    if (refFilename != nullptr) {
+        float maxDiff = CompareToReference(refFilename, output, numChannels, outputRate);
+        if (maxDiff < 0.f) {
+            return 1;
+        }
+        printf("Max diff from reference: %g\n", maxDiff);
+        if (maxDiff > tolerance) {
+            printf("FAILED: render differs from \"%s\" by more than %g\n", refFilename, tolerance);
+            return 1;
+        }
+    }
 
     return 0;
 }
@@ -0,0 +1,379 @@
+#include "synth_simd.h"
+
+#include <cassert>
+
+#include "constants.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define SYNTH_SIMD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#else
+#define SYNTH_SIMD_X86 0
+#endif
+
+#if SYNTH_SIMD_X86 && (defined(__GNUC__) || defined(__clang__))
+#define SYNTH_TARGET_AVX __attribute__((target("avx")))
+#else
+#define SYNTH_TARGET_AVX
+#endif
+
+// The SIMD kernels always apply polyblep. If you turn this off, the best
+// supported kernel falls back to Scalar so that everything still matches.
+#define POLYBLEP 1
+
+namespace synth {
+
+namespace {
+
+#if POLYBLEP
+// invDt is 1/dt, precomputed once per buffer so the SIMD kernels don't have to
+// divide every sample.
+float Polyblep(float t, float dt, float invDt) {
+    if (t < dt) {
+        t *= invDt;
+        return t+t - t*t - 1.0f;
+    } else if (t > 1.0f - dt) {
+        t = (t - 1.0f) * invDt;
+        return t*t + t+t + 1.0f;
+    }
+    else {
+        return 0.0f;
+    }
+}
+#endif
+
+float GenerateSquare(float const phase, float const dt, float const invDt) {
+    float v = 0.0f;
+    if (phase < kPi) {
+        v = 1.0f;
+    } else {
+        v = -1.0f;
+    }
+#if POLYBLEP
+    // polyblep
+     float t = phase * k1_2Pi;
+     v += Polyblep(t, dt, invDt);
+
+     //v -= Polyblep(fmod(t + 0.5f, 1.0f), dt);
+#endif
+    return v;
+}
+
+float GenerateSaw(float const phase, float const dt, float const invDt) {
+    float v = (phase * k1_Pi) - 1.0f;
+#if POLYBLEP
+    // polyblep
+     float t = phase * k1_2Pi;
+     v -= Polyblep(t, dt, invDt);
+#endif
+    return v;
+}
+
+void RenderOscLanesScalar(OscLanes const& lanes, float* output, int outputStride, int numFrames) {
+    for (int laneIx = 0; laneIx < lanes.numLanes; ++laneIx) {
+        bool const square = lanes.isSquare[laneIx] > 0.5f;
+        float const oscGain = lanes.oscGains[laneIx];
+        float* out = output + laneIx * outputStride;
+        float dts[kMaxOscUnison];
+        float invDts[kMaxOscUnison];
+        for (int ii = 0; ii < lanes.unison; ++ii) {
+            dts[ii] = lanes.phaseChanges[ii][laneIx] * k1_2Pi;
+            invDts[ii] = 1.f / dts[ii];
+        }
+        for (int frameIx = 0; frameIx < numFrames; ++frameIx) {
+            float oscV = 0.f;
+            for (int ii = 0; ii < lanes.unison; ++ii) {
+                float& phase = lanes.phases[ii][laneIx];
+                float const phaseChange = lanes.phaseChanges[ii][laneIx];
+                if (phase >= k2Pi) {
+                    phase -= k2Pi;
+                }
+                float v = square ? GenerateSquare(phase, dts[ii], invDts[ii]) : GenerateSaw(phase, dts[ii], invDts[ii]);
+                oscV += lanes.unisonGain * v;
+                phase += phaseChange;
+            }
+            out[frameIx] = oscV * oscGain;
+        }
+    }
+}
+
+#if SYNTH_SIMD_X86
+
+// Everything below is a lane-wise transcription of GenerateSquare/GenerateSaw
+// with the branches turned into masks. Keep the order of operations identical
+// to the scalar code so the results stay bit-exact.
+
+struct SseConsts {
+    __m128 zero = _mm_setzero_ps();
+    __m128 one = _mm_set1_ps(1.f);
+    __m128 minusOne = _mm_set1_ps(-1.f);
+    __m128 pi = _mm_set1_ps(kPi);
+    __m128 twoPi = _mm_set1_ps(k2Pi);
+    __m128 inv2Pi = _mm_set1_ps(k1_2Pi);
+    __m128 invPi = _mm_set1_ps(k1_Pi);
+};
+
+inline __m128 PolyblepSse(__m128 t, __m128 dt, __m128 invDt, SseConsts const& c) {
+    __m128 m1 = _mm_cmplt_ps(t, dt);
+    __m128 m2 = _mm_andnot_ps(m1, _mm_cmpgt_ps(t, _mm_sub_ps(c.one, dt)));
+    __m128 x1 = _mm_mul_ps(t, invDt);
+    __m128 r1 = _mm_sub_ps(_mm_sub_ps(_mm_add_ps(x1, x1), _mm_mul_ps(x1, x1)), c.one);
+    __m128 x2 = _mm_mul_ps(_mm_sub_ps(t, c.one), invDt);
+    __m128 r2 = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x2, x2), x2), x2), c.one);
+    return _mm_or_ps(_mm_and_ps(m1, r1), _mm_and_ps(m2, r2));
+}
+
+inline __m128 TickSse(
+    __m128* phases, __m128 const* phaseChanges, __m128 const* dts, __m128 const* invDts, int unison,
+    __m128 unisonGain, __m128 oscGain, __m128 squareMask, SseConsts const& c) {
+    __m128 sum = c.zero;
+    for (int ii = 0; ii < unison; ++ii) {
+        __m128 p = phases[ii];
+        p = _mm_sub_ps(p, _mm_and_ps(_mm_cmpge_ps(p, c.twoPi), c.twoPi));
+        __m128 t = _mm_mul_ps(p, c.inv2Pi);
+        __m128 blep = PolyblepSse(t, dts[ii], invDts[ii], c);
+        __m128 sq = _mm_or_ps(_mm_and_ps(_mm_cmplt_ps(p, c.pi), c.one), _mm_andnot_ps(_mm_cmplt_ps(p, c.pi), c.minusOne));
+        sq = _mm_add_ps(sq, blep);
+        __m128 saw = _mm_sub_ps(_mm_sub_ps(_mm_mul_ps(p, c.invPi), c.one), blep);
+        __m128 v = _mm_or_ps(_mm_and_ps(squareMask, sq), _mm_andnot_ps(squareMask, saw));
+        sum = _mm_add_ps(sum, _mm_mul_ps(unisonGain, v));
+        phases[ii] = _mm_add_ps(p, phaseChanges[ii]);
+    }
+    return _mm_mul_ps(sum, oscGain);
+}
+
+void RenderOscLaneGroupSse(OscLanes const& lanes, int laneIx, float* output, int outputStride, int numFrames) {
+    SseConsts const c;
+    __m128 phases[kMaxOscUnison];
+    __m128 phaseChanges[kMaxOscUnison];
+    __m128 dts[kMaxOscUnison];
+    __m128 invDts[kMaxOscUnison];
+    for (int ii = 0; ii < lanes.unison; ++ii) {
+        phases[ii] = _mm_loadu_ps(lanes.phases[ii] + laneIx);
+        phaseChanges[ii] = _mm_loadu_ps(lanes.phaseChanges[ii] + laneIx);
+        dts[ii] = _mm_mul_ps(phaseChanges[ii], c.inv2Pi);
+        invDts[ii] = _mm_div_ps(c.one, dts[ii]);
+    }
+    __m128 const unisonGain = _mm_set1_ps(lanes.unisonGain);
+    __m128 const oscGain = _mm_loadu_ps(lanes.oscGains + laneIx);
+    __m128 const squareMask = _mm_cmpgt_ps(_mm_loadu_ps(lanes.isSquare + laneIx), _mm_set1_ps(0.5f));
+
+    float* out0 = output + (laneIx + 0) * outputStride;
+    float* out1 = output + (laneIx + 1) * outputStride;
+    float* out2 = output + (laneIx + 2) * outputStride;
+    float* out3 = output + (laneIx + 3) * outputStride;
+    int frameIx = 0;
+    for (; frameIx + 4 <= numFrames; frameIx += 4) {
+        __m128 s0 = TickSse(phases, phaseChanges, dts, invDts, lanes.unison, unisonGain, oscGain, squareMask, c);
+        __m128 s1 = TickSse(phases, phaseChanges, dts, invDts, lanes.unison, unisonGain, oscGain, squareMask, c);
+        __m128 s2 = TickSse(phases, phaseChanges, dts, invDts, lanes.unison, unisonGain, oscGain, squareMask, c);
+        __m128 s3 = TickSse(phases, phaseChanges, dts, invDts, lanes.unison, unisonGain, oscGain, squareMask, c);
+        // frame-major -> lane-major
+        _MM_TRANSPOSE4_PS(s0, s1, s2, s3);
+        _mm_storeu_ps(out0 + frameIx, s0);
+        _mm_storeu_ps(out1 + frameIx, s1);
+        _mm_storeu_ps(out2 + frameIx, s2);
+        _mm_storeu_ps(out3 + frameIx, s3);
+    }
+    for (; frameIx < numFrames; ++frameIx) {
+        alignas(16) float s[4];
+        _mm_store_ps(s, TickSse(phases, phaseChanges, dts, invDts, lanes.unison, unisonGain, oscGain, squareMask, c));
+        out0[frameIx] = s[0];
+        out1[frameIx] = s[1];
+        out2[frameIx] = s[2];
+        out3[frameIx] = s[3];
+    }
+
+    for (int ii = 0; ii < lanes.unison; ++ii) {
+        _mm_storeu_ps(lanes.phases[ii] + laneIx, phases[ii]);
+    }
+}
+
+void RenderOscLanesSse(OscLanes const& lanes, float* output, int outputStride, int numFrames) {
+    for (int laneIx = 0; laneIx < lanes.numLanes; laneIx += 4) {
+        RenderOscLaneGroupSse(lanes, laneIx, output, outputStride, numFrames);
+    }
+}
+
+struct AvxConsts {
+    __m256 zero;
+    __m256 one;
+    __m256 minusOne;
+    __m256 pi;
+    __m256 twoPi;
+    __m256 inv2Pi;
+    __m256 invPi;
+};
+
+SYNTH_TARGET_AVX inline void InitAvxConsts(AvxConsts& c) {
+    c.zero = _mm256_setzero_ps();
+    c.one = _mm256_set1_ps(1.f);
+    c.minusOne = _mm256_set1_ps(-1.f);
+    c.pi = _mm256_set1_ps(kPi);
+    c.twoPi = _mm256_set1_ps(k2Pi);
+    c.inv2Pi = _mm256_set1_ps(k1_2Pi);
+    c.invPi = _mm256_set1_ps(k1_Pi);
+}
+
+SYNTH_TARGET_AVX inline __m256 PolyblepAvx(__m256 t, __m256 dt, __m256 invDt, AvxConsts const& c) {
+    __m256 m1 = _mm256_cmp_ps(t, dt, _CMP_LT_OQ);
+    __m256 m2 = _mm256_andnot_ps(m1, _mm256_cmp_ps(t, _mm256_sub_ps(c.one, dt), _CMP_GT_OQ));
+    __m256 x1 = _mm256_mul_ps(t, invDt);
+    __m256 r1 = _mm256_sub_ps(_mm256_sub_ps(_mm256_add_ps(x1, x1), _mm256_mul_ps(x1, x1)), c.one);
+    __m256 x2 = _mm256_mul_ps(_mm256_sub_ps(t, c.one), invDt);
+    __m256 r2 = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x2, x2), x2), x2), c.one);
+    return _mm256_or_ps(_mm256_and_ps(m1, r1), _mm256_and_ps(m2, r2));
+}
+
+SYNTH_TARGET_AVX inline __m256 TickAvx(
+    __m256* phases, __m256 const* phaseChanges, __m256 const* dts, __m256 const* invDts, int unison,
+    __m256 unisonGain, __m256 oscGain, __m256 squareMask, AvxConsts const& c) {
+    __m256 sum = c.zero;
+    for (int ii = 0; ii < unison; ++ii) {
+        __m256 p = phases[ii];
+        p = _mm256_sub_ps(p, _mm256_and_ps(_mm256_cmp_ps(p, c.twoPi, _CMP_GE_OQ), c.twoPi));
+        __m256 t = _mm256_mul_ps(p, c.inv2Pi);
+        __m256 blep = PolyblepAvx(t, dts[ii], invDts[ii], c);
+        __m256 lessThanPi = _mm256_cmp_ps(p, c.pi, _CMP_LT_OQ);
+        __m256 sq = _mm256_or_ps(_mm256_and_ps(lessThanPi, c.one), _mm256_andnot_ps(lessThanPi, c.minusOne));
+        sq = _mm256_add_ps(sq, blep);
+        __m256 saw = _mm256_sub_ps(_mm256_sub_ps(_mm256_mul_ps(p, c.invPi), c.one), blep);
+        __m256 v = _mm256_or_ps(_mm256_and_ps(squareMask, sq), _mm256_andnot_ps(squareMask, saw));
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(unisonGain, v));
+        phases[ii] = _mm256_add_ps(p, phaseChanges[ii]);
+    }
+    return _mm256_mul_ps(sum, oscGain);
+}
+
+SYNTH_TARGET_AVX void RenderOscLaneGroupAvx(OscLanes const& lanes, int laneIx, float* output, int outputStride, int numFrames) {
+    AvxConsts c;
+    InitAvxConsts(c);
+    __m256 phases[kMaxOscUnison];
+    __m256 phaseChanges[kMaxOscUnison];
+    __m256 dts[kMaxOscUnison];
+    __m256 invDts[kMaxOscUnison];
+    for (int ii = 0; ii < lanes.unison; ++ii) {
+        phases[ii] = _mm256_loadu_ps(lanes.phases[ii] + laneIx);
+        phaseChanges[ii] = _mm256_loadu_ps(lanes.phaseChanges[ii] + laneIx);
+        dts[ii] = _mm256_mul_ps(phaseChanges[ii], c.inv2Pi);
+        invDts[ii] = _mm256_div_ps(c.one, dts[ii]);
+    }
+    __m256 const unisonGain = _mm256_set1_ps(lanes.unisonGain);
+    __m256 const oscGain = _mm256_loadu_ps(lanes.oscGains + laneIx);
+    __m256 const squareMask = _mm256_cmp_ps(_mm256_loadu_ps(lanes.isSquare + laneIx), _mm256_set1_ps(0.5f), _CMP_GT_OQ);
+
+    float* out[8];
+    for (int ii = 0; ii < 8; ++ii) {
+        out[ii] = output + (laneIx + ii) * outputStride;
+    }
+    int frameIx = 0;
+    for (; frameIx + 4 <= numFrames; frameIx += 4) {
+        __m256 s0 = TickAvx(phases, phaseChanges, dts, invDts, lanes.unison, unisonGain, oscGain, squareMask, c);
+        __m256 s1 = TickAvx(phases, phaseChanges, dts, invDts, lanes.unison, unisonGain, oscGain, squareMask, c);
+        __m256 s2 = TickAvx(phases, phaseChanges, dts, invDts, lanes.unison, unisonGain, oscGain, squareMask, c);
+        __m256 s3 = TickAvx(phases, phaseChanges, dts, invDts, lanes.unison, unisonGain, oscGain, squareMask, c);
+        // Transpose each 4x4 half separately: low halves are lanes 0-3, high halves are lanes 4-7.
+        __m128 l0 = _mm256_castps256_ps128(s0);
+        __m128 l1 = _mm256_castps256_ps128(s1);
+        __m128 l2 = _mm256_castps256_ps128(s2);
+        __m128 l3 = _mm256_castps256_ps128(s3);
+        __m128 h0 = _mm256_extractf128_ps(s0, 1);
+        __m128 h1 = _mm256_extractf128_ps(s1, 1);
+        __m128 h2 = _mm256_extractf128_ps(s2, 1);
+        __m128 h3 = _mm256_extractf128_ps(s3, 1);
+        _MM_TRANSPOSE4_PS(l0, l1, l2, l3);
+        _MM_TRANSPOSE4_PS(h0, h1, h2, h3);
+        _mm_storeu_ps(out[0] + frameIx, l0);
+        _mm_storeu_ps(out[1] + frameIx, l1);
+        _mm_storeu_ps(out[2] + frameIx, l2);
+        _mm_storeu_ps(out[3] + frameIx, l3);
+        _mm_storeu_ps(out[4] + frameIx, h0);
+        _mm_storeu_ps(out[5] + frameIx, h1);
+        _mm_storeu_ps(out[6] + frameIx, h2);
+        _mm_storeu_ps(out[7] + frameIx, h3);
+    }
+    for (; frameIx < numFrames; ++frameIx) {
+        alignas(32) float s[8];
+        _mm256_store_ps(s, TickAvx(phases, phaseChanges, dts, invDts, lanes.unison, unisonGain, oscGain, squareMask, c));
+        for (int ii = 0; ii < 8; ++ii) {
+            out[ii][frameIx] = s[ii];
+        }
+    }
+
+    for (int ii = 0; ii < lanes.unison; ++ii) {
+        _mm256_storeu_ps(lanes.phases[ii] + laneIx, phases[ii]);
+    }
+    _mm256_zeroupper();
+}
+
+void RenderOscLanesAvx(OscLanes const& lanes, float* output, int outputStride, int numFrames) {
+    int laneIx = 0;
+    for (; laneIx + 8 <= lanes.numLanes; laneIx += 8) {
+        RenderOscLaneGroupAvx(lanes, laneIx, output, outputStride, numFrames);
+    }
+    if (laneIx < lanes.numLanes) {
+        RenderOscLaneGroupSse(lanes, laneIx, output, outputStride, numFrames);
+    }
+}
+
+bool CpuSupportsAvx() {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    bool const osxsave = (info[2] & (1 << 27)) != 0;
+    bool const avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx) {
+        return false;
+    }
+    // Make sure the OS saves the YMM registers on context switch.
+    unsigned long long xcr0 = _xgetbv(0);
+    return (xcr0 & 0x6) == 0x6;
+#else
+    return __builtin_cpu_supports("avx");
+#endif
+}
+
+#endif  // SYNTH_SIMD_X86
+
+}  // namespace
+
+OscKernel GetBestSupportedOscKernel() {
+#if SYNTH_SIMD_X86 && POLYBLEP
+    static OscKernel const sBest = CpuSupportsAvx() ? OscKernel::Avx : OscKernel::Sse;
+    return sBest;
+#else
+    return OscKernel::Scalar;
+#endif
+}
+
+char const* OscKernelToString(OscKernel k) {
+    switch (k) {
+        case OscKernel::Scalar: return "Scalar";
+        case OscKernel::Sse: return "SSE";
+        case OscKernel::Avx: return "AVX";
+    }
+    return "";
+}
+
+void RenderOscLanes(OscKernel kernel, OscLanes const& lanes, float* output, int outputStride, int numFrames) {
+    assert(lanes.numLanes % kOscLaneGroupSize == 0);
+    assert(lanes.unison >= 1 && lanes.unison <= kMaxOscUnison);
+#if SYNTH_SIMD_X86 && POLYBLEP
+    switch (kernel) {
+        case OscKernel::Avx:
+            RenderOscLanesAvx(lanes, output, outputStride, numFrames);
+            return;
+        case OscKernel::Sse:
+            RenderOscLanesSse(lanes, output, outputStride, numFrames);
+            return;
+        case OscKernel::Scalar:
+            break;
+    }
+#endif
+    RenderOscLanesScalar(lanes, output, outputStride, numFrames);
+}
+
+}
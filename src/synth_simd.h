@@ -0,0 +1,39 @@
+#pragma once
+
+#include "enums/synth_Waveform.h"
+
+namespace synth {
+
+// Which oscillator kernel to use. Picked at runtime based on what the CPU
+// supports; Scalar is always available and is the reference implementation.
+enum class OscKernel { Scalar, Sse, Avx };
+
+OscKernel GetBestSupportedOscKernel();
+char const* OscKernelToString(OscKernel k);
+
+// SIMD kernels process this many lanes per 128-bit register. Lane arrays
+// passed to RenderOscLanes must be padded up to a multiple of this (AVX
+// internally pairs up groups of 4).
+int constexpr kOscLaneGroupSize = 4;
+int constexpr kMaxOscUnison = 5;
+
+// One "lane" is a single (oscillator, voice) pair. All lanes share the same
+// unison count and unison gain because those are patch-wide.
+//
+// Arrays are unison-major: phases[u][lane].
+struct OscLanes {
+    int numLanes = 0;  // multiple of kOscLaneGroupSize
+    int unison = 1;
+    float unisonGain = 1.f;
+    float* phases[kMaxOscUnison];
+    float const* phaseChanges[kMaxOscUnison];
+    float const* oscGains = nullptr;  // per-lane
+    float const* isSquare = nullptr;  // per-lane. 1.f for square, 0.f for saw.
+};
+
+// Renders saw/square oscillators with polyblep for every lane. Output for lane
+// l goes to output[l * outputStride + frameIx] (overwrites, does not add).
+// Phases are advanced in place. All kernels produce bit-identical output.
+void RenderOscLanes(OscKernel kernel, OscLanes const& lanes, float* output, int outputStride, int numFrames);
+
+}
@@ -0,0 +1,133 @@
+#include "synth_tables.h"
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+namespace synth {
+
+float gMidiToFreq[kNumMidiNotes];
+float gSinTable[kSinTableSize + 1];
+
+namespace {
+
+bool gTablesInitialized = false;
+
+// Highest fundamental (cycles per sample) each octave's table is good for.
+// The top table is a pure sine that's fine right up to Nyquist.
+float gWavetableTopFreqs[kNumWavetableOctaves];
+float gSawTables[kNumWavetableOctaves][kWavetableSize + 1];
+float gSquareTables[kNumWavetableOctaves][kWavetableSize + 1];
+
+void InitWavetables() {
+    int constexpr kMaxHarmonic = kWavetableSize / 2 - 1;
+
+    // Octave o keeps harmonics up to 2^(kNumWavetableOctaves - 1 - o).
+    int harmonicLimits[kNumWavetableOctaves];
+    for (int o = 0; o < kNumWavetableOctaves; ++o) {
+        gWavetableTopFreqs[o] = 0.5f / (float)(1 << (kNumWavetableOctaves - 1 - o));
+        harmonicLimits[o] = std::min(kMaxHarmonic, 1 << (kNumWavetableOctaves - 1 - o));
+    }
+
+    // Additive synthesis, adding one harmonic at a time to every sample and
+    // snapshotting whenever we hit an octave's limit. sin(k*theta_i) is exactly
+    // sin(2pi * (k*i mod N) / N), so one table of sines covers every harmonic.
+    std::vector<double> sines(kWavetableSize);
+    for (int i = 0; i < kWavetableSize; ++i) {
+        sines[i] = std::sin(2.0 * 3.14159265358979323846 * i / kWavetableSize);
+    }
+    std::vector<double> saw(kWavetableSize, 0.0);
+    std::vector<double> square(kWavetableSize, 0.0);
+    double const kInvPi = 1.0 / 3.14159265358979323846;
+    for (int k = 1; k <= kMaxHarmonic; ++k) {
+        // Saw ramping -1 to 1 is -(2/pi) * sum(sin(k x) / k); square is
+        // (4/pi) * sum over odd k of sin(k x) / k.
+        double const sawAmp = -2.0 * kInvPi / k;
+        double const squareAmp = (k % 2 == 1) ? 4.0 * kInvPi / k : 0.0;
+        for (int i = 0; i < kWavetableSize; ++i) {
+            double const s = sines[(k * i) & (kWavetableSize - 1)];
+            saw[i] += sawAmp * s;
+            square[i] += squareAmp * s;
+        }
+        for (int o = 0; o < kNumWavetableOctaves; ++o) {
+            if (harmonicLimits[o] != k) {
+                continue;
+            }
+            for (int i = 0; i < kWavetableSize; ++i) {
+                gSawTables[o][i] = (float)saw[i];
+                gSquareTables[o][i] = (float)square[i];
+            }
+            gSawTables[o][kWavetableSize] = gSawTables[o][0];
+            gSquareTables[o][kWavetableSize] = gSquareTables[o][0];
+        }
+    }
+}
+
+int GetWavetableOctave(float cyclesPerSample) {
+    for (int o = 0; o < kNumWavetableOctaves - 1; ++o) {
+        if (cyclesPerSample <= gWavetableTopFreqs[o]) {
+            return o;
+        }
+    }
+    return kNumWavetableOctaves - 1;
+}
+
+}  // namespace
+
+void InitTables() {
+    if (gTablesInitialized) {
+        return;
+    }
+    gTablesInitialized = true;
+
+    for (int midi = 0; midi < kNumMidiNotes; ++midi) {
+        int const a4 = 69;  // 440Hz
+        gMidiToFreq[midi] = 440.0f * pow(2.0f, (midi - a4) / 12.0f);
+    }
+
+    for (int i = 0; i <= kSinTableSize; ++i) {
+        gSinTable[i] = (float)std::sin(2.0 * 3.14159265358979323846 * i / kSinTableSize);
+    }
+
+    InitWavetables();
+}
+
+void RenderWavetableLanes(OscLanes const& lanes, float* output, int outputStride, int numFrames) {
+    assert(gTablesInitialized);
+    float const phaseToTablePos = kWavetableSize * k1_2Pi;
+    for (int laneIx = 0; laneIx < lanes.numLanes; ++laneIx) {
+        bool const square = lanes.isSquare[laneIx] > 0.5f;
+        float const oscGain = lanes.oscGains[laneIx];
+        float* out = output + laneIx * outputStride;
+        for (int frameIx = 0; frameIx < numFrames; ++frameIx) {
+            out[frameIx] = 0.f;
+        }
+        // One unison voice at a time so its phase and table stay in registers.
+        // Summing into out in unison order gives the same result as summing
+        // all of them per frame.
+        for (int ii = 0; ii < lanes.unison; ++ii) {
+            float phase = lanes.phases[ii][laneIx];
+            float const phaseChange = lanes.phaseChanges[ii][laneIx];
+            int const octave = GetWavetableOctave(phaseChange * k1_2Pi);
+            float const* table = square ? gSquareTables[octave] : gSawTables[octave];
+            float const unisonGain = lanes.unisonGain;
+            for (int frameIx = 0; frameIx < numFrames; ++frameIx) {
+                if (phase >= k2Pi) {
+                    phase -= k2Pi;
+                }
+                float const pos = phase * phaseToTablePos;
+                int const ix = static_cast<int>(pos);
+                float const frac = pos - ix;
+                float const* t = table + (ix & (kWavetableSize - 1));
+                out[frameIx] += unisonGain * (t[0] + frac * (t[1] - t[0]));
+                phase += phaseChange;
+            }
+            lanes.phases[ii][laneIx] = phase;
+        }
+        for (int frameIx = 0; frameIx < numFrames; ++frameIx) {
+            out[frameIx] *= oscGain;
+        }
+    }
+}
+
+}  // namespace synth
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include "constants.h"
+#include "synth_simd.h"
+
+// Lookup tables and cheap approximations for the synth's hot loops. Patches
+// opt in with SynthParamType::LookupTables; everything here is close enough to
+// the libm version that you can't hear the difference, but it isn't bit-exact,
+// so patches that don't opt in keep using libm.
+//
+// Call InitTables() once before rendering anything.
+
+namespace synth {
+
+void InitTables();
+
+// Equal temperament, A4 (69) = 440Hz. Same values as 440 * 2^((midi - 69) / 12)
+// computed in float. Notes outside [0,127] get clamped.
+int constexpr kNumMidiNotes = 128;
+extern float gMidiToFreq[kNumMidiNotes];
+
+inline float MidiToFreq(int midi) {
+    if (midi < 0) {
+        midi = 0;
+    } else if (midi >= kNumMidiNotes) {
+        midi = kNumMidiNotes - 1;
+    }
+    return gMidiToFreq[midi];
+}
+
+// 2^x. 1 + f * (degree-4 polynomial) on the fractional part f, fit at
+// Chebyshev nodes, and the integer part goes straight into the exponent bits.
+// Exact for integer x (so ratios of 1 stay 1). Max relative error 2.9e-7
+// (about 2 ulp) for x in [-126, 127]; outside that the result is clamped to
+// 2^-126 / 2^127.
+inline float FastExp2(float x) {
+    x = std::fmax(-126.f, std::fmin(127.f, x));
+    float const fl = std::floor(x);
+    float const f = x - fl;
+    float p = 1.788368798e-03f;
+    p = p * f + 9.199387394e-03f;
+    p = p * f + 5.565705523e-02f;
+    p = p * f + 2.402071953e-01f;
+    p = p * f + 6.931475401e-01f;
+    p = p * f + 1.f;
+    int32_t const bits = (static_cast<int32_t>(fl) + 127) << 23;
+    float scale;
+    std::memcpy(&scale, &bits, sizeof(scale));
+    return p * scale;
+}
+
+// sin(x) for x in radians, any sign. Linear interpolation into a table of one
+// period. Max absolute error 5.1e-7 for |x| < 2pi. Callers keep their phases
+// wrapped: the error grows with |x| (1.8e-6 at 8pi) because x * N / 2pi gets
+// rounded to float before the table lookup.
+int constexpr kSinTableSize = 4096;
+extern float gSinTable[kSinTableSize + 1];
+
+inline float FastSin(float x) {
+    float const pos = x * (kSinTableSize * k1_2Pi);
+    float const fl = std::floor(pos);
+    float const frac = pos - fl;
+    int const ix = static_cast<int>(static_cast<int64_t>(fl) & (kSinTableSize - 1));
+    float const a = gSinTable[ix];
+    return a + frac * (gSinTable[ix + 1] - a);
+}
+
+// Band-limited saw/square single-cycle tables, one per octave. Table o holds
+// only the harmonics that stay under Nyquist for any fundamental up to
+// kWavetableTopFreqs[o] (in cycles per sample), so playing from the right table
+// never aliases. Same shape and phase as the polyblep oscillators: saw ramps
+// from -1 to 1, square is +1 for the first half of the cycle. This is a sound
+// quality option (SynthParamType::Wavetables), not a speedup: it costs more
+// than the SIMD polyblep kernels.
+int constexpr kWavetableSize = 2048;
+int constexpr kNumWavetableOctaves = 11;
+
+// Renders the same thing as RenderOscLanes (same phase convention, gains and
+// output layout), but reads from the band-limited tables instead of polyblep.
+void RenderWavetableLanes(OscLanes const& lanes, float* output, int outputStride, int numFrames);
+
+}  // namespace synth
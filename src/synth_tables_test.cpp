@@ -0,0 +1,171 @@
+// Checks the error bounds documented in synth_tables.h, that the wavetables
+// are actually band-limited, and prints what each LookupTables mode costs per
+// voice for an FM patch and an analog patch, plus what the wavetables cost.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include "synth.h"
+#include "synth_test_util.h"
+
+namespace {
+
+using synth_test::kFramesPerBuffer;
+using synth_test::kSampleRate;
+
+int constexpr kNumBuffers = 1000;
+
+bool CheckFastSin() {
+    bool success = true;
+    int constexpr kNumSteps = 1 << 22;
+    double const kPiD = 3.14159265358979323846;
+    // FM phases are wrapped to [0, 2pi) before the modulator's offset gets
+    // added, so a few periods either side is all we care about.
+    struct Range { double _maxX; double _maxErr; };
+    for (Range const& r : { Range{ 2.0 * kPiD, 5.1e-7 }, Range{ 8.0 * kPiD, 1.8e-6 } }) {
+        double maxErr = 0.0;
+        for (int i = 0; i <= kNumSteps; ++i) {
+            float const x = (float)(-r._maxX + 2.0 * r._maxX * i / kNumSteps);
+            maxErr = std::max(maxErr, std::abs((double)synth::FastSin(x) - std::sin((double)x)));
+        }
+        printf("FastSin: max abs error %g for |x| < %g\n", maxErr, r._maxX);
+        success = success && maxErr <= r._maxErr;
+    }
+    return success;
+}
+
+bool CheckFastExp2() {
+    double maxErr = 0.0;
+    int constexpr kNumSteps = 1 << 22;
+    for (int i = 0; i <= kNumSteps; ++i) {
+        float const x = (float)(-20.0 + 40.0 * i / kNumSteps);
+        double const exact = std::exp2((double)x);
+        maxErr = std::max(maxErr, std::abs((double)synth::FastExp2(x) - exact) / exact);
+    }
+    bool exactAtIntegers = true;
+    for (int i = -126; i <= 127; ++i) {
+        exactAtIntegers = exactAtIntegers && synth::FastExp2((float)i) == std::ldexp(1.f, i);
+    }
+    printf("FastExp2: max rel error %g for x in [-20, 20], exact at integers: %s\n", maxErr, exactAtIntegers ? "yes" : "NO");
+    return maxErr <= 2.9e-7 && exactAtIntegers;
+}
+
+bool CheckMidiToFreq() {
+    for (int midi = 0; midi < synth::kNumMidiNotes; ++midi) {
+        float const expected = 440.0f * pow(2.0f, (midi - 69) / 12.0f);
+        if (synth::MidiToFreq(midi) != expected) {
+            printf("MidiToFreq: note %d is %f, expected %f\n", midi, synth::MidiToFreq(midi), expected);
+            return false;
+        }
+    }
+    printf("MidiToFreq: matches pow() for all notes\n");
+    return true;
+}
+
+// Renders a saw through the wavetables at a high pitch and checks that no
+// harmonic above Nyquist folded back down: everything that isn't a multiple
+// of the fundamental should be way down.
+bool CheckWavetableAliasing() {
+    int constexpr kNumFrames = 4800;  // whole number of cycles at 4000Hz and 4410Hz
+    bool success = true;
+    for (float freq : { 4000.f, 4410.f }) {
+        float phase = 0.f;
+        float const phaseChange = k2Pi * freq / kSampleRate;
+        float gain = 1.f;
+        float isSquare = 0.f;
+        synth::OscLanes lanes;
+        lanes.numLanes = 1;
+        lanes.phases[0] = &phase;
+        lanes.phaseChanges[0] = &phaseChange;
+        lanes.oscGains = &gain;
+        lanes.isSquare = &isSquare;
+        std::vector<float> out(kNumFrames);
+        synth::RenderWavetableLanes(lanes, out.data(), kNumFrames, kNumFrames);
+
+        // Energy at each harmonic vs total energy; whatever's left over is aliasing.
+        double totalEnergy = 0.0;
+        for (float v : out) {
+            totalEnergy += (double)v * v;
+        }
+        totalEnergy /= kNumFrames;
+        double harmonicEnergy = 0.0;
+        for (int k = 1; k * freq < kSampleRate / 2; ++k) {
+            double re = 0.0, im = 0.0;
+            for (int i = 0; i < kNumFrames; ++i) {
+                double const w = 2.0 * 3.14159265358979323846 * k * freq * i / kSampleRate;
+                re += out[i] * std::cos(w);
+                im += out[i] * std::sin(w);
+            }
+            harmonicEnergy += 2.0 * (re * re + im * im) / ((double)kNumFrames * kNumFrames);
+        }
+        double const aliasDb = 10.0 * std::log10(std::max(1e-20, totalEnergy - harmonicEnergy) / totalEnergy);
+        printf("Wavetable saw at %.0fHz: non-harmonic energy %.1f dB\n", freq, aliasDb);
+        success = success && aliasDb < -60.0;
+    }
+    return success;
+}
+
+void MakePatch(synth::Patch& patch, bool fm, synth::LookupTables tables, bool wavetables) {
+    using audio::SynthParamType;
+    synth_test::ClearPatch(patch);
+    patch.Get(SynthParamType::Gain) = 0.6f;
+    patch.Get(SynthParamType::FM) = fm ? 1.f : 0.f;
+    patch.Get(SynthParamType::FMOsc2Level) = 2.f;
+    patch.Get(SynthParamType::FMOsc2Ratio) = 1.5f;
+    patch.Get(SynthParamType::Osc1Waveform) = 1.f;  // saw
+    patch.Get(SynthParamType::Osc2Waveform) = 0.f;  // square
+    patch.Get(SynthParamType::Unison) = 2.f;
+    patch.Get(SynthParamType::UnisonDetune) = 15.f;
+    patch.Get(SynthParamType::Cutoff) = 3000.f;
+    patch.Get(SynthParamType::PitchLFOGain) = 0.01f;
+    patch.Get(SynthParamType::PitchLFOFreq) = 5.f;
+    patch.Get(SynthParamType::AmpEnvSustain) = 1.f;
+    patch.Get(SynthParamType::LookupTables) = (float)tables;
+    patch.Get(SynthParamType::Wavetables) = wavetables ? 1.f : 0.f;
+}
+
+// Returns microseconds per voice per buffer.
+double TimeVoice(bool fm, synth::LookupTables tables, bool wavetables) {
+    synth::StateData s;
+    synth::InitStateData(s, 0, kSampleRate, kFramesPerBuffer, 1);
+    MakePatch(s.patch, fm, tables, wavetables);
+    for (int v = 0; v < synth::kDefaultPolyphony; ++v) {
+        synth::NoteOn(s, 48 + 7 * v, 0.8f);
+    }
+    auto t0 = std::chrono::high_resolution_clock::now();
+    synth_test::Render(s, kNumBuffers);
+    auto t1 = std::chrono::high_resolution_clock::now();
+    synth::DestroyStateData(s);
+    return std::chrono::duration<double, std::micro>(t1 - t0).count() / (kNumBuffers * synth::kDefaultPolyphony);
+}
+
+}  // namespace
+
+int main() {
+    synth::InitTables();
+
+    bool success = true;
+    success = CheckFastSin() && success;
+    success = CheckFastExp2() && success;
+    success = CheckMidiToFreq() && success;
+    success = CheckWavetableAliasing() && success;
+
+    char const* modeNames[] = { "Off", "FastMath" };
+    for (bool fm : { true, false }) {
+        for (int mode = 0; mode < 2; ++mode) {
+            double us = TimeVoice(fm, (synth::LookupTables)mode, /*wavetables=*/false);
+            printf("%s voice, LookupTables %s: %.2f us per voice per %d-frame buffer\n", fm ? "FM" : "Analog", modeNames[mode], us, kFramesPerBuffer);
+        }
+    }
+    double const wavetableUs = TimeVoice(/*fm=*/false, synth::LookupTables::Off, /*wavetables=*/true);
+    printf("Analog voice, Wavetables: %.2f us per voice per %d-frame buffer\n", wavetableUs, kFramesPerBuffer);
+
+    if (!success) {
+        printf("FAILED\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+// Shared setup for the synth_*_test programs.
+
+#include <vector>
+
+#include "synth.h"
+
+namespace synth_test {
+
+int constexpr kSampleRate = 48000;
+int constexpr kFramesPerBuffer = 512;
+
+// Zeroes every param so each test only has to set the ones it cares about.
+inline void ClearPatch(synth::Patch& patch) {
+    for (int i = 0; i < (int)audio::SynthParamType::Count; ++i) {
+        patch.Get((audio::SynthParamType)i) = 0.f;
+    }
+}
+
+// Process() only recomputes envelope specs when their params change, so
+// send the patch's current values through once like the game does when it
+// loads a patch.
+inline void SendParams(synth::StateData& s, audio::SynthParamType const* params, int numParams, int numChannels = 1) {
+    std::vector<audio::PendingEvent> events(numParams);
+    for (int i = 0; i < numParams; ++i) {
+        events[i]._e.type = audio::EventType::SynthParam;
+        events[i]._e.channel = s.channel;
+        events[i]._e.param = params[i];
+        events[i]._e.paramChangeTimeSecs = 0.0;
+        events[i]._e.newParamValue = s.patch.Get(params[i]);
+    }
+    std::vector<float> scratch(kFramesPerBuffer * numChannels);
+    synth::Process(&s, events.data(), numParams, scratch.data(), numChannels, kFramesPerBuffer, kSampleRate, 0);
+}
+
+// Renders numBuffers mono buffers and throws the output away.
+inline void Render(synth::StateData& s, int numBuffers) {
+    std::vector<float> out(kFramesPerBuffer);
+    for (int i = 0; i < numBuffers; ++i) {
+        synth::Process(&s, nullptr, 0, out.data(), 1, kFramesPerBuffer, kSampleRate, i + 1);
+    }
+}
+
+}  // namespace synth_test
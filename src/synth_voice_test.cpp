@@ -0,0 +1,128 @@
+// Checks voice allocation: a patch gets as many voices as its Polyphony asks
+// for, each VoiceSteal policy takes the voice it says it does, and idle voices
+// cost nothing to process.
+
+#include <chrono>
+#include <cstdio>
+
+#include "synth.h"
+#include "synth_test_util.h"
+
+namespace {
+
+using synth_test::kFramesPerBuffer;
+using synth_test::kSampleRate;
+using synth_test::Render;
+
+void MakePatch(synth::Patch& patch, int polyphony, synth::VoiceSteal steal) {
+    using audio::SynthParamType;
+    synth_test::ClearPatch(patch);
+    patch.Get(SynthParamType::Gain) = 0.6f;
+    patch.Get(SynthParamType::Osc1Waveform) = 1.f;  // saw
+    patch.Get(SynthParamType::Cutoff) = 3000.f;
+    patch.Get(SynthParamType::AmpEnvAttack) = 0.01f;
+    patch.Get(SynthParamType::AmpEnvSustain) = 1.f;
+    patch.Get(SynthParamType::AmpEnvRelease) = 1.f;
+    patch.Get(SynthParamType::Polyphony) = (float)polyphony;
+    patch.Get(SynthParamType::VoiceSteal) = (float)steal;
+}
+
+void SendEnvParams(synth::StateData& s) {
+    audio::SynthParamType const envParams[] = {
+        audio::SynthParamType::AmpEnvAttack, audio::SynthParamType::AmpEnvSustain,
+        audio::SynthParamType::AmpEnvRelease };
+    synth_test::SendParams(s, envParams, 3);
+}
+
+int NumSounding(synth::StateData const& s) {
+    int n = 0;
+    for (synth::Voice const& v : s.voices) {
+        n += (v.currentMidiNote >= 0) ? 1 : 0;
+    }
+    return n;
+}
+
+bool IsSounding(synth::StateData const& s, int midiNote) {
+    for (synth::Voice const& v : s.voices) {
+        if (v.currentMidiNote == midiNote) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CheckPolyphony() {
+    synth::StateData s;
+    synth::InitStateData(s, 0, kSampleRate, kFramesPerBuffer, 1);
+    MakePatch(s.patch, synth::kMaxVoices, synth::VoiceSteal::ReleasedFirst);
+    SendEnvParams(s);
+    for (int i = 0; i < synth::kMaxVoices + 4; ++i) {
+        synth::NoteOn(s, 40 + i, 0.8f);
+    }
+    Render(s, 1);
+    int const n = NumSounding(s);
+    synth::DestroyStateData(s);
+    printf("Polyphony %d: %d notes sounding after %d NoteOns\n", synth::kMaxVoices, n, synth::kMaxVoices + 4);
+    return n == synth::kMaxVoices;
+}
+
+// 4 voices: 60 and 62 held, 64 played quietly, 65 released. Then one more
+// NoteOn has to steal.
+bool CheckSteal(synth::VoiceSteal steal, int expectedStolenNote, char const* name) {
+    synth::StateData s;
+    synth::InitStateData(s, 0, kSampleRate, kFramesPerBuffer, 1);
+    MakePatch(s.patch, 4, steal);
+    SendEnvParams(s);
+    synth::NoteOn(s, 60, 0.8f);
+    Render(s, 4);
+    synth::NoteOn(s, 65, 0.8f);
+    Render(s, 4);
+    synth::NoteOn(s, 62, 0.8f);
+    Render(s, 4);
+    synth::NoteOn(s, 64, 0.1f);
+    Render(s, 4);
+    synth::NoteOff(s, 65);
+    Render(s, 1);
+    synth::NoteOn(s, 72, 0.8f);
+    bool const success = !IsSounding(s, expectedStolenNote) && NumSounding(s) == 4 && IsSounding(s, 72);
+    synth::DestroyStateData(s);
+    printf("VoiceSteal %s: %s\n", name, success ? "ok" : "took the wrong voice");
+    return success;
+}
+
+// Microseconds per buffer for a synth with numNotes held out of 32 voices.
+double TimeBuffer(int numNotes) {
+    synth::StateData s;
+    synth::InitStateData(s, 0, kSampleRate, kFramesPerBuffer, 1);
+    MakePatch(s.patch, synth::kMaxVoices, synth::VoiceSteal::ReleasedFirst);
+    SendEnvParams(s);
+    for (int i = 0; i < numNotes; ++i) {
+        synth::NoteOn(s, 40 + i, 0.8f);
+    }
+    int constexpr kNumBuffers = 500;
+    auto t0 = std::chrono::high_resolution_clock::now();
+    Render(s, kNumBuffers);
+    auto t1 = std::chrono::high_resolution_clock::now();
+    synth::DestroyStateData(s);
+    return std::chrono::duration<double, std::micro>(t1 - t0).count() / kNumBuffers;
+}
+
+}  // namespace
+
+int main() {
+    bool success = true;
+    success = CheckPolyphony() && success;
+    success = CheckSteal(synth::VoiceSteal::ReleasedFirst, 65, "ReleasedFirst") && success;
+    success = CheckSteal(synth::VoiceSteal::Oldest, 60, "Oldest") && success;
+    success = CheckSteal(synth::VoiceSteal::Quietest, 64, "Quietest") && success;
+
+    for (int numNotes : { 0, 1, 4, 16, 32 }) {
+        printf("%2d of %d voices sounding: %.1f us per %d-frame buffer\n", numNotes, synth::kMaxVoices, TimeBuffer(numNotes), kFramesPerBuffer);
+    }
+
+    if (!success) {
+        printf("FAILED\n");
+        return 1;
+    }
+    return 0;
+}
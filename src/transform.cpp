@@ -73,6 +73,23 @@ void Transform::SetFromMat4(Mat4 const& mat4) {
     _mat.SetTranslation(mat4.GetPos());   
 }
 
+Transform Transform::Lerp(Transform const& a, Transform const& b, float t) {
+    Transform result = b;
+    result.SetPos(a.Pos() + t * (b.Pos() - a.Pos()));
+    result._scale = a._scale + t * (b._scale - a._scale);
+    if (a._q._v != b._q._v) {
+        Vec4 qa = a._q._v;
+        if (Vec4::Dot(qa, b._q._v) < 0.f) {
+            qa = -qa;
+        }
+        Vec4 q = qa + t * (b._q._v - qa);
+        q /= std::sqrt(Vec4::Dot(q, q));
+        result._q = Quaternion(q);
+        result._rotMatDirty = true;
+    }
+    return result;
+}
+
 Vec3 Transform::GetXAxis() const {
     MaybeUpdateRotMat();
     return _mat.GetCol3(0);
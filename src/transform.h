@@ -31,6 +31,10 @@ public:
     Mat4 Mat4Scale() const;   
     void SetFromMat4(Mat4 const& mat4);
 
+    // Position and scale are lerped, rotation is nlerped along the shorter
+    // arc. Good for small steps like between two sim ticks.
+    static Transform Lerp(Transform const& a, Transform const& b, float t);
+
     // Returns normalized vectors
     Vec3 GetXAxis() const;
     Vec3 GetYAxis() const;